@@ -1,8 +1,9 @@
-snmptrapd MySQL Logging
------------------------
+snmptrapd SQL Logging
+---------------------
 
 A trap handler for logging traps to a MySQL database was added
-in release 5.5.0.
+in release 5.5.0.  Traps can also be logged to an SQLite database;
+configure with --with-mysql, --with-sqlite or both.
 
 The MySQL database location and password must be configured in
 /root/.my.cnf:
@@ -13,6 +14,14 @@ The MySQL database location and password must be configured in
 
 User may also be configured, if using a MySQL user besides root.
 
+With both backends available, snmptrapd.conf selects one:
+
+	# mysql (the default) or sqlite
+	sqlBackend sqlite
+
+	# the SQLite database; the tables are created if needed
+	sqliteFile /var/lib/net-snmp/snmptrapd.sqlite
+
 snmptrapd.conf must be configured to for the queue size and
 periodic flush interval:
 
@@ -22,8 +31,27 @@ periodic flush interval:
 	# seconds between periodic queue flushes
 	sqlSaveInterval 9
 
-A value of 0 for sqlSaveInterval will completely disable MySQL
+A value of 0 for sqlSaveInterval will completely disable SQL
 logging of traps.
 
+Traps are written in batches, one transaction per batch.  When
+snmptrapd is built with --enable-reentrant, a writer thread saves
+traps as they arrive and sqlMaxQueue is not used.  The batch size
+adapts to the database, and traps that cannot be queued or written
+can be spooled to a file:
+
+	# traps held in memory
+	sqlQueueLimit 10000
+
+	# largest batch, and how long a transaction should take (ms)
+	sqlMaxBatch 1000
+	sqlFlushTarget 500
+
+	# keep traps here while the database is unavailable
+	sqlSpoolFile /var/lib/net-snmp/snmptrapd.spool
+
+	# log the counters every hour
+	sqlStatsInterval 3600
+
 The schema must be loaded into MySQL before running snmptrapd.
 The schema can be found in dist/schema-snmptrapd.sql
@@ -577,7 +577,7 @@ netsnmp_call_handlers(netsnmp_handler_registration *reginfo,
                       netsnmp_request_info *requests)
 {
     netsnmp_request_info *request;
-    int             status;
+    int             status, unlocked;
 
     if (reginfo == NULL || reqinfo == NULL || requests == NULL) {
         snmp_log(LOG_ERR, "netsnmp_call_handlers() called illegally\n");
@@ -628,7 +628,27 @@ netsnmp_call_handlers(netsnmp_handler_registration *reginfo,
         request->processed = 0;
     }
 
-    status = netsnmp_call_handler(reginfo->handler, reginfo, reqinfo, requests);
+    /* thread-safe handlers serving reads may run concurrently */
+    unlocked = reginfo->rootoid_len + 2 < MAX_OID_LEN &&
+        netsnmp_agent_unlock_for_handler(reginfo, reqinfo->mode);
+    if (unlocked) {
+        /*
+         * The scalar and scalar_group helpers extend the root OID of the
+         * registration while they pass a request on, so each thread works
+         * on a private copy of it.
+         */
+        netsnmp_handler_registration reg_copy = *reginfo;
+        oid             root_copy[MAX_OID_LEN];
+
+        memcpy(root_copy, reginfo->rootoid,
+               reginfo->rootoid_len * sizeof(oid));
+        reg_copy.rootoid = root_copy;
+        status = netsnmp_call_handler(reginfo->handler, &reg_copy, reqinfo,
+                                      requests);
+        netsnmp_agent_relock_after_handler();
+    } else
+        status = netsnmp_call_handler(reginfo->handler, reginfo, reqinfo,
+                                      requests);
 
     return status;
 }
@@ -280,6 +280,12 @@ init_agent_read_config(const char *app)
     netsnmp_ds_register_config(ASN_BOOLEAN, app, "dontLogTCPWrappersConnects",
                                NETSNMP_DS_APPLICATION_ID,
                                NETSNMP_DS_AGENT_DONT_LOG_TCPWRAPPERS_CONNECTS);
+    netsnmp_ds_register_config(ASN_BOOLEAN, app, "useEpoll",
+                               NETSNMP_DS_APPLICATION_ID,
+                               NETSNMP_DS_AGENT_USE_EPOLL);
+    netsnmp_ds_register_config(ASN_INTEGER, app, "agentWorkerThreads",
+                               NETSNMP_DS_APPLICATION_ID,
+                               NETSNMP_DS_AGENT_WORKER_THREADS);
     netsnmp_ds_register_config(ASN_INTEGER, app, "maxGetbulkRepeats",
                                NETSNMP_DS_APPLICATION_ID,
                                NETSNMP_DS_AGENT_MAX_GETBULKREPEATS);
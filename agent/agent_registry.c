@@ -78,9 +78,15 @@ netsnmp_feature_child_of(agent_registry_all, libnetsnmpagent);
 netsnmp_feature_child_of(unregister_mib_table_row, agent_registry_all);
 
 /** @defgroup agent_lookup_cache Lookup cache, storing the registered OIDs.
- *     Maintain the cache used for locating sub-trees and OIDs.
+ *     Maintain the index used for locating sub-trees and OIDs.
  *   @ingroup agent_registry
  *
+ * Each context keeps a trie of the start OIDs of its top level subtrees,
+ * one node per sub-identifier.  Finding the subtree preceding an OID then
+ * costs one step per sub-identifier of that OID, however many subtrees
+ * are registered.  The trie is dropped whenever the registrations of the
+ * context change and rebuilt from the subtree list on the next lookup.
+ *
  * @{
  */
 
@@ -90,33 +96,37 @@ netsnmp_feature_child_of(unregister_mib_table_row, agent_registry_all);
 #define SUBTREE_MAX_CACHE_SIZE     32
 int lookup_cache_size = 0; /*enabled later after registrations are loaded */
 
-typedef struct lookup_cache_s {
-   netsnmp_subtree *next;
-   netsnmp_subtree *previous;
-} lookup_cache;
+/** Number of hash buckets for the per-context indexes. */
+#define LOOKUP_CACHE_CONTEXT_BUCKETS 64
+
+typedef struct lookup_index_node_s {
+   oid subid;
+   /** Top level subtree starting at this OID, if any. */
+   netsnmp_subtree *subtree;
+   /** Children, sorted by sub-identifier. */
+   struct lookup_index_node_s **children;
+   unsigned int children_len;
+   unsigned int children_max;
+} lookup_index_node;
 
 typedef struct lookup_cache_context_s {
    char *context;
    struct lookup_cache_context_s *next;
-   int thecachecount;
-   int currentpos;
-   lookup_cache cache[SUBTREE_MAX_CACHE_SIZE];
+   /** Whether root reflects the current subtree list. */
+   int valid;
+   lookup_index_node root;
 } lookup_cache_context;
 
-static lookup_cache_context *thecontextcache = NULL;
+static lookup_cache_context *thecontextcache[LOOKUP_CACHE_CONTEXT_BUCKETS];
 
 /** Set the lookup cache size for optimized agent registration performance.
  * Note that it is only used by master agent - sub-agent doesn't need the cache.
- * The rough guide is that the cache size should be equal to the maximum
- * number of simultaneous managers you expect to talk to the agent (M) times 80%
- * (or so, he says randomly) the average number (N) of varbinds you
- * expect to receive in a given request for a manager.  ie, M times N.
- * Bigger does NOT necessarily mean better.  Certainly 16 should be an
- * upper limit.  32 is the hard coded limit.
- *
- * @param newsize set to the maximum size of a cache for a given
- * context.  Set to 0 to completely disable caching, or to -1 to set
- * to the default cache size (8), or to a number of your chosing.  The
+ * Lookups go through the per-context index whenever the size is not zero;
+ * the value itself is only kept for netsnmp_get_lookup_cache_size().
+ *
+ * @param newsize set to 0 to completely disable the index and walk the
+ * subtree list instead, to -1 to set the default size (8), or to a number
+ * of your chosing (at most 32).
  */
 void
 netsnmp_set_lookup_cache_size(int newsize) {
@@ -138,81 +148,191 @@ netsnmp_get_lookup_cache_size(void) {
     return lookup_cache_size;
 }
 
+/** @private
+ *  Frees the children of an index node.
+ */
+static void
+lookup_index_clear(lookup_index_node *node) {
+    unsigned int i;
+
+    for (i = 0; i < node->children_len; i++) {
+        lookup_index_clear(node->children[i]);
+        free(node->children[i]);
+    }
+    SNMP_FREE(node->children);
+    node->children_len = 0;
+    node->children_max = 0;
+    node->subtree = NULL;
+}
+
+/** @private
+ *  Adds a subtree to an index.  Subtrees must be added in the order of
+ *  the subtree list, so new nodes are always appended to their parent.
+ *
+ *  @return 0 on success, -1 on memory shortage or out of order subtrees.
+ */
+static int
+lookup_index_add(lookup_index_node *root, netsnmp_subtree *subtree) {
+    lookup_index_node *node = root, *child, **children;
+    size_t i;
+
+    for (i = 0; i < subtree->start_len; i++) {
+        child = node->children_len ?
+            node->children[node->children_len - 1] : NULL;
+        if (child && child->subid == subtree->start_a[i]) {
+            node = child;
+            continue;
+        }
+        if (child && child->subid > subtree->start_a[i])
+            return -1;
+        if (node->children_len == node->children_max) {
+            unsigned int max = node->children_max ?
+                2 * node->children_max : 4;
+            children = realloc(node->children, max * sizeof(*children));
+            if (!children)
+                return -1;
+            node->children = children;
+            node->children_max = max;
+        }
+        child = SNMP_MALLOC_TYPEDEF(lookup_index_node);
+        if (!child)
+            return -1;
+        child->subid = subtree->start_a[i];
+        node->children[node->children_len++] = child;
+        node = child;
+    }
+    if (node->subtree)
+        return -1;
+    node->subtree = subtree;
+    return 0;
+}
+
+/** @private
+ *  Rebuilds the index of a context from its subtree list.
+ */
+static int
+lookup_index_build(lookup_cache_context *cptr) {
+    netsnmp_subtree *s;
+
+    lookup_index_clear(&cptr->root);
+    for (s = netsnmp_subtree_find_first(cptr->context); s; s = s->next) {
+        if (lookup_index_add(&cptr->root, s) != 0) {
+            snmp_log(LOG_WARNING, "registry: cannot index context \"%s\"\n",
+                     cptr->context);
+            lookup_index_clear(&cptr->root);
+            return -1;
+        }
+    }
+    cptr->valid = 1;
+    return 0;
+}
+
+/** @private
+ *  Returns the position of the last child of node whose sub-identifier is
+ *  not greater than subid, or -1 if there is none.
+ */
+NETSNMP_STATIC_INLINE int
+lookup_index_child(const lookup_index_node *node, oid subid) {
+    int lo = 0, hi = (int)node->children_len - 1, mid;
+
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (node->children[mid]->subid <= subid)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return hi;
+}
+
+/** @private
+ *  Finds the subtree with the greatest start OID not greater than name.
+ *  While descending along name, the candidate is either a node on the
+ *  path or the greatest entry below a sibling to the left of the path.
+ */
+static netsnmp_subtree *
+lookup_index_find_prev(const lookup_index_node *node, const oid *name,
+                       size_t name_len) {
+    const lookup_index_node *cand = NULL;
+    int cand_below = 0, j;
+    size_t i;
+
+    for (i = 0; ; i++) {
+        if (node->subtree) {
+            cand = node;
+            cand_below = 0;
+        }
+        if (i == name_len ||
+            (j = lookup_index_child(node, name[i])) < 0)
+            break;
+        if (node->children[j]->subid < name[i]) {
+            cand = node->children[j];
+            cand_below = 1;
+            break;
+        }
+        if (j > 0) {
+            cand = node->children[j - 1];
+            cand_below = 1;
+        }
+        node = node->children[j];
+    }
+    if (!cand)
+        return NULL;
+    if (cand_below)
+        while (cand->children_len)
+            cand = cand->children[cand->children_len - 1];
+    return cand->subtree;
+}
+
+NETSNMP_STATIC_INLINE unsigned int
+lookup_cache_context_hash(const char *context) {
+    unsigned int h = 5381;
+
+    while (*context)
+        h = h * 33 + (u_char)*context++;
+    return h % LOOKUP_CACHE_CONTEXT_BUCKETS;
+}
+
 /** Returns lookup cache entry for the context of given name.
  *
  *  @param context Name of the context. Name is case sensitive.
  *
+ *  @param create  Whether to create the entry if the context has
+ *                 registrations but no entry yet.
+ *
  *  @return the lookup cache context
  */
 NETSNMP_STATIC_INLINE lookup_cache_context *
-get_context_lookup_cache(const char *context) {
+get_context_lookup_cache(const char *context, int create) {
     lookup_cache_context *ptr;
+    unsigned int bucket;
+
     if (!context)
         context = "";
+    bucket = lookup_cache_context_hash(context);
 
-    for(ptr = thecontextcache; ptr; ptr = ptr->next) {
+    for(ptr = thecontextcache[bucket]; ptr; ptr = ptr->next) {
         if (strcmp(ptr->context, context) == 0)
             break;
     }
-    if (!ptr) {
+    if (!ptr && create) {
         if (netsnmp_subtree_find_first(context)) {
             ptr = SNMP_MALLOC_TYPEDEF(lookup_cache_context);
             if (!ptr)
                 return NULL;
-            ptr->next = thecontextcache;
             ptr->context = strdup(context);
-            thecontextcache = ptr;
-        } else {
-            return NULL;
+            if (!ptr->context) {
+                free(ptr);
+                return NULL;
+            }
+            ptr->next = thecontextcache[bucket];
+            thecontextcache[bucket] = ptr;
         }
     }
     return ptr;
 }
 
-/** Adds an entry to the Lookup Cache under specified context name.
- *
- *  @param context  Name of the context. Name is case sensitive.
- *
- *  @param next     Next subtree item.
- *
- *  @param previous Previous subtree item.
- */
-NETSNMP_STATIC_INLINE void
-lookup_cache_add(const char *context,
-                 netsnmp_subtree *next, netsnmp_subtree *previous) {
-    lookup_cache_context *cptr;
-
-    if ((cptr = get_context_lookup_cache(context)) == NULL)
-        return;
-
-    if (cptr->thecachecount < lookup_cache_size)
-        cptr->thecachecount++;
-
-    cptr->cache[cptr->currentpos].next = next;
-    cptr->cache[cptr->currentpos].previous = previous;
-
-    if (++cptr->currentpos >= lookup_cache_size)
-        cptr->currentpos = 0;
-}
-
-/** @private
- *  Replaces next and previous pointer in given Lookup Cache.
- *
- *  @param ptr      Lookup Cache pointer.
- *
- *  @param next     Next subtree item.
- *
- *  @param previous Previous subtree item.
- */
-NETSNMP_STATIC_INLINE void
-lookup_cache_replace(lookup_cache *ptr,
-                     netsnmp_subtree *next, netsnmp_subtree *previous) {
-
-    ptr->next = next;
-    ptr->previous = previous;
-}
-
-/** Finds an entry in the Lookup Cache.
+/** Finds the subtree preceding an OID through the index of a context.
  *
  *  @param context  Case sensitive name of the context.
  *
@@ -220,48 +340,34 @@ lookup_cache_replace(lookup_cache *ptr,
  *
  *  @param name_len Number of sub-ids (single integers) in the OID.
  *
- *  @param retcmp   Value set to snmp_oid_compare() call result.
- *                  The value, if set, is always nonnegative.
+ *  @param previous Set to the last subtree starting at or before name,
+ *                  or NULL if there is none.
  *
- *  @return gives Lookup Cache entry, or NULL if not found.
- *
- *  @see snmp_oid_compare()
+ *  @return 0 if previous was set, -1 if the index is not available.
  */
-NETSNMP_STATIC_INLINE lookup_cache *
+NETSNMP_STATIC_INLINE int
 lookup_cache_find(const char *context, const oid *name, size_t name_len,
-                  int *retcmp) {
+                  netsnmp_subtree **previous) {
     lookup_cache_context *cptr;
-    lookup_cache *ret = NULL;
-    int cmp;
-    int i;
 
-    if ((cptr = get_context_lookup_cache(context)) == NULL)
-        return NULL;
+    if ((cptr = get_context_lookup_cache(context, 1)) == NULL)
+        return -1;
+    if (!cptr->valid && lookup_index_build(cptr) != 0)
+        return -1;
 
-    for(i = 0; i < cptr->thecachecount && i < lookup_cache_size; i++) {
-        if (cptr->cache[i].previous->start_a)
-            cmp = snmp_oid_compare(name, name_len,
-                                   cptr->cache[i].previous->start_a,
-                                   cptr->cache[i].previous->start_len);
-        else
-            cmp = 1;
-        if (cmp >= 0) {
-            *retcmp = cmp;
-            ret = &(cptr->cache[i]);
-        }
-    }
-    return ret;
+    *previous = lookup_index_find_prev(&cptr->root, name, name_len);
+    return 0;
 }
 
 /** @private
- *  Clears cache count and position in Lookup Cache.
+ *  Drops the index of a context after its registrations changed.
  */
 NETSNMP_STATIC_INLINE void
 invalidate_lookup_cache(const char *context) {
     lookup_cache_context *cptr;
-    if ((cptr = get_context_lookup_cache(context)) != NULL) {
-        cptr->thecachecount = 0;
-        cptr->currentpos = 0;
+    if ((cptr = get_context_lookup_cache(context, 0)) != NULL) {
+        lookup_index_clear(&cptr->root);
+        cptr->valid = 0;
     }
 }
 
@@ -269,15 +375,19 @@ void
 clear_lookup_cache(void) {
 
     lookup_cache_context *ptr = NULL, *next = NULL;
+    int i;
 
-    ptr = thecontextcache;
-    while (ptr) {
-	next = ptr->next;
-	SNMP_FREE(ptr->context);
-	SNMP_FREE(ptr);
-	ptr = next;
+    for (i = 0; i < LOOKUP_CACHE_CONTEXT_BUCKETS; i++) {
+        ptr = thecontextcache[i];
+        while (ptr) {
+            next = ptr->next;
+            lookup_index_clear(&ptr->root);
+            SNMP_FREE(ptr->context);
+            SNMP_FREE(ptr);
+            ptr = next;
+        }
+        thecontextcache[i] = NULL; /* !!! */
     }
-    thecontextcache = NULL; /* !!! */
 }
 
 /**  @} */
@@ -979,26 +1089,17 @@ netsnmp_subtree *
 netsnmp_subtree_find_prev(const oid *name, size_t len, netsnmp_subtree *subtree,
 			  const char *context_name)
 {
-    lookup_cache *lookup_cache = NULL;
     netsnmp_subtree *myptr = NULL, *previous = NULL;
-    int cmp = 1;
     size_t ll_off = 0;
 
     if (subtree) {
         myptr = subtree;
     } else {
 	/* look through everything */
-        if (lookup_cache_size) {
-            lookup_cache = lookup_cache_find(context_name, name, len, &cmp);
-            if (lookup_cache) {
-                myptr = lookup_cache->next;
-                previous = lookup_cache->previous;
-            }
-            if (!myptr)
-                myptr = netsnmp_subtree_find_first(context_name);
-        } else {
-            myptr = netsnmp_subtree_find_first(context_name);
-        }
+        if (lookup_cache_size &&
+            lookup_cache_find(context_name, name, len, &previous) == 0)
+            return previous;
+        myptr = netsnmp_subtree_find_first(context_name);
     }
 
     /*
@@ -1033,13 +1134,6 @@ netsnmp_subtree_find_prev(const oid *name, size_t len, netsnmp_subtree *subtree,
 #else
         if (snmp_oid_compare(name, len, myptr->start_a, myptr->start_len) < 0) {
 #endif
-            if (lookup_cache_size && previous && cmp) {
-                if (lookup_cache) {
-                    lookup_cache_replace(lookup_cache, myptr, previous);
-                } else {
-                    lookup_cache_add(context_name, myptr, previous);
-                }
-            }
             return previous;
         }
     }
@@ -2016,6 +2110,7 @@ unregister_mibs_by_session(netsnmp_session * ss)
             }
         }
         netsnmp_subtree_join(contextptr->first_subtree);
+        invalidate_lookup_cache(contextptr->context_name);
     }
 }
 
@@ -987,6 +987,15 @@ netsnmp_send_traps(int trap, int specific,
 	}
     }
 
+    /*
+     * The varbinds are the same for every destination, so encode them
+     * once; send_trap_to_sess() then only builds the headers per sink.
+     */
+    if (template_v1pdu)
+        netsnmp_pdu_encode_varbinds(template_v1pdu);
+    if (template_v2pdu)
+        netsnmp_pdu_encode_varbinds(template_v2pdu);
+
     /*
      *  Now loop through the list of trap sinks
      *   and call the trap callback routines,
@@ -1225,7 +1234,15 @@ send_trap_to_sess(netsnmp_session * sess, netsnmp_pdu *template_pdu)
         return;                 /* Skip v2+ sinks for v1 only traps */
 #endif
     template_pdu->version = sess->version;
-    pdu = snmp_clone_pdu(template_pdu);
+    /*
+     * SNMP sessions can share the template's encoded varbinds; others
+     * (AgentX) build the varbinds themselves and need a full copy.
+     */
+    if (sess->version == SNMP_VERSION_1 || sess->version == SNMP_VERSION_2c ||
+        sess->version == SNMP_VERSION_3)
+        pdu = netsnmp_clone_pdu_encoded(template_pdu);
+    else
+        pdu = snmp_clone_pdu(template_pdu);
     if(!pdu) {
         snmp_log(LOG_WARNING, "send_trap: failed to clone PDU\n");
         return;
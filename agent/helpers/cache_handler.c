@@ -27,6 +27,15 @@
 
 #include <net-snmp/agent/cache_handler.h>
 
+#if defined(NETSNMP_REENTRANT) && defined(HAVE_PTHREAD_H) && \
+    !defined(NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER)
+#define NETSNMP_CACHE_THREADS
+#include <pthread.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <errno.h>
+#endif
+
 netsnmp_feature_child_of(cache_handler, mib_helpers);
 
 netsnmp_feature_child_of(cache_find_by_oid, cache_handler);
@@ -35,6 +44,20 @@ netsnmp_feature_child_of(cache_get_head, cache_handler);
 static netsnmp_cache  *cache_head = NULL;
 static int             cache_outstanding_valid = 0;
 static int             _cache_load( netsnmp_cache *cache );
+static void            _cache_reload( netsnmp_cache *cache );
+
+/*
+ * A load of a NETSNMP_CACHE_RELOAD_IN_BACKGROUND cache, possibly
+ * running in a thread of its own.
+ */
+struct netsnmp_cache_reload_s {
+    netsnmp_cache  *cache;      /* NULL if freed meanwhile */
+    netsnmp_cache   shadow;     /* given to the load hook */
+    int             rc;
+    int             discard;    /* data was dropped meanwhile */
+    u_int           load_time;
+    struct netsnmp_cache_reload_s *next;
+};
 
 #define CACHE_RELEASE_FREQUENCY 60      /* Check for expired caches every 60s */
 
@@ -98,6 +121,19 @@ void            release_cached_resources(unsigned int regNo,
  *  not be used if cache is not synchronized automatically as it would
  *  result in stale cache information when if polling happens too fast.
  *
+ *  If NETSNMP_CACHE_RELOAD_IN_BACKGROUND is set, an expired cache which
+ *  still holds data keeps serving it while another thread loads the next
+ *  copy, which then replaces it from the main loop.  The load_cache
+ *  routine is called on a private copy of the cache structure, whose
+ *  magic pointer is NULL and which has no handler-chain hint: it must
+ *  build the data from scratch without touching anything that the MIB
+ *  handlers read, and leave it in that copy's magic pointer.  The
+ *  free_cache routine releases whatever cache->magic points to, after
+ *  which the helper replaces or clears that pointer; the lower handlers
+ *  should always find the data through cache->magic.  The first load, and
+ *  every load in an agent built without thread support, is done
+ *  synchronously, but the same rules apply.
+ *
  *
  *  Here are some suggestions for some common situations.
  *
@@ -141,6 +177,8 @@ void            release_cached_resources(unsigned int regNo,
 
 static void
 _cache_free( netsnmp_cache *cache );
+static int
+_cache_loaded( netsnmp_cache *cache, int ret );
 
 #ifndef NETSNMP_FEATURE_REMOVE_CACHE_GET_HEAD
 /** get cache head
@@ -261,6 +299,9 @@ netsnmp_cache_free(netsnmp_cache *cache)
     if(0 != cache->timer_id)
         netsnmp_cache_timer_stop(cache);
 
+    if (cache->reload)
+        cache->reload->cache = NULL;    /* will clean up after itself */
+
     if (cache->valid)
         _cache_free(cache);
 
@@ -275,6 +316,23 @@ netsnmp_cache_free(netsnmp_cache *cache)
     return SNMPERR_SUCCESS;
 }
 
+/** drops the cached data, so that the next request loads it afresh
+ *
+ * A background load still under way is cancelled: its result is freed
+ * when it arrives, instead of being installed over the emptied cache.
+ */
+void
+netsnmp_cache_empty(netsnmp_cache *cache)
+{
+    if (NULL == cache)
+        return;
+
+    if (cache->reload)
+        cache->reload->discard = 1;
+    _cache_free(cache);
+    SNMP_FREE(cache->timestampM);
+}
+
 /** removes a cache
  */
 int
@@ -315,7 +373,7 @@ _timer_reload(unsigned int regNo, void *clientargs)
 
     cache->expired = 1;
 
-    _cache_load(cache);
+    _cache_reload(cache);
 }
 
 /** starts the recurring cache_load callback */
@@ -573,6 +631,24 @@ netsnmp_cache_check_and_reload(netsnmp_cache * cache)
         DEBUGMSGT(("helper:cache_handler", " no cache\n"));
         return 0;	/* ?? or -1 */
     }
+    if (cache->valid && netsnmp_cache_check_expired(cache) &&
+        (cache->flags & NETSNMP_CACHE_RELOAD_IN_BACKGROUND)) {
+        _cache_reload( cache );
+        if (cache->reload) {
+            struct timeval  now;
+            u_long          age, timeout;
+
+            /* serve the old data meanwhile */
+            netsnmp_get_monotonic_clock(&now);
+            age = uatime_diff(cache->timestampM, &now);
+            timeout = 1000 * SNMP_MAX(cache->timeout, 0);
+            cache->stale_served++;
+            cache->stale_age = age > timeout ? age - timeout : 0;
+            DEBUGMSGT(("helper:cache_handler", " stale (%u ms)\n",
+                       cache->stale_age));
+        }
+        return cache->valid ? 0 : -1;
+    }
     if (!cache->valid || netsnmp_cache_check_expired(cache))
         return _cache_load( cache );
     else {
@@ -692,7 +768,7 @@ netsnmp_cache_helper_handler(netsnmp_mib_handler * handler,
     case MODE_SET_COMMIT:
         if (cache->valid && 
             ! (cache->flags & NETSNMP_CACHE_DONT_INVALIDATE_ON_SET) ) {
-            cache->free_cache(cache, cache->magic);
+            _cache_free(cache);
             cache->valid = 0;
         }
         /** next handler called automatically - 'AUTO_NEXT' */
@@ -716,14 +792,209 @@ _cache_free( netsnmp_cache *cache )
     if (NULL != cache->free_cache) {
         cache->free_cache(cache, cache->magic);
         cache->valid = 0;
+        if (cache->flags & NETSNMP_CACHE_RELOAD_IN_BACKGROUND) {
+            cache->magic = NULL;
+            /* a load already under way may predate a SET */
+            if (cache->reload)
+                cache->reload->discard = 1;
+        }
     }
 }
 
+static u_int
+_cache_ms_since(const struct timeval *start)
+{
+    struct timeval  now;
+
+    netsnmp_get_monotonic_clock(&now);
+    return (now.tv_sec - start->tv_sec) * 1000 +
+        (now.tv_usec - start->tv_usec) / 1000;
+}
+
+/*
+ * Load a NETSNMP_CACHE_RELOAD_IN_BACKGROUND cache into the shadow copy;
+ * may be called from any thread.
+ */
+static void
+_cache_load_shadow(struct netsnmp_cache_reload_s *r)
+{
+    struct timeval  start;
+
+    netsnmp_get_monotonic_clock(&start);
+    r->shadow.magic = NULL;
+    r->rc = r->shadow.load_cache(&r->shadow, NULL);
+    r->load_time = _cache_ms_since(&start);
+}
+
+static void
+_cache_reload_init(struct netsnmp_cache_reload_s *r, netsnmp_cache *cache)
+{
+    memset(r, 0, sizeof(*r));
+    r->cache = cache;
+    r->shadow.flags = cache->flags;
+    r->shadow.enabled = cache->enabled;
+    r->shadow.timeout = cache->timeout;
+    r->shadow.load_cache = cache->load_cache;
+    r->shadow.free_cache = cache->free_cache;
+}
+
+/* Replace the data of a cache by what a (background) load produced. */
+static int
+_cache_install(netsnmp_cache *cache, struct netsnmp_cache_reload_s *r)
+{
+    cache->load_time = r->load_time;
+    if (r->rc < 0 || r->discard) {
+        if (r->rc >= 0 && r->shadow.free_cache)
+            r->shadow.free_cache(&r->shadow, r->shadow.magic);
+        if (r->rc < 0)
+            DEBUGMSGT(("helper:cache_handler", " load failed (%d)\n",
+                       r->rc));
+        /* keep any old data, and try again on the next request */
+        return r->rc < 0 ? r->rc : -1;
+    }
+    if (cache->valid && cache->free_cache)
+        cache->free_cache(cache, cache->magic);
+    cache->magic = r->shadow.magic;
+    return _cache_loaded(cache, r->rc);
+}
+
+#ifdef NETSNMP_CACHE_THREADS
+static int      cache_reload_pipe[2] = { -1, -1 };
+static pthread_mutex_t cache_reload_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct netsnmp_cache_reload_s *cache_reload_done;
+
+/* on the main loop: install the results of finished loads */
+static void
+_cache_reload_finish(int fd, void *data)
+{
+    struct netsnmp_cache_reload_s *r, *next;
+    char            buf[64];
+
+    while (read(fd, buf, sizeof(buf)) > 0)
+        ;
+    pthread_mutex_lock(&cache_reload_lock);
+    r = cache_reload_done;
+    cache_reload_done = NULL;
+    pthread_mutex_unlock(&cache_reload_lock);
+
+    for (; r; r = next) {
+        next = r->next;
+        if (r->cache) {
+            r->cache->reload = NULL;
+            _cache_install(r->cache, r);
+            DEBUGMSGT(("helper:cache_handler", "background load of %p "
+                       "done in %u ms\n", r->cache, r->load_time));
+        } else if (r->rc >= 0 && r->shadow.free_cache) {
+            r->shadow.free_cache(&r->shadow, r->shadow.magic);
+        }
+        free(r);
+    }
+}
+
+static void *
+_cache_reload_run(void *arg)
+{
+    struct netsnmp_cache_reload_s *r = (struct netsnmp_cache_reload_s *) arg;
+
+    _cache_load_shadow(r);
+
+    pthread_mutex_lock(&cache_reload_lock);
+    r->next = cache_reload_done;
+    cache_reload_done = r;
+    pthread_mutex_unlock(&cache_reload_lock);
+    /* if the pipe is full, a wakeup is pending anyway */
+    if (write(cache_reload_pipe[1], "", 1) < 0 && errno != EAGAIN)
+        snmp_log_perror("cache_handler: wakeup");
+    return NULL;
+}
+
+/* start a load in a thread of its own; returns 0 on success */
+static int
+_cache_reload_start(netsnmp_cache *cache)
+{
+    struct netsnmp_cache_reload_s *r;
+    pthread_attr_t  attr;
+    pthread_t       thread;
+    sigset_t        set, oset;
+    int             rc;
+
+    if (cache_reload_pipe[0] < 0) {
+        if (pipe(cache_reload_pipe) != 0) {
+            snmp_log_perror("cache_handler: pipe");
+            return -1;
+        }
+        fcntl(cache_reload_pipe[0], F_SETFL,
+              fcntl(cache_reload_pipe[0], F_GETFL) | O_NONBLOCK);
+        fcntl(cache_reload_pipe[1], F_SETFL,
+              fcntl(cache_reload_pipe[1], F_GETFL) | O_NONBLOCK);
+        if (register_readfd(cache_reload_pipe[0], _cache_reload_finish,
+                            NULL) != FD_REGISTERED_OK) {
+            close(cache_reload_pipe[0]);
+            close(cache_reload_pipe[1]);
+            cache_reload_pipe[0] = cache_reload_pipe[1] = -1;
+            return -1;
+        }
+    }
+
+    r = (struct netsnmp_cache_reload_s *) malloc(sizeof(*r));
+    if (r == NULL)
+        return -1;
+    _cache_reload_init(r, cache);
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    /* signals are for the main loop */
+    sigfillset(&set);
+    pthread_sigmask(SIG_SETMASK, &set, &oset);
+    rc = pthread_create(&thread, &attr, _cache_reload_run, r);
+    pthread_sigmask(SIG_SETMASK, &oset, NULL);
+    pthread_attr_destroy(&attr);
+    if (rc != 0) {
+        snmp_log(LOG_ERR, "cache_handler: cannot start load thread\n");
+        free(r);
+        return -1;
+    }
+    cache->reload = r;
+    DEBUGMSGT(("helper:cache_handler", " loading in background\n"));
+    return 0;
+}
+#endif /* NETSNMP_CACHE_THREADS */
+
+/*
+ * Reload an expired cache: in the background if it asks for that and
+ * still has data to serve meanwhile, and at once otherwise.
+ */
+static void
+_cache_reload( netsnmp_cache *cache )
+{
+    if (cache->reload)
+        return;                 /* under way */
+#ifdef NETSNMP_CACHE_THREADS
+    if (cache->valid && (cache->flags & NETSNMP_CACHE_RELOAD_IN_BACKGROUND) &&
+        _cache_reload_start(cache) == 0)
+        return;
+#endif
+    _cache_load(cache);
+}
+
 static int
 _cache_load( netsnmp_cache *cache )
 {
     int ret = -1;
 
+    if (cache->flags & NETSNMP_CACHE_RELOAD_IN_BACKGROUND) {
+        struct netsnmp_cache_reload_s r;
+
+        if (cache->reload)
+            cache->reload->discard = 1;         /* superseded */
+        _cache_reload_init(&r, cache);
+        if (cache->load_cache)
+            _cache_load_shadow(&r);
+        else
+            r.rc = -1;
+        return _cache_install(cache, &r);
+    }
+
     /*
      * If we've got a valid cache, then release it before reloading
      */
@@ -731,15 +1002,28 @@ _cache_load( netsnmp_cache *cache )
         (! (cache->flags & NETSNMP_CACHE_DONT_FREE_BEFORE_LOAD)))
         _cache_free(cache);
 
-    if ( cache->load_cache)
+    if ( cache->load_cache) {
+        struct timeval  start;
+
+        netsnmp_get_monotonic_clock(&start);
         ret = cache->load_cache(cache, cache->magic);
+        cache->load_time = _cache_ms_since(&start);
+    }
     if (ret < 0) {
         DEBUGMSGT(("helper:cache_handler", " load failed (%d)\n", ret));
         cache->valid = 0;
         return ret;
     }
+    return _cache_loaded(cache, ret);
+}
+
+/* Bookkeeping after a successful load. */
+static int
+_cache_loaded( netsnmp_cache *cache, int ret )
+{
     cache->valid = 1;
     cache->expired = 0;
+    cache->generation++;
 
     /*
      * If we didn't previously have any valid caches outstanding,
@@ -785,7 +1069,7 @@ release_cached_resources(unsigned int regNo, void *clientargs)
              * Otherwise, note that we still have at
              *   least one active cache.
              */
-            if (netsnmp_cache_check_expired(cache)) {
+            if (netsnmp_cache_check_expired(cache) && !cache->reload) {
                 if(! (cache->flags & NETSNMP_CACHE_DONT_FREE_EXPIRED))
                     _cache_free(cache);
             } else {
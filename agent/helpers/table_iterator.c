@@ -104,6 +104,7 @@
 #include <net-snmp/agent/table.h>
 #include <net-snmp/agent/serialize.h>
 #include <net-snmp/agent/stash_cache.h>
+#include <net-snmp/agent/cache_handler.h>
 
 netsnmp_feature_child_of(table_iterator_all, mib_helpers);
 
@@ -117,6 +118,8 @@ netsnmp_feature_require(data_list_get_list_node);
 netsnmp_feature_require(oid_stash_add_data);
 #endif /* NETSNMP_FEATURE_REQUIRE_STASH_CACHE */
 
+static void _ti_index_free(netsnmp_iterator_info *iinfo);
+
 /* ==================================
  *
  * Iterator API: Table maintenance
@@ -169,6 +172,7 @@ netsnmp_iterator_delete_table( netsnmp_iterator_info *iinfo )
         snmp_free_varbind( iinfo->indexes );
         iinfo->indexes = NULL;
     }
+    _ti_index_free(iinfo);
     netsnmp_table_registration_info_free(iinfo->table_reginfo);
     SNMP_FREE( iinfo );
 }
@@ -447,6 +451,430 @@ netsnmp_iterator_remember(netsnmp_request_info *request,
 }    
 
 #define TABLE_ITERATOR_NOTAGAIN 255
+
+/* ==================================
+ *
+ * Iterator API: Row index
+ *
+ * ================================== */
+
+/*
+ * A large iterator table may ask the helper to keep a sorted index of
+ * its rows.  One pass over the iterator hooks records the index OID and
+ * data context of every row, after which GET and GETNEXT requests are
+ * answered by a binary search rather than by a pass over the table each.
+ *
+ * The data contexts are kept from one request to the next, so they must
+ * stay valid until the index is rebuilt: that is, until the table's
+ * netsnmp_cache (if a cache handler serves it) is loaded
+ * again or released, the index times out, or the module calls
+ * netsnmp_iterator_index_invalidate().  Loop contexts are not kept.  If
+ * free_data_context is set, the index owns the contexts it holds and
+ * frees them when it is rebuilt.
+ */
+typedef struct ti_index_row_s {
+    oid            *name;           /* index part of the row OID */
+    size_t          name_len;
+    size_t          offset;         /* of name in the OID pool */
+    void           *data_context;
+} ti_index_row;
+
+struct netsnmp_iterator_index_s {
+    int             valid;
+    int             timeout;        /* in seconds, 0 for none */
+    marker_t        built;
+    netsnmp_cache  *cache;
+    u_int           cache_generation;
+
+    ti_index_row   *rows;
+    size_t          count, size;
+    oid            *oids;
+    size_t          oids_used, oids_size;
+};
+
+static void
+_ti_index_clear(netsnmp_iterator_info *iinfo)
+{
+    struct netsnmp_iterator_index_s *idx = iinfo->row_index;
+    size_t          i;
+
+    if (iinfo->free_data_context)
+        for (i = 0; i < idx->count; i++)
+            if (idx->rows[i].data_context)
+                (iinfo->free_data_context)(idx->rows[i].data_context, iinfo);
+    idx->count = 0;
+    idx->oids_used = 0;
+    idx->valid = 0;
+}
+
+static void
+_ti_index_free(netsnmp_iterator_info *iinfo)
+{
+    struct netsnmp_iterator_index_s *idx = iinfo->row_index;
+
+    if (!idx)
+        return;
+    _ti_index_clear(iinfo);
+    free(idx->rows);
+    free(idx->oids);
+    free(idx->built);
+    free(idx);
+    iinfo->row_index = NULL;
+}
+
+static int
+_ti_index_add(struct netsnmp_iterator_index_s *idx, const oid *name,
+              size_t name_len, void *data_context)
+{
+    ti_index_row   *row;
+
+    if (idx->count == idx->size) {
+        size_t          size = idx->size ? idx->size * 2 : 64;
+        ti_index_row   *rows = realloc(idx->rows, size * sizeof(*rows));
+
+        if (!rows)
+            return SNMPERR_MALLOC;
+        idx->rows = rows;
+        idx->size = size;
+    }
+    if (idx->oids_size - idx->oids_used < name_len) {
+        size_t          size = idx->oids_size ? idx->oids_size * 2 : 1024;
+        oid            *oids;
+
+        while (size - idx->oids_used < name_len)
+            size *= 2;
+        oids = realloc(idx->oids, size * sizeof(oid));
+        if (!oids)
+            return SNMPERR_MALLOC;
+        idx->oids = oids;
+        idx->oids_size = size;
+    }
+    row = &idx->rows[idx->count++];
+    row->offset = idx->oids_used;
+    row->name_len = name_len;
+    row->data_context = data_context;
+    memcpy(idx->oids + idx->oids_used, name, name_len * sizeof(oid));
+    idx->oids_used += name_len;
+    return SNMPERR_SUCCESS;
+}
+
+static int
+_ti_index_compare(const void *a, const void *b)
+{
+    const ti_index_row *ra = (const ti_index_row *) a;
+    const ti_index_row *rb = (const ti_index_row *) b;
+    int             rc;
+
+    rc = snmp_oid_compare(ra->name, ra->name_len, rb->name, rb->name_len);
+    if (rc == 0)
+        rc = ra->offset < rb->offset ? -1 : ra->offset > rb->offset;
+    return rc;
+}
+
+/* one full pass over the iterator hooks */
+static int
+_ti_index_build(netsnmp_iterator_info *iinfo,
+                netsnmp_handler_registration *reginfo)
+{
+    struct netsnmp_iterator_index_s *idx = iinfo->row_index;
+    netsnmp_variable_list *index_search, *free_this_index_search;
+    void           *loop_context = NULL, *last_loop_context;
+    void           *data_context = NULL;
+    netsnmp_mib_handler *cache_handler;
+    oid             name[MAX_OID_LEN];
+    size_t          name_len, i, n;
+    int             rc = SNMPERR_SUCCESS;
+
+    _ti_index_clear(iinfo);
+    if (!iinfo->indexes)
+        return SNMPERR_GENERR;
+    index_search = snmp_clone_varbind(iinfo->indexes);
+    if (!index_search)
+        return SNMPERR_MALLOC;
+    free_this_index_search = index_search;
+
+    index_search = (iinfo->get_first_data_point) (&loop_context,
+                                                  &data_context,
+                                                  index_search, iinfo);
+    while (index_search) {
+        free_this_index_search = index_search;
+        if (!data_context && iinfo->make_data_context)
+            data_context = (iinfo->make_data_context)(loop_context, iinfo);
+        if (rc == SNMPERR_SUCCESS &&
+            build_oid_noalloc(name, MAX_OID_LEN, &name_len, NULL, 0,
+                              index_search) == SNMPERR_SUCCESS)
+            rc = _ti_index_add(idx, name, name_len, data_context);
+        else
+            rc = SNMPERR_GENERR;
+        if (rc != SNMPERR_SUCCESS && data_context &&
+            iinfo->free_data_context)
+            (iinfo->free_data_context)(data_context, iinfo);
+        data_context = NULL;
+
+        last_loop_context = loop_context;
+        index_search = (iinfo->get_next_data_point) (&loop_context,
+                                                     &data_context,
+                                                     index_search, iinfo);
+        if (iinfo->free_loop_context && last_loop_context &&
+            data_context != last_loop_context)
+            (iinfo->free_loop_context) (last_loop_context, iinfo);
+    }
+    if (loop_context && iinfo->free_loop_context_at_end)
+        (iinfo->free_loop_context_at_end) (loop_context, iinfo);
+    snmp_free_varbind(free_this_index_search);
+
+    if (rc != SNMPERR_SUCCESS) {
+        _ti_index_clear(iinfo);
+        return rc;
+    }
+
+    /* sort, and keep the first of any rows with the same index */
+    for (i = 0; i < idx->count; i++)
+        idx->rows[i].name = idx->oids + idx->rows[i].offset;
+    if (idx->count > 1)
+        qsort(idx->rows, idx->count, sizeof(*idx->rows), _ti_index_compare);
+    for (i = n = 0; i < idx->count; i++) {
+        if (n && snmp_oid_compare(idx->rows[n - 1].name,
+                                  idx->rows[n - 1].name_len,
+                                  idx->rows[i].name,
+                                  idx->rows[i].name_len) == 0) {
+            if (idx->rows[i].data_context && iinfo->free_data_context)
+                (iinfo->free_data_context)(idx->rows[i].data_context, iinfo);
+            continue;
+        }
+        idx->rows[n++] = idx->rows[i];
+    }
+    idx->count = n;
+
+    cache_handler = netsnmp_find_handler_by_name(reginfo, "cache_handler");
+    idx->cache = cache_handler ? (netsnmp_cache *) cache_handler->myvoid : NULL;
+    if (idx->cache)
+        idx->cache_generation = idx->cache->generation;
+    netsnmp_set_monotonic_marker(&idx->built);
+    idx->valid = 1;
+    DEBUGMSGTL(("table_iterator", "indexed %" NETSNMP_PRIz "u rows of %s\n",
+                idx->count, reginfo->handlerName));
+    return SNMPERR_SUCCESS;
+}
+
+/* make sure the index reflects the table, rebuilding it if need be */
+static int
+_ti_index_check(netsnmp_iterator_info *iinfo,
+                netsnmp_handler_registration *reginfo)
+{
+    struct netsnmp_iterator_index_s *idx = iinfo->row_index;
+
+    if (idx->valid && idx->cache &&
+        (!idx->cache->valid ||
+         idx->cache->generation != idx->cache_generation))
+        idx->valid = 0;
+    if (idx->valid && idx->timeout > 0 &&
+        netsnmp_ready_monotonic(idx->built, idx->timeout * 1000))
+        idx->valid = 0;
+    if (idx->valid)
+        return SNMPERR_SUCCESS;
+    if (idx->cache && netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID,
+                                             NETSNMP_DS_AGENT_NO_CACHING))
+        return SNMPERR_GENERR;
+    return _ti_index_build(iinfo, reginfo);
+}
+
+/*
+ * The first row whose index is greater than name (or, for an exact
+ * search, greater than or equal to it).
+ */
+static size_t
+_ti_index_search(const struct netsnmp_iterator_index_s *idx,
+                 const oid *name, size_t name_len, int exact)
+{
+    size_t          lo = 0, hi = idx->count, mid;
+    int             rc;
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        rc = snmp_oid_compare(idx->rows[mid].name, idx->rows[mid].name_len,
+                              name, name_len);
+        if (rc < 0 || (rc == 0 && !exact))
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * Asks the table_iterator helper to index the rows of a table.
+ *
+ * The index is built by one pass over the iterator hooks, and is used to
+ * find the rows for GET, GETNEXT and SET requests until it goes stale.
+ * Data contexts returned by the hooks (or made by make_data_context) are
+ * kept along with it, and must remain valid as long as the index does.
+ * A table whose rows are loaded by its cache handler and freed only by
+ * the next load or release of that cache meets this with a timeout of 0:
+ * the index is rebuilt whenever the cache is.  Tables that change their
+ * rows otherwise must call netsnmp_iterator_index_invalidate() first.
+ *
+ * @param iinfo   the iterator information of the table
+ * @param timeout seconds after which the index is rebuilt, or 0 to rely
+ *                on the table's cache handler and on
+ *                netsnmp_iterator_index_invalidate() only
+ *
+ * @return SNMPERR_SUCCESS, or SNMPERR_MALLOC
+ */
+int
+netsnmp_iterator_index_enable(netsnmp_iterator_info *iinfo, int timeout)
+{
+    if (!iinfo)
+        return SNMPERR_GENERR;
+    if (!iinfo->row_index) {
+        iinfo->row_index = SNMP_MALLOC_STRUCT(netsnmp_iterator_index_s);
+        if (!iinfo->row_index)
+            return SNMPERR_MALLOC;
+    }
+    iinfo->row_index->timeout = timeout;
+    iinfo->row_index->valid = 0;
+    return SNMPERR_SUCCESS;
+}
+
+/**
+ * Marks the row index of a table as stale, so that it is rebuilt before
+ * the next request is served from it.  Modules that add, remove or
+ * reorder rows outside of a cache load should call this.
+ */
+void
+netsnmp_iterator_index_invalidate(netsnmp_iterator_info *iinfo)
+{
+    if (iinfo && iinfo->row_index)
+        iinfo->row_index->valid = 0;
+}
+
+/* like netsnmp_iterator_remember(), but the context stays with the index */
+static ti_cache_info *
+_ti_index_remember(netsnmp_request_info *request, const oid *name,
+                   size_t name_len, void *data_context,
+                   netsnmp_iterator_info *iinfo)
+{
+    ti_cache_info  *ti_info;
+
+    ti_info = (ti_cache_info*)
+        netsnmp_request_get_list_data(request, TI_REQUEST_CACHE);
+    if (!ti_info) {
+        ti_info = SNMP_MALLOC_TYPEDEF(ti_cache_info);
+        if (ti_info == NULL)
+            return NULL;
+        netsnmp_request_add_list_data(request,
+                                      netsnmp_create_data_list
+                                      (TI_REQUEST_CACHE,
+                                       ti_info,
+                                       netsnmp_free_ti_cache));
+    }
+    if (ti_info->data_context && ti_info->free_context)
+        (ti_info->free_context)(ti_info->data_context, iinfo);
+    ti_info->data_context = data_context;
+    ti_info->free_context = NULL;
+    ti_info->iinfo = iinfo;
+    ti_info->best_match_len = name_len;
+    memcpy(ti_info->best_match, name, name_len * sizeof(oid));
+    return ti_info;
+}
+
+/* finds the rows for a GET, GETNEXT or SET request using the index */
+static int
+_ti_index_requests(netsnmp_iterator_info *iinfo,
+                   netsnmp_handler_registration *reginfo,
+                   netsnmp_agent_request_info *reqinfo,
+                   netsnmp_request_info *requests,
+                   oid *coloid, size_t coloid_len)
+{
+    struct netsnmp_iterator_index_s *idx = iinfo->row_index;
+    netsnmp_request_info *request;
+    netsnmp_table_request_info *table_info;
+    netsnmp_variable_list *vb, *results;
+    ti_cache_info  *ti_info;
+    oid             name[MAX_OID_LEN];
+    size_t          i;
+    int             rc, nc;
+
+    for (request = requests; request; request = request->next) {
+        if (request->processed)
+            continue;
+        table_info = netsnmp_extract_table_info(request);
+        if (table_info == NULL)
+            return SNMP_ERR_GENERR;
+        vb = request->requestvb;
+
+        if (reqinfo->mode != MODE_GETNEXT) {
+            /* looking for an exact match */
+            coloid[reginfo->rootoid_len + 1] = table_info->colnum;
+            if (vb->name_length <= coloid_len ||
+                snmp_oid_compare(vb->name, coloid_len,
+                                 coloid, coloid_len) != 0)
+                continue;
+            i = _ti_index_search(idx, vb->name + coloid_len,
+                                 vb->name_length - coloid_len, 1);
+            if (i < idx->count &&
+                snmp_oid_compare(idx->rows[i].name, idx->rows[i].name_len,
+                                 vb->name + coloid_len,
+                                 vb->name_length - coloid_len) == 0 &&
+                _ti_index_remember(request, vb->name, vb->name_length,
+                                   idx->rows[i].data_context,
+                                   iinfo) == NULL)
+                return SNMP_ERR_GENERR;
+            continue;
+        }
+
+        /* looking for the next row, in this column or the ones after it */
+        for (;;) {
+            coloid[reginfo->rootoid_len + 1] = table_info->colnum;
+            rc = snmp_oid_compare(vb->name,
+                                  SNMP_MIN(vb->name_length, coloid_len),
+                                  coloid, coloid_len);
+            if (rc < 0 || (rc == 0 && vb->name_length <= coloid_len))
+                i = 0;
+            else if (rc > 0)
+                i = idx->count;
+            else
+                i = _ti_index_search(idx, vb->name + coloid_len,
+                                     vb->name_length - coloid_len, 0);
+            while (i < idx->count &&
+                   coloid_len + idx->rows[i].name_len > MAX_OID_LEN)
+                i++;
+            if (i < idx->count)
+                break;
+            nc = netsnmp_table_next_column(table_info);
+            if (0 == nc) {
+                coloid[reginfo->rootoid_len+1] = table_info->colnum+1;
+                snmp_set_var_objid(vb, coloid, reginfo->rootoid_len+2);
+                request->processed = TABLE_ITERATOR_NOTAGAIN;
+                break;
+            }
+            table_info->colnum = nc;
+        }
+        if (request->processed)
+            continue;
+
+        memcpy(name, coloid, coloid_len * sizeof(oid));
+        memcpy(name + coloid_len, idx->rows[i].name,
+               idx->rows[i].name_len * sizeof(oid));
+        results = snmp_clone_varbind(iinfo->indexes);
+        if (!results ||
+            parse_oid_indexes(idx->rows[i].name, idx->rows[i].name_len,
+                              results) != SNMPERR_SUCCESS ||
+            snmp_set_var_objid(results, name,
+                               coloid_len + idx->rows[i].name_len) ||
+            (ti_info = _ti_index_remember(request, results->name,
+                                          results->name_length,
+                                          idx->rows[i].data_context,
+                                          iinfo)) == NULL) {
+            snmp_free_varbind(results);
+            return SNMP_ERR_GENERR;
+        }
+        snmp_free_varbind(ti_info->results);
+        ti_info->results = results;
+    }
+    return SNMP_ERR_NOERROR;
+}
+
 /* implements the table_iterator helper */
 int
 netsnmp_table_iterator_helper_handler(netsnmp_mib_handler *handler,
@@ -472,6 +900,7 @@ netsnmp_table_iterator_helper_handler(netsnmp_mib_handler *handler,
     void           *callback_data_context = NULL;
     ti_cache_info  *ti_info = NULL;
     int             request_count = 0;
+    int             use_index = 0;
 #ifndef NETSNMP_FEATURE_REMOVE_STASH_CACHE
     netsnmp_oid_stash_node **cinfo = NULL;
     netsnmp_variable_list *old_indexes = NULL, *vb;
@@ -573,10 +1002,30 @@ netsnmp_table_iterator_helper_handler(netsnmp_mib_handler *handler,
         break;
     }
 
+    /*
+     * use the row index if there is one (it is rebuilt in place, so
+     * not for handlers that may run in several threads at once)
+     */
+    if (iinfo->row_index && !(reginfo->modes & HANDLER_CAN_THREADSAFE) &&
+        (reqinfo->mode == MODE_GET ||
+         reqinfo->mode == MODE_GETNEXT
+#ifndef NETSNMP_NO_WRITE_SUPPORT
+         || reqinfo->mode == MODE_SET_RESERVE1
+#endif /* NETSNMP_NO_WRITE_SUPPORT */
+            ) && _ti_index_check(iinfo, reginfo) == SNMPERR_SUCCESS)
+        use_index = 1;
+
+    if (use_index) {
+        ret = _ti_index_requests(iinfo, reginfo, reqinfo, requests,
+                                 coloid, coloid_len);
+        if (ret != SNMP_ERR_NOERROR)
+            return ret;
+    }
+
     /*
      * collect all information for each needed row
      */
-    if (reqinfo->mode == MODE_GET ||
+    else if (reqinfo->mode == MODE_GET ||
         reqinfo->mode == MODE_GETNEXT ||
         reqinfo->mode == MODE_GET_STASH
 #ifndef NETSNMP_NO_WRITE_SUPPORT
@@ -959,6 +1408,13 @@ netsnmp_table_iterator_helper_handler(netsnmp_mib_handler *handler,
         reqinfo->mode = oldmode;
     }
 
+#ifndef NETSNMP_NO_WRITE_SUPPORT
+    /* a SET may have created, changed or destroyed rows */
+    if (reqinfo->mode == MODE_SET_COMMIT || reqinfo->mode == MODE_SET_UNDO ||
+        reqinfo->mode == MODE_SET_FREE)
+        netsnmp_iterator_index_invalidate(iinfo);
+#endif /* NETSNMP_NO_WRITE_SUPPORT */
+
     /* cleanup */
     if (free_this_index_search)
         snmp_free_varbind(free_this_index_search);
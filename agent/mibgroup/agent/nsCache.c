@@ -39,6 +39,10 @@ extern netsnmp_cache *netsnmp_cache_get_head(void);
 
 #define  NSCACHE_TIMEOUT	2
 #define  NSCACHE_STATUS		3
+#define  NSCACHE_LOADS		4
+#define  NSCACHE_LOADTIME	5
+#define  NSCACHE_STALEREQUESTS	6
+#define  NSCACHE_STALEAGE	7
 
 #define NSCACHE_STATUS_ENABLED  1
 #define NSCACHE_STATUS_DISABLED 2
@@ -88,7 +92,7 @@ init_nsCache(void)
     }
     netsnmp_table_helper_add_indexes(table_info, ASN_PRIV_IMPLIED_OBJECT_ID, 0);
     table_info->min_column = NSCACHE_TIMEOUT;
-    table_info->max_column = NSCACHE_STATUS;
+    table_info->max_column = NSCACHE_STALEAGE;
 
 
     /*
@@ -316,6 +320,34 @@ handle_nsCacheTable(netsnmp_mib_handler *handler,
                                          (u_char*)&status, sizeof(status));
 	        break;
 
+            case NSCACHE_LOADS:
+            case NSCACHE_LOADTIME:
+            case NSCACHE_STALEREQUESTS:
+            case NSCACHE_STALEAGE:
+                if (!cache_entry) {
+                    netsnmp_set_request_error(reqinfo, request, SNMP_NOSUCHINSTANCE);
+                    continue;
+		}
+                switch (table_info->colnum) {
+                case NSCACHE_LOADS:
+                    snmp_set_var_typed_integer(request->requestvb, ASN_COUNTER,
+                                               cache_entry->generation);
+                    break;
+                case NSCACHE_LOADTIME:
+                    snmp_set_var_typed_integer(request->requestvb, ASN_GAUGE,
+                                               cache_entry->load_time);
+                    break;
+                case NSCACHE_STALEREQUESTS:
+                    snmp_set_var_typed_integer(request->requestvb, ASN_COUNTER,
+                                               cache_entry->stale_served);
+                    break;
+                default:
+                    snmp_set_var_typed_integer(request->requestvb, ASN_GAUGE,
+                                               cache_entry->stale_age);
+                    break;
+                }
+	        break;
+
             default:
                 netsnmp_set_request_error(reqinfo, request, SNMP_NOSUCHOBJECT);
                 continue;
@@ -414,9 +446,7 @@ handle_nsCacheTable(netsnmp_mib_handler *handler,
                         cache_entry->enabled = 0;
                         break;
 		    case NSCACHE_STATUS_EMPTY:
-                        cache_entry->free_cache(cache_entry, cache_entry->magic);
-                        free(cache_entry->timestampM);
-                        cache_entry->timestampM = NULL;
+                        netsnmp_cache_empty(cache_entry);
                         break;
 		}
 	        break;
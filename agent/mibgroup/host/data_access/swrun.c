@@ -33,6 +33,7 @@ netsnmp_feature_child_of(swrun_count_processes_by_regex, software_running);
  */
 static int _swrun_init = 0;
        int _swrun_max  = 0;
+       int _swrun_update = 0;
 static netsnmp_cache     *swrun_cache     = NULL;
 static netsnmp_container *swrun_container = NULL;
 
@@ -58,6 +59,15 @@ init_swrun(void)
     (void)netsnmp_swrun_container();
     netsnmp_arch_swrun_init();
     (void) netsnmp_swrun_cache();
+
+    /*
+     * if the arch code can update the previous contents, keep them
+     * around instead of starting from scratch on every load. (The cache
+     * may have been created by a table registered before us.)
+     */
+    if (_swrun_update && swrun_cache)
+        swrun_cache->flags |= NETSNMP_CACHE_DONT_FREE_BEFORE_LOAD |
+                              NETSNMP_CACHE_DONT_FREE_EXPIRED;
 }
 
 void
@@ -162,7 +172,8 @@ swrun_count_processes_by_name( char *name )
 static int
 _cache_load( netsnmp_cache *cache,  void *magic )
 {
-    netsnmp_swrun_container_load( swrun_container, 0 );
+    netsnmp_swrun_container_load( swrun_container,
+                                  _swrun_update ? NETSNMP_SWRUN_UPDATE : 0 );
     return 0;
 }
 
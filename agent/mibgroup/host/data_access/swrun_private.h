@@ -1,3 +1,9 @@
 extern void netsnmp_arch_swrun_init(void);
 extern int netsnmp_arch_swrun_container_load(netsnmp_container* container,
                                              u_int load_flags);
+
+/*
+ * set by netsnmp_arch_swrun_init() if netsnmp_arch_swrun_container_load()
+ * can update the container of the previous load (NETSNMP_SWRUN_UPDATE)
+ */
+extern int _swrun_update;
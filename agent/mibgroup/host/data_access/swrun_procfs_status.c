@@ -4,6 +4,7 @@
  *     /proc/{pid}/status interface - Linux
  */
 #include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-features.h>
 
 #include <stdio.h>
 #include <ctype.h>
@@ -31,8 +32,11 @@
 #include <net-snmp/data_access/swrun.h>
 #include "swrun_private.h"
 
+netsnmp_feature_require(container_lifo);
+
 static long pagesize;
 static long sc_clk_tck;
+static u_int load_count;
 
 /* ---------------------------------------------------------------------
  */
@@ -45,20 +49,189 @@ netsnmp_arch_swrun_init(void)
     
     pagesize = getpagesize();
     sc_clk_tck = sysconf(_SC_CLK_TCK);
+    _swrun_update = 1;
     return;
 }
 
+/*
+ * Read the name of process <pid> from /proc/<pid>/status and its path and
+ * parameters from /proc/<pid>/cmdline.
+ */
+static int
+_swrun_read_name(int pid, netsnmp_swrun_entry *entry)
+{
+    FILE                *fp;
+    int                  ret;
+    char                 buf[BUFSIZ], buf2[BUFSIZ], *cp;
+
+    /*
+     *   Name:  process name
+     */
+    snprintf( buf2, BUFSIZ, "/proc/%d/status", pid );
+    fp = fopen( buf2, "r" );
+    if (!fp)
+        return -1; /* file (process) probably went away */
+    memset(buf, 0, sizeof(buf));
+    if (fgets( buf, BUFSIZ-1, fp ) == NULL) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    for ( cp = buf; *cp != ':'; cp++ )
+        ;
+    while (isspace(*(++cp)))	/* Skip ':' and following spaces */
+        ;
+    entry->hrSWRunName_len = snprintf(entry->hrSWRunName,
+                               sizeof(entry->hrSWRunName)-1, "%s", cp);
+    if ( '\n' == entry->hrSWRunName[ entry->hrSWRunName_len-1 ]) {
+        entry->hrSWRunName[ entry->hrSWRunName_len-1 ] = '\0';
+        entry->hrSWRunName_len--;           /* Stamp on trailing newline */
+    }
+
+    /*
+     *  Command Line:
+     *     argv[0] '\0' argv[1] '\0' ....
+     */
+    snprintf( buf2, BUFSIZ, "/proc/%d/cmdline", pid );
+    fp = fopen( buf2, "r" );
+    if (!fp)
+        return -1; /* file (process) probably went away */
+    entry->hrSWRunType = HRSWRUNTYPE_APPLICATION;
+    memset(buf, 0, sizeof(buf));
+    cp = fgets( buf, BUFSIZ-1, fp );
+    fclose(fp);
+    if (cp != NULL) {
+        /*
+         *     argv[0]   is hrSWRunPath
+         */
+        ret = snprintf(entry->hrSWRunPath, sizeof(entry->hrSWRunPath),
+                       "%s", buf);
+
+        if (ret < sizeof(entry->hrSWRunPath))
+            entry->hrSWRunPath_len = ret;
+        else
+            entry->hrSWRunPath_len = sizeof(entry->hrSWRunPath) - 1;
+
+        /*
+         * Stitch together argv[1..] to construct hrSWRunParameters
+         */
+        for (cp = buf + ret; ! (*cp == '\0' && *(cp + 1) == '\0'); cp++)
+                if (*cp == '\0')
+                        *cp = ' ';
+
+        entry->hrSWRunParameters_len
+            = sprintf(entry->hrSWRunParameters, "%.*s",
+                      (int)sizeof(entry->hrSWRunParameters) - 1,
+                      buf + ret + 1);
+    } else {
+        /* empty /proc/PID/cmdline, it's probably a kernel thread */
+        entry->hrSWRunPath_len = 0;
+        entry->hrSWRunParameters_len = 0;
+        entry->hrSWRunType = HRSWRUNTYPE_OPERATINGSYSTEM;
+    }
+    return 0;
+}
+
+/*
+ * Read /proc/<pid>/stat:
+ *   PID (COMM) STATUS  {xxx}*10  UTIME STIME  {xxx}*6 STARTTIME {xxx} RSS
+ *
+ * The status and the perf values are stored in the entry, the command
+ * name and the start time (which together tell a process apart from an
+ * earlier one with the same PID) are returned to the caller.
+ */
+static int
+_swrun_read_stat(int pid, netsnmp_swrun_entry *entry,
+                 char *comm, size_t comm_size,
+                 unsigned long long *start_time)
+{
+    FILE                *fp;
+    int                  i;
+    unsigned long long   val, cpu = 0;
+    char                 buf[BUFSIZ], *cp, *cp1;
+
+    snprintf( buf, BUFSIZ, "/proc/%d/stat", pid );
+    fp = fopen( buf, "r" );
+    if (!fp)
+        return -1; /* file (process) probably went away */
+    if (fgets( buf, BUFSIZ-1, fp ) == NULL) {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    cp = strchr(buf, '(');
+    cp1 = strrchr(buf, ')');       /* COMM may itself contain ')' */
+    if (!cp || !cp1 || cp1[1] != ' ')
+        return -1;
+    snprintf(comm, comm_size, "%.*s", (int)(cp1 - cp - 1), cp + 1);
+    cp = cp1 + 2;
+
+    switch (*cp) {
+    case 'R':  entry->hrSWRunStatus = HRSWRUNSTATUS_RUNNING;
+               break;
+    case 'S':  entry->hrSWRunStatus = HRSWRUNSTATUS_RUNNABLE;
+               break;
+    case 'D':
+    case 'T':  entry->hrSWRunStatus = HRSWRUNSTATUS_NOTRUNNABLE;
+               break;
+    case 'Z':
+    default:   entry->hrSWRunStatus = HRSWRUNSTATUS_INVALID;
+               break;
+    }
+    for (i = 4; i <= 24; i++) {   /* STATUS is field 3, RSS field 24 */
+        cp = strchr(cp, ' ');
+        if (!cp)
+            return -1;
+        val = strtoull(++cp, NULL, 10);
+        switch (i) {
+        case 14:                                  /*  utime */
+        case 15:                                  /* +stime */
+            cpu += val;
+            break;
+        case 22:
+            *start_time = val;
+            break;
+        case 24:
+            entry->hrSWRunPerfMem = val * (pagesize/1024);   /* in kB */
+            break;
+        }
+    }
+    entry->hrSWRunPerfCPU  = cpu * 100 / sc_clk_tck;
+    return 0;
+}
+
+/*
+ * container callback: collect the entries of processes that have exited
+ */
+static void
+_swrun_collect_gone(void *what, void *magic)
+{
+    netsnmp_swrun_entry *entry = what;
+    netsnmp_container   *gone = magic;
+
+    if (entry->load_count != load_count)
+        CONTAINER_INSERT(gone, entry);
+}
+
 /* ---------------------------------------------------------------------
+ *
+ * With NETSNMP_SWRUN_UPDATE the container holds the result of the
+ * previous load. Processes still there only get their status and perf
+ * values refreshed from /proc/<pid>/stat; names and command lines are
+ * only read for new processes, or if the start time or command name
+ * shows that the PID now belongs to another process or program.
  */
 int
 netsnmp_arch_swrun_container_load( netsnmp_container *container, u_int flags)
 {
     DIR                 *procdir = NULL;
     struct dirent       *procentry_p;
-    FILE                *fp;
-    int                  pid, i, ret;
-    unsigned long long   cpu;
-    char                 buf[BUFSIZ], buf2[BUFSIZ], *cp, *cp1;
+    netsnmp_container   *gone;
+    int                  pid, is_new;
+    unsigned long long   start_time = 0;
+    char                 comm[sizeof(((netsnmp_swrun_entry *)0)->hrSWRunName)];
     netsnmp_swrun_entry *entry;
     
     procdir = opendir("/proc");
@@ -66,6 +239,7 @@ netsnmp_arch_swrun_container_load( netsnmp_container *container, u_int flags)
         snmp_log( LOG_ERR, "Failed to open /proc" );
         return -1;
     }
+    load_count++;
 
     /*
      * Walk through the list of processes in the /proc tree
@@ -75,146 +249,61 @@ netsnmp_arch_swrun_container_load( netsnmp_container *container, u_int flags)
         if ( 0 == pid )
             continue;   /* Presumably '.' or '..' */
 
-        entry = netsnmp_swrun_entry_create(pid);
-        if (NULL == entry)
-            continue;   /* error already logged by function */
+        entry = NULL;
+        if (flags & NETSNMP_SWRUN_UPDATE)
+            entry = netsnmp_swrun_entry_get_by_index(container, pid);
+        is_new = (NULL == entry);
+        if (is_new) {
+            entry = netsnmp_swrun_entry_create(pid);
+            if (NULL == entry)
+                continue;   /* error already logged by function */
+        }
 
         /*
          * Now extract the interesting information
          *   from the various /proc{PID}/ interface files
          */
-
-        /*
-         *   Name:  process name
-         */
-        snprintf( buf2, BUFSIZ, "/proc/%d/status", pid );
-        fp = fopen( buf2, "r" );
-        if (!fp) {
-            netsnmp_swrun_entry_free(entry);
-            continue; /* file (process) probably went away */
-	}
-        memset(buf, 0, sizeof(buf));
-        if (fgets( buf, BUFSIZ-1, fp ) == NULL) {
-            fclose(fp);
-            netsnmp_swrun_entry_free(entry);
-            continue;
-        }
-        fclose(fp);
-
-        for ( cp = buf; *cp != ':'; cp++ )
-            ;
-        while (isspace(*(++cp)))	/* Skip ':' and following spaces */
-            ;
-        entry->hrSWRunName_len = snprintf(entry->hrSWRunName,
-                                   sizeof(entry->hrSWRunName)-1, "%s", cp);
-        if ( '\n' == entry->hrSWRunName[ entry->hrSWRunName_len-1 ]) {
-            entry->hrSWRunName[ entry->hrSWRunName_len-1 ] = '\0';
-            entry->hrSWRunName_len--;           /* Stamp on trailing newline */
-        }
-
-        /*
-         *  Command Line:
-         *     argv[0] '\0' argv[1] '\0' ....
-         */
-        snprintf( buf2, BUFSIZ, "/proc/%d/cmdline", pid );
-        fp = fopen( buf2, "r" );
-        if (!fp) {
-            netsnmp_swrun_entry_free(entry);
-            continue; /* file (process) probably went away */
+        if (_swrun_read_stat(pid, entry, comm, sizeof(comm),
+                             &start_time) < 0) {
+            if (is_new)
+                netsnmp_swrun_entry_free(entry);
+            continue;   /* gone, the sweep below removes old entries */
         }
-        entry->hrSWRunType = HRSWRUNTYPE_APPLICATION;
-        memset(buf, 0, sizeof(buf));
-        cp = fgets( buf, BUFSIZ-1, fp );
-        fclose(fp);
-        if (cp != NULL) {
-            /*
-             *     argv[0]   is hrSWRunPath
-             */
-            ret = snprintf(entry->hrSWRunPath, sizeof(entry->hrSWRunPath),
-                           "%s", buf);
-
-            if (ret < sizeof(entry->hrSWRunPath))
-                entry->hrSWRunPath_len = ret;
-            else
-                entry->hrSWRunPath_len = sizeof(entry->hrSWRunPath) - 1;
-
-            /*
-             * Stitch together argv[1..] to construct hrSWRunParameters
-             */
-            for (cp = buf + ret; ! (*cp == '\0' && *(cp + 1) == '\0'); cp++)
-                    if (*cp == '\0')
-                            *cp = ' ';
-
-            entry->hrSWRunParameters_len
-                = sprintf(entry->hrSWRunParameters, "%.*s",
-                          (int)sizeof(entry->hrSWRunParameters) - 1,
-                          buf + ret + 1);
-        } else {
-            /* empty /proc/PID/cmdline, it's probably a kernel thread */
-            entry->hrSWRunPath_len = 0;
-            entry->hrSWRunParameters_len = 0;
-            entry->hrSWRunType = HRSWRUNTYPE_OPERATINGSYSTEM;
-        }
-
-        /*
-         *   {xxx} {xxx} STATUS  {xxx}*10  UTIME STIME  {xxx}*8 RSS
-         */
-        snprintf( buf, BUFSIZ, "/proc/%d/stat", pid );
-        fp = fopen( buf, "r" );
-        if (!fp) {
-            netsnmp_swrun_entry_free(entry);
-            continue; /* file (process) probably went away */
-	}
-        if (fgets( buf, BUFSIZ-1, fp ) == NULL) {
-            fclose(fp);
-            netsnmp_swrun_entry_free(entry);
-            continue;
+        if (is_new || entry->start_time != start_time ||
+            strcmp(entry->hrSWRunName, comm) != 0) {
+            DEBUGMSGTL(("swrun:load:arch", "%s process %d (%s)\n",
+                        is_new ? "new" : "changed", pid, comm));
+            if (_swrun_read_name(pid, entry) < 0) {
+                if (is_new)
+                    netsnmp_swrun_entry_free(entry);
+                continue;
+            }
+            entry->start_time = start_time;
         }
-        fclose(fp);
+        entry->load_count = load_count;
+        if (is_new)
+            CONTAINER_INSERT(container, entry);
+    }
+    closedir( procdir );
 
-        cp = buf;
-        while ( ' ' != *(cp++))    /* Skip first field */
-            ;
-        cp1 = cp;                  /* Skip second field */
-        while (*cp1) {
-            if (*cp1 == ')') cp = cp1;
-            cp1++;
-        }
-        cp += 2;
-        
-        switch (*cp) {
-        case 'R':  entry->hrSWRunStatus = HRSWRUNSTATUS_RUNNING;
-                   break;
-        case 'S':  entry->hrSWRunStatus = HRSWRUNSTATUS_RUNNABLE;
-                   break;
-        case 'D':
-        case 'T':  entry->hrSWRunStatus = HRSWRUNSTATUS_NOTRUNNABLE;
-                   break;
-        case 'Z':
-        default:   entry->hrSWRunStatus = HRSWRUNSTATUS_INVALID;
-                   break;
-        }
-        for (i=11; i; i--) {   /* Skip STATUS + 10 fields */
-            while (' ' != *(++cp))
-                ;
-            cp++;
-        }
-        cpu  = atol( cp );                     /*  utime */
-        while ( ' ' != *(++cp))
-            ;
-        cpu += atol( cp );                     /* +stime */
-        entry->hrSWRunPerfCPU  = cpu * 100 / sc_clk_tck;
-
-        for (i=9; i; i--) {   /* Skip stime + 8 fields */
-            while (' ' != *(++cp))
-                ;
-            cp++;
+    /*
+     * Remove the processes that have exited since the previous load
+     */
+    if (flags & NETSNMP_SWRUN_UPDATE) {
+        gone = netsnmp_container_find("lifo");
+        if (gone) {
+            CONTAINER_FOR_EACH(container, _swrun_collect_gone, gone);
+            while (CONTAINER_SIZE(gone)) {
+                entry = CONTAINER_FIRST(gone);
+                DEBUGMSGTL(("swrun:load:arch", "process %" NETSNMP_PRIo
+                            "d has exited\n", entry->hrSWRunIndex));
+                CONTAINER_REMOVE(container, entry);
+                netsnmp_swrun_entry_free(entry);
+                CONTAINER_REMOVE(gone, NULL);
+            }
+            CONTAINER_FREE(gone);
         }
-        entry->hrSWRunPerfMem  = atol( cp );       /* rss   */
-        entry->hrSWRunPerfMem *= (pagesize/1024);  /* in kB */
-        CONTAINER_INSERT(container, entry);
     }
-    closedir( procdir );
 
     DEBUGMSGTL(("swrun:load:arch"," loaded %" NETSNMP_PRIz "d entries\n",
                 CONTAINER_SIZE(container)));
@@ -789,6 +789,23 @@ netsnmp_access_interface_entry_overrides(netsnmp_interface_entry *entry)
     }
 }
 
+/**
+ * read the IP parameters of an interface, if that was deferred at load time
+ */
+void
+netsnmp_access_interface_entry_ip_params_get(netsnmp_interface_entry *entry)
+{
+    if ((NULL == entry) ||
+        !(entry->ns_flags & NETSNMP_INTERFACE_FLAGS_IP_PARAMS_PENDING))
+        return;
+
+    DEBUGMSGTL(("access:interface", "ip_params_get %s\n", entry->name));
+    entry->ns_flags &= ~NETSNMP_INTERFACE_FLAGS_IP_PARAMS_PENDING;
+#if defined(linux)
+    netsnmp_arch_interface_ip_params_get(entry);
+#endif
+}
+
 /*
  * ifmib_max_num_ifaces config token
  *
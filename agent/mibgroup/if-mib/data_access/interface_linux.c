@@ -708,6 +708,20 @@ static void netsnmp_retrieve_one_link_info(struct rtnl_link *rtnl_link, int fd,
     if (load_stats)
         _retrieve_stats(entry, rtnl_link);
 
+    /*
+     * The retransmit/reachable times and the IPv6 forwarding setting take
+     * several /proc/sys reads per interface and are only needed by the
+     * IP-MIB interface tables, so leave them until someone asks.
+     */
+    entry->ns_flags |= NETSNMP_INTERFACE_FLAGS_IP_PARAMS_PENDING;
+}
+
+/**
+ * read the per-interface settings deferred by netsnmp_retrieve_one_link_info()
+ */
+void
+netsnmp_arch_interface_ip_params_get(netsnmp_interface_entry *entry)
+{
     _arch_interface_flags_v4_get(entry);
 
 #ifdef NETSNMP_ENABLE_IPV6
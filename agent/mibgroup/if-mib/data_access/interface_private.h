@@ -10,3 +10,5 @@ int netsnmp_arch_interface_container_load(struct netsnmp_container_s* container,
 oid netsnmp_arch_interface_index_find(const char *name);
 int netsnmp_arch_set_admin_status(struct netsnmp_interface_entry_s * entry,
                                   int ifAdminStatus_val);
+void netsnmp_arch_interface_ip_params_get(struct netsnmp_interface_entry_s *
+                                          entry);
@@ -425,6 +425,7 @@ ipv4InterfaceRetransmitTime_get(ipv4InterfaceTable_rowreq_ctx * rowreq_ctx,
 
     netsnmp_assert(NULL != rowreq_ctx);
 
+    netsnmp_access_interface_entry_ip_params_get(rowreq_ctx->data.ifentry);
     if (!
         (rowreq_ctx->data.ifentry->
          ns_flags & NETSNMP_INTERFACE_FLAGS_HAS_V4_RETRANSMIT))
@@ -158,10 +158,15 @@ ipv4InterfaceTable_check_entry_for_updates(const ifTable_rowreq_ctx *
             changed = 1;
         } else {
             /*
-             * still applicable. anything changed?
+             * still applicable. anything changed? the retransmit time
+             * is read on demand; only compare it if it was read before.
              */
-            if ((entry->retransmit_v4 !=
-                 ift_rrc->data.ifentry->retransmit_v4) ||
+            if (!(ift_rrc->data.ifentry->ns_flags &
+                  NETSNMP_INTERFACE_FLAGS_IP_PARAMS_PENDING))
+                netsnmp_access_interface_entry_ip_params_get(entry);
+            if (((entry->ns_flags & NETSNMP_INTERFACE_FLAGS_HAS_V4_RETRANSMIT)
+                 && (entry->retransmit_v4 !=
+                     ift_rrc->data.ifentry->retransmit_v4)) ||
                 (entry->reasm_max_v4 != ift_rrc->data.ifentry->reasm_max_v4)) {
                 DEBUGMSGTL(("ipv4InterfaceTable:check_entry_for_updates",
                             "row changed for %" NETSNMP_PRIo "d\n",
@@ -538,6 +538,7 @@ ipv6InterfaceReachableTime_get(ipv6InterfaceTable_rowreq_ctx * rowreq_ctx,
 
     netsnmp_assert(NULL != rowreq_ctx);
 
+    netsnmp_access_interface_entry_ip_params_get(rowreq_ctx->data.ifentry);
     if (!
         (rowreq_ctx->data.ifentry->
          ns_flags & NETSNMP_INTERFACE_FLAGS_HAS_V6_REACHABLE))
@@ -599,6 +600,7 @@ ipv6InterfaceRetransmitTime_get(ipv6InterfaceTable_rowreq_ctx * rowreq_ctx,
 
     netsnmp_assert(NULL != rowreq_ctx);
 
+    netsnmp_access_interface_entry_ip_params_get(rowreq_ctx->data.ifentry);
     if (!
         (rowreq_ctx->data.ifentry->
          ns_flags & NETSNMP_INTERFACE_FLAGS_HAS_V6_RETRANSMIT))
@@ -679,6 +681,7 @@ ipv6InterfaceForwarding_get(ipv6InterfaceTable_rowreq_ctx * rowreq_ctx,
 
     netsnmp_assert(NULL != rowreq_ctx);
 
+    netsnmp_access_interface_entry_ip_params_get(rowreq_ctx->data.ifentry);
     if (!
         (rowreq_ctx->data.ifentry->
          ns_flags & NETSNMP_INTERFACE_FLAGS_HAS_V6_FORWARDING))
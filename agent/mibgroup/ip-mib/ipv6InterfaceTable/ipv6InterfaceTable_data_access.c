@@ -158,8 +158,13 @@ ipv6InterfaceTable_check_entry_for_updates(const ifTable_rowreq_ctx *
             changed = 1;
         } else {
             /*
-             * still applicable. anything changed?
+             * still applicable. anything changed? retransmit, reachable
+             * time and forwarding are read on demand; only compare them
+             * if they were read before.
              */
+            if (!(ift_rrc->data.ifentry->ns_flags &
+                  NETSNMP_INTERFACE_FLAGS_IP_PARAMS_PENDING))
+                netsnmp_access_interface_entry_ip_params_get(entry);
             if (/** retransmit */
                    ((entry->
                      ns_flags & NETSNMP_INTERFACE_FLAGS_HAS_V6_RETRANSMIT)
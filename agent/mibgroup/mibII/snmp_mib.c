@@ -97,7 +97,7 @@ init_snmp_mib(void)
     NETSNMP_REGISTER_STATISTIC_HANDLER(
         netsnmp_create_handler_registration(
             "mibII/snmp", handle_snmp, snmp_oid, OID_LENGTH(snmp_oid),
-            HANDLER_CAN_RONLY),
+            HANDLER_CAN_RONLY | HANDLER_CAN_THREADSAFE),
         1, SNMP);
     {
         oid snmpEnableAuthenTraps_oid[] = { SNMP_OID, 30, 0 };
@@ -106,6 +106,7 @@ struct netsnmp_tcpConnEntry_s {
 #define	TCPTABLE_REMOTEADDRESS	inp_faddr.s_addr 
 #define	TCPTABLE_REMOTEPORT	inp_fport
 #define	TCPTABLE_IS_LINKED_LIST
+#define	TCPTABLE_RELOAD_IN_BACKGROUND
 
 #elif defined(HAVE_KVM_GETFILES)
 #define	TCPTABLE_ENTRY_TYPE	struct kinfo_file
@@ -157,6 +158,18 @@ TCPTABLE_ENTRY_TYPE	*tcp_head  = NULL;
 int                      tcp_size  = 0;	/* Only used for table-based systems */
 int                      tcp_estab = 0;
 
+#ifdef TCPTABLE_RELOAD_IN_BACKGROUND
+	/*
+	 * The list is loaded on a copy of the cache, possibly by
+	 *   another thread, and handed over through tcp_cache->magic
+	 */
+static netsnmp_cache    *tcp_cache = NULL;
+#define TCPTABLE_HEAD \
+    (tcp_cache ? (TCPTABLE_ENTRY_TYPE *) tcp_cache->magic : NULL)
+#else
+#define TCPTABLE_HEAD	tcp_head
+#endif
+
 
 	/*
 	 *
@@ -184,6 +197,7 @@ init_tcpTable(void)
     netsnmp_table_registration_info *table_info;
     netsnmp_iterator_info           *iinfo;
     netsnmp_handler_registration    *reginfo;
+    netsnmp_mib_handler             *handler;
     int                              rc;
 
     DEBUGMSGTL(("mibII/tcpTable", "Initialising TCP Table\n"));
@@ -216,6 +230,7 @@ init_tcpTable(void)
 #if defined (WIN32) || defined (cygwin)
     iinfo->flags               |= NETSNMP_ITERATOR_FLAG_SORTED;
 #endif /* WIN32 || cygwin */
+    netsnmp_iterator_index_enable(iinfo, 0);
 
 
     /*
@@ -233,10 +248,16 @@ init_tcpTable(void)
      * .... with a local cache
      *    (except for Solaris, which uses a different approach)
      */
-    netsnmp_inject_handler( reginfo,
-		    netsnmp_get_cache_handler(TCP_STATS_CACHE_TIMEOUT,
-			   		tcpTable_load, tcpTable_free,
-					tcpTable_oid, OID_LENGTH(tcpTable_oid)));
+    handler = netsnmp_get_cache_handler(TCP_STATS_CACHE_TIMEOUT,
+                                        tcpTable_load, tcpTable_free,
+                                        tcpTable_oid, OID_LENGTH(tcpTable_oid));
+#ifdef TCPTABLE_RELOAD_IN_BACKGROUND
+    if (handler && handler->myvoid) {
+        tcp_cache = (netsnmp_cache *) handler->myvoid;
+        tcp_cache->flags |= NETSNMP_CACHE_RELOAD_IN_BACKGROUND;
+    }
+#endif
+    netsnmp_inject_handler( reginfo, handler);
 }
 
 
@@ -346,8 +367,18 @@ tcpTable_handler(netsnmp_mib_handler          *handler,
 #ifndef NETSNMP_FEATURE_REMOVE_TCP_COUNT_CONNECTIONS
 int
 TCP_Count_Connections( void ) {
+#ifdef TCPTABLE_RELOAD_IN_BACKGROUND
+    TCPTABLE_ENTRY_TYPE *entry;
+#endif
 #if (defined(CAN_USE_SYSCTL) && defined(TCPCTL_PCBLIST))
     tcpTable_load(NULL, NULL);
+#endif
+#ifdef TCPTABLE_RELOAD_IN_BACKGROUND
+    tcp_estab = 0;
+    for (entry = TCPTABLE_HEAD; entry; entry = entry->INP_NEXT_SYMBOL)
+        if (entry->TCPTABLE_STATE == 5 /* established */ ||
+            entry->TCPTABLE_STATE == 8 /*  closeWait  */ )
+            tcp_estab++;
 #endif
     return tcp_estab;
 }
@@ -471,14 +502,14 @@ tcpTable_first_entry(void **loop_context,
      * XXX - How can we tell if the cache is valid?
      *       No access to 'reqinfo'
      */
-    if (tcp_head == NULL)
+    if (TCPTABLE_HEAD == NULL)
         return NULL;
 
     /*
      * Point to the first entry, and use the
      * 'next_entry' hook to retrieve this row
      */
-    *loop_context = (void*)tcp_head;
+    *loop_context = (void*)TCPTABLE_HEAD;
     return tcpTable_next_entry( loop_context, data_context, index, data );
 }
 
@@ -535,6 +566,15 @@ void
 tcpTable_free(netsnmp_cache *cache, void *magic)
 {
     TCPTABLE_ENTRY_TYPE *p;
+#ifdef TCPTABLE_RELOAD_IN_BACKGROUND
+    TCPTABLE_ENTRY_TYPE *head = (TCPTABLE_ENTRY_TYPE *)magic;
+
+    while (head) {
+        p = head;
+        head = head->INP_NEXT_SYMBOL;
+        free(p);
+    }
+#else
     while (tcp_head) {
         p = tcp_head;
         tcp_head = tcp_head->INP_NEXT_SYMBOL;
@@ -544,6 +584,7 @@ tcpTable_free(netsnmp_cache *cache, void *magic)
     tcp_head  = NULL;
     tcp_size  = 0;
     tcp_estab = 0;
+#endif
 }
 #endif		/* TCPTABLE_IS_LINKED_LIST */
 #endif		/* TCPTABLE_IS_TABLE */
@@ -645,7 +686,7 @@ static void nl_socket_free(struct nl_handle *ns)
 #endif /* HAVE_LIBNL3 */
 
 static int
-tcpTable_load_netlink(void)
+tcpTable_load_netlink(struct inpcb **head)
 {
 	/* TODO: perhaps use permanent nl socket ? */
 	struct nl_sock *nl = nl_socket_alloc();
@@ -730,9 +771,6 @@ tcpTable_load_netlink(void)
 			pcb.inp_fport = r->id.idiag_dport;
 
 			pcb.inp_state = (r->idiag_state & 0xf) < 12 ? linux_states[r->idiag_state & 0xf] : 2;
-			if (pcb.inp_state == 5 /* established */ ||
-				pcb.inp_state == 8 /*  closeWait  */ )
-				tcp_estab++;
 			pcb.uid = r->idiag_uid;
 
 			nnew = SNMP_MALLOC_TYPEDEF(struct inpcb);
@@ -742,8 +780,8 @@ tcpTable_load_netlink(void)
 				break;
 			}
 			memcpy(nnew, &pcb, sizeof(struct inpcb));
-			nnew->inp_next = tcp_head;
-			tcp_head       = nnew;
+			nnew->inp_next = *head;
+			*head          = nnew;
 
 			h = nlmsg_next(h, &len);
 		}
@@ -752,7 +790,7 @@ tcpTable_load_netlink(void)
 
 	nl_socket_free(nl);
 
-	if (tcp_head) {
+	if (*head) {
 		DEBUGMSGTL(("mibII/tcpTable", "Loaded TCP Table using netlink\n"));
 		return 0;
 	}
@@ -766,13 +804,20 @@ tcpTable_load(netsnmp_cache *cache, void *vmagic)
 {
     FILE           *in;
     char            line[256];
+    struct inpcb   *head = NULL;
 
-    tcpTable_free(cache, NULL);
-
+    /*
+     * This runs on a private copy of the cache, maybe in a thread of
+     * its own: the new list is returned in cache->magic, and the global
+     * state is left alone.
+     */
 #ifdef HAVE_NETLINK_NETLINK_H
-	if (tcpTable_load_netlink() == 0) {
+	if (tcpTable_load_netlink(&head) == 0) {
+		cache->magic = head;
 		return 0;
 	}
+	tcpTable_free(cache, head);
+	head = NULL;
 #endif
 
     if (!(in = fopen("/proc/net/tcp", "r"))) {
@@ -802,20 +847,18 @@ tcpTable_load(netsnmp_cache *cache, void *vmagic)
         pcb.inp_fport = htons((unsigned short) fp);
 
         pcb.inp_state = (state & 0xf) < 12 ? linux_states[state & 0xf] : 2;
-        if (pcb.inp_state == 5 /* established */ ||
-            pcb.inp_state == 8 /*  closeWait  */ )
-            tcp_estab++;
         pcb.uid = uid;
 
         nnew = SNMP_MALLOC_TYPEDEF(struct inpcb);
         if (nnew == NULL)
             break;
         memcpy(nnew, &pcb, sizeof(struct inpcb));
-        nnew->inp_next = tcp_head;
-        tcp_head       = nnew;
+        nnew->inp_next = head;
+        head           = nnew;
     }
 
     fclose(in);
+    cache->magic = head;
 
     DEBUGMSGTL(("mibII/tcpTable", "Loaded TCP Table (linux)\n"));
     return 0;
@@ -191,6 +191,7 @@ init_udpTable(void)
 #if defined (WIN32) || defined (cygwin)
     iinfo->flags               |= NETSNMP_ITERATOR_FLAG_SORTED;
 #endif /* WIN32 || cygwin */
+    netsnmp_iterator_index_enable(iinfo, 0);
 
 
     /*
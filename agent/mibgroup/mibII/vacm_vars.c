@@ -1771,11 +1771,13 @@ write_vacmViewMask(int action,
             length = vptr->viewMaskLen;
             memcpy(vptr->viewMask, var_val, var_val_len);
             vptr->viewMaskLen = var_val_len;
+            vacm_viewEntriesChanged();
         }
     } else if (action == FREE) {
         if ((vptr = view_parse_viewEntry(name, name_len)) != NULL) {
             memcpy(vptr->viewMask, string, length);
             vptr->viewMaskLen = length;
+            vacm_viewEntriesChanged();
         }
     }
     return SNMP_ERR_NOERROR;
@@ -1808,10 +1810,12 @@ write_vacmViewType(int action,
         } else {
             oldValue = vptr->viewType;
             vptr->viewType = newValue;
+            vacm_viewEntriesChanged();
         }
     } else if (action == UNDO) {
         if ((vptr = view_parse_viewEntry(name, name_len)) != NULL) {
             vptr->viewType = oldValue;
+            vacm_viewEntriesChanged();
         }
     }
 
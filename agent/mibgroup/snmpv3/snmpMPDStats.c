@@ -40,7 +40,7 @@ init_snmpMPDStats(void)
     netsnmp_handler_registration* s =
         netsnmp_create_handler_registration(
             "snmpMPDStats", NULL, snmpMPDStats, OID_LENGTH(snmpMPDStats),
-            HANDLER_CAN_RONLY);
+            HANDLER_CAN_RONLY | HANDLER_CAN_THREADSAFE);
     if (!s)
         return;
 
@@ -30,7 +30,7 @@ init_usmStats(void)
     netsnmp_handler_registration* s =
         netsnmp_create_handler_registration(
             "usmStats", NULL, usmStats, OID_LENGTH(usmStats),
-            HANDLER_CAN_RONLY);
+            HANDLER_CAN_RONLY | HANDLER_CAN_THREADSAFE);
     if (s &&
 	NETSNMP_REGISTER_STATISTIC_HANDLER(s, 1, USM) == MIB_REGISTERED_OK) {
         REGISTER_SYSOR_ENTRY(usmMIBCompliance,
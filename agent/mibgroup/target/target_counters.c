@@ -27,5 +27,5 @@ init_target_counters(void)
     NETSNMP_REGISTER_STATISTIC_HANDLER(
         netsnmp_create_handler_registration(
             "target_counters", NULL, target_oid, OID_LENGTH(target_oid),
-            HANDLER_CAN_RONLY), 4, TARGET);
+            HANDLER_CAN_RONLY | HANDLER_CAN_THREADSAFE), 4, TARGET);
 }
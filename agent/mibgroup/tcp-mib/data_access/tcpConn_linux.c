@@ -12,6 +12,18 @@
 #include "tcp-mib/tcpConnectionTable/tcpConnectionTable_constants.h"
 #include "tcp-mib/data_access/tcpConn_private.h"
 #include "mibgroup/util_funcs/get_pid_from_inode.h"
+
+#if defined(HAVE_LINUX_NETLINK_H) && defined(HAVE_LINUX_SOCK_DIAG_H) && \
+    defined(HAVE_LINUX_INET_DIAG_H)
+#define TCPCONN_USE_SOCK_DIAG
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#include <errno.h>
+#include <unistd.h>
+#endif
+
 static int
 linux_states[12] = { 1, 5, 3, 4, 6, 7, 11, 1, 8, 9, 2, 10 };
 
@@ -19,6 +31,25 @@ static int _load4(netsnmp_container *container, u_int flags);
 #if defined (NETSNMP_ENABLE_IPV6)
 static int _load6(netsnmp_container *container, u_int flags);
 #endif
+#ifdef TCPCONN_USE_SOCK_DIAG
+static int _load_sock_diag(netsnmp_container *container, u_int flags,
+                           int family);
+static int sock_diag_unavailable = 0;
+#endif
+
+/*
+ * The directory holding the tcp and tcp6 tables.  Setting
+ * NETSNMP_DS_AGENT_PROC_NET_DIR also skips sock_diag, so the parser can
+ * be timed on its own or run against a copy of those files.
+ */
+static const char *
+_proc_net_dir(void)
+{
+    const char     *dir = netsnmp_ds_get_string(NETSNMP_DS_APPLICATION_ID,
+                                                NETSNMP_DS_AGENT_PROC_NET_DIR);
+
+    return dir ? dir : "/proc/net";
+}
 
 /*
  * initialize arch specific storage
@@ -92,7 +123,19 @@ netsnmp_arch_tcpconn_container_load(netsnmp_container *container,
         return -1;
     }
 
-    rc = _load4(container, load_flags);
+    /*
+     * Ask the kernel over sock_diag first, and fall back to parsing
+     * /proc/net/tcp if that is not supported (-2).
+     */
+    rc = -2;
+#ifdef TCPCONN_USE_SOCK_DIAG
+    if (!sock_diag_unavailable &&
+        !netsnmp_ds_get_string(NETSNMP_DS_APPLICATION_ID,
+                               NETSNMP_DS_AGENT_PROC_NET_DIR))
+        rc = _load_sock_diag(container, load_flags, AF_INET);
+#endif
+    if (-2 == rc)
+        rc = _load4(container, load_flags);
 
 #if defined (NETSNMP_ENABLE_IPV6)
     if((0 != rc) || (load_flags & NETSNMP_ACCESS_TCPCONN_LOAD_IPV4_ONLY))
@@ -102,7 +145,15 @@ netsnmp_arch_tcpconn_container_load(netsnmp_container *container,
      * load ipv6. ipv6 module might not be loaded,
      * so ignore -2 err (file not found)
      */
-    rc = _load6(container, load_flags);
+    rc = -2;
+#ifdef TCPCONN_USE_SOCK_DIAG
+    if (!sock_diag_unavailable &&
+        !netsnmp_ds_get_string(NETSNMP_DS_APPLICATION_ID,
+                               NETSNMP_DS_AGENT_PROC_NET_DIR))
+        rc = _load_sock_diag(container, load_flags, AF_INET6);
+#endif
+    if (-2 == rc)
+        rc = _load6(container, load_flags);
     if (-2 == rc)
         rc = 0;
 #endif
@@ -120,15 +171,15 @@ _load4(netsnmp_container *container, u_int load_flags)
 {
     int             rc = 0;
     FILE           *in;
-    char            line[160];
+    char            line[160], procfile[SNMP_MAXPATH];
     enum            { rbufsize = 65536 };
     void           *rbuf = alloca(rbufsize);
     
     netsnmp_assert(NULL != container);
 
-#define PROCFILE "/proc/net/tcp"
-    if (!(in = fopen(PROCFILE, "r"))) {
-        snmp_log(LOG_ERR,"could not open " PROCFILE "\n");
+    snprintf(procfile, sizeof(procfile), "%s/tcp", _proc_net_dir());
+    if (!(in = fopen(procfile, "r"))) {
+        snmp_log(LOG_ERR,"could not open %s\n", procfile);
         return -2;
     }
     
@@ -153,7 +204,8 @@ _load4(netsnmp_container *container, u_int load_flags)
             DEBUGMSGT(("access:tcpconn:container",
                        "error parsing line (%d != 6)\n", rc));
             DEBUGMSGT(("access:tcpconn:container"," line '%s'\n", line));
-	    snmp_log(LOG_ERR, "tcp:_load4: bad line in " PROCFILE ": %s\n", line);
+	    snmp_log(LOG_ERR, "tcp:_load4: bad line in %s: %s\n", procfile,
+                     line);
 	    rc = 0;
             continue;
         }
@@ -266,16 +318,16 @@ _load6(netsnmp_container *container, u_int load_flags)
 {
     int             rc = 0;
     FILE           *in;
-    char            line[360];
+    char            line[360], procfile[SNMP_MAXPATH];
     enum            { rbufsize = 65536 };
     void           *rbuf = alloca(rbufsize);
 
     netsnmp_assert(NULL != container);
 
-#undef PROCFILE
-#define PROCFILE "/proc/net/tcp6"
-    if (!(in = fopen(PROCFILE, "r"))) {
-        DEBUGMSGTL(("access:tcpconn:container","could not open " PROCFILE "\n"));
+    snprintf(procfile, sizeof(procfile), "%s/tcp6", _proc_net_dir());
+    if (!(in = fopen(procfile, "r"))) {
+        DEBUGMSGTL(("access:tcpconn:container","could not open %s\n",
+                    procfile));
         return -2;
     }
 
@@ -302,7 +354,8 @@ _load6(netsnmp_container *container, u_int load_flags)
             DEBUGMSGT(("access:tcpconn:container",
                        "error parsing line (%d != 6)\n", rc));
             DEBUGMSGT(("access:tcpconn:container"," line '%s'\n", line));
-	    snmp_log(LOG_ERR, "tcp:_load6: bad line in " PROCFILE ": %s\n", line);
+	    snmp_log(LOG_ERR, "tcp:_load6: bad line in %s: %s\n", procfile,
+                     line);
 	    rc = 0;
             continue;
         }
@@ -404,3 +457,164 @@ _load6(netsnmp_container *container, u_int load_flags)
     return 0;
 }
 #endif /* NETSNMP_ENABLE_IPV6 */
+
+#ifdef TCPCONN_USE_SOCK_DIAG
+/*
+ * TCP states as bits for inet_diag_req_v2.idiag_states,
+ *   see <netinet/tcp.h>
+ */
+#define TCPCONN_DIAG_LISTEN       (1 << 10)     /* TCP_LISTEN */
+#define TCPCONN_DIAG_ALL          0xfff
+#define TCPCONN_DIAG_NEW_SYN_RECV 12            /* request socket */
+
+/**
+ * Load the sockets of one address family over NETLINK_SOCK_DIAG.
+ *
+ * The kernel streams binary records, already filtered by state, so
+ * this is much cheaper than formatting and parsing /proc/net/tcp(6)
+ * when there are many connections.
+ *
+ * @retval  0 no errors
+ * @retval -2 sock_diag not supported (nothing loaded, try /proc)
+ * @retval <0 other errors
+ */
+static int
+_load_sock_diag(netsnmp_container *container, u_int load_flags, int family)
+{
+    struct {
+        struct nlmsghdr         nlh;
+        struct inet_diag_req_v2 req;
+    }               msg;
+    struct sockaddr_nl nladdr;
+    enum            { rbufsize = 65536 };
+    void           *rbuf = alloca(rbufsize);
+    int             fd, rc = -1, done = 0, count = 0;
+    size_t          addr_len = (AF_INET == family) ? 4 : 16;
+
+    netsnmp_assert(NULL != container);
+
+    fd = socket(AF_NETLINK, SOCK_DGRAM, NETLINK_INET_DIAG);
+    if (fd < 0) {
+        DEBUGMSGTL(("access:tcpconn:container",
+                    "no sock_diag socket (%s), using /proc\n",
+                    strerror(errno)));
+        sock_diag_unavailable = 1;
+        return -2;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    msg.nlh.nlmsg_len = sizeof(msg);
+    msg.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    msg.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    msg.req.sdiag_family = family;
+    msg.req.sdiag_protocol = IPPROTO_TCP;
+    /*
+     * let the kernel skip what we don't care about
+     */
+    if (load_flags & NETSNMP_ACCESS_TCPCONN_LOAD_ONLYLISTEN)
+        msg.req.idiag_states = TCPCONN_DIAG_LISTEN;
+    else if (load_flags & NETSNMP_ACCESS_TCPCONN_LOAD_NOLISTEN)
+        msg.req.idiag_states = TCPCONN_DIAG_ALL & ~TCPCONN_DIAG_LISTEN;
+    else
+        msg.req.idiag_states = TCPCONN_DIAG_ALL;
+
+    memset(&nladdr, 0, sizeof(nladdr));
+    nladdr.nl_family = AF_NETLINK;
+    if (sendto(fd, &msg, sizeof(msg), 0, (struct sockaddr *) &nladdr,
+               sizeof(nladdr)) < 0) {
+        DEBUGMSGTL(("access:tcpconn:container",
+                    "sock_diag request failed (%s), using /proc\n",
+                    strerror(errno)));
+        close(fd);
+        return -2;
+    }
+
+    while (!done) {
+        struct nlmsghdr *h;
+        ssize_t         len;
+
+        len = recv(fd, rbuf, rbufsize, 0);
+        if (len < 0 && EINTR == errno)
+            continue;
+        if (len <= 0) {
+            snmp_log(LOG_ERR, "tcp:_load_sock_diag: recv: %s\n",
+                     len < 0 ? strerror(errno) : "no data");
+            break;
+        }
+
+        for (h = (struct nlmsghdr *) rbuf; NLMSG_OK(h, len);
+             h = NLMSG_NEXT(h, len)) {
+            struct inet_diag_msg *r;
+            netsnmp_tcpconn_entry *entry;
+            int             state;
+
+            if (NLMSG_DONE == h->nlmsg_type) {
+                rc = 0;
+                done = 1;
+                break;
+            }
+            if (NLMSG_ERROR == h->nlmsg_type) {
+                struct nlmsgerr *err = (struct nlmsgerr *) NLMSG_DATA(h);
+
+                /*
+                 * e.g. no inet_diag/tcp_diag module, or no IPv6:
+                 *   let /proc have a go unless we are half way through
+                 */
+                DEBUGMSGTL(("access:tcpconn:container",
+                            "sock_diag error %d (family %d)\n",
+                            err->error, family));
+                rc = count ? -1 : -2;
+                done = 1;
+                break;
+            }
+            if (SOCK_DIAG_BY_FAMILY != h->nlmsg_type ||
+                h->nlmsg_len < NLMSG_LENGTH(sizeof(*r)))
+                continue;
+
+            r = (struct inet_diag_msg *) NLMSG_DATA(h);
+            if (r->idiag_family != family)
+                continue;
+
+            state = r->idiag_state;
+            if (TCPCONN_DIAG_NEW_SYN_RECV == state)
+                state = 3;      /* reported as SYN_RECV by /proc */
+            state = (state & 0xf) < 12 ? linux_states[state & 0xf] : 2;
+
+            entry = netsnmp_access_tcpconn_entry_create();
+            if(NULL == entry) {
+                rc = -3;
+                done = 1;
+                break;
+            }
+
+            entry->loc_port = ntohs(r->id.idiag_sport);
+            entry->rmt_port = ntohs(r->id.idiag_dport);
+            entry->tcpConnState = state;
+            entry->pid = netsnmp_get_pid_from_inode(r->idiag_inode);
+
+            /** already in network order */
+            memcpy(entry->loc_addr, r->id.idiag_src, addr_len);
+            entry->loc_addr_len = addr_len;
+            memcpy(entry->rmt_addr, r->id.idiag_dst, addr_len);
+            entry->rmt_addr_len = addr_len;
+
+            /*
+             * add entry to container
+             */
+            entry->arbitrary_index = CONTAINER_SIZE(container) + 1;
+            if (CONTAINER_INSERT(container, entry) < 0) {
+                netsnmp_access_tcpconn_entry_free(entry);
+                continue;
+            }
+            ++count;
+        }
+    }
+
+    close(fd);
+
+    DEBUGMSGTL(("access:tcpconn:container",
+                "loaded %d sockets over sock_diag (family %d, rc %d)\n",
+                count, family, rc));
+    return rc;
+}
+#endif /* TCPCONN_USE_SOCK_DIAG */
@@ -26,17 +26,58 @@
 # define SOCKET_TYPE_1      "socket:["
 # define SOCKET_TYPE_2      "[0000]:"
 
-/* Definition of a simple open addressing hash table.*/
-/* When inode == 0 then the entry is empty.*/
+/*
+ * The inode -> pid table is kept between table loads. It is an open
+ * addressing hash table with linear probing that doubles in size when it
+ * gets half full. Each entry also remembers the file descriptor through
+ * which the process held the socket, so that an entry found in a later
+ * round can be checked with a single readlink() instead of rescanning
+ * /proc.
+ *
+ * Each call of netsnmp_get_pid_from_inode_init() starts a new round.
+ * Inodes that are not in the table, or whose entry is no longer valid,
+ * make the lookup continue a scan of /proc/<pid>/fd/ that is shared by
+ * the whole round: every process is scanned at most once per round,
+ * processes known to own sockets first, and the scan stops as soon as
+ * the inode has been found. Sockets without a visible owner (e.g. ones
+ * held by processes in another pid namespace) are remembered with pid 0
+ * for INODE_PID_MAX_AGE rounds, so that they do not cause a scan of all
+ * of /proc on every load. Such a socket may still turn up in a process
+ * started later (a forked child, or one that received it over a unix
+ * socket), so the first lookup of an ownerless socket in a round scans
+ * the processes that have appeared since the last complete scan.
+ */
 typedef struct {
-    ino64_t inode;
-    pid_t   pid;
+    ino64_t inode;      /* 0: empty slot */
+    pid_t   pid;        /* 0: no owner found */
+    int     fd;
+    u_int   round;      /* round in which the entry was last confirmed */
 } inode_pid_ent_t;
 
-#define INODE_PID_TABLE_MAX_COLLISIONS 1000
-#define INODE_PID_TABLE_LENGTH 20000
-#define INODE_PID_TABLE_SIZE (INODE_PID_TABLE_LENGTH * sizeof (inode_pid_ent_t))
-static inode_pid_ent_t  inode_pid_table[INODE_PID_TABLE_LENGTH];
+#define INODE_PID_TABLE_MIN_LENGTH 1024
+/* entries not confirmed for this many rounds are dropped */
+#define INODE_PID_MAX_AGE          16
+
+static inode_pid_ent_t *inode_pid_table;
+static uint32_t         inode_pid_table_length;  /* a power of two */
+static uint32_t         inode_pid_table_count;
+static u_int            load_round;
+
+/* the /proc scan of the current round */
+static pid_t           *scan_pids;
+static size_t           scan_count, scan_next;
+static int              scan_started;
+
+/* the processes whose sockets were all seen, sorted; see _scan_new() */
+static pid_t           *known_pids;
+static size_t           known_count;
+static u_int            known_round;
+static int              new_scanned;
+
+/* statistics of the current round */
+static struct {
+    u_int   lookups, hits, stale, misses, pids_scanned, new_pids, max_probe;
+} stats;
 
 static uint32_t
 _hash(uint64_t key)
@@ -50,142 +91,406 @@ _hash(uint64_t key)
     return key;
 }
 
-static void
-_clear(void)
+static inode_pid_ent_t *
+_find(ino64_t inode)
 {
-    /* Clear the inode/pid hash table.*/
-    memset(inode_pid_table, 0, INODE_PID_TABLE_SIZE);
+    uint32_t        mask = inode_pid_table_length - 1;
+    uint32_t        i, n;
+    inode_pid_ent_t *entry;
+
+    if (!inode_pid_table)
+        return NULL;
+    for (i = _hash(inode) & mask, n = 0; ; i = (i + 1) & mask, n++) {
+        entry = &inode_pid_table[i];
+        if (entry->inode == inode) {
+            if (n > stats.max_probe)
+                stats.max_probe = n;
+            return entry;
+        }
+        if (entry->inode == 0)
+            return NULL;
+    }
 }
 
+/* Remove an entry, moving later entries of its probe sequence back. */
 static void
-_set(ino64_t inode, pid_t pid)
+_remove(inode_pid_ent_t *entry)
 {
-    uint32_t        hash = _hash(inode);
-    uint32_t        i;
-    inode_pid_ent_t *entry;
+    uint32_t        mask = inode_pid_table_length - 1;
+    uint32_t        i = entry - inode_pid_table, j, home;
 
-    /* We will try for a maximum number of collisions.*/
-    for (i = 0; i < INODE_PID_TABLE_MAX_COLLISIONS; i++) {
-        entry = &inode_pid_table[(hash + i) % INODE_PID_TABLE_LENGTH];
-
-        /* Check if this entry is empty, or the actual inode we were looking for.*/
-        /* The second part should never happen, but it is here for completeness.*/
-        if (entry->inode == 0 || entry->inode == inode) {
-            entry->inode = inode;
-            entry->pid = pid;
-            return;
+    for (j = (i + 1) & mask; inode_pid_table[j].inode; j = (j + 1) & mask) {
+        home = _hash(inode_pid_table[j].inode) & mask;
+        /* can the entry at j move to the hole at i? */
+        if (((j - home) & mask) >= ((j - i) & mask)) {
+            inode_pid_table[i] = inode_pid_table[j];
+            i = j;
         }
     }
-
-    /* We will silently fail to insert the inode if we get too many collisions.*/
-    /* the _get function will return a zero pid.*/
+    memset(&inode_pid_table[i], 0, sizeof(inode_pid_table[i]));
+    inode_pid_table_count--;
 }
 
-static pid_t _get(ino64_t inode)
+static int
+_resize(uint32_t length)
 {
-    uint32_t        hash = _hash(inode);
-    uint32_t        i;
-    inode_pid_ent_t *entry;
+    inode_pid_ent_t *old = inode_pid_table;
+    uint32_t        old_length = inode_pid_table_length, i, j;
 
-    /* We will try for a maximum number of collisions.*/
-    for (i = 0; i < INODE_PID_TABLE_MAX_COLLISIONS; i++) {
-        entry = &inode_pid_table[(hash + i) % INODE_PID_TABLE_LENGTH];
+    inode_pid_table = calloc(length, sizeof(*inode_pid_table));
+    if (!inode_pid_table) {
+        inode_pid_table = old;
+        return -1;
+    }
+    inode_pid_table_length = length;
+    for (i = 0; i < old_length; i++) {
+        if (old[i].inode == 0)
+            continue;
+        for (j = _hash(old[i].inode) & (length - 1);
+             inode_pid_table[j].inode; j = (j + 1) & (length - 1))
+            ;
+        inode_pid_table[j] = old[i];
+    }
+    free(old);
+    DEBUGMSGTL(("get_pid_from_inode", "table resized to %u entries\n",
+                length));
+    return 0;
+}
 
-        /* Check if this entry is empty, or the actual inode we were looking for.*/
-        /* If the entry is empty it means the inode is not in the table and we*/
-        /* should return 0, the entry will also have a zero pid.*/
-        if (entry->inode == 0 || entry->inode == inode) {
-            return entry->pid;
-        }
+static void
+_set(ino64_t inode, pid_t pid, int fd)
+{
+    inode_pid_ent_t *entry = _find(inode);
+    uint32_t        mask;
+
+    if (!entry) {
+        if (2 * (inode_pid_table_count + 1) > inode_pid_table_length &&
+            _resize(inode_pid_table_length ? 2 * inode_pid_table_length :
+                    INODE_PID_TABLE_MIN_LENGTH) < 0)
+            return;     /* the lookup will return a zero pid */
+        mask = inode_pid_table_length - 1;
+        for (entry = &inode_pid_table[_hash(inode) & mask]; entry->inode;
+             entry = &inode_pid_table[(entry - inode_pid_table + 1) & mask])
+            ;
+        entry->inode = inode;
+        inode_pid_table_count++;
     }
+    entry->pid = pid;
+    entry->fd = fd;
+    entry->round = load_round;
+}
 
-    /* We could not find the pid.*/
+/* Is process <pid> still holding socket <inode> as file descriptor <fd>? */
+static int
+_check(const inode_pid_ent_t *entry)
+{
+    char            path_name[64];
+    char            socket_lnk[64];
+    int             readlen;
+
+    snprintf(path_name, sizeof(path_name), PROC_PATH "/%d/fd/%d",
+             (int)entry->pid, entry->fd);
+    readlen = readlink(path_name, socket_lnk, sizeof(socket_lnk) - 1);
+    if (readlen < 0)
+        return 0;
+    socket_lnk[readlen] = '\0';
+    if (!strncmp(socket_lnk, SOCKET_TYPE_1, 8))
+        return strtoull(socket_lnk + 8, NULL, 0) == entry->inode;
+    if (!strncmp(socket_lnk, SOCKET_TYPE_2, 7))
+        return strtoull(socket_lnk + 7, NULL, 0) == entry->inode;
     return 0;
 }
 
-void
-netsnmp_get_pid_from_inode_init(void)
+/* Add all sockets of process <pid> to the table. */
+static void
+_scan_pid(pid_t pid)
 {
-    DIR            *procdirs = NULL, *piddirs = NULL;
+    DIR            *piddirs = NULL;
     char            path_name[PATH_MAX + 1];
     char            socket_lnk[NAME_MAX + 1];
     int             filelen = 0, readlen = 0;
-    struct dirent  *procinfo, *pidinfo;
-    pid_t           pid = 0;
+    struct dirent  *pidinfo;
     ino64_t         temp_inode;
 
-    _clear();
+    /* Create the /proc/<pid>/fd/ path name.*/
+    filelen = snprintf(path_name, PATH_MAX, PROC_PATH "/%d/fd/", (int)pid);
+    if (filelen <= 0 || PATH_MAX < filelen)
+        return;
+
+    /* walk over all the files in /proc/<pid>/fd/*/
+    if (!(piddirs = opendir(path_name)))
+        return;
+    stats.pids_scanned++;
+
+    while ((pidinfo = readdir(piddirs)) != NULL) {
+        if (!isdigit(pidinfo->d_name[0]))
+            continue;
+        if (filelen + strlen(pidinfo->d_name) > PATH_MAX)
+            continue;
+
+        strlcpy(path_name + filelen, pidinfo->d_name,
+                sizeof(path_name) - filelen);
+
+        /* The file discriptor is a symbolic link to a socket or a file.*/
+        /* Thus read the symbolic link.*/
+        readlen = readlink(path_name, socket_lnk, NAME_MAX);
+        if (readlen < 0)
+            continue;
+
+        socket_lnk[readlen] = '\0';
+
+        /* Check if to see if the file descriptor is a socket by comparing*/
+        /* the start to a string. Also extract the inode number from this*/
+        /* symbolic link.*/
+        if (!strncmp(socket_lnk, SOCKET_TYPE_1, 8)) {
+            temp_inode = strtoull(socket_lnk + 8, NULL, 0);
+        } else if (!strncmp(socket_lnk, SOCKET_TYPE_2, 7)) {
+            temp_inode = strtoull(socket_lnk + 7, NULL, 0);
+        } else {
+            temp_inode = 0;
+        }
+
+        /* Add the inode/pid combination to our hash table.*/
+        if (temp_inode != 0)
+            _set(temp_inode, pid, atoi(pidinfo->d_name));
+    }
+    closedir(piddirs);
+}
+
+static int
+_pid_compare(const void *a, const void *b)
+{
+    pid_t           pa = *(const pid_t *)a, pb = *(const pid_t *)b;
+
+    return pa < pb ? -1 : pa > pb;
+}
+
+/*
+ * List the processes in /proc, skipping the ones in <skip> (sorted).
+ * Returns the number found, or -1 if /proc cannot be read.
+ */
+static ssize_t
+_list_pids(pid_t **pids, const pid_t *skip, size_t skip_count)
+{
+    DIR            *procdirs = NULL;
+    struct dirent  *procinfo;
+    pid_t          *list = NULL, pid;
+    size_t          count = 0, alloc = 0;
+    const char     *name;
 
     /* walk over all directories in /proc*/
     if (!(procdirs = opendir(PROC_PATH))) {
         NETSNMP_LOGONCE((LOG_ERR, "snmpd: cannot open /proc\n"));
-        return;
+        return -1;
     }
 
     while ((procinfo = readdir(procdirs)) != NULL) {
-        const char* name = procinfo->d_name;
+        name = procinfo->d_name;
 
         /* A pid directory only contains digits, check for those.*/
         for (; *name; name++) {
             if (!isdigit(*name))
                 break;
         }
-        if(*name)
+        if (*name || name == procinfo->d_name)
             continue;
 
-        /* Create the /proc/<pid>/fd/ path name.*/
-        memset(path_name, '\0', PATH_MAX + 1);
-        filelen = snprintf(path_name, PATH_MAX,
-                           PROC_PATH "/%s/fd/", procinfo->d_name);
-        if (filelen <= 0 || PATH_MAX < filelen)
+        pid = strtoul(procinfo->d_name, NULL, 0);
+        if (skip &&
+            bsearch(&pid, skip, skip_count, sizeof(*skip), _pid_compare))
             continue;
+        if (count == alloc) {
+            pid_t          *p;
 
-        /* walk over all the files in /proc/<pid>/fd/*/
-        if (!(piddirs = opendir(path_name)))
-        continue;
-
-        while ((pidinfo = readdir(piddirs)) != NULL) {
-            if (filelen + strlen(pidinfo->d_name) > PATH_MAX)
-                continue;
-
-            strlcpy(path_name + filelen, pidinfo->d_name,
-                    sizeof(path_name) - filelen);
-
-            /* The file discriptor is a symbolic link to a socket or a file.*/
-            /* Thus read the symbolic link.*/
-            memset(socket_lnk, '\0', NAME_MAX + 1);
-            readlen = readlink(path_name, socket_lnk, NAME_MAX);
-            if (readlen < 0)
-                continue;
-
-            socket_lnk[readlen] = '\0';
-
-            /* Check if to see if the file descriptor is a socket by comparing*/
-            /* the start to a string. Also extract the inode number from this*/
-            /* symbolic link.*/
-            if (!strncmp(socket_lnk, SOCKET_TYPE_1, 8)) {
-                temp_inode = strtoull(socket_lnk + 8, NULL, 0);
-            } else if (!strncmp(socket_lnk, SOCKET_TYPE_2, 7)) {
-                temp_inode = strtoull(socket_lnk + 7, NULL, 0);
-            } else {
-                temp_inode = 0;
-            }
-
-            /* Add the inode/pid combination to our hash table.*/
-            if (temp_inode != 0) {
-                pid = strtoul(procinfo->d_name, NULL, 0);
-                _set(temp_inode, pid);
-            }
+            alloc = alloc ? 2 * alloc : 1024;
+            p = realloc(list, alloc * sizeof(*list));
+            if (!p)
+                break;
+            list = p;
+        }
+        list[count++] = pid;
+    }
+    closedir(procdirs);
+    *pids = list;
+    return count;
+}
+
+/* Remember <pids> as processes whose sockets are all in the table. */
+static void
+_known_add(const pid_t *pids, size_t count)
+{
+    pid_t          *p;
+
+    if (count == 0)
+        return;
+    p = realloc(known_pids, (known_count + count) * sizeof(*known_pids));
+    if (!p)
+        return;
+    known_pids = p;
+    memcpy(known_pids + known_count, pids, count * sizeof(*known_pids));
+    known_count += count;
+    qsort(known_pids, known_count, sizeof(*known_pids), _pid_compare);
+}
+
+/*
+ * Scan the processes that did not exist at the last complete scan, once
+ * per round: they may own sockets that were remembered without an owner.
+ */
+static void
+_scan_new(void)
+{
+    pid_t          *pids = NULL;
+    ssize_t         count, i;
+
+    new_scanned = 1;
+    count = _list_pids(&pids, known_pids, known_count);
+    for (i = 0; i < count; i++)
+        _scan_pid(pids[i]);
+    if (count > 0) {
+        stats.new_pids += count;
+        _known_add(pids, count);
+    }
+    free(pids);
+}
+
+/*
+ * List the processes to scan in this round: the ones that owned sockets
+ * in earlier rounds first, since new sockets most likely belong to them.
+ */
+static void
+_scan_start(void)
+{
+    pid_t          *owners = NULL, *others = NULL;
+    ssize_t         others_count;
+    size_t          owners_count = 0, i, j;
+
+    scan_started = 1;
+    scan_count = scan_next = 0;
+    free(scan_pids);
+    scan_pids = NULL;
+
+    /* the distinct owners of the sockets in the table, sorted */
+    if (inode_pid_table_count)
+        owners = malloc(inode_pid_table_count * sizeof(*owners));
+    if (owners) {
+        for (i = 0; i < inode_pid_table_length; i++)
+            if (inode_pid_table[i].inode && inode_pid_table[i].pid)
+                owners[owners_count++] = inode_pid_table[i].pid;
+        qsort(owners, owners_count, sizeof(*owners), _pid_compare);
+        for (i = j = 0; i < owners_count; i++)
+            if (j == 0 || owners[j - 1] != owners[i])
+                owners[j++] = owners[i];
+        owners_count = j;
+    }
+
+    /* the owners are added below */
+    others_count = _list_pids(&others, owners, owners_count);
+    if (others_count < 0) {
+        free(owners);
+        return;
+    }
+
+    /* owners that have exited are simply not found by _scan_pid() */
+    scan_pids = malloc((owners_count + others_count + 1) * sizeof(*scan_pids));
+    if (scan_pids) {
+        if (owners_count)
+            memcpy(scan_pids, owners, owners_count * sizeof(*scan_pids));
+        if (others_count)
+            memcpy(scan_pids + owners_count, others,
+                   others_count * sizeof(*scan_pids));
+        scan_count = owners_count + others_count;
+    }
+    free(owners);
+    free(others);
+}
+
+void
+netsnmp_get_pid_from_inode_init(void)
+{
+    uint32_t        i;
+
+    if (load_round)
+        DEBUGMSGTL(("get_pid_from_inode",
+                    "round %u: %u lookups, %u hits, %u stale, %u misses, "
+                    "%u processes scanned (%u new); %u of %u entries used, "
+                    "longest probe %u\n", load_round, stats.lookups,
+                    stats.hits, stats.stale, stats.misses, stats.pids_scanned,
+                    stats.new_pids, inode_pid_table_count,
+                    inode_pid_table_length, stats.max_probe));
+    memset(&stats, 0, sizeof(stats));
+    load_round++;
+    scan_started = 0;
+    scan_count = scan_next = 0;
+    new_scanned = 0;
+
+    /* drop entries of sockets nobody has asked about for a while */
+    if (load_round % INODE_PID_MAX_AGE == 0) {
+        for (i = 0; i < inode_pid_table_length; ) {
+            if (inode_pid_table[i].inode &&
+                load_round - inode_pid_table[i].round > INODE_PID_MAX_AGE)
+                _remove(&inode_pid_table[i]);   /* refills slot i */
+            else
+                i++;
         }
-        closedir(piddirs);
+        if (inode_pid_table_length > INODE_PID_TABLE_MIN_LENGTH &&
+            8 * inode_pid_table_count < inode_pid_table_length)
+            _resize(inode_pid_table_length / 2);
     }
-    if (procdirs)
-        closedir(procdirs);
 }
 
 pid_t
 netsnmp_get_pid_from_inode(ino64_t inode)
 {
-    return _get(inode);
-}
+    inode_pid_ent_t *entry;
+
+    if (inode == 0)
+        return 0;
+    stats.lookups++;
 
+    entry = _find(inode);
+    if (entry && entry->pid == 0 && !new_scanned && known_pids) {
+        _scan_new();
+        entry = _find(inode);   /* the table may have been resized */
+    }
+    if (entry && entry->pid == 0) {
+        if (load_round - entry->round < INODE_PID_MAX_AGE) {
+            stats.hits++;
+            return 0;
+        }
+        _remove(entry);
+        entry = NULL;
+    }
+    if (entry) {
+        if (entry->round == load_round || _check(entry)) {
+            entry->round = load_round;
+            stats.hits++;
+            return entry->pid;
+        }
+        stats.stale++;
+        _remove(entry);
+    }
+
+    /* continue this round's scan of /proc until the inode turns up */
+    stats.misses++;
+    if (!scan_started)
+        _scan_start();
+    while (scan_next < scan_count) {
+        _scan_pid(scan_pids[scan_next++]);
+        entry = _find(inode);
+        if (entry)
+            return entry->pid;
+    }
+    if (scan_pids) {
+        /* the scan is complete: every process it listed has been seen */
+        if (known_round != load_round) {
+            known_round = load_round;
+            free(known_pids);
+            known_pids = NULL;
+            known_count = 0;
+            _known_add(scan_pids, scan_count);
+            new_scanned = 1;
+        }
+        _set(inode, 0, -1);
+    }
+    return 0;
+}
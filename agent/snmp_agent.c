@@ -73,11 +73,21 @@ SOFTWARE.
 #ifdef HAVE_SYS_SELECT_H
 #include <sys/select.h>
 #endif
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#endif
 #ifdef HAVE_NETINET_IN_H
 #include <netinet/in.h>
 #endif
 #include <errno.h>
 
+#if defined(NETSNMP_REENTRANT) && defined(HAVE_PTHREAD_H) && \
+    defined(SO_REUSEPORT) && !defined(NETSNMP_NO_LISTEN_SUPPORT)
+#define NETSNMP_AGENT_WORKERS
+#include <pthread.h>
+#include <signal.h>
+#endif
+
 #define SNMP_NEED_REQUEST_LIST
 #include <net-snmp/net-snmp-includes.h>
 #include <net-snmp/agent/net-snmp-agent-includes.h>
@@ -362,6 +372,9 @@ typedef struct _agent_nsap {
 } agent_nsap;
 
 static agent_nsap *agent_nsap_list = NULL;
+#ifdef NETSNMP_AGENT_WORKERS
+static void     _agent_worker_remove(int handle);
+#endif
 static netsnmp_agent_session *agent_session_list = NULL;
 netsnmp_agent_session *netsnmp_processing_set = NULL;
 netsnmp_agent_session *agent_delegated_list = NULL;
@@ -773,6 +786,13 @@ agent_check_and_process(int block)
     struct timeval       timeout = { LONG_MAX, 0 }, *tvp = &timeout;
     int                  count;
     int                  fakeblock = 0;
+    int                  use_epoll = 0;
+
+#ifndef NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER
+    use_epoll = netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID,
+                                       NETSNMP_DS_AGENT_USE_EPOLL) &&
+        netsnmp_epoll_init() == 0;
+#endif /* NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER */
 
     numfds = 0;
     netsnmp_large_fd_set_init(&readfds, FD_SETSIZE);
@@ -781,7 +801,8 @@ agent_check_and_process(int block)
     NETSNMP_LARGE_FD_ZERO(&readfds);
     NETSNMP_LARGE_FD_ZERO(&writefds);
     NETSNMP_LARGE_FD_ZERO(&exceptfds);
-    snmp_select_info2(&numfds, &readfds, tvp, &fakeblock);
+    /* with epoll only the timeout is needed */
+    snmp_select_info2(&numfds, use_epoll ? NULL : &readfds, tvp, &fakeblock);
     if (block != 0 && fakeblock != 0) {
         /*
          * There are no alarms registered, and the caller asked for blocking, so
@@ -805,20 +826,34 @@ agent_check_and_process(int block)
     }
 
 #ifndef NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER
-    netsnmp_external_event_info2(&numfds, &readfds, &writefds, &exceptfds);
+    if (use_epoll) {
+        /* dispatches the ready fds itself */
+        count = netsnmp_agent_epoll_wait(tvp);
+    } else
+#endif /* NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER */
+    {
+#ifndef NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER
+        netsnmp_external_event_info2(&numfds, &readfds, &writefds, &exceptfds);
 #endif /* NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER */
 
-    count = netsnmp_large_fd_set_select(numfds, &readfds, &writefds, &exceptfds, tvp);
+        netsnmp_agent_workers_release();
+        count = netsnmp_large_fd_set_select(numfds, &readfds, &writefds,
+                                            &exceptfds, tvp);
+        netsnmp_agent_workers_acquire();
+    }
 
     if (count > 0) {
         /*
          * packets found, process them 
          */
+        if (!use_epoll) {
 #ifndef NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER
-        netsnmp_dispatch_external_events2(&count, &readfds, &writefds, &exceptfds);
+            netsnmp_dispatch_external_events2(&count, &readfds, &writefds,
+                                              &exceptfds);
 #endif /* NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER */
 
-        snmp_read2(&readfds);
+            snmp_read2(&readfds);
+        }
     } else
         switch (count) {
         case 0:
@@ -1277,6 +1312,11 @@ netsnmp_register_agent_nsap(netsnmp_transport *t)
     s->authenticator = NULL;
     s->flags = netsnmp_ds_get_int(NETSNMP_DS_APPLICATION_ID, 
 				  NETSNMP_DS_AGENT_FLAGS);
+    /*
+     * Requests are cloned into the agent session before processing, so the
+     * received PDU never outlives the callback and can use an arena.
+     */
+    s->flags |= SNMP_FLAGS_PDU_ARENA;
     s->isAuthoritative = SNMP_SESS_AUTHORITATIVE;
 
     /* Optional supplimental transport configuration information and
@@ -1356,6 +1396,9 @@ netsnmp_deregister_agent_nsap(int handle)
 
     if (a != NULL && a->handle == handle) {
         *prevNext = a->next;
+#ifdef NETSNMP_AGENT_WORKERS
+        _agent_worker_remove(handle);
+#endif
 	if (snmp_sess_session_lookup(a->s)) {
             if (main_session == snmp_sess_session(a->s)) {
                 main_session_deregistered = 1;
@@ -1391,15 +1434,367 @@ netsnmp_deregister_agent_nsap(int handle)
     }
 }
 
+#ifdef NETSNMP_AGENT_WORKERS
+/*
+ * Worker threads.
+ *
+ * With agentWorkerThreads N, every UDP address the agent listens on is
+ * opened N times with SO_REUSEPORT, and each of these NSAPs is read by a
+ * thread of its own; the kernel spreads the incoming requests over them.
+ * The sessions are flagged SNMP_FLAGS_OWN_THREAD once the threads run, so
+ * that the main loop no longer selects on them.
+ *
+ * Two locks keep the agent consistent:
+ *
+ *  - agent_workers_rwlock is held exclusively by the main loop except
+ *    while it waits for events, so alarms, SETs of other NSAPs, AgentX
+ *    traffic, delegated requests and reconfiguration never overlap with
+ *    the workers.  Workers hold it shared while they process a packet.
+ *    agent_workers_gate makes workers queue up behind a waiting main loop.
+ *
+ *  - MT_APP_AGENT serialises the workers among themselves.  It is only
+ *    dropped while a handler registered with HANDLER_CAN_THREADSAFE serves
+ *    a GET, GETNEXT or GETBULK, which is where the work runs in parallel.
+ *    SETs and all other handlers are processed one at a time, and so is
+ *    everything while debug output is enabled.
+ *
+ * A handler may only be marked HANDLER_CAN_THREADSAFE if it (and every
+ * helper in its chain) serves reads without writing shared state; the
+ * registration itself is handed to it as a per-thread copy.  Currently
+ * these are the read-only system scalars and the statistics counters
+ * (mibII/snmp, usmStats, snmpMPDStats, target counters); requests for
+ * other objects are served one at a time, as without workers.
+ */
+struct agent_worker {
+    int             handle;         /* agent NSAP */
+    void           *sessp;
+    int             sock;
+    int             stop_pipe[2];
+    int             running;
+    pthread_t       thread;
+    struct agent_worker *next;
+};
+
+static struct agent_worker *agent_workers;
+static int      agent_workers_started;
+static int      agent_workers_active;  /* threads running */
+static pthread_t agent_workers_main;    /* thread running the main loop */
+static pthread_mutex_t agent_workers_gate = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t agent_workers_rwlock = PTHREAD_RWLOCK_INITIALIZER;
+
+static void
+_agent_workers_wrlock(void)
+{
+    pthread_mutex_lock(&agent_workers_gate);
+    pthread_rwlock_wrlock(&agent_workers_rwlock);
+    pthread_mutex_unlock(&agent_workers_gate);
+}
+
+static void *
+_agent_worker_run(void *arg)
+{
+    struct agent_worker *w = (struct agent_worker *) arg;
+    netsnmp_large_fd_set readfds;
+    int             numfds, count;
+
+    numfds = SNMP_MAX(w->sock, w->stop_pipe[0]) + 1;
+    netsnmp_large_fd_set_init(&readfds, numfds);
+    DEBUGMSGTL(("snmp_agent:workers", "worker for fd %d started\n", w->sock));
+    for (;;) {
+        NETSNMP_LARGE_FD_ZERO(&readfds);
+        NETSNMP_LARGE_FD_SET(w->sock, &readfds);
+        NETSNMP_LARGE_FD_SET(w->stop_pipe[0], &readfds);
+        count = netsnmp_large_fd_set_select(numfds, &readfds, NULL, NULL,
+                                            NULL);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            snmp_log_perror("agent worker select");
+            break;
+        }
+        if (NETSNMP_LARGE_FD_ISSET(w->stop_pipe[0], &readfds))
+            break;
+
+        pthread_mutex_lock(&agent_workers_gate);
+        pthread_rwlock_rdlock(&agent_workers_rwlock);
+        pthread_mutex_unlock(&agent_workers_gate);
+        snmp_res_lock(MT_APPLICATION_ID, MT_APP_AGENT);
+        snmp_sess_read2(w->sessp, &readfds);
+        snmp_res_unlock(MT_APPLICATION_ID, MT_APP_AGENT);
+        pthread_rwlock_unlock(&agent_workers_rwlock);
+    }
+    DEBUGMSGTL(("snmp_agent:workers", "worker for fd %d stopped\n", w->sock));
+    netsnmp_large_fd_set_cleanup(&readfds);
+    return NULL;
+}
+
+/*
+ * Start the worker threads.  Called by the main loop, which keeps the
+ * agent locked from now on except while waiting for events.  Threads are
+ * not started earlier since they would not survive the daemon's fork().
+ */
+static void
+_agent_workers_start(void)
+{
+    struct agent_worker *w;
+    sigset_t        set, oset;
+    netsnmp_session *s;
+
+    agent_workers_started = 1;
+    if (agent_workers == NULL)
+        return;
+
+    agent_workers_main = pthread_self();
+    _agent_workers_wrlock();
+
+    /* signals are for the main loop */
+    sigfillset(&set);
+    pthread_sigmask(SIG_SETMASK, &set, &oset);
+    for (w = agent_workers; w; w = w->next) {
+        s = snmp_sess_session(w->sessp);
+        if (s == NULL || pipe(w->stop_pipe) != 0)
+            continue;
+        s->flags |= SNMP_FLAGS_OWN_THREAD;
+        if (pthread_create(&w->thread, NULL, _agent_worker_run, w) != 0) {
+            snmp_log(LOG_ERR, "agent: cannot start worker thread\n");
+            s->flags &= ~SNMP_FLAGS_OWN_THREAD;
+            close(w->stop_pipe[0]);
+            close(w->stop_pipe[1]);
+            continue;
+        }
+        w->running = 1;
+        agent_workers_active++;
+#ifndef NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER
+        netsnmp_epoll_update_fd(w->sock);
+#endif
+    }
+    pthread_sigmask(SIG_SETMASK, &oset, NULL);
+
+    snmp_log(LOG_INFO, "Serving UDP requests with %d worker threads\n",
+             agent_workers_active);
+    if (agent_workers_active == 0)
+        pthread_rwlock_unlock(&agent_workers_rwlock);
+}
+
+/*
+ * Stop the thread of a worker; the caller holds the agent exclusively.
+ */
+static void
+_agent_worker_stop(struct agent_worker *w)
+{
+    netsnmp_session *s;
+
+    if (!w->running)
+        return;
+    if (write(w->stop_pipe[1], "", 1) != 1)
+        snmp_log_perror("agent worker stop");
+    /* let it finish the packet it may be waiting to process */
+    pthread_rwlock_unlock(&agent_workers_rwlock);
+    pthread_join(w->thread, NULL);
+    if (--agent_workers_active > 0)
+        _agent_workers_wrlock();
+    w->running = 0;
+    close(w->stop_pipe[0]);
+    close(w->stop_pipe[1]);
+    s = snmp_sess_session_lookup(w->sessp) ? snmp_sess_session(w->sessp) :
+        NULL;
+    if (s)
+        s->flags &= ~SNMP_FLAGS_OWN_THREAD;
+}
+
+static void
+_agent_worker_remove(int handle)
+{
+    struct agent_worker *w, **prevNext;
+
+    for (prevNext = &agent_workers; (w = *prevNext) != NULL;
+         prevNext = &w->next) {
+        if (w->handle == handle) {
+            _agent_worker_stop(w);
+            *prevNext = w->next;
+            free(w);
+            return;
+        }
+    }
+}
+
+static void
+_agent_workers_shutdown(void)
+{
+    while (agent_workers)
+        _agent_worker_remove(agent_workers->handle);
+}
+
+/*
+ * Add further NSAPs sharing the UDP port of the NSAP handle, so that
+ * there is one per worker thread.
+ */
+static void
+_agent_workers_add(const char *port, int handle, netsnmp_transport *first)
+{
+    netsnmp_tdomain_spec tspec;
+    netsnmp_transport *t = first;
+    struct agent_worker *w, **tail;
+    agent_nsap     *a;
+    int             i, n;
+
+    n = netsnmp_ds_get_int(NETSNMP_DS_APPLICATION_ID,
+                           NETSNMP_DS_AGENT_WORKER_THREADS);
+    memset(&tspec, 0, sizeof(tspec));
+    tspec.application = "snmp";
+    tspec.target = port;
+    tspec.flags = NETSNMP_TSPEC_LOCAL | NETSNMP_TSPEC_REUSEPORT;
+
+    for (tail = &agent_workers; *tail; tail = &(*tail)->next)
+        ;
+    for (i = 0; i < n; i++) {
+        if (i > 0) {
+            t = netsnmp_tdomain_transport_tspec(&tspec);
+            if (t == NULL)
+                break;
+            if (t->sock == first->sock) {
+                /* a single socket handed over by systemd */
+                t->sock = -1;
+                netsnmp_transport_free(t);
+                break;
+            }
+            handle = netsnmp_register_agent_nsap(t);
+            if (handle < 0)
+                break;
+        }
+        for (a = agent_nsap_list; a && a->handle != handle; a = a->next)
+            ;
+        w = calloc(1, sizeof(*w));
+        if (a == NULL || w == NULL) {
+            free(w);
+            break;
+        }
+        w->handle = handle;
+        w->sessp = a->s;
+        w->sock = t->sock;
+        *tail = w;
+        tail = &w->next;
+    }
+    if (i < n)
+        snmp_log(LOG_WARNING, "agent: only %d of %d worker threads can "
+                 "serve \"%s\"\n", i, n, port);
+}
+#endif /* NETSNMP_AGENT_WORKERS */
+
+/**
+ * Releases the agent while the main loop waits for events, so that the
+ * worker threads can process requests.  Starts the workers the first time.
+ */
+void
+netsnmp_agent_workers_release(void)
+{
+#ifdef NETSNMP_AGENT_WORKERS
+    if (!agent_workers_started)
+        _agent_workers_start();
+    if (agent_workers_active)
+        pthread_rwlock_unlock(&agent_workers_rwlock);
+#endif
+}
+
+/**
+ * Takes the agent back once the main loop's wait is over.
+ */
+void
+netsnmp_agent_workers_acquire(void)
+{
+#ifdef NETSNMP_AGENT_WORKERS
+    if (agent_workers_active)
+        _agent_workers_wrlock();
+#endif
+}
+
+#ifndef NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER
+/**
+ * netsnmp_epoll_wait() for the main loop: the worker threads may run while
+ * it waits, but not while it dispatches the events.
+ */
+int
+netsnmp_agent_epoll_wait(struct timeval *timeout)
+{
+#ifdef NETSNMP_AGENT_WORKERS
+    struct timeval  zero = { 0, 0 };
+    int             count;
+
+    netsnmp_agent_workers_release();
+    if (agent_workers_active) {
+        count = netsnmp_epoll_ready(timeout);
+        netsnmp_agent_workers_acquire();
+        return count > 0 ? netsnmp_epoll_wait(&zero) : count;
+    }
+#endif
+    return netsnmp_epoll_wait(timeout);
+}
+#endif /* NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER */
+
+/**
+ * Called around each handler call: lets a worker thread run a
+ * HANDLER_CAN_THREADSAFE handler for a read request without the agent lock.
+ *
+ * @return 1 if the lock was released and must be taken back with
+ *         netsnmp_agent_relock_after_handler(), 0 otherwise.
+ */
+int
+netsnmp_agent_unlock_for_handler(const netsnmp_handler_registration *reginfo,
+                                 int mode)
+{
+#ifdef NETSNMP_AGENT_WORKERS
+    if (!agent_workers_active || !(reginfo->modes & HANDLER_CAN_THREADSAFE))
+        return 0;
+    if (mode != MODE_GET && mode != MODE_GETNEXT && mode != MODE_GETBULK)
+        return 0;
+    /* the bulk_to_next helper marks the shared handler while it runs */
+    if (mode == MODE_GETBULK && !(reginfo->modes & HANDLER_CAN_GETBULK))
+        return 0;
+    if (pthread_equal(pthread_self(), agent_workers_main))
+        return 0;
+    /* debug output and its indent level are shared by all threads */
+    if (snmp_get_do_debugging())
+        return 0;
+    /* fails if a handler further up the stack released it already */
+    return snmp_res_unlock(MT_APPLICATION_ID, MT_APP_AGENT) == 0;
+#else
+    return 0;
+#endif
+}
+
+void
+netsnmp_agent_relock_after_handler(void)
+{
+#ifdef NETSNMP_AGENT_WORKERS
+    snmp_res_lock(MT_APPLICATION_ID, MT_APP_AGENT);
+#endif
+}
+
 int
 netsnmp_agent_listen_on(const char *port)
 {
     netsnmp_transport *transport;
     int                handle;
+#ifdef NETSNMP_AGENT_WORKERS
+    int                workers;
+#endif
 
     if (NULL == port)
         return -1;
 
+#ifdef NETSNMP_AGENT_WORKERS
+    workers = netsnmp_ds_get_int(NETSNMP_DS_APPLICATION_ID,
+                                 NETSNMP_DS_AGENT_WORKER_THREADS) > 0;
+    if (workers) {
+        netsnmp_tdomain_spec tspec;
+
+        memset(&tspec, 0, sizeof(tspec));
+        tspec.application = "snmp";
+        tspec.target = port;
+        tspec.flags = NETSNMP_TSPEC_LOCAL | NETSNMP_TSPEC_REUSEPORT;
+        transport = netsnmp_tdomain_transport_tspec(&tspec);
+    } else
+#endif
     transport = netsnmp_transport_open_server("snmp", port);
     if (transport == NULL) {
         snmp_log(LOG_ERR, "Error opening specified endpoint \"%s\"\n", port);
@@ -1417,6 +1812,12 @@ netsnmp_agent_listen_on(const char *port)
                     port));
     }
 
+#ifdef NETSNMP_AGENT_WORKERS
+    /* only plain UDP over IPv4 can share its port */
+    if (workers && transport->domain == netsnmpUDPDomain)
+        _agent_workers_add(port, handle, transport);
+#endif
+
     return handle;
 }
 
@@ -1550,6 +1951,9 @@ clear_nsap_list(void)
 void
 shutdown_master_agent(void)
 {
+#ifdef NETSNMP_AGENT_WORKERS
+    _agent_workers_shutdown();
+#endif
     clear_nsap_list();
 
 #ifndef NETSNMP_NO_PDU_STATS
@@ -1196,6 +1196,7 @@ receive(void)
     netsnmp_large_fd_set readfds, writefds, exceptfds;
     struct timeval  timeout, *tvp = &timeout;
     int             count, block, i;
+    int             use_epoll = 0;
 #ifdef	USING_SMUX_MODULE
     int             sd;
 #endif                          /* USING_SMUX_MODULE */
@@ -1229,18 +1230,31 @@ receive(void)
         tvp->tv_sec = INT_MAX;
         tvp->tv_usec = 0;
 
+#ifndef NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER
+        /*
+         * The SMUX sockets are not known to the epoll event loop, so fall
+         * back to select() while SMUX is listening.
+         */
+        use_epoll = netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID,
+                                           NETSNMP_DS_AGENT_USE_EPOLL)
+#ifdef	USING_SMUX_MODULE
+            && smux_listen_sd < 0
+#endif                          /* USING_SMUX_MODULE */
+            && netsnmp_epoll_init() == 0;
+#endif /* NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER */
+
         numfds = 0;
         NETSNMP_LARGE_FD_ZERO(&readfds);
         NETSNMP_LARGE_FD_ZERO(&writefds);
         NETSNMP_LARGE_FD_ZERO(&exceptfds);
         block = 0;
-        snmp_select_info2(&numfds, &readfds, tvp, &block);
+        snmp_select_info2(&numfds, use_epoll ? NULL : &readfds, tvp, &block);
         if (block == 1) {
             tvp = NULL;         /* block without timeout */
 	}
 
 #ifdef	USING_SMUX_MODULE
-        if (smux_listen_sd >= 0) {
+        if (smux_listen_sd >= 0 && !use_epoll) {
             NETSNMP_LARGE_FD_SET(smux_listen_sd, &readfds);
             numfds =
                 smux_listen_sd >= numfds ? smux_listen_sd + 1 : numfds;
@@ -1257,7 +1271,9 @@ receive(void)
 #endif                          /* USING_SMUX_MODULE */
 
 #ifndef NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER
-        netsnmp_external_event_info2(&numfds, &readfds, &writefds, &exceptfds);
+        if (!use_epoll)
+            netsnmp_external_event_info2(&numfds, &readfds, &writefds,
+                                         &exceptfds);
 #endif /* NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER */
 
     reselect:
@@ -1275,11 +1291,23 @@ receive(void)
         if (tvp)
             DEBUGMSGTL(("timer", "tvp %ld.%ld\n", (long) tvp->tv_sec,
                         (long) tvp->tv_usec));
-        count = netsnmp_large_fd_set_select(numfds, &readfds, &writefds, &exceptfds,
-				     tvp);
+#ifndef NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER
+        if (use_epoll)
+            count = netsnmp_agent_epoll_wait(tvp);
+        else
+#endif /* NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER */
+        {
+            /* let the worker threads, if any, run while we wait */
+            netsnmp_agent_workers_release();
+            count = netsnmp_large_fd_set_select(numfds, &readfds, &writefds,
+                                                &exceptfds, tvp);
+            netsnmp_agent_workers_acquire();
+        }
         DEBUGMSGTL(("snmpd/select", "returned, count = %d\n", count));
 
-        if (count > 0) {
+        if (count > 0 && use_epoll) {
+            /* netsnmp_epoll_wait() has dispatched the events already */
+        } else if (count > 0) {
 
 #ifdef USING_SMUX_MODULE
             /*
@@ -56,6 +56,7 @@ SOFTWARE.
 #endif
 #include <stdio.h>
 #include <ctype.h>
+#include <errno.h>
 #ifdef HAVE_NETDB_H
 #include <netdb.h>
 #endif
@@ -68,20 +69,68 @@ SOFTWARE.
 #define NETSNMP_DS_WALK_INCLUDE_REQUESTED		1
 #define NETSNMP_DS_WALK_PRINT_STATISTICS		2
 #define NETSNMP_DS_WALK_DONT_CHECK_LEXICOGRAPHIC	3
+#define NETSNMP_DS_WALK_SPLIT_COLUMNS			4
 
 oid             objid_mib[] = { 1, 3, 6, 1, 2, 1 };
 int             numprinted = 0;
 int             reps = 10, non_reps = 0;
+int             max_in_flight = 1;
+char           *extra_agents = NULL;
+oid            *split_index = NULL;
+int             num_split_index = 0;
+
+/*
+ * Each subtree is walked in one or more lanes, every lane walking a range
+ * of the subtree on one agent with its own GETBULK request outstanding.
+ * The lanes are kept in the order a serial walk would print their results
+ * in, and the output of a lane is held back until all lanes before it are
+ * done.
+ */
+#define LANE_GET            1   /* -Ci: GET of the root itself */
+#define LANE_WALK           2
+#define LANE_GET_IF_EMPTY   3   /* GET of the root if nothing was found */
+
+#define LANE_IDLE           0   /* next request not sent yet */
+#define LANE_SENT           1
+#define LANE_DONE           2
+
+struct walk_root {
+    netsnmp_session *ss;
+    const char     *agent;      /* output prefix, when walking several agents */
+    oid             name[MAX_OID_LEN];
+    size_t          name_length;
+    int             found;      /* variables printed */
+    int             failed;     /* a request timed out or could not be sent */
+    int             lanes_left; /* LANE_GET and LANE_WALK lanes not done */
+};
+
+struct walk_lane {
+    struct walk_root *root;
+    int             type;
+    int             state;
+    oid             name[MAX_OID_LEN];  /* last OID received */
+    size_t          name_length;
+    oid             end[MAX_OID_LEN];   /* last OID of the range */
+    size_t          end_length;         /* 0 if up to the end of the root */
+    u_char         *buf;                /* output not printed yet */
+    size_t          buf_len, out_len;
+};
+
+static struct walk_lane *lanes;
+static int      num_lanes, max_lanes, first_lane, in_flight;
+static int      check, exitval = 1;
 
 void
 usage(void)
 {
     fprintf(stderr, "USAGE: snmpbulkwalk ");
     snmp_parse_args_usage(stderr);
-    fprintf(stderr, " [OID]\n\n");
+    fprintf(stderr, " [OID...]\n\n");
     snmp_parse_args_descriptions(stderr);
     fprintf(stderr,
             "  -C APPOPTS\t\tSet various application specific behaviours:\n");
+    fprintf(stderr,
+            "\t\t\t  A {AGENT,...}:  walk these agents too\n");
     fprintf(stderr,
             "\t\t\t  c:       do not check returned OIDs are increasing\n");
     fprintf(stderr,
@@ -89,28 +138,411 @@ usage(void)
     fprintf(stderr, "\t\t\t  n<NUM>:  set non-repeaters to <NUM>\n");
     fprintf(stderr,
             "\t\t\t  p:       print the number of variables found\n");
+    fprintf(stderr,
+            "\t\t\t  P<NUM>:  send up to <NUM> requests in parallel\n");
     fprintf(stderr, "\t\t\t  r<NUM>:  set max-repeaters to <NUM>\n");
+    fprintf(stderr,
+            "\t\t\t  s:       walk each column of a table separately\n");
+    fprintf(stderr,
+            "\t\t\t  S<NUM>[,<NUM>...]:  also split walks at these index values\n");
+}
+
+static int
+compare_subid(const void *p1, const void *p2)
+{
+    oid             a = *(const oid *) p1, b = *(const oid *) p2;
+
+    return a < b ? -1 : a > b;
+}
+
+/*
+ * Sorts subids and drops duplicates, returning the new count.
+ */
+static int
+sort_subids(oid * subids, int count)
+{
+    int             i, n;
+
+    qsort(subids, count, sizeof(oid), compare_subid);
+    for (i = 1, n = count ? 1 : 0; i < count; i++)
+        if (subids[i] != subids[n - 1])
+            subids[n++] = subids[i];
+    return n;
+}
+
+static struct walk_lane *
+walk_add_lane(struct walk_root *root, int type,
+              const oid * name, size_t name_length)
+{
+    struct walk_lane *lane;
+
+    if (num_lanes == max_lanes) {
+        max_lanes = max_lanes ? 2 * max_lanes : 16;
+        lanes = realloc(lanes, max_lanes * sizeof(*lanes));
+        if (lanes == NULL) {
+            fprintf(stderr, "snmpbulkwalk: out of memory\n");
+            exit(1);
+        }
+    }
+    lane = &lanes[num_lanes++];
+    memset(lane, 0, sizeof(*lane));
+    lane->root = root;
+    lane->type = type;
+    memmove(lane->name, name, name_length * sizeof(oid));
+    lane->name_length = name_length;
+    if (type != LANE_GET_IF_EMPTY)
+        root->lanes_left++;
+    return lane;
+}
+
+/*
+ * Ends lane at name, inclusive, and starts a new lane right after it.
+ */
+static struct walk_lane *
+walk_split_lane(struct walk_lane *lane, const oid * name, size_t name_length)
+{
+    memmove(lane->end, name, name_length * sizeof(oid));
+    lane->end_length = name_length;
+    return walk_add_lane(lane->root, LANE_WALK, name, name_length);
+}
+
+/*
+ * Adds the lanes walking root: one per column of a table or table entry
+ * with -Cs, each further split at the -CS index values.
+ */
+static void
+walk_add_root(netsnmp_session * ss, const char *agent,
+              const oid * name, size_t name_length)
+{
+    struct walk_root *root;
+    struct walk_lane *lane;
+    struct tree    *tp, *entry = NULL;
+    oid             point[MAX_OID_LEN];
+    size_t          depth, prefix_length = name_length;
+    oid            *columns = NULL;
+    int             i, j, num_columns = 0;
+
+    root = calloc(1, sizeof(*root));
+    if (root == NULL) {
+        fprintf(stderr, "snmpbulkwalk: out of memory\n");
+        exit(1);
+    }
+    root->ss = ss;
+    root->agent = agent;
+    memmove(root->name, name, name_length * sizeof(oid));
+    root->name_length = name_length;
+    memmove(point, name, name_length * sizeof(oid));
+
+    if (netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID,
+			       NETSNMP_DS_WALK_INCLUDE_REQUESTED))
+        walk_add_lane(root, LANE_GET, name, name_length);
+
+    if (netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID,
+                               NETSNMP_DS_WALK_SPLIT_COLUMNS) &&
+        (tp = get_tree(name, name_length, get_tree_head())) != NULL) {
+        for (depth = 0, entry = tp; entry; entry = entry->parent)
+            depth++;
+        if (depth != name_length)
+            entry = NULL;
+        else if (tp->indexes || tp->augments)
+            entry = tp;
+        else if (tp->child_list && name_length < MAX_OID_LEN - 2 &&
+                 (tp->child_list->indexes || tp->child_list->augments)) {
+            entry = tp->child_list;
+            point[prefix_length++] = entry->subid;
+        }
+    }
+    if (entry) {
+        for (tp = entry->child_list; tp; tp = tp->next_peer)
+            num_columns++;
+        columns = calloc(num_columns ? num_columns : 1, sizeof(oid));
+        if (columns == NULL) {
+            fprintf(stderr, "snmpbulkwalk: out of memory\n");
+            exit(1);
+        }
+        for (i = 0, tp = entry->child_list; tp; tp = tp->next_peer)
+            columns[i++] = tp->subid;
+        num_columns = sort_subids(columns, num_columns);
+    } else if (num_split_index) {
+        /*
+         * Split the root itself at the index values.
+         */
+        num_columns = 1;
+        prefix_length--;
+    }
+
+    lane = walk_add_lane(root, LANE_WALK, name, name_length);
+    for (i = 0; i < num_columns && prefix_length < MAX_OID_LEN - 1; i++) {
+        if (columns) {
+            point[prefix_length] = columns[i];
+            if (i > 0)
+                lane = walk_split_lane(lane, point, prefix_length + 1);
+        }
+        for (j = 0; j < num_split_index; j++) {
+            point[prefix_length + 1] = split_index[j];
+            lane = walk_split_lane(lane, point, prefix_length + 2);
+        }
+    }
+    free(columns);
+
+    walk_add_lane(root, LANE_GET_IF_EMPTY, name, name_length);
+}
+
+static void
+walk_lane_done(struct walk_lane *lane)
+{
+    lane->state = LANE_DONE;
+    if (lane->type != LANE_GET_IF_EMPTY)
+        lane->root->lanes_left--;
 }
 
 static void
-snmp_get_and_print(netsnmp_session * ss, oid * theoid, size_t theoid_len)
+walk_buffer(struct walk_lane *lane)
 {
-    netsnmp_pdu    *pdu, *response;
+    if (lane->buf == NULL) {
+        lane->buf_len = 256;
+        lane->buf = (u_char *) malloc(lane->buf_len);
+        if (lane->buf == NULL) {
+            fprintf(stderr, "snmpbulkwalk: out of memory\n");
+            exit(1);
+        }
+    }
+}
+
+/*
+ * Prints a variable into the output buffer of lane.
+ */
+static void
+walk_print(struct walk_lane *lane, netsnmp_variable_list * vars)
+{
+    struct walk_root *root = lane->root;
+
+    numprinted++;
+    root->found++;
+    walk_buffer(lane);
+    if (root->agent) {
+        snmp_cstrcat(&lane->buf, &lane->buf_len, &lane->out_len, 1,
+                     root->agent);
+        snmp_cstrcat(&lane->buf, &lane->buf_len, &lane->out_len, 1, ": ");
+    }
+    if (!sprint_realloc_variable(&lane->buf, &lane->buf_len, &lane->out_len,
+                                 1, vars->name, vars->name_length, vars))
+        snmp_cstrcat(&lane->buf, &lane->buf_len, &lane->out_len, 1,
+                     " [TRUNCATED]");
+    snmp_cstrcat(&lane->buf, &lane->buf_len, &lane->out_len, 1, "\n");
+}
+
+/*
+ * Prints the output of the lanes at the head of the walk, up to the
+ * first lane that is not done yet.
+ */
+static void
+walk_flush(void)
+{
+    struct walk_lane *lane;
+
+    while (first_lane < num_lanes) {
+        lane = &lanes[first_lane];
+        if (lane->out_len) {
+            fwrite(lane->buf, 1, lane->out_len, stdout);
+            lane->out_len = 0;
+        }
+        if (lane->state != LANE_DONE)
+            break;
+        SNMP_FREE(lane->buf);
+        first_lane++;
+    }
+}
+
+static int
+walk_response(int operation, netsnmp_session * ss, int reqid,
+              netsnmp_pdu *response, void *magic)
+{
+    struct walk_lane *lane = (struct walk_lane *) magic;
+    struct walk_root *root = lane->root;
     netsnmp_variable_list *vars;
-    int             status;
+    int             count, running = 1;
 
-    pdu = snmp_pdu_create(SNMP_MSG_GET);
-    snmp_add_null_var(pdu, theoid, theoid_len);
+    if (operation == NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE &&
+        response->command == SNMP_MSG_REPORT) {
+        /*
+         * the library either resends the request or gives up with a
+         * security error
+         */
+        ss->s_snmp_errno = snmpv3_get_report_type(response);
+        return 1;
+    }
+    if (operation == NETSNMP_CALLBACK_OP_RESEND)
+        return 1;
+
+    in_flight--;
+    lane->state = LANE_IDLE;
+
+    if (lane->type != LANE_WALK) {
+        if (operation == NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE &&
+            response->errstat == SNMP_ERR_NOERROR)
+            for (vars = response->variables; vars;
+                 vars = vars->next_variable)
+                walk_print(lane, vars);
+        walk_lane_done(lane);
+        return 1;
+    }
 
-    status = snmp_synch_response(ss, pdu, &response);
-    if (status == STAT_SUCCESS && response->errstat == SNMP_ERR_NOERROR) {
-        for (vars = response->variables; vars; vars = vars->next_variable) {
-            numprinted++;
-            print_variable(vars->name, vars->name_length, vars);
+    switch (operation) {
+    case NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE:
+        if (response->errstat == SNMP_ERR_NOERROR) {
+            /*
+             * check resulting variables 
+             */
+            for (vars = response->variables; vars;
+                 vars = vars->next_variable) {
+                if ((vars->name_length < root->name_length)
+                    || (memcmp(root->name, vars->name,
+                               root->name_length * sizeof(oid)) != 0)
+                    || (lane->end_length &&
+                        snmp_oid_compare(vars->name, vars->name_length,
+                                         lane->end,
+                                         lane->end_length) > 0)) {
+                    /*
+                     * not part of this subtree, or walked by the next lane
+                     */
+                    running = 0;
+                    continue;
+                }
+                walk_print(lane, vars);
+                if ((vars->type != SNMP_ENDOFMIBVIEW) &&
+                    (vars->type != SNMP_NOSUCHOBJECT) &&
+                    (vars->type != SNMP_NOSUCHINSTANCE)) {
+                    /*
+                     * not an exception value 
+                     */
+                    if (check
+                        && snmp_oid_compare(lane->name, lane->name_length,
+                                            vars->name,
+                                            vars->name_length) >= 0) {
+                        walk_flush();
+                        fflush(stdout);
+                        fprintf(stderr, "Error: OID not increasing: ");
+                        fprint_objid(stderr, lane->name, lane->name_length);
+                        fprintf(stderr, " >= ");
+                        fprint_objid(stderr, vars->name,
+                                     vars->name_length);
+                        fprintf(stderr, "\n");
+                        running = 0;
+                        exitval = 1;
+                    }
+                    /*
+                     * Check if last variable, and if so, save for next request.  
+                     */
+                    if (vars->next_variable == NULL) {
+                        memmove(lane->name, vars->name,
+                                vars->name_length * sizeof(oid));
+                        lane->name_length = vars->name_length;
+                    }
+                } else {
+                    /*
+                     * an exception value, so stop 
+                     */
+                    running = 0;
+                }
+            }
+        } else {
+            /*
+             * error in response, print it 
+             */
+            running = 0;
+            if (response->errstat == SNMP_ERR_NOSUCHNAME) {
+                walk_buffer(lane);
+                snmp_cstrcat(&lane->buf, &lane->buf_len, &lane->out_len, 1,
+                             "End of MIB\n");
+            } else {
+                fprintf(stderr, "Error in packet.\nReason: %s\n",
+                        snmp_errstring(response->errstat));
+                if (response->errindex != 0) {
+                    fprintf(stderr, "Failed object: ");
+                    for (count = 1, vars = response->variables;
+                         vars && count != response->errindex;
+                         vars = vars->next_variable, count++)
+                        /*EMPTY*/;
+                    if (vars)
+                        fprint_objid(stderr, vars->name,
+                                     vars->name_length);
+                    fprintf(stderr, "\n");
+                }
+                exitval = 2;
+            }
         }
+        break;
+
+    case NETSNMP_CALLBACK_OP_TIMED_OUT:
+        fprintf(stderr, "Timeout: No Response from %s\n", ss->peername);
+        running = 0;
+        root->failed = 1;
+        exitval = 1;
+        break;
+
+    default:
+        snmp_sess_perror("snmpbulkwalk", ss);
+        running = 0;
+        root->failed = 1;
+        exitval = 1;
+        break;
     }
-    if (response) {
-        snmp_free_pdu(response);
+    if (!running)
+        walk_lane_done(lane);
+    return 1;
+}
+
+/*
+ * Sends the next request of idle lanes, the earliest lanes first, while
+ * fewer than max_in_flight requests are outstanding.
+ */
+static void
+walk_send(void)
+{
+    struct walk_lane *lane;
+    netsnmp_pdu    *pdu;
+    int             i;
+
+    for (i = first_lane; i < num_lanes && in_flight < max_in_flight; i++) {
+        lane = &lanes[i];
+        if (lane->state != LANE_IDLE)
+            continue;
+        if (lane->type == LANE_GET_IF_EMPTY) {
+            /*
+             * no printed successful results, which may mean we were
+             * pointed at an only existing instance.  Attempt a GET, just
+             * for get measure. 
+             */
+            if (lane->root->lanes_left)
+                continue;
+            if (lane->root->found || lane->root->failed) {
+                walk_lane_done(lane);
+                continue;
+            }
+        }
+        if (lane->type == LANE_WALK) {
+            pdu = snmp_pdu_create(SNMP_MSG_GETBULK);
+            pdu->non_repeaters = non_reps;
+            pdu->max_repetitions = reps;    /* fill the packet */
+            snmp_add_null_var(pdu, lane->name, lane->name_length);
+        } else {
+            pdu = snmp_pdu_create(SNMP_MSG_GET);
+            snmp_add_null_var(pdu, lane->root->name,
+                              lane->root->name_length);
+        }
+        if (snmp_async_send(lane->root->ss, pdu, walk_response, lane) == 0) {
+            snmp_free_pdu(pdu);
+            if (lane->type == LANE_WALK) {
+                snmp_sess_perror("snmpbulkwalk", lane->root->ss);
+                lane->root->failed = 1;
+                exitval = 1;
+            }
+            walk_lane_done(lane);
+            continue;
+        }
+        lane->state = LANE_SENT;
+        in_flight++;
     }
 }
 
@@ -119,11 +551,16 @@ static
 optProc(int argc, char *const *argv, int opt)
 {
     char           *endptr = NULL;
+    long            value;
 
     switch (opt) {
     case 'C':
         while (*optarg) {
             switch (*optarg++) {
+            case 'A':
+                extra_agents = argv[optind++];
+                break;
+
             case 'c':
                 netsnmp_ds_toggle_boolean(NETSNMP_DS_APPLICATION_ID,
 				     NETSNMP_DS_WALK_DONT_CHECK_LEXICOGRAPHIC);
@@ -136,13 +573,17 @@ optProc(int argc, char *const *argv, int opt)
 
             case 'n':
             case 'r':
+            case 'P':
+                value = strtol(optarg, &endptr, 0);
                 if (*(optarg - 1) == 'r') {
-                    reps = strtol(optarg, &endptr, 0);
+                    reps = value;
+                } else if (*(optarg - 1) == 'n') {
+                    non_reps = value;
                 } else {
-                    non_reps = strtol(optarg, &endptr, 0);
+                    max_in_flight = value;
                 }
 
-                if (endptr == optarg) {
+                if (endptr == optarg || max_in_flight < 1) {
                     /*
                      * No number given -- error.  
                      */
@@ -161,6 +602,33 @@ optProc(int argc, char *const *argv, int opt)
 					  NETSNMP_DS_WALK_PRINT_STATISTICS);
                 break;
 
+            case 's':
+                netsnmp_ds_toggle_boolean(NETSNMP_DS_APPLICATION_ID,
+					  NETSNMP_DS_WALK_SPLIT_COLUMNS);
+                break;
+
+            case 'S':
+                do {
+                    split_index = realloc(split_index, (num_split_index + 1) *
+                                          sizeof(oid));
+                    if (split_index == NULL) {
+                        fprintf(stderr, "snmpbulkwalk: out of memory\n");
+                        exit(1);
+                    }
+                    split_index[num_split_index] =
+                        strtoul(optarg, &endptr, 0);
+                    if (endptr == optarg) {
+                        usage();
+                        exit(1);
+                    }
+                    num_split_index++;
+                    optarg = endptr;
+                } while (*optarg == ',' && *++optarg);
+                if (isspace((unsigned char)(*optarg))) {
+                    return;
+                }
+                break;
+
             default:
                 fprintf(stderr, "Unknown flag passed to -C: %c\n",
                         optarg[-1]);
@@ -174,19 +642,16 @@ optProc(int argc, char *const *argv, int opt)
 int
 main(int argc, char *argv[])
 {
-    netsnmp_session session, *ss;
-    netsnmp_pdu    *pdu, *response;
-    netsnmp_variable_list *vars;
-    int             arg;
-    oid             name[MAX_OID_LEN];
-    size_t          name_length;
-    oid             root[MAX_OID_LEN];
-    size_t          rootlen;
-    int             count;
-    int             running;
-    int             status = STAT_ERROR;
-    int             check;
-    int             exitval = 1;
+    netsnmp_session session, *ss, **sessions = NULL;
+    int             num_sessions = 0, max_sessions = 1;
+    char          **agents = NULL, *agent, *next;
+    int             arg, i, j;
+    oid            *roots = NULL;
+    size_t         *rootlens = NULL;
+    int             num_roots;
+    int             numfds, block, count;
+    fd_set          fdset;
+    struct timeval  timeout, *tvp;
 
     SOCK_STARTUP;
 
@@ -217,167 +682,112 @@ main(int argc, char *argv[])
     }
 
     /*
-     * get the initial object and subtree 
+     * get the initial objects and subtrees 
      */
+    num_roots = arg < argc ? argc - arg : 1;
+    roots = (oid *) malloc(num_roots * MAX_OID_LEN * sizeof(oid));
+    rootlens = (size_t *) malloc(num_roots * sizeof(size_t));
+    if (roots == NULL || rootlens == NULL) {
+        fprintf(stderr, "snmpbulkwalk: out of memory\n");
+        goto out;
+    }
     if (arg < argc) {
         /*
          * specified on the command line 
          */
-        rootlen = MAX_OID_LEN;
-        if (snmp_parse_oid(argv[arg], root, &rootlen) == NULL) {
-            snmp_perror(argv[arg]);
-            goto out;
+        for (i = 0; i < num_roots; i++) {
+            rootlens[i] = MAX_OID_LEN;
+            if (snmp_parse_oid(argv[arg + i], roots + i * MAX_OID_LEN,
+                               &rootlens[i]) == NULL) {
+                snmp_perror(argv[arg + i]);
+                goto out;
+            }
         }
     } else {
         /*
          * use default value 
          */
-        memmove(root, objid_mib, sizeof(objid_mib));
-        rootlen = OID_LENGTH(objid_mib);
+        memmove(roots, objid_mib, sizeof(objid_mib));
+        rootlens[0] = OID_LENGTH(objid_mib);
     }
+    num_split_index = sort_subids(split_index, num_split_index);
 
     /*
-     * open an SNMP session 
+     * the agents to walk: the one given as usual, and those of -CA 
      */
-    ss = snmp_open(&session);
-    if (ss == NULL) {
-        /*
-         * diagnose snmp_open errors with the input netsnmp_session pointer 
-         */
-        snmp_sess_perror("snmpbulkwalk", &session);
+    if (extra_agents) {
+        for (next = extra_agents; (next = strchr(next, ',')) != NULL; next++)
+            max_sessions++;
+        max_sessions++;
+    }
+    sessions = (netsnmp_session **) calloc(max_sessions, sizeof(*sessions));
+    agents = (char **) calloc(max_sessions, sizeof(*agents));
+    if (sessions == NULL || agents == NULL) {
+        fprintf(stderr, "snmpbulkwalk: out of memory\n");
         goto out;
     }
+    agents[0] = session.peername;
+    for (i = 1, agent = extra_agents; agent && *agent; agent = next) {
+        next = strchr(agent, ',');
+        if (next)
+            *next++ = '\0';
+        else
+            next = agent + strlen(agent);
+        if (*agent)
+            agents[i++] = agent;
+    }
 
     /*
-     * setup initial object name 
+     * open an SNMP session for each agent
      */
-    memmove(name, root, rootlen * sizeof(oid));
-    name_length = rootlen;
-
-    running = 1;
+    for (i = 0; i < max_sessions && agents[i]; i++) {
+        session.peername = agents[i];
+        ss = snmp_open(&session);
+        if (ss == NULL) {
+            /*
+             * diagnose snmp_open errors with the input netsnmp_session pointer 
+             */
+            snmp_sess_perror("snmpbulkwalk", &session);
+            session.peername = agents[0];
+            goto out;
+        }
+        sessions[num_sessions++] = ss;
+    }
+    session.peername = agents[0];
 
     check = !netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID,
 				    NETSNMP_DS_WALK_DONT_CHECK_LEXICOGRAPHIC);
-    if (netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID,
-			       NETSNMP_DS_WALK_INCLUDE_REQUESTED)) {
-        snmp_get_and_print(ss, root, rootlen);
-    }
+    for (i = 0; i < num_sessions; i++)
+        for (j = 0; j < num_roots; j++)
+            walk_add_root(sessions[i], num_sessions > 1 ? agents[i] : NULL,
+                          roots + j * MAX_OID_LEN, rootlens[j]);
 
     exitval = 0;
 
-    while (running) {
-        /*
-         * create PDU for GETBULK request and add object name to request 
-         */
-        pdu = snmp_pdu_create(SNMP_MSG_GETBULK);
-        pdu->non_repeaters = non_reps;
-        pdu->max_repetitions = reps;    /* fill the packet */
-        snmp_add_null_var(pdu, name, name_length);
-
-        /*
-         * do the request 
-         */
-        status = snmp_synch_response(ss, pdu, &response);
-        if (status == STAT_SUCCESS) {
-            if (response->errstat == SNMP_ERR_NOERROR) {
-                /*
-                 * check resulting variables 
-                 */
-                for (vars = response->variables; vars;
-                     vars = vars->next_variable) {
-                    if ((vars->name_length < rootlen)
-                        || (memcmp(root, vars->name, rootlen * sizeof(oid))
-                            != 0)) {
-                        /*
-                         * not part of this subtree 
-                         */
-                        running = 0;
-                        continue;
-                    }
-                    numprinted++;
-                    print_variable(vars->name, vars->name_length, vars);
-                    if ((vars->type != SNMP_ENDOFMIBVIEW) &&
-                        (vars->type != SNMP_NOSUCHOBJECT) &&
-                        (vars->type != SNMP_NOSUCHINSTANCE)) {
-                        /*
-                         * not an exception value 
-                         */
-                        if (check
-                            && snmp_oid_compare(name, name_length,
-                                                vars->name,
-                                                vars->name_length) >= 0) {
-                            fflush(stdout);
-                            fprintf(stderr, "Error: OID not increasing: ");
-                            fprint_objid(stderr, name, name_length);
-                            fprintf(stderr, " >= ");
-                            fprint_objid(stderr, vars->name,
-                                         vars->name_length);
-                            fprintf(stderr, "\n");
-                            running = 0;
-                            exitval = 1;
-                        }
-                        /*
-                         * Check if last variable, and if so, save for next request.  
-                         */
-                        if (vars->next_variable == NULL) {
-                            memmove(name, vars->name,
-                                    vars->name_length * sizeof(oid));
-                            name_length = vars->name_length;
-                        }
-                    } else {
-                        /*
-                         * an exception value, so stop 
-                         */
-                        running = 0;
-                    }
-                }
-            } else {
-                /*
-                 * error in response, print it 
-                 */
-                running = 0;
-                if (response->errstat == SNMP_ERR_NOSUCHNAME) {
-                    printf("End of MIB\n");
-                } else {
-                    fprintf(stderr, "Error in packet.\nReason: %s\n",
-                            snmp_errstring(response->errstat));
-                    if (response->errindex != 0) {
-                        fprintf(stderr, "Failed object: ");
-                        for (count = 1, vars = response->variables;
-                             vars && count != response->errindex;
-                             vars = vars->next_variable, count++)
-                            /*EMPTY*/;
-                        if (vars)
-                            fprint_objid(stderr, vars->name,
-                                         vars->name_length);
-                        fprintf(stderr, "\n");
-                    }
-                    exitval = 2;
-                }
-            }
-        } else if (status == STAT_TIMEOUT) {
-            fprintf(stderr, "Timeout: No Response from %s\n",
-                    session.peername);
-            running = 0;
-            exitval = 1;
-        } else {                /* status == STAT_ERROR */
-            snmp_sess_perror("snmpbulkwalk", ss);
-            running = 0;
+    walk_send();
+    while (in_flight) {
+        numfds = 0;
+        FD_ZERO(&fdset);
+        block = 1;
+        tvp = &timeout;
+        timerclear(tvp);
+        snmp_select_info(&numfds, &fdset, tvp, &block);
+        if (block == 1)
+            tvp = NULL;         /* block without timeout */
+        count = select(numfds, &fdset, NULL, NULL, tvp);
+        if (count > 0) {
+            snmp_read(&fdset);
+        } else if (count == 0) {
+            snmp_timeout();
+        } else if (errno != EINTR) {
+            perror("select");
             exitval = 1;
+            break;
         }
-        if (response)
-            snmp_free_pdu(response);
-    }
-
-    if (numprinted == 0 && status == STAT_SUCCESS) {
-        /*
-         * no printed successful results, which may mean we were
-         * pointed at an only existing instance.  Attempt a GET, just
-         * for get measure. 
-         */
-        snmp_get_and_print(ss, root, rootlen);
+        walk_send();
+        walk_flush();
     }
-    snmp_close(ss);
+    walk_flush();
 
     if (netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID, 
 			       NETSNMP_DS_WALK_PRINT_STATISTICS)) {
@@ -385,6 +795,12 @@ main(int argc, char *argv[])
     }
 
 out:
+    for (i = 0; i < num_sessions; i++)
+        snmp_close(sessions[i]);
+    free(sessions);
+    free(agents);
+    free(roots);
+    free(rootlens);
     netsnmp_cleanup_session(&session);
     SOCK_CLEANUP;
     return exitval;
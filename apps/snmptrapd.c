@@ -108,6 +108,7 @@ SOFTWARE.
 #include "snmptrapd_log.h"
 #include "snmptrapd_auth.h"
 #include "snmptrapd_sql.h"
+#include "snmptrapd_pipeline.h"
 #include "notification-log-mib/notification_log.h"
 #include "tlstm-mib/snmpTlstmCertToTSNTable/snmpTlstmCertToTSNTable.h"
 #include "mibII/vacm_conf.h"
@@ -522,6 +523,7 @@ snmptrapd_main_loop(void)
                 snmp_log(LOG_INFO, "NET-SNMP version %s restarted\n",
                          netsnmp_get_version());
             trapd_update_config();
+            snmptrapd_pipeline_reconfigured();
             if (trap1_fmt_str_remember) {
                 parse_format( NULL, trap1_fmt_str_remember );
             }
@@ -540,8 +542,10 @@ snmptrapd_main_loop(void)
 #endif /* NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER */
         timeout2.tv_sec = timeout.tv_sec;
         timeout2.tv_usec = timeout.tv_usec;
+        snmptrapd_pipeline_release();
         count = select(numfds, &readfds, &writefds, &exceptfds,
                        !block ? &timeout2 : NULL);
+        snmptrapd_pipeline_acquire();
         if (count > 0) {
 #ifndef NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER
             netsnmp_dispatch_external_events(&count, &readfds, &writefds,
@@ -645,9 +649,10 @@ main(int argc, char *argv[])
      * register our configuration handlers now so -H properly displays them 
      */
     snmptrapd_register_configs( );
-#ifdef NETSNMP_USE_MYSQL
+#if defined(NETSNMP_USE_MYSQL) || defined(NETSNMP_USE_SQLITE)
     snmptrapd_register_sql_configs( );
 #endif
+    snmptrapd_register_pipeline_configs( );
 #ifdef NETSNMP_SECMOD_USM
     init_usm_conf( "snmptrapd" );
 #endif /* NETSNMP_SECMOD_USM */
@@ -1165,6 +1170,7 @@ main(int argc, char *argv[])
             } else {
                 ss->next = sess_list;
                 sess_list = ss;
+                snmptrapd_pipeline_add_session(ss);
             }
         }
 
@@ -1181,9 +1187,9 @@ main(int argc, char *argv[])
     }
     SNMP_FREE(listen_ports); /* done with them */
 
-#ifdef NETSNMP_USE_MYSQL
+#if defined(NETSNMP_USE_MYSQL) || defined(NETSNMP_USE_SQLITE)
     if( netsnmp_mysql_init() ) {
-        fprintf(stderr, "MySQL initialization failed\n");
+        fprintf(stderr, "SQL initialization failed\n");
         goto sock_cleanup;
     }
 #endif
@@ -1307,6 +1313,7 @@ main(int argc, char *argv[])
     trapd_status = SNMPTRAPD_RUNNING;
 #endif
 
+    snmptrapd_pipeline_start();
     snmptrapd_main_loop();
 
     if (snmp_get_do_logging()) {
@@ -1324,6 +1331,7 @@ main(int argc, char *argv[])
 #ifdef NETSNMP_EMBEDDED_PERL
     shutdown_perl();
 #endif
+    snmptrapd_pipeline_shutdown();
     snmptrapd_close_sessions(sess_list);
     snmp_shutdown("snmptrapd");
 #ifdef WIN32SERVICE
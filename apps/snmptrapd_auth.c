@@ -59,14 +59,19 @@ init_netsnmp_trapd_auth(void)
 
 /* XXX: store somewhere in the PDU instead */
 static int lastlookup;
+/* result of netsnmp_trapd_authorize() computed in advance, or -1 */
+static int presetlookup = -1;
 
 /**
- * Authorizes incoming notifications for further processing
+ * Checks an incoming notification against the VACM views.  This only
+ * depends on the notification and the configuration, so the worker
+ * threads of the receive pipeline call it ahead of the handlers.
+ *
+ * @return the bitmask of the views (TRAP_AUTH_*) that authorize it,
+ *         0 if it should be dropped.
  */
 int
-netsnmp_trapd_auth(netsnmp_pdu           *pdu,
-                   netsnmp_transport     *transport,
-                   netsnmp_trapd_handler *handler)
+netsnmp_trapd_authorize(netsnmp_pdu *pdu)
 {
     int ret = 0;
     oid snmptrapoid[] = { 1,3,6,1,6,3,1,1,4,1,0 };
@@ -79,34 +84,34 @@ netsnmp_trapd_auth(netsnmp_pdu           *pdu,
 
     /* check to see if authorization was not disabled */
     if (netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID,
-                               NETSNMP_DS_APP_NO_AUTHORIZATION)) {
-        DEBUGMSGTL(("snmptrapd:auth",
-                    "authorization turned off: not checking\n"));
-        return NETSNMPTRAPD_HANDLER_OK;
-    }
+                               NETSNMP_DS_APP_NO_AUTHORIZATION))
+        return TRAP_AUTH_ALL;
+
+    if (!pdu)
+        return 0;
 
-    /* bail early if called illegally */
-    if (!pdu || !transport || !handler)
-        return NETSNMPTRAPD_HANDLER_FINISH;
-    
     /* convert to v2 so we can check it in a consistent manner */
 #ifndef NETSNMP_DISABLE_SNMPV1
     if (pdu->version == SNMP_VERSION_1) {
         newpdu = convert_v1pdu_to_v2(pdu);
         if (!newpdu) {
             snmp_log(LOG_ERR, "Failed to duplicate incoming PDU.  Refusing to authorize.\n");
-            return NETSNMPTRAPD_HANDLER_FINISH;
+            return 0;
         }
     }
 #endif
 
+    /* the views are compiled on first use */
+    snmp_res_lock(MT_APPLICATION_ID, MT_APP_TRAPD);
+
     if (!vacm_is_configured()) {
+        snmp_res_unlock(MT_APPLICATION_ID, MT_APP_TRAPD);
 #ifndef NETSNMP_DISABLE_SNMPV1
         if (newpdu != pdu)
             snmp_free_pdu(newpdu);
 #endif
         snmp_log(LOG_WARNING, "No access configuration - dropping trap.\n");
-        return NETSNMPTRAPD_HANDLER_FINISH;
+        return 0;
     }
 
     /* loop through each variable and find the snmpTrapOID.0 var
@@ -119,12 +124,13 @@ netsnmp_trapd_auth(netsnmp_pdu           *pdu,
 
     /* make sure we can continue: we found the snmpTrapOID.0 and its an oid */
     if (!var || var->type != ASN_OBJECT_ID) {
+        snmp_res_unlock(MT_APPLICATION_ID, MT_APP_TRAPD);
         snmp_log(LOG_ERR, "Can't determine trap identifier; refusing to authorize it\n");
 #ifndef NETSNMP_DISABLE_SNMPV1
         if (newpdu != pdu)
             snmp_free_pdu(newpdu);
 #endif
-        return NETSNMPTRAPD_HANDLER_FINISH;
+        return 0;
     }
 
 #ifdef USING_MIBII_VACM_CONF_MODULE
@@ -147,23 +153,62 @@ netsnmp_trapd_auth(netsnmp_pdu           *pdu,
     }
     DEBUGMSGTL(("snmptrapd:auth", "Final bitmask auth: %x\n", ret));
 #endif
+    snmp_res_unlock(MT_APPLICATION_ID, MT_APP_TRAPD);
 
-    if (ret) {
-        /* we have policy to at least do "something".  Remember and continue. */
-        lastlookup = ret;
 #ifndef NETSNMP_DISABLE_SNMPV1
-        if (newpdu != pdu)
-            snmp_free_pdu(newpdu);
+    if (newpdu != pdu)
+        snmp_free_pdu(newpdu);
 #endif
+    if (!ret) {
+        /* No policy was met, so we drop the PDU from further processing */
+        DEBUGMSGTL(("snmptrapd:auth", "Dropping unauthorized message\n"));
+    }
+    return ret;
+}
+
+/**
+ * Makes the next call of netsnmp_trapd_auth() use a result of
+ * netsnmp_trapd_authorize() computed in advance; -1 clears it.
+ */
+void
+netsnmp_trapd_auth_preset(int authmask)
+{
+    presetlookup = authmask;
+}
+
+/**
+ * Authorizes incoming notifications for further processing
+ */
+int
+netsnmp_trapd_auth(netsnmp_pdu           *pdu,
+                   netsnmp_transport     *transport,
+                   netsnmp_trapd_handler *handler)
+{
+    int ret;
+
+    /* check to see if authorization was not disabled */
+    if (netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID,
+                               NETSNMP_DS_APP_NO_AUTHORIZATION)) {
+        DEBUGMSGTL(("snmptrapd:auth",
+                    "authorization turned off: not checking\n"));
         return NETSNMPTRAPD_HANDLER_OK;
     }
 
-    /* No policy was met, so we drop the PDU from further processing */
-    DEBUGMSGTL(("snmptrapd:auth", "Dropping unauthorized message\n"));
-#ifndef NETSNMP_DISABLE_SNMPV1
-    if (newpdu != pdu)
-        snmp_free_pdu(newpdu);
-#endif
+    /* bail early if called illegally */
+    if (!pdu || !transport || !handler)
+        return NETSNMPTRAPD_HANDLER_FINISH;
+
+    if (presetlookup >= 0) {
+        ret = presetlookup;
+        presetlookup = -1;
+    } else
+        ret = netsnmp_trapd_authorize(pdu);
+
+    if (ret) {
+        /* we have policy to at least do "something".  Remember and continue. */
+        lastlookup = ret;
+        return NETSNMPTRAPD_HANDLER_OK;
+    }
     return NETSNMPTRAPD_HANDLER_FINISH;
 }
 
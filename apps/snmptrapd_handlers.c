@@ -27,6 +27,11 @@
 #ifdef HAVE_SYS_WAIT_H
 #include <sys/wait.h>
 #endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#include <errno.h>
+#include <signal.h>
 
 #include <net-snmp/config_api.h>
 #include <net-snmp/output_api.h>
@@ -83,6 +88,422 @@ trap_description(int trap)
 
 
 
+#if defined(HAVE_FORK) && defined(HAVE_WAITPID) && !defined(WIN32) && \
+    !defined(NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER)
+#define NETSNMP_TRAPHANDLE_WORKERS 1
+#endif
+
+#define TRAPHANDLE_QUEUE_DEFAULT  1000
+
+#ifdef NETSNMP_TRAPHANDLE_WORKERS
+/*
+ * Persistent traphandle workers ("traphandle -P").  Rather than running
+ * the command once per trap, a few long-lived copies of it are started
+ * and each trap is written to one of them as a record: a line holding
+ * the length of the record in bytes, then the record itself, in the same
+ * format as the input of a per-trap command.  Records wait in a bounded
+ * queue while all workers are busy; when the queue is full new traps are
+ * dropped and counted.  Workers that exit are restarted after a delay
+ * that doubles while they keep failing.
+ *
+ * The workers are started by the first trap or timer tick, not while the
+ * configuration is read, so that they are children of the daemon rather
+ * than of the process that forked it.
+ */
+#define TRAPHANDLE_RESTART_MIN    1     /* seconds */
+#define TRAPHANDLE_RESTART_MAX    60
+#define TRAPHANDLE_STABLE_RUN     60    /* resets the restart delay */
+#define TRAPHANDLE_STOP_WAIT      200   /* ticks of 10 ms, after EOF */
+#define TRAPHANDLE_TERM_WAIT      100   /* ... and after SIGTERM */
+
+struct traphandle_record {
+    struct traphandle_record *next;
+    size_t          len;
+    char            data[1];
+};
+
+struct traphandle_pool;
+
+struct traphandle_worker {
+    struct traphandle_pool *pool;
+    pid_t           pid;        /* 0 when not running */
+    int             fd;         /* the worker's stdin, or -1 */
+    int             waiting;    /* registered for writability */
+    struct traphandle_record *rec;      /* being written */
+    size_t          written;
+    time_t          started;
+    time_t          restart_at;
+    int             failures;   /* consecutive short runs */
+};
+
+struct traphandle_pool {
+    struct traphandle_pool *next;
+    char           *command;
+    int             num_workers;
+    struct traphandle_worker *workers;
+    int             started;
+    int             rr;
+    struct traphandle_record *head, *tail;
+    int             queued, queue_max;
+    u_long          received, delivered, dropped, restarts;
+    u_long          dropped_logged;
+};
+
+static struct traphandle_pool *traphandle_pools;
+static unsigned int traphandle_timer;
+
+static void     traphandle_worker_write(struct traphandle_worker *w);
+
+static void
+traphandle_worker_start(struct traphandle_worker *w)
+{
+    int             fds[2];
+    pid_t           pid;
+
+    if (pipe(fds) < 0) {
+        snmp_log_perror("traphandle: pipe");
+        return;
+    }
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    pid = fork();
+    if (pid < 0) {
+        snmp_log_perror("traphandle: fork");
+        close(fds[0]);
+        close(fds[1]);
+        return;
+    }
+    if (pid == 0) {
+        /* a group of its own, so that signals also reach what sh starts */
+        setpgid(0, 0);
+        dup2(fds[0], 0);
+        close(fds[0]);
+        close(fds[1]);
+        signal(SIGPIPE, SIG_DFL);
+        execl("/bin/sh", "sh", "-c", w->pool->command, (char *) NULL);
+        _exit(127);
+    }
+    setpgid(pid, pid);
+    close(fds[0]);
+    fcntl(fds[1], F_SETFL, fcntl(fds[1], F_GETFL) | O_NONBLOCK);
+    w->pid = pid;
+    w->fd = fds[1];
+    w->started = time(NULL);
+    DEBUGMSGTL(("snmptrapd:workers", "started '%s' as pid %d\n",
+                w->pool->command, (int) pid));
+}
+
+/*
+ * Closes the pipe to a worker.  A record that was being written goes
+ * back to the head of the queue for another worker.
+ */
+static void
+traphandle_worker_close(struct traphandle_worker *w)
+{
+    struct traphandle_pool *pool = w->pool;
+
+    if (w->fd < 0)
+        return;
+    if (w->waiting)
+        unregister_writefd(w->fd);
+    w->waiting = 0;
+    close(w->fd);
+    w->fd = -1;
+    if (w->rec) {
+        w->rec->next = pool->head;
+        pool->head = w->rec;
+        if (pool->tail == NULL)
+            pool->tail = w->rec;
+        pool->queued++;
+        w->rec = NULL;
+    }
+}
+
+/* Hands queued records to the workers that can take them. */
+static void
+traphandle_pool_dispatch(struct traphandle_pool *pool)
+{
+    struct traphandle_worker *w;
+    int             i, idle;
+
+    do {
+        idle = 0;
+        for (i = 0; i < pool->num_workers && pool->head; i++) {
+            w = &pool->workers[(pool->rr + i) % pool->num_workers];
+            if (w->fd < 0 || w->rec)
+                continue;
+            w->rec = pool->head;
+            pool->head = w->rec->next;
+            if (pool->head == NULL)
+                pool->tail = NULL;
+            pool->queued--;
+            w->written = 0;
+            traphandle_worker_write(w);
+            if (w->fd >= 0 && w->rec == NULL)
+                idle = 1;
+        }
+        pool->rr = (pool->rr + 1) % pool->num_workers;
+    } while (idle && pool->head);
+}
+
+static void
+traphandle_worker_writable(int fd, void *data)
+{
+    struct traphandle_worker *w = (struct traphandle_worker *) data;
+
+    traphandle_worker_write(w);
+    traphandle_pool_dispatch(w->pool);
+}
+
+static void
+traphandle_worker_write(struct traphandle_worker *w)
+{
+    struct traphandle_record *rec = w->rec;
+    ssize_t         n;
+
+    while (rec && w->written < rec->len) {
+        n = write(w->fd, rec->data + w->written, rec->len - w->written);
+        if (n > 0) {
+            w->written += n;
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && errno == EAGAIN) {
+            if (!w->waiting &&
+                register_writefd(w->fd, traphandle_worker_writable,
+                                 w) == FD_REGISTERED_OK)
+                w->waiting = 1;
+            return;
+        }
+        /* the worker has gone away; the timer restarts it */
+        DEBUGMSGTL(("snmptrapd:workers", "pid %d stopped reading\n",
+                    (int) w->pid));
+        traphandle_worker_close(w);
+        return;
+    }
+    if (rec) {
+        w->pool->delivered++;
+        free(rec);
+        w->rec = NULL;
+    }
+    if (w->waiting) {
+        unregister_writefd(w->fd);
+        w->waiting = 0;
+    }
+}
+
+/* Reaps and restarts workers, and reports dropped traps. */
+static void
+traphandle_pool_check(struct traphandle_pool *pool, time_t now)
+{
+    struct traphandle_worker *w;
+    int             i, status, delay;
+    pid_t           pid;
+
+    for (i = 0; i < pool->num_workers; i++) {
+        w = &pool->workers[i];
+        status = 0;
+        pid = w->pid ? waitpid(w->pid, &status, WNOHANG) : 0;
+        if (w->pid && (pid == w->pid || (pid < 0 && errno == ECHILD))) {
+            traphandle_worker_close(w);
+            if (now - w->started >= TRAPHANDLE_STABLE_RUN)
+                w->failures = 0;
+            delay = TRAPHANDLE_RESTART_MIN << (w->failures < 6 ?
+                                               w->failures : 6);
+            if (delay > TRAPHANDLE_RESTART_MAX)
+                delay = TRAPHANDLE_RESTART_MAX;
+            w->failures++;
+            w->restart_at = now + delay;
+            snmp_log(LOG_WARNING, "traphandle '%s': pid %d exited with "
+                     "status %d, restarting in %d seconds\n", pool->command,
+                     (int) w->pid, WIFEXITED(status) ? WEXITSTATUS(status)
+                     : -1, delay);
+            w->pid = 0;
+        }
+        if (w->pid == 0 && now >= w->restart_at) {
+            traphandle_worker_start(w);
+            if (w->pid)
+                pool->restarts++;
+        }
+    }
+    traphandle_pool_dispatch(pool);
+
+    if (pool->dropped != pool->dropped_logged) {
+        snmp_log(LOG_WARNING, "traphandle '%s': %lu traps dropped, "
+                 "queue full (%d)\n", pool->command,
+                 pool->dropped - pool->dropped_logged, pool->queue_max);
+        pool->dropped_logged = pool->dropped;
+    }
+}
+
+static void
+traphandle_pool_start(struct traphandle_pool *pool)
+{
+    int             i;
+
+    pool->started = 1;
+    for (i = 0; i < pool->num_workers; i++)
+        traphandle_worker_start(&pool->workers[i]);
+}
+
+static void
+traphandle_timer_cb(unsigned int clientreg, void *clientarg)
+{
+    struct traphandle_pool *pool;
+    time_t          now = time(NULL);
+
+    for (pool = traphandle_pools; pool; pool = pool->next) {
+        if (!pool->started)
+            traphandle_pool_start(pool);
+        traphandle_pool_check(pool, now);
+    }
+}
+
+static struct traphandle_pool *
+traphandle_pool_create(const char *command, int num_workers, int queue_max)
+{
+    struct traphandle_pool *pool;
+    int             i;
+
+    pool = calloc(1, sizeof(*pool));
+    if (pool == NULL)
+        return NULL;
+    pool->workers = calloc(num_workers, sizeof(*pool->workers));
+    pool->command = strdup(command);
+    if (pool->workers == NULL || pool->command == NULL) {
+        free(pool->workers);
+        free(pool->command);
+        free(pool);
+        return NULL;
+    }
+    pool->num_workers = num_workers;
+    pool->queue_max = queue_max;
+    for (i = 0; i < num_workers; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].fd = -1;
+    }
+    pool->next = traphandle_pools;
+    traphandle_pools = pool;
+    if (traphandle_timer == 0)
+        traphandle_timer = snmp_alarm_register(1, SA_REPEAT,
+                                               traphandle_timer_cb, NULL);
+    return pool;
+}
+
+/*
+ * Reaps the workers of a pool that exit within ticks * 10 ms.  Returns
+ * the number still running.
+ */
+static int
+traphandle_pool_wait(struct traphandle_pool *pool, int ticks)
+{
+    struct traphandle_worker *w;
+    int             i, running;
+
+    for (;;) {
+        for (i = 0, running = 0; i < pool->num_workers; i++) {
+            w = &pool->workers[i];
+            if (w->pid && waitpid(w->pid, NULL, WNOHANG) != 0)
+                w->pid = 0;
+            if (w->pid)
+                running++;
+        }
+        if (!running || ticks-- <= 0)
+            return running;
+        usleep(10000);
+    }
+}
+
+/*
+ * Stops a pool's workers: they see the end of their input and are given
+ * a moment to finish, then a moment to handle SIGTERM, before they are
+ * killed.
+ */
+static void
+traphandle_pool_free(struct traphandle_pool *pool)
+{
+    struct traphandle_pool **prev;
+    struct traphandle_record *rec;
+    struct traphandle_worker *w;
+    int             i;
+
+    for (prev = &traphandle_pools; *prev; prev = &(*prev)->next)
+        if (*prev == pool) {
+            *prev = pool->next;
+            break;
+        }
+    if (traphandle_pools == NULL && traphandle_timer) {
+        snmp_alarm_unregister(traphandle_timer);
+        traphandle_timer = 0;
+    }
+
+    for (i = 0; i < pool->num_workers; i++)
+        traphandle_worker_close(&pool->workers[i]);
+    if (traphandle_pool_wait(pool, TRAPHANDLE_STOP_WAIT)) {
+        for (i = 0; i < pool->num_workers; i++)
+            if (pool->workers[i].pid)
+                kill(-pool->workers[i].pid, SIGTERM);
+    }
+    if (traphandle_pool_wait(pool, TRAPHANDLE_TERM_WAIT)) {
+        for (i = 0; i < pool->num_workers; i++) {
+            w = &pool->workers[i];
+            if (w->pid) {
+                snmp_log(LOG_WARNING, "traphandle '%s': killing pid %d\n",
+                         pool->command, (int) w->pid);
+                kill(-w->pid, SIGKILL);
+                waitpid(w->pid, NULL, 0);
+            }
+        }
+    }
+
+    snmp_log(LOG_INFO, "traphandle '%s': %lu traps, %lu delivered, "
+             "%lu dropped, %d not delivered, %lu restarts\n", pool->command,
+             pool->received, pool->delivered, pool->dropped, pool->queued,
+             pool->restarts);
+    while ((rec = pool->head) != NULL) {
+        pool->head = rec->next;
+        free(rec);
+    }
+    free(pool->workers);
+    free(pool->command);
+    free(pool);
+}
+
+static void
+traphandle_pool_send(struct traphandle_pool *pool, const u_char *buf,
+                     size_t len)
+{
+    struct traphandle_record *rec;
+    char            hdr[32];
+    int             hdr_len;
+
+    pool->received++;
+    if (pool->queued >= pool->queue_max) {
+        pool->dropped++;
+        return;
+    }
+    hdr_len = snprintf(hdr, sizeof(hdr), "%lu\n", (u_long) len);
+    rec = malloc(sizeof(*rec) + hdr_len + len);
+    if (rec == NULL) {
+        pool->dropped++;
+        return;
+    }
+    rec->next = NULL;
+    rec->len = hdr_len + len;
+    memcpy(rec->data, hdr, hdr_len);
+    memcpy(rec->data + hdr_len, buf, len);
+    if (pool->tail)
+        pool->tail->next = rec;
+    else
+        pool->head = rec;
+    pool->tail = rec;
+    pool->queued++;
+    if (!pool->started)
+        traphandle_pool_start(pool);
+    traphandle_pool_dispatch(pool);
+}
+#endif /* NETSNMP_TRAPHANDLE_WORKERS */
+
 void
 snmptrapd_parse_traphandle(const char *token, char *line)
 {
@@ -93,21 +514,46 @@ snmptrapd_parse_traphandle(const char *token, char *line)
     netsnmp_trapd_handler *traph;
     int             flags = 0;
     char           *format = NULL;
+    int             workers = 0, queue_max = 0;
 
     memset( buf, 0, sizeof(buf));
     memset(obuf, 0, sizeof(obuf));
     cptr = copy_nword(line, buf, sizeof(buf));
 
-    if ( buf[0] == '-' && buf[1] == 'F' ) {
-        cptr = copy_nword(cptr, buf, sizeof(buf));
-        format = strdup( buf );
-        cptr = copy_nword(cptr, buf, sizeof(buf));
+    while ( cptr && buf[0] == '-' ) {
+        if ( buf[1] == 'F' ) {
+            cptr = copy_nword(cptr, buf, sizeof(buf));
+            free(format);
+            format = strdup( buf );
+        } else if ( buf[1] == 'P' ) {
+            /* -P workers[:queue] -- persistent worker processes */
+            cptr = copy_nword(cptr, buf, sizeof(buf));
+            workers = atoi(buf);
+            cp = strchr(buf, ':');
+            queue_max = cp ? atoi(cp + 1) : TRAPHANDLE_QUEUE_DEFAULT;
+            if (workers <= 0 || queue_max <= 0) {
+                netsnmp_config_error("Bad traphandle -P setting (%s)", buf);
+                free(format);
+                return;
+            }
+        } else {
+            netsnmp_config_error("Unknown traphandle option (%s)", buf);
+            free(format);
+            return;
+        }
+        cptr = cptr ? copy_nword(cptr, buf, sizeof(buf)) : NULL;
     }
     if ( !cptr ) {
         netsnmp_config_error("Missing traphandle command (%s)", buf);
         free(format);
         return;
     }
+#ifndef NETSNMP_TRAPHANDLE_WORKERS
+    if (workers) {
+        netsnmp_config_error("traphandle -P is not supported on this platform");
+        workers = 0;
+    }
+#endif
 
     DEBUGMSGTL(("read_config:traphandle", "registering handler for: "));
     if (!strcmp(buf, "default")) {
@@ -147,6 +593,11 @@ snmptrapd_parse_traphandle(const char *token, char *line)
             traph->format = format;
             format = NULL;
         }
+#ifdef NETSNMP_TRAPHANDLE_WORKERS
+        if (workers)
+            traph->handler_data = traphandle_pool_create(cptr, workers,
+                                                         queue_max);
+#endif
     }
     free(format);
 }
@@ -329,7 +780,8 @@ snmptrapd_register_configs( void )
     register_config_handler("snmptrapd", "traphandle",
                             snmptrapd_parse_traphandle,
                             snmptrapd_free_traphandle,
-                            "oid|\"default\" program [args ...] ");
+                            "[-P workers[:queue]] oid|\"default\" "
+                            "program [args ...] ");
     register_config_handler("snmptrapd", "format1",
                             parse_trap1_fmt, free_trap1_fmt, "format");
     register_config_handler("snmptrapd", "format2",
@@ -514,6 +966,17 @@ netsnmp_add_traphandler(Netsnmp_Trap_Handler* handler,
     return traph;
 }
 
+static void
+snmptrapd_free_handler_data(netsnmp_trapd_handler *traph)
+{
+#ifdef NETSNMP_TRAPHANDLE_WORKERS
+    if (traph->handler == command_handler && traph->handler_data) {
+        traphandle_pool_free(traph->handler_data);
+        traph->handler_data = NULL;
+    }
+#endif
+}
+
 void
 snmptrapd_free_traphandle(void)
 {
@@ -529,6 +992,7 @@ snmptrapd_free_traphandle(void)
     while (traph) {
        DEBUGMSG(("snmptrapd", "Freeing default trap handler\n"));
 	nexth = traph->nexth;
+	snmptrapd_free_handler_data(traph);
 	SNMP_FREE(traph->token);
 	SNMP_FREE(traph);
 	traph = nexth;
@@ -546,6 +1010,7 @@ snmptrapd_free_traphandle(void)
 	while (traph) {
 	    DEBUGMSG(("snmptrapd", "Freeing specific trap handler\n"));
 	    nexth = traph->nexth;
+	    snmptrapd_free_handler_data(traph);
 	    SNMP_FREE(traph->token);
 	    SNMP_FREE(traph->trapoid);
 	    SNMP_FREE(traph);
@@ -623,6 +1088,35 @@ netsnmp_get_traphandler( oid *trapOid, int trapOidLen ) {
     return netsnmp_default_traphandlers;
 }
 
+/*
+ * The notification being dispatched, if it was prepared in advance by
+ * netsnmp_trapd_prepare().
+ */
+static netsnmp_trapd_prepared *trapd_prepared;
+
+/*
+ * Logs the output that was formatted in advance for handler, if any.
+ * Returns 1 and sets *ret to the handler result if there was one.
+ */
+static int
+trapd_prepared_output(netsnmp_trapd_handler *handler, int *ret)
+{
+    netsnmp_trapd_output *out;
+
+    if (!trapd_prepared)
+        return 0;
+    for (out = trapd_prepared->outputs; out; out = out->next) {
+        if (out->traph == handler) {
+            if (out->text)
+                snmp_log(out->priority, "%s%s", out->text,
+                         (out->truncated ? " [TRUNCATED]\n" : ""));
+            *ret = out->status;
+            return 1;
+        }
+    }
+    return 0;
+}
+
 /*-----------------------------
  *
  * Standard traphandlers for the common requirements
@@ -634,18 +1128,21 @@ netsnmp_get_traphandler( oid *trapOid, int trapOidLen ) {
 #define SYSLOG_V23_NOTIFICATION_FORMAT "%B [%b]: Trap %#v\n"	 	   /* XXX - introduces a leading " ," */
 
 /*
- *  Trap handler for logging via syslog
+ *  Format a trap for syslog_handler.  Sets *rbuf to NULL if the trap is
+ *  not to be logged.
  */
-int   syslog_handler(  netsnmp_pdu           *pdu,
-                       netsnmp_transport     *transport,
-                       netsnmp_trapd_handler *handler)
+static int
+format_syslog_trap(netsnmp_pdu           *pdu,
+                   netsnmp_transport     *transport,
+                   netsnmp_trapd_handler *handler,
+                   u_char **rbufp, int *truncp)
 {
     u_char         *rbuf = NULL;
     size_t          r_len = 64, o_len = 0;
     int             trunc = 0;
 
-    DEBUGMSGTL(( "snmptrapd", "syslog_handler\n"));
-
+    *rbufp = NULL;
+    *truncp = 0;
     if (SyslogTrap)
         return NETSNMPTRAPD_HANDLER_OK;
 
@@ -707,26 +1204,52 @@ int   syslog_handler(  netsnmp_pdu           *pdu,
 	    }
         }
     }
-    snmp_log(LOG_WARNING, "%s%s", rbuf, (trunc?" [TRUNCATED]\n":""));
-    free(rbuf);
+    *rbufp = rbuf;
+    *truncp = trunc;
     return NETSNMPTRAPD_HANDLER_OK;
 }
 
+/*
+ *  Trap handler for logging via syslog
+ */
+int   syslog_handler(  netsnmp_pdu           *pdu,
+                       netsnmp_transport     *transport,
+                       netsnmp_trapd_handler *handler)
+{
+    u_char         *rbuf = NULL;
+    int             trunc = 0, ret;
+
+    DEBUGMSGTL(( "snmptrapd", "syslog_handler\n"));
+
+    if (trapd_prepared_output(handler, &ret))
+        return ret;
+    ret = format_syslog_trap(pdu, transport, handler, &rbuf, &trunc);
+    if (rbuf) {
+        snmp_log(LOG_WARNING, "%s%s", rbuf, (trunc?" [TRUNCATED]\n":""));
+        free(rbuf);
+    }
+    return ret;
+}
+
 
 #define PRINT_V23_NOTIFICATION_FORMAT "%.4y-%.2m-%.2l %.2h:%.2j:%.2k %B [%b]:\n%v\n"
 
 /*
- *  Trap handler for logging to a file
+ *  Format a trap for print_handler.  Sets *rbuf to NULL if the trap is
+ *  not to be logged.
  */
-int   print_handler(   netsnmp_pdu           *pdu,
-                       netsnmp_transport     *transport,
-                       netsnmp_trapd_handler *handler)
+static int
+format_print_trap(netsnmp_pdu           *pdu,
+                  netsnmp_transport     *transport,
+                  netsnmp_trapd_handler *handler,
+                  u_char **rbufp, int *truncp)
 {
     u_char         *rbuf = NULL;
     size_t          r_len = 64, o_len = 0;
     int             trunc = 0;
 
-    DEBUGMSGTL(( "snmptrapd", "print_handler\n"));
+    *rbufp = NULL;
+    *truncp = 0;
 
     /*
      *  Don't bother logging authentication failures
@@ -786,11 +1309,34 @@ int   print_handler(   netsnmp_pdu           *pdu,
 	    }
         }
     }
-    snmp_log(LOG_INFO, "%s%s", rbuf, (trunc?" [TRUNCATED]\n":""));
-    free(rbuf);
+    *rbufp = rbuf;
+    *truncp = trunc;
     return NETSNMPTRAPD_HANDLER_OK;
 }
 
+/*
+ *  Trap handler for logging to a file
+ */
+int   print_handler(   netsnmp_pdu           *pdu,
+                       netsnmp_transport     *transport,
+                       netsnmp_trapd_handler *handler)
+{
+    u_char         *rbuf = NULL;
+    int             trunc = 0, ret;
+
+    DEBUGMSGTL(( "snmptrapd", "print_handler\n"));
+
+    if (trapd_prepared_output(handler, &ret))
+        return ret;
+    ret = format_print_trap(pdu, transport, handler, &rbuf, &trunc);
+    if (rbuf) {
+        snmp_log(LOG_INFO, "%s%s", rbuf, (trunc?" [TRUNCATED]\n":""));
+        free(rbuf);
+    }
+    return ret;
+}
+
+
 
 #define EXECUTE_FORMAT	"%B\n%b\n%V\n%v\n"
 
@@ -861,6 +1407,11 @@ int   command_handler( netsnmp_pdu           *pdu,
         /*
          *  and pass this formatted string to the command specified
          */
+#ifdef NETSNMP_TRAPHANDLE_WORKERS
+        if (handler->handler_data)
+            traphandle_pool_send(handler->handler_data, rbuf, o_len);
+        else
+#endif
         run_shell_command(handler->token, (char*)rbuf, NULL, NULL);   /* Not interested in output */
         netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, 
                                NETSNMP_DS_LIB_QUICK_PRINT, oldquick);
@@ -1079,152 +1630,257 @@ int   notification_handler(netsnmp_pdu           *pdu,
 
 
 
-int
-snmp_input(int op, netsnmp_session *session,
-           int reqid, netsnmp_pdu *pdu, void *magic)
+/*
+ * Determine the OID that identifies the trap being handled.
+ * Returns 0 on success, -1 if the PDU carries no trap OID.
+ */
+static int
+trapd_get_trapoid(netsnmp_pdu *pdu, oid *trapOid, int *trapOidLen)
 {
     oid stdTrapOidRoot[] = { 1, 3, 6, 1, 6, 3, 1, 1, 5 };
     oid snmpTrapOid[]    = { 1, 3, 6, 1, 6, 3, 1, 1, 4, 1, 0 };
-    oid trapOid[MAX_OID_LEN+2] = {0};
-    int trapOidLen;
     netsnmp_variable_list *vars;
-    netsnmp_trapd_handler *traph;
-    netsnmp_transport *transport = (netsnmp_transport *) magic;
-    int ret, idx;
 
-    switch (op) {
-    case NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE:
+    DEBUGMSGTL(("snmptrapd", "input: %x\n", pdu->command));
+    switch (pdu->command) {
+    case SNMP_MSG_TRAP:
         /*
-         * Drops packets with reception problems
+         * Convert v1 traps into a v2-style trap OID
+         *    (following RFC 2576)
          */
-        if (session->s_snmp_errno) {
-            /* drop problem packets */
-            return 1;
+        if (pdu->trap_type == SNMP_TRAP_ENTERPRISESPECIFIC) {
+            *trapOidLen = pdu->enterprise_length;
+            memcpy(trapOid, pdu->enterprise, sizeof(oid) * *trapOidLen);
+            if (trapOid[*trapOidLen - 1] != 0) {
+                trapOid[(*trapOidLen)++] = 0;
+            }
+            trapOid[(*trapOidLen)++] = pdu->specific_type;
+        } else {
+            memcpy(trapOid, stdTrapOidRoot, sizeof(stdTrapOidRoot));
+            *trapOidLen = OID_LENGTH(stdTrapOidRoot);  /* 9 */
+            trapOid[(*trapOidLen)++] = pdu->trap_type+1;
         }
+        break;
 
+    case SNMP_MSG_TRAP2:
+    case SNMP_MSG_INFORM:
         /*
-	 * Determine the OID that identifies the trap being handled
-	 */
-        DEBUGMSGTL(("snmptrapd", "input: %x\n", pdu->command));
-        switch (pdu->command) {
-        case SNMP_MSG_TRAP:
+         * v2c/v3 notifications *should* have snmpTrapOID as the
+         *    second varbind, so we can go straight there.
+         *    But check, just to make sure
+         */
+        vars = pdu->variables;
+        if (vars)
+            vars = vars->next_variable;
+        if (!vars || snmp_oid_compare(vars->name, vars->name_length,
+                                      snmpTrapOid, OID_LENGTH(snmpTrapOid))) {
             /*
-	     * Convert v1 traps into a v2-style trap OID
-	     *    (following RFC 2576)
-	     */
-            if (pdu->trap_type == SNMP_TRAP_ENTERPRISESPECIFIC) {
-                trapOidLen = pdu->enterprise_length;
-                memcpy(trapOid, pdu->enterprise, sizeof(oid) * trapOidLen);
-                if (trapOid[trapOidLen - 1] != 0) {
-                    trapOid[trapOidLen++] = 0;
-                }
-                trapOid[trapOidLen++] = pdu->specific_type;
-            } else {
-                memcpy(trapOid, stdTrapOidRoot, sizeof(stdTrapOidRoot));
-                trapOidLen = OID_LENGTH(stdTrapOidRoot);  /* 9 */
-                trapOid[trapOidLen++] = pdu->trap_type+1;
+             * Didn't find it!
+             * Let's look through the full list....
+             */
+            for ( vars = pdu->variables; vars; vars=vars->next_variable) {
+                if (!snmp_oid_compare(vars->name, vars->name_length,
+                                      snmpTrapOid, OID_LENGTH(snmpTrapOid)))
+                    break;
             }
-            break;
+            if (!vars) {
+                /*
+                 * Still can't find it!  Give up.
+                 */
+                snmp_log(LOG_ERR, "Cannot find TrapOID in TRAP2 PDU\n");
+                return -1;		/* ??? */
+            }
+        }
+        memcpy(trapOid, vars->val.objid, vars->val_len);
+        *trapOidLen = vars->val_len /sizeof(oid);
+        break;
 
-        case SNMP_MSG_TRAP2:
-        case SNMP_MSG_INFORM:
-            /*
-	     * v2c/v3 notifications *should* have snmpTrapOID as the
-	     *    second varbind, so we can go straight there.
-	     *    But check, just to make sure
-	     */
-            vars = pdu->variables;
-            if (vars)
-                vars = vars->next_variable;
-            if (!vars || snmp_oid_compare(vars->name, vars->name_length,
-                                          snmpTrapOid, OID_LENGTH(snmpTrapOid))) {
-	        /*
-		 * Didn't find it!
-		 * Let's look through the full list....
-		 */
-		for ( vars = pdu->variables; vars; vars=vars->next_variable) {
-                    if (!snmp_oid_compare(vars->name, vars->name_length,
-                                          snmpTrapOid, OID_LENGTH(snmpTrapOid)))
-                        break;
-                }
-                if (!vars) {
-	            /*
-		     * Still can't find it!  Give up.
-		     */
-		    snmp_log(LOG_ERR, "Cannot find TrapOID in TRAP2 PDU\n");
-		    return 1;		/* ??? */
-		}
-	    }
-            memcpy(trapOid, vars->val.objid, vars->val_len);
-            trapOidLen = vars->val_len /sizeof(oid);
-            break;
+    default:
+        /* SHOULDN'T HAPPEN! */
+        return -1;	/* ??? */
+    }
+    DEBUGMSGTL(( "snmptrapd", "Trap OID: "));
+    DEBUGMSGOID(("snmptrapd", trapOid, *trapOidLen));
+    DEBUGMSG(( "snmptrapd", "\n"));
+    return 0;
+}
 
-        default:
-            /* SHOULDN'T HAPPEN! */
-            return 1;	/* ??? */
-	}
-        DEBUGMSGTL(( "snmptrapd", "Trap OID: "));
-        DEBUGMSGOID(("snmptrapd", trapOid, trapOidLen));
-        DEBUGMSG(( "snmptrapd", "\n"));
+/*
+ * Does the work of snmp_input() that depends only on the notification and
+ * the configuration: finds the trap OID, authorizes the notification,
+ * looks up the trap specific handlers and formats the output of the
+ * print and syslog handlers it will reach.  The receive pipeline's worker
+ * threads call this in parallel; netsnmp_trapd_dispatch() then runs the
+ * handlers in order.
+ *
+ * Returns 0 if prep is ready for netsnmp_trapd_dispatch(), -1 if the
+ * notification is to be dropped.
+ */
+int
+netsnmp_trapd_prepare(netsnmp_pdu *pdu, netsnmp_transport *transport,
+                      netsnmp_trapd_prepared *prep)
+{
+    netsnmp_trapd_handler *traph;
+    netsnmp_trapd_output *out, **tail;
+    int idx;
+
+    memset(prep, 0, sizeof(*prep));
+    if (trapd_get_trapoid(pdu, prep->trapOid, &prep->trapOidLen) < 0)
+        return -1;
+    prep->prepared = 1;
+    prep->authmask = netsnmp_trapd_authorize(pdu);
+    if (!prep->authmask)
+        return 0;       /* dropped by the authorization handler */
+    prep->specific = netsnmp_get_traphandler(prep->trapOid,
+                                             prep->trapOidLen);
+
+    tail = &prep->outputs;
+    for( idx = 0; handlers[idx].descr; ++idx ) {
+        traph = handlers[idx].handler ? *handlers[idx].handler :
+            prep->specific;
+        for( ; traph; traph = traph->nexth) {
+            if (traph->handler != print_handler &&
+                traph->handler != syslog_handler)
+                continue;
+            if ((traph->authtypes & prep->authmask) != traph->authtypes)
+                continue;
+            out = SNMP_MALLOC_TYPEDEF(netsnmp_trapd_output);
+            if (!out)
+                break;
+            out->traph = traph;
+            if (traph->handler == print_handler) {
+                out->priority = LOG_INFO;
+                out->status = format_print_trap(pdu, transport, traph,
+                                                &out->text, &out->truncated);
+            } else {
+                out->priority = LOG_WARNING;
+                out->status = format_syslog_trap(pdu, transport, traph,
+                                                 &out->text, &out->truncated);
+            }
+            *tail = out;
+            tail = &out->next;
+        }
+    }
+    return 0;
+}
 
+void
+netsnmp_trapd_prepared_free(netsnmp_trapd_prepared *prep)
+{
+    netsnmp_trapd_output *out;
 
-        /*
-	 *  OK - We've found the Trap OID used to identify this trap.
-         *  Call each of the various lists of handlers:
-         *     a) authentication-related handlers,
-         *     b) other handlers to be applied to all traps
-         *		(*before* trap-specific handlers)
-         *     c) the handler(s) specific to this trap
-t        *     d) any other global handlers
-         *
-	 *  In each case, a particular trap handler can abort further
-         *     processing - either just for that particular list,
-         *     or for the trap completely.
-         *
-	 *  This is particularly designed for authentication-related
-	 *     handlers, but can also be used elsewhere.
-         *
-         *  OK - Enough waffling, let's get to work.....
-	 */
+    while ((out = prep->outputs) != NULL) {
+        prep->outputs = out->next;
+        free(out->text);
+        free(out);
+    }
+}
 
-        for( idx = 0; handlers[idx].descr; ++idx ) {
-            DEBUGMSGTL(("snmptrapd", "Running %s handlers\n",
-                        handlers[idx].descr));
-            if (NULL == handlers[idx].handler) /* specific */
-                traph = netsnmp_get_traphandler(trapOid, trapOidLen);
-            else
-                traph = *handlers[idx].handler;
+/*
+ * Runs the handlers for a notification whose trap OID is in prep, and
+ * answers it if it is an INFORM.  Returns 1 if a handler stopped the
+ * processing, 0 otherwise.
+ */
+int
+netsnmp_trapd_dispatch(netsnmp_session *session, netsnmp_pdu *pdu,
+                       netsnmp_transport *transport,
+                       netsnmp_trapd_prepared *prep)
+{
+    netsnmp_trapd_handler *traph;
+    int ret, idx, finished = 0;
 
-            for( ; traph; traph = traph->nexth) {
-                if (!netsnmp_trapd_check_auth(traph->authtypes))
-                    continue; /* we continue on and skip this one */
+    if (prep->prepared) {
+        trapd_prepared = prep;
+        netsnmp_trapd_auth_preset(prep->authmask);
+    }
 
-                ret = (*(traph->handler))(pdu, transport, traph);
-                if(NETSNMPTRAPD_HANDLER_FINISH == ret)
-                    return 1;
-                if (ret == NETSNMPTRAPD_HANDLER_BREAK)
-                    break; /* move on to next type */
-            } /* traph */
-        } /* handlers */
+    /*
+     *  OK - We've found the Trap OID used to identify this trap.
+     *  Call each of the various lists of handlers:
+     *     a) authentication-related handlers,
+     *     b) other handlers to be applied to all traps
+     *		(*before* trap-specific handlers)
+     *     c) the handler(s) specific to this trap
+     *     d) any other global handlers
+     *
+     *  In each case, a particular trap handler can abort further
+     *     processing - either just for that particular list,
+     *     or for the trap completely.
+     *
+     *  This is particularly designed for authentication-related
+     *     handlers, but can also be used elsewhere.
+     *
+     *  OK - Enough waffling, let's get to work.....
+     */
 
+    for( idx = 0; handlers[idx].descr && !finished; ++idx ) {
+        DEBUGMSGTL(("snmptrapd", "Running %s handlers\n",
+                    handlers[idx].descr));
+        if (NULL != handlers[idx].handler)
+            traph = *handlers[idx].handler;
+        else if (prep->prepared)
+            traph = prep->specific;
+        else /* specific */
+            traph = netsnmp_get_traphandler(prep->trapOid, prep->trapOidLen);
+
+        for( ; traph; traph = traph->nexth) {
+            if (!netsnmp_trapd_check_auth(traph->authtypes))
+                continue; /* we continue on and skip this one */
+
+            ret = (*(traph->handler))(pdu, transport, traph);
+            if(NETSNMPTRAPD_HANDLER_FINISH == ret) {
+                finished = 1;
+                break;
+            }
+            if (ret == NETSNMPTRAPD_HANDLER_BREAK)
+                break; /* move on to next type */
+        } /* traph */
+    } /* handlers */
+
+    trapd_prepared = NULL;
+    netsnmp_trapd_auth_preset(-1);
+    if (finished)
+        return 1;
+
+    if (pdu->command == SNMP_MSG_INFORM) {
+        netsnmp_pdu *reply = snmp_clone_pdu(pdu);
+        if (!reply) {
+            snmp_log(LOG_ERR, "couldn't clone PDU for INFORM response\n");
+        } else {
+            reply->command = SNMP_MSG_RESPONSE;
+            reply->errstat = 0;
+            reply->errindex = 0;
+            if (!snmp_send(session, reply)) {
+                snmp_sess_perror("snmptrapd: Couldn't respond to inform pdu",
+                                session);
+                snmp_free_pdu(reply);
+            }
+        }
+    }
+    return 0;
+}
 
-	if (pdu->command == SNMP_MSG_INFORM) {
-	    netsnmp_pdu *reply = snmp_clone_pdu(pdu);
-	    if (!reply) {
-		snmp_log(LOG_ERR, "couldn't clone PDU for INFORM response\n");
-	    } else {
-		reply->command = SNMP_MSG_RESPONSE;
-		reply->errstat = 0;
-		reply->errindex = 0;
-		if (!snmp_send(session, reply)) {
-		    snmp_sess_perror("snmptrapd: Couldn't respond to inform pdu",
-                                    session);
-		    snmp_free_pdu(reply);
-		}
-	    }
-	}
+int
+snmp_input(int op, netsnmp_session *session,
+           int reqid, netsnmp_pdu *pdu, void *magic)
+{
+    netsnmp_trapd_prepared prep;
+    netsnmp_transport *transport = (netsnmp_transport *) magic;
 
-        break;
+    switch (op) {
+    case NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE:
+        /*
+         * Drops packets with reception problems
+         */
+        if (session->s_snmp_errno) {
+            /* drop problem packets */
+            return 1;
+        }
+
+        memset(&prep, 0, sizeof(prep));
+        if (trapd_get_trapoid(pdu, prep.trapOid, &prep.trapOidLen) < 0)
+            return 1;
+        return netsnmp_trapd_dispatch(session, pdu, transport, &prep);
 
     case NETSNMP_CALLBACK_OP_TIMED_OUT:
         snmp_log(LOG_ERR, "Timeout: This shouldn't happen!\n");
@@ -61,9 +61,39 @@ netsnmp_trapd_handler *netsnmp_add_traphandler(Netsnmp_Trap_Handler* handler,
                         oid *trapOid, int trapOidLen);
 netsnmp_trapd_handler *netsnmp_get_traphandler(oid *trapOid, int trapOidLen);
 
+/*
+ * A notification prepared for netsnmp_trapd_dispatch() in advance,
+ * possibly by another thread (see netsnmp_trapd_prepare()).
+ */
+typedef struct netsnmp_trapd_output_s netsnmp_trapd_output;
+
+struct netsnmp_trapd_output_s {
+     netsnmp_trapd_handler *traph;	/* print or syslog handler */
+     int     status;			/* its result */
+     int     priority;			/* and what it logs */
+     u_char *text;
+     int     truncated;
+     netsnmp_trapd_output *next;
+};
+
+typedef struct netsnmp_trapd_prepared_s {
+     oid   trapOid[MAX_OID_LEN+2];
+     int   trapOidLen;
+     int   prepared;		/* the fields below are set */
+     int   authmask;		/* netsnmp_trapd_authorize() */
+     netsnmp_trapd_handler *specific;	/* netsnmp_get_traphandler() */
+     netsnmp_trapd_output  *outputs;
+} netsnmp_trapd_prepared;
+
 const char *trap_description(int trap);
 int snmp_input(int op, netsnmp_session *session,
            int reqid, netsnmp_pdu *pdu, void *magic);
+int netsnmp_trapd_prepare(netsnmp_pdu *pdu, netsnmp_transport *transport,
+                          netsnmp_trapd_prepared *prep);
+void netsnmp_trapd_prepared_free(netsnmp_trapd_prepared *prep);
+int netsnmp_trapd_dispatch(netsnmp_session *session, netsnmp_pdu *pdu,
+                           netsnmp_transport *transport,
+                           netsnmp_trapd_prepared *prep);
 
 void parse_format(const char *token, char *line);
 
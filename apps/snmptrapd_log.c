@@ -109,10 +109,9 @@ typedef struct {
     int             left_justify;       /* if true, left justify this field */
     int             alt_format; /* if true, display in alternate format */
     int             leading_zeroes;     /* if true, display with leading zeroes */
+    const char     *separator;  /* between variables, set by %V */
 } options_type;
 
-char            separator[32];
-
 /*
  * These symbols define the characters that the parser recognizes.
  * The rather odd choice of symbols comes from an attempt to avoid
@@ -454,6 +453,9 @@ realloc_handle_time_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
     time_t          time_val;   /* the time value to output */
     unsigned long   time_ul;    /* u_long time/timeticks */
     struct tm      *parsed_time;        /* parsed version of current time */
+#ifdef HAVE_LOCALTIME_R
+    struct tm       tm_buf;
+#endif
     char           *safe_bfr = NULL;
     char            fmt_cmd = options->cmd;     /* the format command to use */
 
@@ -513,11 +515,20 @@ realloc_handle_time_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
          * Handle other time fields.  
          */
 
+#ifdef HAVE_LOCALTIME_R
+        /* traps may be formatted by several threads at once */
+        if (options->alt_format) {
+            parsed_time = gmtime_r(&time_val, &tm_buf);
+        } else {
+            parsed_time = localtime_r(&time_val, &tm_buf);
+        }
+#else
         if (options->alt_format) {
             parsed_time = gmtime(&time_val);
         } else {
             parsed_time = localtime(&time_val);
         }
+#endif
 
         switch (fmt_cmd) {
 
@@ -628,7 +639,7 @@ realloc_handle_ip_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
     u_char         *temp_buf = NULL;
     size_t          temp_buf_len = 64, temp_out_len = 0;
     char           *tstr;
-    unsigned int    oflags;
+    netsnmp_transport fmt_transport;
 
     if ((temp_buf = calloc(temp_buf_len, 1)) == NULL) {
         return 0;
@@ -672,11 +683,14 @@ realloc_handle_ip_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
          * Write the numerical transport information.  
          */
         if (transport != NULL && transport->f_fmtaddr != NULL) {
-            oflags = transport->flags;
-            transport->flags &= ~NETSNMP_TRANSPORT_FLAG_HOSTNAME;
-            tstr = transport->f_fmtaddr(transport, pdu->transport_data,
+            /*
+             * Format with a copy of the transport, since other threads
+             * may be formatting addresses of the same transport.
+             */
+            fmt_transport = *transport;
+            fmt_transport.flags &= ~NETSNMP_TRANSPORT_FLAG_HOSTNAME;
+            tstr = transport->f_fmtaddr(&fmt_transport, pdu->transport_data,
                                         pdu->transport_data_length);
-            transport->flags = oflags;
           
             if (!tstr) goto noip;
             if (!snmp_strcat(&temp_buf, &temp_buf_len, &temp_out_len,
@@ -704,13 +718,15 @@ noip:
          * Otherwise falls back to the numeric address format.
          */
         if (transport != NULL && transport->f_fmtaddr != NULL) {
-            oflags = transport->flags;
+            fmt_transport = *transport;
             if (!netsnmp_ds_get_boolean(NETSNMP_DS_APPLICATION_ID, 
                                         NETSNMP_DS_APP_NUMERIC_IP))
-                transport->flags |= NETSNMP_TRANSPORT_FLAG_HOSTNAME;
-            tstr = transport->f_fmtaddr(transport, pdu->transport_data,
+                fmt_transport.flags |= NETSNMP_TRANSPORT_FLAG_HOSTNAME;
+            /* the lookup returns the resolver's static data */
+            snmp_res_lock(MT_APPLICATION_ID, MT_APP_TRAPD);
+            tstr = transport->f_fmtaddr(&fmt_transport, pdu->transport_data,
                                         pdu->transport_data_length);
-            transport->flags = oflags;
+            snmp_res_unlock(MT_APPLICATION_ID, MT_APP_TRAPD);
           
             if (!tstr) goto nohost;
             if (!snmp_strcat(&temp_buf, &temp_buf_len, &temp_out_len,
@@ -836,7 +852,7 @@ realloc_handle_trap_fmt(u_char ** buf, size_t * buf_len, size_t * out_len,
     char            fmt_cmd = options->cmd;     /* what we're outputting */
     u_char         *temp_buf = NULL;
     size_t          tbuf_len = 64, tout_len = 0;
-    const char           *sep = separator;
+    const char           *sep = options->separator;
     const char           *default_sep = "\t";
     const char           *default_alt_sep = ", ";
 
@@ -1335,6 +1351,9 @@ realloc_format_plain_trap(u_char ** buf, size_t * buf_len,
 {
     time_t          now;        /* the current time */
     struct tm      *now_parsed; /* time in struct format */
+#ifdef HAVE_LOCALTIME_R
+    struct tm       tm_buf;
+#endif
     char            safe_bfr[200];      /* holds other strings */
     struct in_addr *agent_inaddr = (struct in_addr *) pdu->agent_addr;
     char host[16];                      /* host name */
@@ -1350,7 +1369,11 @@ realloc_format_plain_trap(u_char ** buf, size_t * buf_len,
      * buffer of guaranteed length and then copy it to the output buffer.
      */
     time(&now);
+#ifdef HAVE_LOCALTIME_R
+    now_parsed = localtime_r(&now, &tm_buf);
+#else
     now_parsed = localtime(&now);
+#endif
     sprintf(safe_bfr, "%.4d-%.2d-%.2d %.2d:%.2d:%.2d ",
             now_parsed->tm_year + 1900, now_parsed->tm_mon + 1,
             now_parsed->tm_mday, now_parsed->tm_hour,
@@ -1573,6 +1596,7 @@ realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
 {
     unsigned long   fmt_idx = 0;        /* index into the format string */
     options_type    options;    /* formatting options */
+    char            separator[32];      /* %V, per trap for worker threads */
     parse_state_type state = PARSE_NORMAL;      /* state of the parser */
     char            next_chr;   /* for speed */
     int             reset_options = TRUE;       /* reset opts on next NORMAL state */
@@ -1582,6 +1606,7 @@ realloc_format_trap(u_char ** buf, size_t * buf_len, size_t * out_len,
     }
 
     memset(separator, 0, sizeof(separator));
+    options.separator = separator;
     /*
      * Go until we reach the end of the format string:  
      */
@@ -0,0 +1,556 @@
+/*
+ * snmptrapd_pipeline.c - receive and decode notifications in threads
+ *
+ * Use is subject to license terms specified in the COPYING file
+ * distributed with the Net-SNMP package.
+ */
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-features.h>
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#include <strings.h>
+#endif
+#include <errno.h>
+#include <sys/types.h>
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#endif
+
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/large_fd_set.h>
+#include <net-snmp/library/fd_event_manager.h>
+#include "snmptrapd_handlers.h"
+#include "snmptrapd_pipeline.h"
+
+/*
+ * With trapdWorkerThreads N, each UDP address snmptrapd listens on is
+ * read by a receiver thread of its own, and N worker threads decode the
+ * notifications (including USM authentication and decryption), authorize
+ * them and format what the print and syslog handlers will log.  The main
+ * loop then runs the handler chains in the order the notifications
+ * arrived, using the prepared results.
+ *
+ * Like the agent's worker threads, the workers hold pipeline_rwlock
+ * shared while they decode, and the main loop holds it exclusively
+ * except while it waits for events, so configuration, handlers and
+ * alarms never overlap with the workers.  MT_APP_TRAPD serialises the
+ * workers where they share state (VACM, the resolver).
+ *
+ * This needs a library built with --enable-reentrant; otherwise the
+ * setting is ignored.
+ */
+#if defined(NETSNMP_REENTRANT) && defined(HAVE_PTHREAD_H) && \
+    !defined(NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER)
+#define NETSNMP_TRAPD_PIPELINE
+#include <pthread.h>
+#include <signal.h>
+#endif
+
+#define PIPELINE_THREADS_MAX 64
+#define PIPELINE_QUEUE_MAX   4096   /* received, not yet delivered */
+#define PIPELINE_RECV_BURST  64     /* datagrams per wakeup */
+
+static int      pipeline_threads;   /* trapdWorkerThreads */
+
+#ifdef NETSNMP_TRAPD_PIPELINE
+/* transportDomainUdpIpv6, RFC 3419 */
+static const oid pipeline_udp6_domain[] = { 1, 3, 6, 1, 2, 1, 100, 1, 2 };
+
+struct pipeline_receiver {
+    netsnmp_session *session;
+    void           *sessp;
+    netsnmp_transport *transport;
+    int             stop_pipe[2];
+    int             running;
+    pthread_t       thread;
+    struct pipeline_receiver *next;
+};
+
+struct pipeline_item {
+    struct pipeline_receiver *rcv;
+    u_char         *packet;
+    int             length;
+    void           *opaque;
+    int             olength;
+    netsnmp_pdu    *pdu;            /* NULL: dropped */
+    netsnmp_trapd_prepared prep;
+    u_int           generation;     /* configuration prep was made with */
+    int             done;
+    struct pipeline_item *next;     /* in arrival order */
+    struct pipeline_item *next_work;
+};
+
+static struct pipeline_receiver *pipeline_receivers;
+static pthread_t *pipeline_workers;
+static int      pipeline_active;    /* worker threads running */
+static u_int    pipeline_generation;
+static pthread_mutex_t pipeline_gate = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t pipeline_rwlock = PTHREAD_RWLOCK_INITIALIZER;
+
+/*
+ * pipeline_lock protects the queue: every notification received is on
+ * the arrival list until the main loop has delivered it, and on the work
+ * list until a worker picks it up.
+ */
+static pthread_mutex_t pipeline_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pipeline_work_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pipeline_space_cond = PTHREAD_COND_INITIALIZER;
+static struct pipeline_item *pipeline_head, **pipeline_tail = &pipeline_head;
+static struct pipeline_item *pipeline_work, **pipeline_work_tail =
+    &pipeline_work;
+static int      pipeline_queued;
+static int      pipeline_stopping;  /* receivers: drop, exit */
+static int      pipeline_draining;  /* workers: finish the queue, exit */
+static int      pipeline_wake[2] = { -1, -1 };
+static int      pipeline_wake_pending;
+
+static void
+_pipeline_wrlock(void)
+{
+    pthread_mutex_lock(&pipeline_gate);
+    pthread_rwlock_wrlock(&pipeline_rwlock);
+    pthread_mutex_unlock(&pipeline_gate);
+}
+
+static void
+_pipeline_queue(struct pipeline_receiver *r, const u_char *packet,
+                int length, void *opaque, int olength)
+{
+    struct pipeline_item *item;
+
+    item = SNMP_MALLOC_TYPEDEF(struct pipeline_item);
+    if (item)
+        item->packet = netsnmp_memdup(packet, length);
+    if (item == NULL || item->packet == NULL) {
+        snmp_log(LOG_ERR, "snmptrapd: no memory for a notification\n");
+        free(item);
+        SNMP_FREE(opaque);
+        return;
+    }
+    item->rcv = r;
+    item->length = length;
+    item->opaque = opaque;
+    item->olength = olength;
+
+    pthread_mutex_lock(&pipeline_lock);
+    /* let the socket buffer absorb the burst rather than memory */
+    while (pipeline_queued >= PIPELINE_QUEUE_MAX && !pipeline_stopping)
+        pthread_cond_wait(&pipeline_space_cond, &pipeline_lock);
+    if (pipeline_stopping) {
+        pthread_mutex_unlock(&pipeline_lock);
+        SNMP_FREE(item->opaque);
+        free(item->packet);
+        free(item);
+        return;
+    }
+    *pipeline_tail = item;
+    pipeline_tail = &item->next;
+    *pipeline_work_tail = item;
+    pipeline_work_tail = &item->next_work;
+    pipeline_queued++;
+    pthread_cond_signal(&pipeline_work_cond);
+    pthread_mutex_unlock(&pipeline_lock);
+}
+
+static void *
+_pipeline_receive(void *arg)
+{
+    struct pipeline_receiver *r = (struct pipeline_receiver *) arg;
+    netsnmp_large_fd_set readfds;
+    u_char         *buf;
+    void           *opaque;
+    int             sock = r->transport->sock;
+    int             numfds, count, length, olength, i;
+
+    buf = (u_char *) malloc(SNMP_MAX_RCV_MSG_SIZE);
+    if (buf == NULL)
+        return NULL;
+    numfds = SNMP_MAX(sock, r->stop_pipe[0]) + 1;
+    netsnmp_large_fd_set_init(&readfds, numfds);
+    DEBUGMSGTL(("snmptrapd:pipeline", "receiver for fd %d started\n", sock));
+    for (;;) {
+        NETSNMP_LARGE_FD_ZERO(&readfds);
+        NETSNMP_LARGE_FD_SET(sock, &readfds);
+        NETSNMP_LARGE_FD_SET(r->stop_pipe[0], &readfds);
+        count = netsnmp_large_fd_set_select(numfds, &readfds, NULL, NULL,
+                                            NULL);
+        if (count < 0) {
+            if (errno == EINTR)
+                continue;
+            snmp_log_perror("snmptrapd receiver select");
+            break;
+        }
+        if (NETSNMP_LARGE_FD_ISSET(r->stop_pipe[0], &readfds))
+            break;
+
+        for (i = 0; i < PIPELINE_RECV_BURST; i++) {
+            opaque = NULL;
+            olength = 0;
+            length = netsnmp_transport_recv(r->transport, buf,
+                                            SNMP_MAX_RCV_MSG_SIZE,
+                                            &opaque, &olength);
+            if (length <= 0) {
+                SNMP_FREE(opaque);
+                break;
+            }
+            _pipeline_queue(r, buf, length, opaque, olength);
+        }
+    }
+    DEBUGMSGTL(("snmptrapd:pipeline", "receiver for fd %d stopped\n", sock));
+    netsnmp_large_fd_set_cleanup(&readfds);
+    free(buf);
+    return NULL;
+}
+
+/*
+ * Decode, authorize and format a notification; the caller holds
+ * pipeline_rwlock shared.
+ */
+static void
+_pipeline_prepare(struct pipeline_item *item)
+{
+    struct pipeline_receiver *r = item->rcv;
+
+    item->pdu = snmp_sess_parse_packet(r->sessp, item->opaque,
+                                       item->olength, item->packet,
+                                       item->length);
+    item->opaque = NULL;
+    SNMP_FREE(item->packet);
+    if (item->pdu == NULL)
+        return;
+    if (item->pdu->flags & UCD_MSG_FLAG_RESPONSE_PDU ||
+        netsnmp_trapd_prepare(item->pdu, r->transport, &item->prep) < 0) {
+        /* nothing the handlers would process */
+        netsnmp_trapd_prepared_free(&item->prep);
+        snmp_free_pdu(item->pdu);
+        item->pdu = NULL;
+        return;
+    }
+    item->generation = pipeline_generation;
+}
+
+static void *
+_pipeline_work_run(void *arg)
+{
+    struct pipeline_item *item;
+
+    pthread_mutex_lock(&pipeline_lock);
+    for (;;) {
+        while (pipeline_work == NULL && !pipeline_draining)
+            pthread_cond_wait(&pipeline_work_cond, &pipeline_lock);
+        item = pipeline_work;
+        if (item == NULL)
+            break;
+        pipeline_work = item->next_work;
+        if (pipeline_work == NULL)
+            pipeline_work_tail = &pipeline_work;
+        pthread_mutex_unlock(&pipeline_lock);
+
+        pthread_mutex_lock(&pipeline_gate);
+        pthread_rwlock_rdlock(&pipeline_rwlock);
+        pthread_mutex_unlock(&pipeline_gate);
+        _pipeline_prepare(item);
+        pthread_rwlock_unlock(&pipeline_rwlock);
+
+        pthread_mutex_lock(&pipeline_lock);
+        item->done = 1;
+        /* delivery waits for the oldest notification */
+        if (item == pipeline_head && !pipeline_wake_pending) {
+            pipeline_wake_pending = 1;
+            if (write(pipeline_wake[1], "", 1) != 1)
+                snmp_log_perror("snmptrapd pipeline wakeup");
+        }
+    }
+    pthread_mutex_unlock(&pipeline_lock);
+    return NULL;
+}
+
+/*
+ * Run the handlers for the notifications that have been prepared, in the
+ * order they arrived.  Called by the main loop, holding the pipeline.
+ */
+static void
+_pipeline_deliver(void)
+{
+    struct pipeline_item *ready, **tail = &ready, *item;
+    struct pipeline_receiver *r;
+    int             n = 0;
+
+    pthread_mutex_lock(&pipeline_lock);
+    pipeline_wake_pending = 0;
+    while (pipeline_head && pipeline_head->done) {
+        *tail = pipeline_head;
+        tail = &pipeline_head->next;
+        pipeline_head = pipeline_head->next;
+        n++;
+    }
+    *tail = NULL;
+    if (pipeline_head == NULL)
+        pipeline_tail = &pipeline_head;
+    pipeline_queued -= n;
+    if (n)
+        pthread_cond_broadcast(&pipeline_space_cond);
+    pthread_mutex_unlock(&pipeline_lock);
+
+    while ((item = ready) != NULL) {
+        ready = item->next;
+        r = item->rcv;
+        if (item->pdu) {
+            if (item->generation != pipeline_generation) {
+                /* prepared with handlers that have been re-read since */
+                netsnmp_trapd_prepared_free(&item->prep);
+                item->prep.prepared = 0;
+            }
+            netsnmp_trapd_dispatch(r->session, item->pdu, r->transport,
+                                   &item->prep);
+            netsnmp_trapd_prepared_free(&item->prep);
+            snmp_free_pdu(item->pdu);
+        }
+        free(item);
+    }
+}
+
+static void
+_pipeline_wakeup(int fd, void *data)
+{
+    char            buf[16];
+
+    if (read(fd, buf, sizeof(buf)) < 0 && errno != EINTR && errno != EAGAIN)
+        snmp_log_perror("snmptrapd pipeline wakeup");
+    _pipeline_deliver();
+}
+
+/*
+ * Start the threads.  The main loop keeps the pipeline locked from now on
+ * except while waiting for events.
+ */
+static void
+_pipeline_start(void)
+{
+    struct pipeline_receiver *r;
+    sigset_t        set, oset;
+    int             i;
+
+    if (pipeline_threads <= 0 || pipeline_receivers == NULL)
+        return;
+    if (pipe(pipeline_wake) != 0) {
+        snmp_log_perror("snmptrapd pipeline");
+        return;
+    }
+    pipeline_workers = (pthread_t *) calloc(pipeline_threads,
+                                            sizeof(pthread_t));
+    if (pipeline_workers == NULL ||
+        register_readfd(pipeline_wake[0], _pipeline_wakeup, NULL) != 0) {
+        SNMP_FREE(pipeline_workers);
+        close(pipeline_wake[0]);
+        close(pipeline_wake[1]);
+        pipeline_wake[0] = pipeline_wake[1] = -1;
+        return;
+    }
+    /*
+     * The receivers read the sockets themselves, so the datagrams they
+     * queue must not be held back in a batch of the transport.
+     */
+    netsnmp_ds_set_int(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_SERVER_UDP_BATCH,
+                       1);
+
+    _pipeline_wrlock();
+
+    /* signals are for the main loop */
+    sigfillset(&set);
+    pthread_sigmask(SIG_SETMASK, &set, &oset);
+    for (i = 0; i < pipeline_threads; i++) {
+        if (pthread_create(&pipeline_workers[pipeline_active], NULL,
+                           _pipeline_work_run, NULL) != 0) {
+            snmp_log(LOG_ERR, "snmptrapd: cannot start worker thread\n");
+            break;
+        }
+        pipeline_active++;
+    }
+    for (r = pipeline_receivers; r && pipeline_active; r = r->next) {
+        if (pipe(r->stop_pipe) != 0)
+            continue;
+        r->session->flags |= SNMP_FLAGS_OWN_THREAD;
+        if (pthread_create(&r->thread, NULL, _pipeline_receive, r) != 0) {
+            snmp_log(LOG_ERR, "snmptrapd: cannot start receiver thread\n");
+            r->session->flags &= ~SNMP_FLAGS_OWN_THREAD;
+            close(r->stop_pipe[0]);
+            close(r->stop_pipe[1]);
+            continue;
+        }
+        r->running = 1;
+    }
+    pthread_sigmask(SIG_SETMASK, &oset, NULL);
+
+    snmp_log(LOG_INFO, "Processing notifications with %d worker threads\n",
+             pipeline_active);
+    if (pipeline_active == 0)
+        pthread_rwlock_unlock(&pipeline_rwlock);
+}
+#endif /* NETSNMP_TRAPD_PIPELINE */
+
+static void
+_parse_worker_threads(const char *token, char *cptr)
+{
+    int             n = atoi(cptr);
+
+    if (n < 0 || n > PIPELINE_THREADS_MAX) {
+        config_perror("trapdWorkerThreads must be between 0 and 64");
+        return;
+    }
+    pipeline_threads = n;
+}
+
+void
+snmptrapd_register_pipeline_configs(void)
+{
+    register_config_handler("snmptrapd", "trapdWorkerThreads",
+                            _parse_worker_threads, NULL, "integer");
+}
+
+/*
+ * Have the notifications arriving on a session received and decoded by
+ * the pipeline, if it runs.  Only UDP sessions qualify; the others stay
+ * with the main loop.
+ */
+void
+snmptrapd_pipeline_add_session(netsnmp_session *session)
+{
+#ifdef NETSNMP_TRAPD_PIPELINE
+    struct pipeline_receiver *r, **tail;
+    netsnmp_transport *t;
+    void           *sessp = snmp_sess_pointer(session);
+
+    t = sessp ? snmp_sess_transport(sessp) : NULL;
+    if (t == NULL || t->sock < 0 ||
+        (t->flags & (NETSNMP_TRANSPORT_FLAG_STREAM |
+                     NETSNMP_TRANSPORT_FLAG_LISTEN)))
+        return;
+    if (netsnmp_oid_equals(t->domain, t->domain_length, netsnmpUDPDomain,
+                           netsnmpUDPDomain_len) != 0 &&
+        netsnmp_oid_equals(t->domain, t->domain_length, pipeline_udp6_domain,
+                           OID_LENGTH(pipeline_udp6_domain)) != 0)
+        return;
+
+    r = SNMP_MALLOC_TYPEDEF(struct pipeline_receiver);
+    if (r == NULL)
+        return;
+    r->session = session;
+    r->sessp = sessp;
+    r->transport = t;
+    for (tail = &pipeline_receivers; *tail; tail = &(*tail)->next)
+        ;
+    *tail = r;
+#endif /* NETSNMP_TRAPD_PIPELINE */
+}
+
+/**
+ * Starts the threads, if trapdWorkerThreads asks for them.  Called once
+ * the daemon has forked, since threads would not survive the fork(), and
+ * before the main loop first looks for events.
+ */
+void
+snmptrapd_pipeline_start(void)
+{
+#ifdef NETSNMP_TRAPD_PIPELINE
+    _pipeline_start();
+#endif
+}
+
+/**
+ * Releases the pipeline while the main loop waits for events, so that the
+ * workers can decode notifications.
+ */
+void
+snmptrapd_pipeline_release(void)
+{
+#ifdef NETSNMP_TRAPD_PIPELINE
+    if (pipeline_active)
+        pthread_rwlock_unlock(&pipeline_rwlock);
+#endif
+}
+
+/**
+ * Takes the pipeline back once the main loop has events to process.
+ */
+void
+snmptrapd_pipeline_acquire(void)
+{
+#ifdef NETSNMP_TRAPD_PIPELINE
+    if (pipeline_active)
+        _pipeline_wrlock();
+#endif
+}
+
+/**
+ * The configuration has been re-read: notifications prepared before are
+ * processed afresh when they are delivered.
+ */
+void
+snmptrapd_pipeline_reconfigured(void)
+{
+#ifdef NETSNMP_TRAPD_PIPELINE
+    pipeline_generation++;
+#endif
+}
+
+/**
+ * Stops the threads, delivering the notifications received so far.
+ * Called by the main loop, holding the pipeline, before the sessions are
+ * closed.
+ */
+void
+snmptrapd_pipeline_shutdown(void)
+{
+#ifdef NETSNMP_TRAPD_PIPELINE
+    struct pipeline_receiver *r;
+    int             i;
+
+    if (pipeline_active) {
+        pthread_mutex_lock(&pipeline_lock);
+        pipeline_stopping = 1;
+        pthread_cond_broadcast(&pipeline_space_cond);
+        pthread_mutex_unlock(&pipeline_lock);
+        for (r = pipeline_receivers; r; r = r->next) {
+            if (!r->running)
+                continue;
+            if (write(r->stop_pipe[1], "", 1) != 1)
+                snmp_log_perror("snmptrapd receiver stop");
+            pthread_join(r->thread, NULL);
+            r->running = 0;
+            close(r->stop_pipe[0]);
+            close(r->stop_pipe[1]);
+            r->session->flags &= ~SNMP_FLAGS_OWN_THREAD;
+        }
+
+        pthread_mutex_lock(&pipeline_lock);
+        pipeline_draining = 1;
+        pthread_cond_broadcast(&pipeline_work_cond);
+        pthread_mutex_unlock(&pipeline_lock);
+        pthread_rwlock_unlock(&pipeline_rwlock);
+        for (i = 0; i < pipeline_active; i++)
+            pthread_join(pipeline_workers[i], NULL);
+        pipeline_active = 0;
+        _pipeline_deliver();
+    }
+    if (pipeline_wake[0] >= 0) {
+        unregister_readfd(pipeline_wake[0]);
+        close(pipeline_wake[0]);
+        close(pipeline_wake[1]);
+        pipeline_wake[0] = pipeline_wake[1] = -1;
+    }
+    SNMP_FREE(pipeline_workers);
+    while ((r = pipeline_receivers) != NULL) {
+        pipeline_receivers = r->next;
+        free(r);
+    }
+#endif /* NETSNMP_TRAPD_PIPELINE */
+}
@@ -0,0 +1,12 @@
+#ifndef SNMPTRAPD_PIPELINE_H
+#define SNMPTRAPD_PIPELINE_H
+
+void snmptrapd_register_pipeline_configs(void);
+void snmptrapd_pipeline_add_session(netsnmp_session *session);
+void snmptrapd_pipeline_start(void);
+void snmptrapd_pipeline_release(void);
+void snmptrapd_pipeline_acquire(void);
+void snmptrapd_pipeline_reconfigured(void);
+void snmptrapd_pipeline_shutdown(void);
+
+#endif /* SNMPTRAPD_PIPELINE_H */
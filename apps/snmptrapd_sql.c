@@ -7,17 +7,18 @@
  * distributed with the Net-SNMP package.
  *
  * This file implements a handler for snmptrapd which will cache incoming
- * traps and then write them to a MySQL database.
+ * traps and then write them to a MySQL or SQLite database.
  *
  */
 #include <net-snmp/net-snmp-config.h>
 #include <net-snmp/net-snmp-features.h>
 
-#ifdef NETSNMP_USE_MYSQL
+#if defined(NETSNMP_USE_MYSQL) || defined(NETSNMP_USE_SQLITE)
 
 /*
  * SQL includes
  */
+#ifdef NETSNMP_USE_MYSQL
 #undef PACKAGE_BUGREPORT
 #undef PACKAGE_NAME
 #undef PACKAGE_STRING
@@ -33,6 +34,10 @@
 #endif
 #include <mysql.h>
 #include <errmsg.h>
+#endif /* NETSNMP_USE_MYSQL */
+#ifdef NETSNMP_USE_SQLITE
+#include <sqlite3.h>
+#endif
 
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
@@ -47,6 +52,7 @@
 #include <strings.h>
 #endif
 #include <ctype.h>
+#include <errno.h>
 #include <sys/types.h>
 #ifdef HAVE_NETINET_IN_H
 #include <netinet/in.h>
@@ -62,89 +68,32 @@
 #include "snmptrapd_log.h"
 #include "snmptrapd_sql.h"
 
-netsnmp_feature_require(container_fifo);
-
 /*
- * define a structure to hold all the file globals
+ * In reentrant builds a writer thread does the database work, so that a
+ * slow database does not hold up trap reception.  Otherwise the queue is
+ * written from the main loop, as it always was.
  */
-typedef struct netsnmp_sql_globals_t {
-    char        *host_name;       /* server host (def=localhost) */
-    char        *user_name;       /* username (def=login name) */
-    char        *password;        /* password (def=none) */
-    u_int        port_num;        /* port number (built-in value) */
-    char        *socket_name;     /* socket name (built-in value) */
-    const char  *db_name;         /* database name (def=none) */
-    u_int        flags;           /* connection flags (none) */
-    MYSQL       *conn;            /* connection */
-    u_char       connected;       /* connected flag */
-    const char  *groups[3];
-    MYSQL_STMT  *trap_stmt, *vb_stmt; /* prepared statements */
-    u_int        alarm_id;        /* id of periodic save alarm */
-    netsnmp_container *queue;     /* container; traps pending database write */
-    u_int        queue_max;       /* auto save queue when it gets this big */
-    int          queue_interval;  /* auto save every N seconds */
-} netsnmp_sql_globals;
-
-static netsnmp_sql_globals _sql = {
-    NULL,                  /* host */
-    NULL,                  /* username */
-    NULL,                  /* password */
-    0,                     /* port */
-    NULL,                  /* socket */
-    "net_snmp",            /* database */
-    0,                     /* conn flags */
-    NULL,                  /* connection */
-    0,                     /* connected */
-    { "client", "snmptrapd", NULL },  /* groups to read from .my.cnf */
-    NULL,                  /* trap_stmt */
-    NULL,                  /* vb_stmt */
-    0,                     /* alarm_id */
-    NULL,                  /* queue */
-    1,                     /* queue_max */
-    -1                     /* queue_interval */
-};
+#if defined(NETSNMP_REENTRANT) && defined(HAVE_PTHREAD_H)
+#define NETSNMP_SQL_WRITER_THREAD
+#include <pthread.h>
+#include <signal.h>
+#endif
 
-/*
- * log traps as text, or binary blobs?
- */
-#define NETSNMP_MYSQL_TRAP_VALUE_TEXT 1
+netsnmp_feature_require(container_fifo);
 
-/*
- * We will be using prepared statements for performance reasons. This
- * requires a sql bind structure for each cell to be inserted in the
- * database. We will be using 2 global static structures to bind to,
- * and a netsnmp container to store the necessary data until it is
- * written to the database. Fixed size buffers are also used to
- * simplify memory management.
- */
-/** enums for the trap fields to be bound */
-enum{
-    TBIND_DATE = 0,           /* time received */
-    TBIND_HOST,               /* src ip */
-    TBIND_USER,               /* auth/user information */
-    TBIND_TYPE,               /* pdu type */
-    TBIND_VER,                /* snmp version */
-    TBIND_REQID,              /* request id */
-    TBIND_OID,                /* trap OID */
-    TBIND_TRANSPORT,          /* transport */
-    TBIND_SECURITY_MODEL,     /* security model */
-    TBIND_v3_MSGID,           /* v3 msg id */
-    TBIND_v3_SECURITY_LEVEL,  /* security level */
-    TBIND_v3_CONTEXT_NAME,    /* context */
-    TBIND_v3_CONTEXT_ENGINE,  /* context engine id */
-    TBIND_v3_SECURITY_NAME,   /* security name */
-    TBIND_v3_SECURITY_ENGINE, /* security engine id */
-    TBIND_MAX
-};
+#define SQL_QUEUE_MAX_DEFAULT    100   /* traps per flush without a thread */
+#define SQL_FLUSH_DELAY_MS       100   /* ... or this long after the first */
+#define SQL_QUEUE_LIMIT_DEFAULT  10000 /* traps held in memory */
+#define SQL_BATCH_START          32    /* initial traps per transaction */
+#define SQL_BATCH_MAX_DEFAULT    1000
+#define SQL_FLUSH_TARGET_DEFAULT 500   /* ms per transaction */
+#define SQL_VB_QUERY_MAX         (256 * 1024) /* bytes per varbind INSERT */
 
-/** enums for the varbind fields to be bound */
-enum {
-    VBIND_ID = 0,             /* trap_id */
-    VBIND_OID,                /* varbind oid */
-    VBIND_TYPE,               /* varbind type */
-    VBIND_VAL,                /* varbind value */
-    VBIND_MAX
-};
+/** a broken down time stamp, as stored in the database */
+typedef struct sql_time_t {
+    u_int      year, month, day;
+    u_int      hour, minute, second;
+} sql_time;
 
 /** buffer struct for varbind data */
 typedef struct sql_vb_buf_t {
@@ -161,6 +110,8 @@ typedef struct sql_vb_buf_t {
 
 /** buffer struct for trap data */
 typedef struct sql_buf_t {
+    struct sql_buf_t *next;     /* queue link */
+
     char      *host;
     u_long     host_len;
 
@@ -170,7 +121,7 @@ typedef struct sql_buf_t {
     char      *user;
     u_long     user_len;
 
-    MYSQL_TIME time;
+    sql_time   time;
     uint16_t   version, type;
     uint32_t   reqid;
 
@@ -198,12 +149,148 @@ typedef struct sql_buf_t {
 } sql_buf;
 
 /*
- * static bind structures, plus 2 static buffers to bind to.
+ * A database backend.  write() stores a batch of traps in one
+ * transaction and returns 0, or rolls back and returns -1.  A backend
+ * that loses its connection clears _sql.connected, and the traps are
+ * then kept (spooled) for a later attempt.
  */
-static MYSQL_BIND _tbind[TBIND_MAX], _vbind[VBIND_MAX];
-static char       _no_v3;
+typedef struct netsnmp_sql_backend_t {
+    const char  *name;
+    int        (*init)(void);
+    int        (*connect)(void);
+    void       (*disconnect)(void);
+    int        (*write)(sql_buf **traps, int count);
+    void       (*cleanup)(void);
+    void       (*thread_init)(void);
+    void       (*thread_end)(void);
+} netsnmp_sql_backend;
+
+/*
+ * define a structure to hold all the file globals
+ */
+typedef struct netsnmp_sql_globals_t {
+#ifdef NETSNMP_USE_MYSQL
+    char        *host_name;       /* server host (def=localhost) */
+    char        *user_name;       /* username (def=login name) */
+    char        *password;        /* password (def=none) */
+    u_int        port_num;        /* port number (built-in value) */
+    char        *socket_name;     /* socket name (built-in value) */
+    const char  *db_name;         /* database name (def=none) */
+    u_int        flags;           /* connection flags (none) */
+    MYSQL       *conn;            /* connection */
+    const char  *groups[3];
+    MYSQL_STMT  *trap_stmt;       /* prepared statement */
+    char        *vb_query;        /* multi-row varbind INSERT */
+    size_t       vb_query_len, vb_query_size;
+#endif
+#ifdef NETSNMP_USE_SQLITE
+    char        *sqlite_file;     /* database file */
+    sqlite3     *db;              /* connection */
+    sqlite3_stmt *lite_trap_stmt, *lite_vb_stmt; /* prepared statements */
+#endif
+    char        *backend_name;    /* sqlBackend (def=first available) */
+    const netsnmp_sql_backend *backend;
+    u_char       connected;       /* connected flag */
+    time_t       connect_retry;   /* don't reconnect before this time */
+    u_int        alarm_id;        /* id of periodic save alarm */
+    u_int        flush_alarm_id;  /* id of the delayed flush alarm */
+    sql_buf     *head, *tail;     /* traps pending database write */
+    u_int        queued;          /* number of traps in the queue */
+    u_int        queue_max;       /* auto save queue when it gets this big */
+    u_int        queue_limit;     /* spool (or drop) traps beyond this */
+    int          queue_interval;  /* auto save every N seconds */
+    u_int        batch;           /* traps per transaction (adaptive) */
+    u_int        batch_max;       /* upper bound for batch */
+    u_int        flush_target;    /* transaction latency target (ms) */
+    sql_buf    **batch_buf;       /* the batch being written */
+    char        *spool_file;      /* spool file name */
+    FILE        *spool;           /* traps waiting on disk */
+    long         spool_rd;        /* offset of the first unwritten record */
+    long         spool_end;       /* end of the last complete record */
+    u_long       spool_pending;   /* number of unwritten records */
+    int          stats_interval;  /* log statistics every N seconds */
+    u_int        stats_alarm_id;  /* id of the statistics alarm */
+} netsnmp_sql_globals;
+
+static netsnmp_sql_globals _sql = {
+#ifdef NETSNMP_USE_MYSQL
+    NULL,                  /* host */
+    NULL,                  /* username */
+    NULL,                  /* password */
+    0,                     /* port */
+    NULL,                  /* socket */
+    "net_snmp",            /* database */
+    0,                     /* conn flags */
+    NULL,                  /* connection */
+    { "client", "snmptrapd", NULL },  /* groups to read from .my.cnf */
+    NULL,                  /* trap_stmt */
+    NULL, 0, 0,            /* vb_query */
+#endif
+#ifdef NETSNMP_USE_SQLITE
+    NULL,                  /* sqlite_file */
+    NULL,                  /* db */
+    NULL, NULL,            /* sqlite statements */
+#endif
+    NULL,                  /* backend_name */
+    NULL,                  /* backend */
+    0,                     /* connected */
+    0,                     /* connect_retry */
+    0,                     /* alarm_id */
+    0,                     /* flush_alarm_id */
+    NULL, NULL,            /* queue */
+    0,                     /* queued */
+    SQL_QUEUE_MAX_DEFAULT, /* queue_max */
+    SQL_QUEUE_LIMIT_DEFAULT, /* queue_limit */
+    -1,                    /* queue_interval */
+    SQL_BATCH_START,       /* batch */
+    SQL_BATCH_MAX_DEFAULT, /* batch_max */
+    SQL_FLUSH_TARGET_DEFAULT, /* flush_target */
+    NULL,                  /* batch_buf */
+    NULL,                  /* spool_file */
+    NULL,                  /* spool */
+    0, 0, 0,               /* spool offsets and count */
+    0,                     /* stats_interval */
+    0                      /* stats_alarm_id */
+};
+
+/*
+ * counters, logged every sqlStatsInterval seconds and at exit
+ */
+static struct {
+    u_long       received;        /* traps handed to the sql handler */
+    u_long       written;         /* traps committed to the database */
+    u_long       batches;         /* transactions committed */
+    u_long       spooled;         /* traps written to the spool file */
+    u_long       logged;          /* traps only logged (not stored) */
+    u_long       dropped;         /* traps logged because the queue was full */
+    u_int        queue_peak;      /* largest queue length */
+    u_long       flush_last;      /* last transaction latency (ms) */
+    u_long       flush_max;
+    u_long       flush_total;
+} _sql_stats;
+
+#ifdef NETSNMP_SQL_WRITER_THREAD
+static pthread_mutex_t _sql_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  _sql_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t       _sql_thread;
+static int             _sql_writer;       /* 1 running, -1 failed to start */
+static int             _sql_writer_stop;
+#define SQL_LOCK()           pthread_mutex_lock(&_sql_lock)
+#define SQL_UNLOCK()         pthread_mutex_unlock(&_sql_lock)
+#define SQL_WRITER_RUNNING() (_sql_writer > 0)
+#else
+#define SQL_LOCK()
+#define SQL_UNLOCK()
+#define SQL_WRITER_RUNNING() 0
+#endif
+
+/*
+ * log traps as text, or binary blobs?
+ */
+#define NETSNMP_MYSQL_TRAP_VALUE_TEXT 1
 
 static void _sql_process_queue(u_int dontcare, void *meeither);
+static void _sql_flush_alarm(u_int clientreg, void *clientarg);
 
 /*
  * parse the sqlMaxQueue configuration token
@@ -226,6 +313,51 @@ _parse_interval_fmt(const char *token, char *cptr)
                 _sql.queue_interval));
 }
 
+/*
+ * parse the sqlQueueLimit, sqlMaxBatch, sqlFlushTarget and
+ * sqlStatsInterval configuration tokens
+ */
+static void
+_parse_number_fmt(const char *token, char *cptr)
+{
+    int          value = atoi(cptr);
+
+    if (value < 0) {
+        netsnmp_config_error("%s must not be negative", token);
+        return;
+    }
+    if (strcmp(token, "sqlQueueLimit") == 0)
+        _sql.queue_limit = value;
+    else if (strcmp(token, "sqlMaxBatch") == 0)
+        _sql.batch_max = value;
+    else if (strcmp(token, "sqlFlushTarget") == 0)
+        _sql.flush_target = value;
+    else
+        _sql.stats_interval = value;
+    DEBUGMSGTL(("sql:queue","%s now %d\n", token, value));
+}
+
+/*
+ * parse the sqlBackend, sqliteFile and sqlSpoolFile configuration tokens
+ */
+static void
+_parse_string_fmt(const char *token, char *cptr)
+{
+    char       **value;
+
+    if (strcmp(token, "sqlBackend") == 0)
+        value = &_sql.backend_name;
+#ifdef NETSNMP_USE_SQLITE
+    else if (strcmp(token, "sqliteFile") == 0)
+        value = &_sql.sqlite_file;
+#endif
+    else
+        value = &_sql.spool_file;
+    free(*value);
+    *value = strdup(cptr);
+    DEBUGMSGTL(("sql:queue","%s now %s\n", token, cptr));
+}
+
 /*
  * register sql related configuration tokens
  */
@@ -236,8 +368,58 @@ snmptrapd_register_sql_configs( void )
                             _parse_queue_fmt, NULL, "integer");
     register_config_handler("snmptrapd", "sqlSaveInterval",
                             _parse_interval_fmt, NULL, "seconds");
+    register_config_handler("snmptrapd", "sqlQueueLimit",
+                            _parse_number_fmt, NULL, "integer");
+    register_config_handler("snmptrapd", "sqlMaxBatch",
+                            _parse_number_fmt, NULL, "integer");
+    register_config_handler("snmptrapd", "sqlFlushTarget",
+                            _parse_number_fmt, NULL, "milliseconds");
+    register_config_handler("snmptrapd", "sqlStatsInterval",
+                            _parse_number_fmt, NULL, "seconds");
+    register_config_handler("snmptrapd", "sqlSpoolFile",
+                            _parse_string_fmt, NULL, "file");
+    register_config_handler("snmptrapd", "sqlBackend",
+                            _parse_string_fmt, NULL, "mysql|sqlite");
+#ifdef NETSNMP_USE_SQLITE
+    register_config_handler("snmptrapd", "sqliteFile",
+                            _parse_string_fmt, NULL, "file");
+#endif
 }
 
+#ifdef NETSNMP_USE_MYSQL
+/*
+ * We will be using a prepared statement for performance reasons. This
+ * requires a sql bind structure for each cell to be inserted in the
+ * database. We will be using a global static structure to bind to,
+ * and a queue to store the necessary data until it is written to the
+ * database.  The varbinds of a batch go into multi-row INSERTs.
+ */
+/** enums for the trap fields to be bound */
+enum{
+    TBIND_DATE = 0,           /* time received */
+    TBIND_HOST,               /* src ip */
+    TBIND_USER,               /* auth/user information */
+    TBIND_TYPE,               /* pdu type */
+    TBIND_VER,                /* snmp version */
+    TBIND_REQID,              /* request id */
+    TBIND_OID,                /* trap OID */
+    TBIND_TRANSPORT,          /* transport */
+    TBIND_SECURITY_MODEL,     /* security model */
+    TBIND_v3_MSGID,           /* v3 msg id */
+    TBIND_v3_SECURITY_LEVEL,  /* security level */
+    TBIND_v3_CONTEXT_NAME,    /* context */
+    TBIND_v3_CONTEXT_ENGINE,  /* context engine id */
+    TBIND_v3_SECURITY_NAME,   /* security name */
+    TBIND_v3_SECURITY_ENGINE, /* security engine id */
+    TBIND_MAX
+};
+
+/*
+ * static bind structure, plus a static buffer to bind to.
+ */
+static MYSQL_BIND _tbind[TBIND_MAX];
+static char       _no_v3;
+
 static void
 netsnmp_sql_disconnected(void)
 {
@@ -250,10 +432,6 @@ netsnmp_sql_disconnected(void)
         mysql_stmt_close(_sql.trap_stmt);
         _sql.trap_stmt = NULL;
     }
-    if (_sql.vb_stmt) {
-        mysql_stmt_close(_sql.vb_stmt);
-        _sql.vb_stmt = NULL;
-    }
 }
 
 static int
@@ -308,31 +486,27 @@ netsnmp_sql_stmt_error (MYSQL_STMT *stmt, const char *message)
 }
 
 /*
- * sql cleanup function, called at exit
+ * close the connection
  */
 static void
-netsnmp_mysql_cleanup(void)
+netsnmp_mysql_disconnect(void)
 {
-    DEBUGMSGTL(("sql:cleanup"," called\n"));
-
-    /** unregister alarm */
-    if (_sql.alarm_id)
-        snmp_alarm_unregister(_sql.alarm_id);
-
-    /** save any queued traps */
-    if (CONTAINER_SIZE(_sql.queue))
-        _sql_process_queue(0,NULL);
-
-    CONTAINER_FREE(_sql.queue);
-    _sql.queue = NULL;
-
-    /** disconnect from server */
     netsnmp_sql_disconnected();
 
     if (_sql.conn) {
         mysql_close(_sql.conn);
         _sql.conn = NULL;
     }
+}
+
+/*
+ * sql cleanup function, called at exit
+ */
+static void
+netsnmp_mysql_cleanup(void)
+{
+    SNMP_FREE(_sql.vb_query);
+    _sql.vb_query_size = 0;
 
     mysql_library_end();
 }
@@ -374,8 +548,6 @@ netsnmp_mysql_connect(void)
     char trap_stmt[] = "INSERT INTO notifications "
         "(date_time, host, auth, type, version, request_id, snmpTrapOID, transport, security_model, v3msgid, v3security_level, v3context_name, v3context_engine, v3security_name, v3security_engine) "
         "VALUES(?,?,?,?,?,?,?,?,?,?,?,?,?,?,?)";
-    char vb_stmt[] = "INSERT INTO varbinds "
-        "(trap_id, oid, type, value) VALUES (?,?,?,?)";
 
     /** initialize connection handler */
     if (_sql.connected)
@@ -413,20 +585,13 @@ netsnmp_mysql_connect(void)
         goto err;
     }
 
-    netsnmp_assert((_sql.trap_stmt == NULL) && (_sql.vb_stmt == NULL));
+    netsnmp_assert(_sql.trap_stmt == NULL);
 
     /** prepared statement for inserts */
     if (0 != netsnmp_mysql_bind(trap_stmt,sizeof(trap_stmt), &_sql.trap_stmt,
                                 _tbind))
         goto err;
 
-    if (0 != netsnmp_mysql_bind(vb_stmt,sizeof(vb_stmt),&_sql.vb_stmt,
-                                _vbind)) {
-        mysql_stmt_close(_sql.trap_stmt);
-        _sql.trap_stmt = NULL;
-        goto err;
-    }
-
     return 0;
 
   err:
@@ -437,27 +602,9 @@ netsnmp_mysql_connect(void)
 }
 
 /** one-time initialization for mysql */
-int
-netsnmp_mysql_init(void)
+static int
+netsnmp_mysql_backend_init(void)
 {
-    netsnmp_trapd_handler *traph;
-
-    DEBUGMSGTL(("sql:init","called\n"));
-
-    /** negative or 0 interval disables sql logging */
-    if (_sql.queue_interval <= 0) {
-        DEBUGMSGTL(("sql:init",
-                    "mysql not enabled (sqlSaveInterval is <= 0)\n"));
-        return 0;
-    }
-
-    /** create queue for storing traps til they are written to the db */
-    _sql.queue = netsnmp_container_find("fifo");
-    if (NULL == _sql.queue) {
-        snmp_log(LOG_ERR, "Could not allocate sql buf container\n");
-        return -1;
-    }
-
 #if defined(HAVE_MYSQL_INIT)
     mysql_init(NULL);
 #elif defined(HAVE_MY_INIT)
@@ -504,7 +651,6 @@ netsnmp_mysql_init(void)
 
     /** init bind structures */
     memset(_tbind, 0x0, sizeof(_tbind));
-    memset(_vbind, 0x0, sizeof(_vbind));
 
     /** trap static bindings */
     _tbind[TBIND_HOST].buffer_type = MYSQL_TYPE_STRING;
@@ -556,75 +702,547 @@ netsnmp_mysql_init(void)
         _tbind[TBIND_v3_CONTEXT_ENGINE].is_null =
         _tbind[TBIND_v3_SECURITY_NAME].is_null =
         _tbind[TBIND_v3_SECURITY_ENGINE].is_null = &_no_v3;
-    
-    /** variable static bindings */
-    _vbind[VBIND_ID].buffer_type = MYSQL_TYPE_LONG;
-    _vbind[VBIND_ID].is_unsigned = 1;
-
-    _vbind[VBIND_OID].buffer_type = MYSQL_TYPE_STRING;
-    _vbind[VBIND_OID].length = &_vbind[VBIND_OID].buffer_length;
-
-    _vbind[VBIND_TYPE].buffer_type = MYSQL_TYPE_SHORT;
-    _vbind[VBIND_TYPE].is_unsigned = 1;
-
-#ifdef NETSNMP_MYSQL_TRAP_VALUE_TEXT
-    _vbind[VBIND_VAL].buffer_type = MYSQL_TYPE_STRING;
-#else
-    _vbind[VBIND_VAL].buffer_type = MYSQL_TYPE_BLOB;
-#endif
-    _vbind[VBIND_VAL].length = &_vbind[VBIND_VAL].buffer_length;
-
-    /** try to connect; we'll try again later if we fail */
-    (void) netsnmp_mysql_connect();
-
-    /** register periodic queue save */
-    _sql.alarm_id = snmp_alarm_register(_sql.queue_interval, /* seconds */
-                                        1,                   /* repeat */
-                                        _sql_process_queue,  /* function */
-                                        NULL);               /* client args */
-
-    /** add handler */
-    traph = netsnmp_add_global_traphandler(NETSNMPTRAPD_PRE_HANDLER,
-                                           mysql_handler);
-    if (NULL == traph) {
-        snmp_log(LOG_ERR, "Could not allocate sql trap handler\n");
-        return -1;
-    }
-    traph->authtypes = TRAP_AUTH_LOG;
 
-    atexit(netsnmp_mysql_cleanup);
     return 0;
 }
 
 /*
- * log CSV version of trap.
- * dontcare param is there so this function can be passed directly
- * to CONTAINER_FOR_EACH.
+ * insert a trap row, returning its trap_id
  */
-static void
-_sql_log(sql_buf *sqlb, void* dontcare)
+static int
+netsnmp_mysql_insert_trap(sql_buf *sqlb, u_long *trap_id)
 {
-    netsnmp_iterator     *it;
-    sql_vb_buf           *sqlvb;
-
-    if ((NULL == sqlb) || sqlb->logged)
-        return;
+    MYSQL_TIME   mtime;
 
     /*
-     * log trap info
-     * nothing done to protect against data insertion attacks with
-     * respect to bad data (commas, newlines, etc)
+     * the prepared statement is bound to the static buffer objects,
+     * so copy the queued data to the static version.
      */
-    snmp_log(LOG_ERR,
-             "trap:%d-%d-%d %d:%d:%d,%s,%d,%d,%d,%s,%s,%d,%d,%d,%s,%s,%s,%s\n",
-             sqlb->time.year,sqlb->time.month,sqlb->time.day,
-             sqlb->time.hour,sqlb->time.minute,sqlb->time.second,
-             sqlb->user,
-             sqlb->type, sqlb->version, sqlb->reqid, sqlb->oid,
-             sqlb->transport, sqlb->security_model, sqlb->msgid,
-             sqlb->security_level, sqlb->context,
-             sqlb->context_engine, sqlb->security_name,
-             sqlb->security_engine);
+    memset(&mtime, 0x0, sizeof(mtime));
+    mtime.year = sqlb->time.year;
+    mtime.month = sqlb->time.month;
+    mtime.day = sqlb->time.day;
+    mtime.hour = sqlb->time.hour;
+    mtime.minute = sqlb->time.minute;
+    mtime.second = sqlb->time.second;
+    mtime.time_type = MYSQL_TIMESTAMP_DATETIME;
+
+    _tbind[TBIND_HOST].buffer = sqlb->host;
+    _tbind[TBIND_HOST].buffer_length = sqlb->host_len;
+
+    _tbind[TBIND_OID].buffer = sqlb->oid;
+    _tbind[TBIND_OID].buffer_length = sqlb->oid_len;
+
+    _tbind[TBIND_REQID].buffer = (void *)&sqlb->reqid;
+    _tbind[TBIND_VER].buffer = (void *)&sqlb->version;
+    _tbind[TBIND_TYPE].buffer = (void *)&sqlb->type;
+    _tbind[TBIND_SECURITY_MODEL].buffer = (void *)&sqlb->security_model;
+
+    _tbind[TBIND_DATE].buffer = (void *)&mtime;
+
+    _tbind[TBIND_USER].buffer = sqlb->user;
+    _tbind[TBIND_USER].buffer_length = sqlb->user_len;
+
+    _tbind[TBIND_TRANSPORT].buffer = sqlb->transport;
+    if (sqlb->transport)
+        _tbind[TBIND_TRANSPORT].buffer_length = strlen(sqlb->transport);
+    else
+        _tbind[TBIND_TRANSPORT].buffer_length = 0;
+
+
+    if ((SNMP_MP_MODEL_SNMPv3+1) == sqlb->version) {
+        _no_v3 = 0;
+
+        _tbind[TBIND_v3_MSGID].buffer = &sqlb->msgid;
+
+        _tbind[TBIND_v3_SECURITY_LEVEL].buffer = &sqlb->security_level;
+
+        _tbind[TBIND_v3_CONTEXT_NAME].buffer = sqlb->context;
+        _tbind[TBIND_v3_CONTEXT_NAME].buffer_length = sqlb->context_len;
+
+        _tbind[TBIND_v3_CONTEXT_ENGINE].buffer = sqlb->context_engine;
+        _tbind[TBIND_v3_CONTEXT_ENGINE].buffer_length =
+            sqlb->context_engine_len;
+
+        _tbind[TBIND_v3_SECURITY_NAME].buffer = sqlb->security_name;
+        _tbind[TBIND_v3_SECURITY_NAME].buffer_length = sqlb->security_name_len;
+
+        _tbind[TBIND_v3_SECURITY_ENGINE].buffer = sqlb->security_engine;
+        _tbind[TBIND_v3_SECURITY_ENGINE].buffer_length =
+            sqlb->security_engine_len;
+    }
+    else {
+        _no_v3 = 1;
+    }
+
+    if (mysql_stmt_bind_param(_sql.trap_stmt, _tbind) != 0) {
+        netsnmp_sql_stmt_error(_sql.trap_stmt,
+                               "Could not bind parameters for INSERT");
+        return -1;
+    }
+
+    /** execute the prepared statement */
+    if (mysql_stmt_execute(_sql.trap_stmt) != 0) {
+        netsnmp_sql_stmt_error(_sql.trap_stmt,
+                               "Could not execute insert statement for trap");
+        return -1;
+    }
+    *trap_id = mysql_insert_id(_sql.conn);
+    return 0;
+}
+
+/*
+ * send the pending multi-row varbind INSERT
+ */
+static int
+netsnmp_mysql_flush_varbinds(void)
+{
+    int          rc;
+
+    if (0 == _sql.vb_query_len)
+        return 0;
+
+    rc = mysql_real_query(_sql.conn, _sql.vb_query, _sql.vb_query_len);
+    _sql.vb_query_len = 0;
+    if (rc != 0) {
+        netsnmp_sql_error("Could not execute insert statement for varbinds");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * add a row to the pending multi-row varbind INSERT
+ */
+static int
+netsnmp_mysql_add_varbind(u_long trap_id, sql_vb_buf *sqlvb)
+{
+    static const char prefix[] =
+        "INSERT INTO varbinds (trap_id, oid, type, value) VALUES ";
+    const char  *oid = sqlvb->oid ? sqlvb->oid : "";
+    const char  *val = sqlvb->val ? (const char *)sqlvb->val : "";
+    size_t       need, size;
+    char        *query;
+
+    /** every character may need escaping */
+    need = 2 * (sqlvb->oid_len + sqlvb->val_len) + 64;
+    if (_sql.vb_query_len && _sql.vb_query_len + need > SQL_VB_QUERY_MAX &&
+        netsnmp_mysql_flush_varbinds() != 0)
+        return -1;
+
+    if (_sql.vb_query_len + need + sizeof(prefix) > _sql.vb_query_size) {
+        size = SNMP_MAX(2 * _sql.vb_query_size,
+                        _sql.vb_query_len + need + sizeof(prefix));
+        query = realloc(_sql.vb_query, size);
+        if (NULL == query) {
+            snmp_log(LOG_ERR, "Could not allocate sql varbind query\n");
+            return -1;
+        }
+        _sql.vb_query = query;
+        _sql.vb_query_size = size;
+    }
+
+    query = _sql.vb_query;
+    if (0 == _sql.vb_query_len) {
+        memcpy(query, prefix, sizeof(prefix) - 1);
+        _sql.vb_query_len = sizeof(prefix) - 1;
+    } else
+        query[_sql.vb_query_len++] = ',';
+    _sql.vb_query_len += sprintf(query + _sql.vb_query_len, "(%lu,'", trap_id);
+    _sql.vb_query_len += mysql_real_escape_string(_sql.conn,
+                                                  query + _sql.vb_query_len,
+                                                  oid, sqlvb->oid_len);
+    _sql.vb_query_len += sprintf(query + _sql.vb_query_len, "',%u,'",
+                                 (u_int)sqlvb->type);
+    _sql.vb_query_len += mysql_real_escape_string(_sql.conn,
+                                                  query + _sql.vb_query_len,
+                                                  val, sqlvb->val_len);
+    query[_sql.vb_query_len++] = '\'';
+    query[_sql.vb_query_len++] = ')';
+    query[_sql.vb_query_len] = '\0';
+    return 0;
+}
+
+/*
+ * save a batch of traps in one transaction: a row for each trap, then
+ * their varbinds in as few INSERTs as possible.
+ */
+static int
+netsnmp_mysql_write(sql_buf **traps, int count)
+{
+    netsnmp_iterator     *it;
+    sql_vb_buf           *sqlvb;
+    u_long                trap_id;
+    int                   i, rc = 0;
+
+    _sql.vb_query_len = 0;
+    for (i = 0; i < count && 0 == rc; i++) {
+        rc = netsnmp_mysql_insert_trap(traps[i], &trap_id);
+        if (rc)
+            break;
+
+        it = CONTAINER_ITERATOR(traps[i]->varbinds);
+        if (NULL == it) {
+            snmp_log(LOG_ERR,"Could not allocate iterator\n");
+            rc = -1;
+            break;
+        }
+        for (sqlvb = ITERATOR_FIRST(it); sqlvb && 0 == rc;
+             sqlvb = ITERATOR_NEXT(it))
+            rc = netsnmp_mysql_add_varbind(trap_id, sqlvb);
+        ITERATOR_RELEASE(it);
+    }
+    if (0 == rc)
+        rc = netsnmp_mysql_flush_varbinds();
+    if (0 == rc && mysql_commit(_sql.conn) != 0) {
+        netsnmp_sql_error("commit failed");
+        rc = -1;
+    }
+    if (rc && _sql.connected)
+        mysql_rollback(_sql.conn);
+    return rc;
+}
+
+static void
+netsnmp_mysql_thread_init(void)
+{
+    mysql_thread_init();
+}
+
+static void
+netsnmp_mysql_thread_end(void)
+{
+    mysql_thread_end();
+}
+
+static const netsnmp_sql_backend _mysql_backend = {
+    "mysql",
+    netsnmp_mysql_backend_init,
+    netsnmp_mysql_connect,
+    netsnmp_mysql_disconnect,
+    netsnmp_mysql_write,
+    netsnmp_mysql_cleanup,
+    netsnmp_mysql_thread_init,
+    netsnmp_mysql_thread_end
+};
+#endif /* NETSNMP_USE_MYSQL */
+
+#ifdef NETSNMP_USE_SQLITE
+/*
+ * The SQLite tables follow dist/schema-snmptrapd.sql, with the ENUM
+ * columns stored as the same (1 based) numbers.
+ */
+static const char _sqlite_schema[] =
+    "CREATE TABLE IF NOT EXISTS notifications ("
+    " trap_id INTEGER PRIMARY KEY AUTOINCREMENT,"
+    " date_time TEXT NOT NULL,"
+    " host TEXT NOT NULL,"
+    " auth TEXT NOT NULL,"
+    " type INTEGER NOT NULL,"
+    " version INTEGER NOT NULL,"
+    " request_id INTEGER NOT NULL,"
+    " snmpTrapOID TEXT NOT NULL,"
+    " transport TEXT NOT NULL,"
+    " security_model INTEGER NOT NULL,"
+    " v3msgid INTEGER,"
+    " v3security_level INTEGER,"
+    " v3context_name TEXT,"
+    " v3context_engine TEXT,"
+    " v3security_name TEXT,"
+    " v3security_engine TEXT);"
+    "CREATE TABLE IF NOT EXISTS varbinds ("
+    " trap_id INTEGER NOT NULL DEFAULT 0,"
+    " oid TEXT NOT NULL,"
+    " type INTEGER NOT NULL,"
+    " value BLOB NOT NULL);"
+    "CREATE INDEX IF NOT EXISTS varbinds_trap_id ON varbinds (trap_id);";
+
+static void
+netsnmp_sqlite_disconnect(void)
+{
+    DEBUGMSGTL(("sql:connection","disconnected\n"));
+
+    _sql.connected = 0;
+
+    /** release prepared statements */
+    if (_sql.lite_trap_stmt) {
+        sqlite3_finalize(_sql.lite_trap_stmt);
+        _sql.lite_trap_stmt = NULL;
+    }
+    if (_sql.lite_vb_stmt) {
+        sqlite3_finalize(_sql.lite_vb_stmt);
+        _sql.lite_vb_stmt = NULL;
+    }
+    if (_sql.db) {
+        sqlite3_close(_sql.db);
+        _sql.db = NULL;
+    }
+}
+
+/*
+ * log sqlite errors.  Errors caused by the data leave the database
+ * open; anything else (busy, I/O, full disk ...) closes it, so that the
+ * traps are kept and written after reconnecting.
+ */
+static void
+netsnmp_sqlite_error(const char *message, int rc)
+{
+    snmp_log(LOG_ERR, "%s\n", message);
+    if (_sql.db)
+        snmp_log(LOG_ERR, "SQLite error %d: %s\n", rc,
+                 sqlite3_errmsg(_sql.db));
+
+    switch (rc & 0xff) {
+    case SQLITE_CONSTRAINT:
+    case SQLITE_TOOBIG:
+    case SQLITE_MISMATCH:
+    case SQLITE_RANGE:
+        break;
+    default:
+        netsnmp_sqlite_disconnect();
+    }
+}
+
+/*
+ * open the database, create the tables and prepare the statements
+ */
+static int
+netsnmp_sqlite_connect(void)
+{
+    static const char trap_stmt[] = "INSERT INTO notifications "
+        "(date_time, host, auth, type, version, request_id, snmpTrapOID, transport, security_model, v3msgid, v3security_level, v3context_name, v3context_engine, v3security_name, v3security_engine) "
+        "VALUES(?,?,?,?,?,?,?,?,?,?,?,?,?,?,?)";
+    static const char vb_stmt[] = "INSERT INTO varbinds "
+        "(trap_id, oid, type, value) VALUES (?,?,?,?)";
+    int          rc;
+
+    if (_sql.connected)
+        return 0;
+
+    DEBUGMSGTL(("sql:connection","opening %s\n", _sql.sqlite_file));
+
+    rc = sqlite3_open_v2(_sql.sqlite_file, &_sql.db,
+                         SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL);
+    if (rc != SQLITE_OK) {
+        snmp_log(LOG_ERR, "Could not open SQLite database %s\n",
+                 _sql.sqlite_file);
+        goto err;
+    }
+    sqlite3_busy_timeout(_sql.db, 5000);
+
+    rc = sqlite3_exec(_sql.db, "PRAGMA journal_mode=WAL;"
+                      "PRAGMA synchronous=NORMAL;", NULL, NULL, NULL);
+    if (SQLITE_OK == rc)
+        rc = sqlite3_exec(_sql.db, _sqlite_schema, NULL, NULL, NULL);
+    if (rc != SQLITE_OK) {
+        snmp_log(LOG_ERR, "Could not create the SQLite tables in %s\n",
+                 _sql.sqlite_file);
+        goto err;
+    }
+
+    rc = sqlite3_prepare_v2(_sql.db, trap_stmt, sizeof(trap_stmt),
+                            &_sql.lite_trap_stmt, NULL);
+    if (SQLITE_OK == rc)
+        rc = sqlite3_prepare_v2(_sql.db, vb_stmt, sizeof(vb_stmt),
+                                &_sql.lite_vb_stmt, NULL);
+    if (rc != SQLITE_OK) {
+        snmp_log(LOG_ERR, "Could not prepare INSERT\n");
+        goto err;
+    }
+
+    _sql.connected = 1;
+    return 0;
+
+  err:
+    if (_sql.db)
+        snmp_log(LOG_ERR, "SQLite error %d: %s\n", rc,
+                 sqlite3_errmsg(_sql.db));
+    netsnmp_sqlite_disconnect();
+    return -1;
+}
+
+static int
+netsnmp_sqlite_bind_text(sqlite3_stmt *stmt, int col, const char *text,
+                         u_long len)
+{
+    if (NULL == text)
+        return sqlite3_bind_text(stmt, col, "", 0, SQLITE_STATIC);
+    return sqlite3_bind_text(stmt, col, text, len, SQLITE_STATIC);
+}
+
+/*
+ * save a batch of traps in one transaction
+ */
+static int
+netsnmp_sqlite_write(sql_buf **traps, int count)
+{
+    sqlite3_stmt         *ts = _sql.lite_trap_stmt, *vs = _sql.lite_vb_stmt;
+    netsnmp_iterator     *it;
+    sql_vb_buf           *sqlvb;
+    sql_buf              *sqlb;
+    sqlite3_int64         trap_id;
+    char                  date[32];
+    int                   i, col, rc;
+
+    rc = sqlite3_exec(_sql.db, "BEGIN", NULL, NULL, NULL);
+    if (rc != SQLITE_OK) {
+        netsnmp_sqlite_error("Could not begin transaction", rc);
+        return -1;
+    }
+
+    for (i = 0; i < count && SQLITE_OK == rc; i++) {
+        sqlb = traps[i];
+        snprintf(date, sizeof(date), "%04u-%02u-%02u %02u:%02u:%02u",
+                 sqlb->time.year, sqlb->time.month, sqlb->time.day,
+                 sqlb->time.hour, sqlb->time.minute, sqlb->time.second);
+        sqlite3_bind_text(ts, 1, date, -1, SQLITE_TRANSIENT);
+        netsnmp_sqlite_bind_text(ts, 2, sqlb->host, sqlb->host_len);
+        netsnmp_sqlite_bind_text(ts, 3, sqlb->user, sqlb->user_len);
+        sqlite3_bind_int(ts, 4, sqlb->type);
+        sqlite3_bind_int(ts, 5, sqlb->version);
+        sqlite3_bind_int64(ts, 6, sqlb->reqid);
+        netsnmp_sqlite_bind_text(ts, 7, sqlb->oid, sqlb->oid_len);
+        netsnmp_sqlite_bind_text(ts, 8, sqlb->transport,
+                                 sqlb->transport ? strlen(sqlb->transport) : 0);
+        sqlite3_bind_int(ts, 9, sqlb->security_model);
+        if ((SNMP_MP_MODEL_SNMPv3+1) == sqlb->version) {
+            sqlite3_bind_int64(ts, 10, sqlb->msgid);
+            sqlite3_bind_int(ts, 11, sqlb->security_level);
+            netsnmp_sqlite_bind_text(ts, 12, sqlb->context,
+                                     sqlb->context_len);
+            netsnmp_sqlite_bind_text(ts, 13, sqlb->context_engine,
+                                     sqlb->context_engine_len);
+            netsnmp_sqlite_bind_text(ts, 14, sqlb->security_name,
+                                     sqlb->security_name_len);
+            netsnmp_sqlite_bind_text(ts, 15, sqlb->security_engine,
+                                     sqlb->security_engine_len);
+        } else {
+            for (col = 10; col <= 15; col++)
+                sqlite3_bind_null(ts, col);
+        }
+        rc = sqlite3_step(ts);
+        if (rc != SQLITE_DONE)
+            break;
+        sqlite3_reset(ts);
+        rc = SQLITE_OK;
+        trap_id = sqlite3_last_insert_rowid(_sql.db);
+
+        it = CONTAINER_ITERATOR(sqlb->varbinds);
+        if (NULL == it) {
+            snmp_log(LOG_ERR,"Could not allocate iterator\n");
+            rc = SQLITE_NOMEM;
+            break;
+        }
+        for (sqlvb = ITERATOR_FIRST(it); sqlvb; sqlvb = ITERATOR_NEXT(it)) {
+            sqlite3_bind_int64(vs, 1, trap_id);
+            netsnmp_sqlite_bind_text(vs, 2, sqlvb->oid, sqlvb->oid_len);
+            sqlite3_bind_int(vs, 3, sqlvb->type);
+#ifdef NETSNMP_MYSQL_TRAP_VALUE_TEXT
+            netsnmp_sqlite_bind_text(vs, 4, (char *)sqlvb->val,
+                                     sqlvb->val_len);
+#else
+            sqlite3_bind_blob(vs, 4, sqlvb->val ? sqlvb->val : (u_char *)"",
+                              sqlvb->val_len, SQLITE_STATIC);
+#endif
+            rc = sqlite3_step(vs);
+            if (rc != SQLITE_DONE)
+                break;
+            sqlite3_reset(vs);
+            rc = SQLITE_OK;
+        }
+        ITERATOR_RELEASE(it);
+    }
+
+    if (SQLITE_OK == rc) {
+        rc = sqlite3_exec(_sql.db, "COMMIT", NULL, NULL, NULL);
+        if (SQLITE_OK == rc)
+            return 0;
+    }
+
+    sqlite3_reset(ts);
+    sqlite3_reset(vs);
+    netsnmp_sqlite_error("Could not insert traps", rc);
+    if (_sql.db)
+        sqlite3_exec(_sql.db, "ROLLBACK", NULL, NULL, NULL);
+    return -1;
+}
+
+/** one-time initialization for sqlite */
+static int
+netsnmp_sqlite_init(void)
+{
+    char         file[SNMP_MAXPATH];
+
+    if (NULL == _sql.sqlite_file) {
+        snprintf(file, sizeof(file), "%s/snmptrapd.sqlite",
+                 get_persistent_directory());
+        _sql.sqlite_file = strdup(file);
+        if (NULL == _sql.sqlite_file)
+            return -1;
+    }
+    return 0;
+}
+
+static void
+netsnmp_sqlite_cleanup(void)
+{
+    SNMP_FREE(_sql.sqlite_file);
+}
+
+static const netsnmp_sql_backend _sqlite_backend = {
+    "sqlite",
+    netsnmp_sqlite_init,
+    netsnmp_sqlite_connect,
+    netsnmp_sqlite_disconnect,
+    netsnmp_sqlite_write,
+    netsnmp_sqlite_cleanup,
+    NULL,
+    NULL
+};
+#endif /* NETSNMP_USE_SQLITE */
+
+static const netsnmp_sql_backend *_sql_backends[] = {
+#ifdef NETSNMP_USE_MYSQL
+    &_mysql_backend,
+#endif
+#ifdef NETSNMP_USE_SQLITE
+    &_sqlite_backend,
+#endif
+    NULL
+};
+
+/*
+ * log CSV version of trap.
+ * dontcare param is there so this function can be passed directly
+ * to CONTAINER_FOR_EACH.
+ */
+static void
+_sql_log(sql_buf *sqlb, void* dontcare)
+{
+    netsnmp_iterator     *it;
+    sql_vb_buf           *sqlvb;
+
+    if ((NULL == sqlb) || sqlb->logged)
+        return;
+
+    /** keep the lines of a trap together */
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_LOGGING);
+
+    /*
+     * log trap info
+     * nothing done to protect against data insertion attacks with
+     * respect to bad data (commas, newlines, etc)
+     */
+    snmp_log(LOG_ERR,
+             "trap:%d-%d-%d %d:%d:%d,%s,%d,%d,%d,%s,%s,%d,%d,%d,%s,%s,%s,%s\n",
+             sqlb->time.year,sqlb->time.month,sqlb->time.day,
+             sqlb->time.hour,sqlb->time.minute,sqlb->time.second,
+             sqlb->user,
+             sqlb->type, sqlb->version, sqlb->reqid, sqlb->oid,
+             sqlb->transport, sqlb->security_model, sqlb->msgid,
+             sqlb->security_level, sqlb->context,
+             sqlb->context_engine, sqlb->security_name,
+             sqlb->security_engine);
 
     sqlb->logged = 1; /* prevent multiple logging */
 
@@ -632,6 +1250,7 @@ _sql_log(sql_buf *sqlb, void* dontcare)
     if (NULL == it) {
         snmp_log(LOG_ERR,
                  "error creating iterator; incomplete trap logged\n");
+        snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_LOGGING);
         return;
     }
 
@@ -653,7 +1272,7 @@ _sql_log(sql_buf *sqlb, void* dontcare)
 #endif
     }
     ITERATOR_RELEASE(it);
-   
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_LOGGING);
 }
 
 /*
@@ -759,8 +1378,6 @@ _sql_save_trap_info(sql_buf *sqlb, netsnmp_pdu  *pdu,
     sqlb->time.hour = cur_time->tm_hour;
     sqlb->time.minute = cur_time->tm_min;
     sqlb->time.second = cur_time->tm_sec;
-    sqlb->time.second_part = 0;
-    sqlb->time.neg = 0;
 
     /** host name */
     buf_host_len_t = 0;
@@ -930,177 +1547,845 @@ _sql_save_varbind_info(sql_buf *sqlb, netsnmp_pdu  *pdu)
 }
 
 /*
- * sql trap handler
+ * The spool file keeps traps that could not be written (or queued) while
+ * the database is slow or unreachable, in arrival order, until they can
+ * be written.  Each record is a header of 32 bit numbers followed by
+ * length prefixed strings; it is only ever read back on the same host.
  */
-int
-mysql_handler(netsnmp_pdu           *pdu,
-              netsnmp_transport     *transport,
-              netsnmp_trapd_handler *handler)
+enum {
+    SPOOL_MAGIC = 0,
+    SPOOL_YEAR, SPOOL_MONTH, SPOOL_DAY, SPOOL_HOUR, SPOOL_MINUTE, SPOOL_SECOND,
+    SPOOL_VERSION, SPOOL_TYPE, SPOOL_REQID,
+    SPOOL_SECURITY_LEVEL, SPOOL_SECURITY_MODEL, SPOOL_MSGID,
+    SPOOL_VARBINDS,
+    SPOOL_HDR_MAX
+};
+#define SQL_SPOOL_MAGIC     0x4e535450     /* "NSTP" */
+#define SQL_SPOOL_NULL      0xffffffffU    /* length of a NULL string */
+#define SQL_SPOOL_FIELD_MAX (1024 * 1024)  /* sanity limit when reading */
+
+static int
+_sql_spool_put(const void *data, u_long len)
 {
-    sql_buf     *sqlb;
-    int          old_format, rc;
+    uint32_t     l = data ? (uint32_t)len : SQL_SPOOL_NULL;
 
-    DEBUGMSGTL(("sql:handler", "called\n"));
+    if (fwrite(&l, sizeof(l), 1, _sql.spool) != 1)
+        return -1;
+    if (data && len && fwrite(data, len, 1, _sql.spool) != 1)
+        return -1;
+    return 0;
+}
+
+static int
+_sql_spool_get(char **data, u_long *len)
+{
+    uint32_t     l;
+
+    *data = NULL;
+    *len = 0;
+    if (fread(&l, sizeof(l), 1, _sql.spool) != 1)
+        return -1;
+    if (SQL_SPOOL_NULL == l)
+        return 0;
+    if (l > SQL_SPOOL_FIELD_MAX)
+        return -1;
+    *data = malloc(l + 1);
+    if (NULL == *data)
+        return -1;
+    if (l && fread(*data, l, 1, _sql.spool) != 1) {
+        SNMP_FREE(*data);
+        return -1;
+    }
+    (*data)[l] = '\0';
+    *len = l;
+    return 0;
+}
+
+/*
+ * append a trap to the spool.  Called with the queue locked.
+ */
+static int
+_sql_spool_write(sql_buf *sqlb)
+{
+    netsnmp_iterator     *it;
+    sql_vb_buf           *sqlvb;
+    uint32_t              hdr[SPOOL_HDR_MAX], type;
+    int                   rc = 0;
+
+    it = CONTAINER_ITERATOR(sqlb->varbinds);
+    if (NULL == it)
+        return -1;
+
+    hdr[SPOOL_MAGIC] = SQL_SPOOL_MAGIC;
+    hdr[SPOOL_YEAR] = sqlb->time.year;
+    hdr[SPOOL_MONTH] = sqlb->time.month;
+    hdr[SPOOL_DAY] = sqlb->time.day;
+    hdr[SPOOL_HOUR] = sqlb->time.hour;
+    hdr[SPOOL_MINUTE] = sqlb->time.minute;
+    hdr[SPOOL_SECOND] = sqlb->time.second;
+    hdr[SPOOL_VERSION] = sqlb->version;
+    hdr[SPOOL_TYPE] = sqlb->type;
+    hdr[SPOOL_REQID] = sqlb->reqid;
+    hdr[SPOOL_SECURITY_LEVEL] = sqlb->security_level;
+    hdr[SPOOL_SECURITY_MODEL] = sqlb->security_model;
+    hdr[SPOOL_MSGID] = sqlb->msgid;
+    hdr[SPOOL_VARBINDS] = CONTAINER_SIZE(sqlb->varbinds);
+
+    if (fseek(_sql.spool, _sql.spool_end, SEEK_SET) != 0 ||
+        fwrite(hdr, sizeof(hdr), 1, _sql.spool) != 1 ||
+        _sql_spool_put(sqlb->host, sqlb->host_len) ||
+        _sql_spool_put(sqlb->oid, sqlb->oid_len) ||
+        _sql_spool_put(sqlb->user, sqlb->user_len) ||
+        _sql_spool_put(sqlb->transport,
+                       sqlb->transport ? strlen(sqlb->transport) : 0) ||
+        _sql_spool_put(sqlb->context, sqlb->context_len) ||
+        _sql_spool_put(sqlb->context_engine, sqlb->context_engine_len) ||
+        _sql_spool_put(sqlb->security_name, sqlb->security_name_len) ||
+        _sql_spool_put(sqlb->security_engine, sqlb->security_engine_len))
+        rc = -1;
+
+    for (sqlvb = ITERATOR_FIRST(it); sqlvb && 0 == rc;
+         sqlvb = ITERATOR_NEXT(it)) {
+        type = sqlvb->type;
+        if (_sql_spool_put(sqlvb->oid, sqlvb->oid_len) ||
+            _sql_spool_put(sqlvb->val, sqlvb->val_len) ||
+            fwrite(&type, sizeof(type), 1, _sql.spool) != 1)
+            rc = -1;
+    }
+    ITERATOR_RELEASE(it);
+
+    if (0 == rc && fflush(_sql.spool) != 0)
+        rc = -1;
+    if (rc) {
+        /** don't leave a partial record behind */
+        snmp_log(LOG_ERR, "Could not write sql spool file %s: %s\n",
+                 _sql.spool_file, strerror(errno));
+        fflush(_sql.spool);
+        if (ftruncate(fileno(_sql.spool), _sql.spool_end) != 0)
+            snmp_log(LOG_ERR, "Could not truncate sql spool file\n");
+        return -1;
+    }
+    _sql.spool_end = ftell(_sql.spool);
+    _sql.spool_pending++;
+    return 0;
+}
+
+/*
+ * read the spooled trap at *offset and advance *offset past it.
+ * Called with the queue locked.  A damaged record ends the spool.
+ */
+static sql_buf *
+_sql_spool_read(long *offset)
+{
+    uint32_t              hdr[SPOOL_HDR_MAX], type, i;
+    sql_buf              *sqlb;
+    sql_vb_buf           *sqlvb;
+    char                 *val;
+    u_long                len;
+
+    if (*offset >= _sql.spool_end ||
+        fseek(_sql.spool, *offset, SEEK_SET) != 0)
+        return NULL;
+    if (fread(hdr, sizeof(hdr), 1, _sql.spool) != 1 ||
+        hdr[SPOOL_MAGIC] != SQL_SPOOL_MAGIC)
+        goto damaged;
 
-    /** allocate a buffer to save data */
     sqlb = _sql_buf_get();
-    if (NULL == sqlb) {
-        snmp_log(LOG_ERR, "Could not allocate trap sql buffer\n");
-        return syslog_handler( pdu, transport, handler );
+    if (NULL == sqlb)
+        return NULL;
+
+    sqlb->time.year = hdr[SPOOL_YEAR];
+    sqlb->time.month = hdr[SPOOL_MONTH];
+    sqlb->time.day = hdr[SPOOL_DAY];
+    sqlb->time.hour = hdr[SPOOL_HOUR];
+    sqlb->time.minute = hdr[SPOOL_MINUTE];
+    sqlb->time.second = hdr[SPOOL_SECOND];
+    sqlb->version = hdr[SPOOL_VERSION];
+    sqlb->type = hdr[SPOOL_TYPE];
+    sqlb->reqid = hdr[SPOOL_REQID];
+    sqlb->security_level = hdr[SPOOL_SECURITY_LEVEL];
+    sqlb->security_model = hdr[SPOOL_SECURITY_MODEL];
+    sqlb->msgid = hdr[SPOOL_MSGID];
+
+    if (_sql_spool_get(&sqlb->host, &sqlb->host_len) ||
+        _sql_spool_get(&sqlb->oid, &sqlb->oid_len) ||
+        _sql_spool_get(&sqlb->user, &sqlb->user_len) ||
+        _sql_spool_get(&sqlb->transport, &sqlb->transport_len) ||
+        _sql_spool_get(&sqlb->context, &sqlb->context_len) ||
+        _sql_spool_get(&sqlb->context_engine, &sqlb->context_engine_len) ||
+        _sql_spool_get(&sqlb->security_name, &sqlb->security_name_len) ||
+        _sql_spool_get(&sqlb->security_engine, &sqlb->security_engine_len))
+        goto damaged_buf;
+
+    for (i = 0; i < hdr[SPOOL_VARBINDS]; i++) {
+        sqlvb = SNMP_MALLOC_TYPEDEF(sql_vb_buf);
+        if (NULL == sqlvb)
+            goto damaged_buf;
+        if (_sql_spool_get(&sqlvb->oid, &sqlvb->oid_len) ||
+            _sql_spool_get(&val, &len) ||
+            (sqlvb->val = (u_char *)val, sqlvb->val_len = len,
+             fread(&type, sizeof(type), 1, _sql.spool) != 1) ||
+            CONTAINER_INSERT(sqlb->varbinds, sqlvb)) {
+            _sql_vb_buf_free(sqlvb, NULL);
+            goto damaged_buf;
+        }
+        sqlvb->type = type;
     }
 
-    /** save OID output format and change to numeric */
-    old_format = netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID,
-                                    NETSNMP_DS_LIB_OID_OUTPUT_FORMAT);
-    netsnmp_ds_set_int(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_OID_OUTPUT_FORMAT,
-                       NETSNMP_OID_OUTPUT_NUMERIC);
+    *offset = ftell(_sql.spool);
+    return sqlb;
 
+  damaged_buf:
+    _sql_buf_free(sqlb, NULL);
+  damaged:
+    snmp_log(LOG_ERR, "sql spool file %s is damaged at offset %ld; "
+             "discarding %ld bytes\n", _sql.spool_file, *offset,
+             _sql.spool_end - *offset);
+    fflush(_sql.spool);
+    if (ftruncate(fileno(_sql.spool), *offset) != 0)
+        snmp_log(LOG_ERR, "Could not truncate sql spool file\n");
+    _sql.spool_end = *offset;
+    return NULL;
+}
 
-    rc = _sql_save_trap_info(sqlb, pdu, transport);
-    rc = _sql_save_varbind_info(sqlb, pdu);
+/*
+ * spooled records up to offset have been dealt with.  Called with the
+ * queue locked.
+ */
+static void
+_sql_spool_done(long offset, int count)
+{
+    _sql.spool_rd = offset;
+    _sql.spool_pending -= SNMP_MIN(_sql.spool_pending, (u_long)count);
+    if (_sql.spool_rd < _sql.spool_end)
+        return;
 
-    /** restore previous OID output format */
-    netsnmp_ds_set_int(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_OID_OUTPUT_FORMAT,
-                       old_format);
+    /** all caught up: start over with an empty file */
+    fflush(_sql.spool);
+    if (ftruncate(fileno(_sql.spool), 0) != 0)
+        snmp_log(LOG_ERR, "Could not truncate sql spool file\n");
+    _sql.spool_rd = _sql.spool_end = 0;
+    _sql.spool_pending = 0;
+}
 
-    /** insert into queue */
-    rc = CONTAINER_INSERT(_sql.queue, sqlb);
-    if(rc) {
-        snmp_log(LOG_ERR, "Could not log queue sql trap buffer\n");
-        _sql_log(sqlb, NULL);
+/*
+ * open the spool file, keeping whatever an earlier run left in it
+ */
+static int
+_sql_spool_open(void)
+{
+    sql_buf     *sqlb;
+    long         offset = 0;
+
+    _sql.spool = fopen(_sql.spool_file, "r+b");
+    if (NULL == _sql.spool)
+        _sql.spool = fopen(_sql.spool_file, "w+b");
+    if (NULL == _sql.spool) {
+        snmp_log(LOG_ERR, "Could not open sql spool file %s: %s\n",
+                 _sql.spool_file, strerror(errno));
+        return -1;
+    }
+    if (fseek(_sql.spool, 0, SEEK_END) != 0) {
+        fclose(_sql.spool);
+        _sql.spool = NULL;
+        return -1;
+    }
+    _sql.spool_end = ftell(_sql.spool);
+    _sql.spool_rd = 0;
+    _sql.spool_pending = 0;
+
+    /** count (and check) the spooled traps */
+    while ((sqlb = _sql_spool_read(&offset)) != NULL) {
+        _sql.spool_pending++;
         _sql_buf_free(sqlb, NULL);
+    }
+    if (_sql.spool_pending)
+        snmp_log(LOG_INFO, "%lu traps waiting in sql spool file %s\n",
+                 _sql.spool_pending, _sql.spool_file);
+    else if (_sql.spool_end)
+        _sql_spool_done(_sql.spool_end, 0);
+    return 0;
+}
+
+/*
+ * connect to the database, unless an attempt failed recently
+ */
+static int
+_sql_connect(void)
+{
+    time_t       now;
+
+    if (_sql.connected)
+        return 0;
+
+    now = time(NULL);
+    if (now < _sql.connect_retry)
         return -1;
+    _sql.connect_retry = now + SNMP_MAX(_sql.queue_interval, 1);
+
+    return _sql.backend->connect();
+}
+
+/*
+ * take up to max traps to write: from the queue or, when that is empty
+ * and use_spool is set, from the spool.  *spool_next is where the spool
+ * continues after the batch, or -1 for a batch from the queue.
+ */
+static int
+_sql_take(sql_buf **batch, int max, int use_spool, long *spool_next)
+{
+    sql_buf     *sqlb;
+    long         offset;
+    int          count = 0;
+
+    *spool_next = -1;
+
+    SQL_LOCK();
+    while (count < max && _sql.head) {
+        sqlb = _sql.head;
+        _sql.head = sqlb->next;
+        if (NULL == _sql.head)
+            _sql.tail = NULL;
+        sqlb->next = NULL;
+        _sql.queued--;
+        batch[count++] = sqlb;
     }
 
-    /** save queue if size is > max */
-    if (CONTAINER_SIZE(_sql.queue) >= _sql.queue_max)
-        _sql_process_queue(0,NULL);
+    if (0 == count && use_spool && _sql.spool &&
+        _sql.spool_rd < _sql.spool_end) {
+        offset = _sql.spool_rd;
+        while (count < max && (sqlb = _sql_spool_read(&offset)) != NULL)
+            batch[count++] = sqlb;
+        if (count)
+            *spool_next = offset;
+        else
+            _sql_spool_done(offset, 0);
+    }
+    SQL_UNLOCK();
 
-    return 0;
+    return count;
 }
 
 /*
- * save a buffered trap to sql database
+ * a batch was committed
  */
 static void
-_sql_save(sql_buf *sqlb, void *dontcare)
+_sql_written(sql_buf **batch, int count, long spool_next, u_long ms)
 {
-    netsnmp_iterator     *it;
-    sql_vb_buf           *sqlvb;
-    u_long                trap_id;
+    int          i;
+
+    SQL_LOCK();
+    if (spool_next >= 0)
+        _sql_spool_done(spool_next, count);
+
+    _sql_stats.written += count;
+    _sql_stats.batches++;
+    _sql_stats.flush_last = ms;
+    _sql_stats.flush_total += ms;
+    if (ms > _sql_stats.flush_max)
+        _sql_stats.flush_max = ms;
 
     /*
-     * don't even try if we don't have a database connection
+     * Adapt the batch size: halve it when a transaction takes longer
+     * than the target, double it when full batches are well within it.
      */
-    if (0 == _sql.connected) {
-        _sql_log(sqlb, NULL);
-        return;
+    if (ms > _sql.flush_target && _sql.batch > 1)
+        _sql.batch /= 2;
+    else if ((u_int)count == _sql.batch && ms * 2 < _sql.flush_target &&
+             _sql.batch < _sql.batch_max)
+        _sql.batch = SNMP_MIN(_sql.batch * 2, _sql.batch_max);
+    SQL_UNLOCK();
+
+    DEBUGMSGTL(("sql:process", "%d traps written in %lu ms, batch size %u\n",
+                count, ms, _sql.batch));
+
+    for (i = 0; i < count; i++)
+        _sql_buf_free(batch[i], NULL);
+}
+
+/*
+ * log and free traps that will not be written
+ */
+static void
+_sql_give_up(sql_buf **batch, int count)
+{
+    int          i, logged = 0;
+
+    for (i = 0; i < count; i++) {
+        if (NULL == batch[i])
+            continue;
+        _sql_log(batch[i], NULL);
+        _sql_buf_free(batch[i], NULL);
+        logged++;
     }
 
-    /*
-     * the prepared statements are bound to the static buffer objects,
-     * so copy the queued data to the static version.
-     */
-    _tbind[TBIND_HOST].buffer = sqlb->host;
-    _tbind[TBIND_HOST].buffer_length = sqlb->host_len;
+    if (logged) {
+        SQL_LOCK();
+        _sql_stats.logged += logged;
+        SQL_UNLOCK();
+    }
+}
 
-    _tbind[TBIND_OID].buffer = sqlb->oid;
-    _tbind[TBIND_OID].buffer_length = sqlb->oid_len;
+/*
+ * a batch could not be written.  Traps from the queue are spooled if
+ * there is a spool file, and logged otherwise.  Spooled traps stay in
+ * the spool while the database is down; if the database is still up the
+ * data itself is at fault, and they are logged rather than retried.
+ */
+static void
+_sql_failed(sql_buf **batch, int count, long spool_next)
+{
+    int          i;
 
-    _tbind[TBIND_REQID].buffer = (void *)&sqlb->reqid;
-    _tbind[TBIND_VER].buffer = (void *)&sqlb->version;
-    _tbind[TBIND_TYPE].buffer = (void *)&sqlb->type;
-    _tbind[TBIND_SECURITY_MODEL].buffer = (void *)&sqlb->security_model;
+    SQL_LOCK();
+    if (spool_next >= 0) {
+        if (_sql.connected)
+            _sql_spool_done(spool_next, count);
+        else {
+            for (i = 0; i < count; i++) {
+                _sql_buf_free(batch[i], NULL);
+                batch[i] = NULL;
+            }
+        }
+    } else if (_sql.spool) {
+        for (i = 0; i < count; i++) {
+            if (_sql_spool_write(batch[i]) == 0) {
+                _sql_stats.spooled++;
+                _sql_buf_free(batch[i], NULL);
+                batch[i] = NULL;
+            }
+        }
+    }
+    SQL_UNLOCK();
 
-    _tbind[TBIND_DATE].buffer = (void *)&sqlb->time;
+    _sql_give_up(batch, count);
+}
 
-    _tbind[TBIND_USER].buffer = sqlb->user;
-    _tbind[TBIND_USER].buffer_length = sqlb->user_len;
+/*
+ * a batch failed but the database is still up, so some of its traps are
+ * at fault.  Write them one at a time and give up only on those that
+ * fail.  Should the database go away meanwhile, the rest are handled as
+ * a failed batch; for a batch from the spool that means it is written
+ * again later, including the traps already written here.
+ */
+static void
+_sql_write_rows(sql_buf **batch, int count, long spool_next)
+{
+    int          i, failed = 0, written = 0;
+
+    for (i = 0; i < count && _sql.connected; i++) {
+        if (_sql.backend->write(&batch[i], 1) == 0) {
+            _sql_buf_free(batch[i], NULL);
+            written++;
+        } else
+            batch[failed++] = batch[i];
+    }
+    for (; i < count; i++)
+        batch[failed++] = batch[i];
 
-    _tbind[TBIND_TRANSPORT].buffer = sqlb->transport;
-    if (sqlb->transport)
-        _tbind[TBIND_TRANSPORT].buffer_length = strlen(sqlb->transport);
+    DEBUGMSGTL(("sql:process", "%d of %d traps written one by one\n",
+                written, count));
+
+    SQL_LOCK();
+    _sql_stats.written += written;
+    if (_sql.connected && spool_next >= 0)
+        _sql_spool_done(spool_next, count);
+    SQL_UNLOCK();
+
+    if (_sql.connected)
+        _sql_give_up(batch, failed);
     else
-        _tbind[TBIND_TRANSPORT].buffer_length = 0;
+        _sql_failed(batch, failed, spool_next);
+}
 
+/*
+ * write queued traps to the database, in batches.  Spooled traps are
+ * written once the queue is empty, up to spool_batches batches of them
+ * (-1 for all).
+ */
+static void
+_sql_flush(int spool_batches)
+{
+    sql_buf    **batch = _sql.batch_buf;
+    struct timeval start, now;
+    long         spool_next;
+    u_long       ms;
+    int          count, rc;
+
+    for (;;) {
+        if (0 == _sql.connected && _sql_connect() != 0) {
+            /** no database: spool (or log) what is in memory */
+            count = _sql_take(batch, _sql.batch_max, 0, &spool_next);
+            if (0 == count)
+                break;
+            _sql_failed(batch, count, spool_next);
+            continue;
+        }
 
-    if ((SNMP_MP_MODEL_SNMPv3+1) == sqlb->version) {
-        _no_v3 = 0;
+        count = _sql_take(batch, _sql.batch, spool_batches != 0,
+                          &spool_next);
+        if (0 == count)
+            break;
+        if (spool_next >= 0 && spool_batches > 0)
+            spool_batches--;
+
+        netsnmp_get_monotonic_clock(&start);
+        rc = _sql.backend->write(batch, count);
+        netsnmp_get_monotonic_clock(&now);
+        ms = (now.tv_sec - start.tv_sec) * 1000 +
+            (now.tv_usec - start.tv_usec) / 1000;
+
+        if (0 == rc)
+            _sql_written(batch, count, spool_next, ms);
+        else if (count > 1 && _sql.connected)
+            _sql_write_rows(batch, count, spool_next);
+        else
+            _sql_failed(batch, count, spool_next);
+    }
+}
 
-        _tbind[TBIND_v3_MSGID].buffer = &sqlb->msgid;
-        
-        _tbind[TBIND_v3_SECURITY_LEVEL].buffer = &sqlb->security_level;
-        
-        _tbind[TBIND_v3_CONTEXT_NAME].buffer = sqlb->context;
-        _tbind[TBIND_v3_CONTEXT_NAME].buffer_length = sqlb->context_len;
+#ifdef NETSNMP_SQL_WRITER_THREAD
+/*
+ * the writer thread: write traps as soon as they are queued.  Traps that
+ * arrive during a transaction make up the next batch.
+ */
+static void *
+_sql_writer_run(void *arg)
+{
+    struct timespec ts;
+
+    if (_sql.backend->thread_init)
+        _sql.backend->thread_init();
+
+    SQL_LOCK();
+    while (!_sql_writer_stop) {
+        if (NULL == _sql.head) {
+            /** wake up now and then for the spool */
+            ts.tv_sec = time(NULL) + 1;
+            ts.tv_nsec = 0;
+            pthread_cond_timedwait(&_sql_cond, &_sql_lock, &ts);
+            if (NULL == _sql.head && _sql.spool_rd >= _sql.spool_end)
+                continue;
+        }
+        SQL_UNLOCK();
+        _sql_flush(-1);
+        SQL_LOCK();
+    }
+    SQL_UNLOCK();
 
-        _tbind[TBIND_v3_CONTEXT_ENGINE].buffer = sqlb->context_engine;
-        _tbind[TBIND_v3_CONTEXT_ENGINE].buffer_length =
-            sqlb->context_engine_len;
+    /** write what is still queued, leave the spool for next time */
+    _sql_flush(0);
+    _sql.backend->disconnect();
 
-        _tbind[TBIND_v3_SECURITY_NAME].buffer = sqlb->security_name;
-        _tbind[TBIND_v3_SECURITY_NAME].buffer_length = sqlb->security_name_len;
+    if (_sql.backend->thread_end)
+        _sql.backend->thread_end();
+    return NULL;
+}
 
-        _tbind[TBIND_v3_SECURITY_ENGINE].buffer = sqlb->security_engine;
-        _tbind[TBIND_v3_SECURITY_ENGINE].buffer_length =
-            sqlb->security_engine_len;
-    }
+/*
+ * start the writer thread.  This is done from the main loop, once
+ * snmptrapd has forked.
+ */
+static void
+_sql_writer_start(void)
+{
+    sigset_t     sigs, old;
+
+    if (_sql_writer)
+        return;
+
+    /** signals are for the main thread */
+    sigfillset(&sigs);
+    pthread_sigmask(SIG_BLOCK, &sigs, &old);
+    if (pthread_create(&_sql_thread, NULL, _sql_writer_run, NULL) == 0)
+        _sql_writer = 1;
     else {
-        _no_v3 = 1;
+        snmp_log(LOG_WARNING, "Could not start the sql writer thread; "
+                 "writing traps from the main loop\n");
+        _sql_writer = -1;
     }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+#endif /* NETSNMP_SQL_WRITER_THREAD */
 
-    if (mysql_stmt_bind_param(_sql.trap_stmt, _tbind) != 0) {
-        netsnmp_sql_stmt_error(_sql.trap_stmt,
-                               "Could not bind parameters for INSERT");
-        _sql_log(sqlb, NULL);
+/*
+ * log the counters.  The parameters are there so this function can be
+ * used as a netsnmp_alarm callback function.
+ */
+static void
+_sql_stats_log(u_int dontcare, void *meeither)
+{
+    u_int        queued, batch;
+    u_long       spooled;
+
+    SQL_LOCK();
+    queued = _sql.queued;
+    batch = _sql.batch;
+    spooled = _sql.spool_pending;
+    snmp_log(LOG_INFO, "sql: %lu traps received, %lu written in %lu "
+             "batches, %lu spooled, %lu logged, %lu dropped; queue %u "
+             "(peak %u), spool %lu, batch size %u; flush latency %lu ms "
+             "(avg %lu, max %lu)\n", _sql_stats.received,
+             _sql_stats.written, _sql_stats.batches, _sql_stats.spooled,
+             _sql_stats.logged, _sql_stats.dropped, queued,
+             _sql_stats.queue_peak, spooled, batch, _sql_stats.flush_last,
+             _sql_stats.batches ?
+             _sql_stats.flush_total / _sql_stats.batches : 0,
+             _sql_stats.flush_max);
+    SQL_UNLOCK();
+}
+
+/*
+ * sql cleanup function, called at shutdown (or exit)
+ */
+static void
+netsnmp_sql_cleanup(void)
+{
+    if (NULL == _sql.backend)
         return;
+
+    DEBUGMSGTL(("sql:cleanup"," called\n"));
+
+    /** unregister alarms */
+    if (_sql.alarm_id)
+        snmp_alarm_unregister(_sql.alarm_id);
+    if (_sql.stats_alarm_id)
+        snmp_alarm_unregister(_sql.stats_alarm_id);
+    if (_sql.flush_alarm_id) {
+        snmp_alarm_unregister(_sql.flush_alarm_id);
+        _sql.flush_alarm_id = 0;
     }
 
-    /** execute the prepared statement */
-    if (mysql_stmt_execute(_sql.trap_stmt) != 0) {
-        netsnmp_sql_stmt_error(_sql.trap_stmt,
-                               "Could not execute insert statement for trap");
-        _sql_log(sqlb, NULL);
-        return;
+    /** save any queued traps; try to reconnect first if needed */
+    _sql.connect_retry = 0;
+#ifdef NETSNMP_SQL_WRITER_THREAD
+    if (_sql_writer > 0) {
+        SQL_LOCK();
+        _sql_writer_stop = 1;
+        pthread_cond_signal(&_sql_cond);
+        SQL_UNLOCK();
+        pthread_join(_sql_thread, NULL);
+        _sql_writer = 0;
+    } else
+#endif
+    {
+        _sql_flush(0);
+        _sql.backend->disconnect();
     }
-    trap_id = mysql_insert_id(_sql.conn);
 
-    /*
-     * iterate over the varbinds, copy data and insert
-     */
-    it = CONTAINER_ITERATOR(sqlb->varbinds);
-    if (NULL == it) {
-        snmp_log(LOG_ERR,"Could not allocate iterator\n");
-        _sql_log(sqlb, NULL);
-        return;
+    _sql_stats_log(0, NULL);
+
+    if (_sql.spool) {
+        fclose(_sql.spool);
+        _sql.spool = NULL;
     }
+    SNMP_FREE(_sql.batch_buf);
 
-    for( sqlvb = ITERATOR_FIRST(it); sqlvb; sqlvb = ITERATOR_NEXT(it)) {
+    _sql.backend->cleanup();
+    _sql.backend = NULL;
+}
 
-        _vbind[VBIND_ID].buffer = (void *)&trap_id;
-        _vbind[VBIND_TYPE].buffer = (void *)&sqlvb->type;
+/*
+ * shutdown callback: clean up while logging still works
+ */
+static int
+_sql_shutdown(int majorID, int minorID, void *serverarg, void *clientarg)
+{
+    netsnmp_sql_cleanup();
+    return SNMPERR_SUCCESS;
+}
+
+/** one-time initialization for sql logging */
+int
+netsnmp_mysql_init(void)
+{
+    netsnmp_trapd_handler *traph;
+    int                    i;
 
-        _vbind[VBIND_OID].buffer = sqlvb->oid;
-        _vbind[VBIND_OID].buffer_length = sqlvb->oid_len;
+    DEBUGMSGTL(("sql:init","called\n"));
 
-        _vbind[VBIND_VAL].buffer = sqlvb->val;
-        _vbind[VBIND_VAL].buffer_length = sqlvb->val_len;
+    /** negative or 0 interval disables sql logging */
+    if (_sql.queue_interval <= 0) {
+        DEBUGMSGTL(("sql:init",
+                    "sql not enabled (sqlSaveInterval is <= 0)\n"));
+        return 0;
+    }
 
-        if (mysql_stmt_bind_param(_sql.vb_stmt, _vbind) != 0) {
-            netsnmp_sql_stmt_error(_sql.vb_stmt,
-                                   "Could not bind parameters for INSERT");
-            _sql_log(sqlb, NULL);
+    /** pick the backend */
+    for (i = 0; _sql_backends[i]; i++)
+        if (NULL == _sql.backend_name ||
+            strcasecmp(_sql.backend_name, _sql_backends[i]->name) == 0)
             break;
-        }
+    _sql.backend = _sql_backends[i];
+    if (NULL == _sql.backend) {
+        snmp_log(LOG_ERR, "sqlBackend %s is not available\n",
+                 _sql.backend_name);
+        return -1;
+    }
+    DEBUGMSGTL(("sql:init","using %s\n", _sql.backend->name));
+
+    /** batch sizes */
+    if (0 == _sql.batch_max)
+        _sql.batch_max = 1;
+    _sql.batch = SNMP_MIN(_sql.batch, _sql.batch_max);
+    _sql.batch_buf = calloc(_sql.batch_max, sizeof(sql_buf *));
+    if (NULL == _sql.batch_buf) {
+        snmp_log(LOG_ERR, "Could not allocate sql batch\n");
+        return -1;
+    }
 
-        if (mysql_stmt_execute(_sql.vb_stmt) != 0) {
-            netsnmp_sql_stmt_error(_sql.vb_stmt,
-                                   "Could not execute insert statement for varbind");
-            _sql_log(sqlb, NULL);
-            break;
+    if (_sql.backend->init() != 0) {
+        snmp_log(LOG_ERR, "Could not initialize sql backend %s\n",
+                 _sql.backend->name);
+        return -1;
+    }
+
+    if (_sql.spool_file && _sql_spool_open() != 0)
+        snmp_log(LOG_WARNING, "sql traps will not be spooled\n");
+
+#ifndef NETSNMP_SQL_WRITER_THREAD
+    /** try to connect; we'll try again later if we fail */
+    (void) _sql_connect();
+#endif
+
+    /** register periodic queue save */
+    _sql.alarm_id = snmp_alarm_register(_sql.queue_interval, /* seconds */
+                                        1,                   /* repeat */
+                                        _sql_process_queue,  /* function */
+                                        NULL);               /* client args */
+    if (_sql.stats_interval > 0)
+        _sql.stats_alarm_id = snmp_alarm_register(_sql.stats_interval, 1,
+                                                  _sql_stats_log, NULL);
+
+    /** add handler */
+    traph = netsnmp_add_global_traphandler(NETSNMPTRAPD_PRE_HANDLER,
+                                           mysql_handler);
+    if (NULL == traph) {
+        snmp_log(LOG_ERR, "Could not allocate sql trap handler\n");
+        return -1;
+    }
+    traph->authtypes = TRAP_AUTH_LOG;
+
+    snmp_register_callback(SNMP_CALLBACK_LIBRARY, SNMP_CALLBACK_SHUTDOWN,
+                           _sql_shutdown, NULL);
+    atexit(netsnmp_sql_cleanup);
+    return 0;
+}
+
+/*
+ * queue a trap for the database.  Once the queue is full, or while there
+ * are older traps in the spool, traps go to the spool; without a spool
+ * file they are logged and dropped.
+ */
+static void
+_sql_enqueue(sql_buf *sqlb)
+{
+    int          flush;
+
+    SQL_LOCK();
+    _sql_stats.received++;
+    if (_sql.queued >= _sql.queue_limit || _sql.spool_rd < _sql.spool_end) {
+        if (_sql.spool && _sql_spool_write(sqlb) == 0) {
+            _sql_stats.spooled++;
+            flush = !SQL_WRITER_RUNNING() &&
+                _sql.spool_pending >= _sql.queue_max;
+            SQL_UNLOCK();
+            _sql_buf_free(sqlb, NULL);
+            if (flush)
+                _sql_flush(1);
+            return;
         }
+        _sql_stats.dropped++;
+        SQL_UNLOCK();
+        DEBUGMSGTL(("sql:queue", "queue full; trap not saved\n"));
+        _sql_log(sqlb, NULL);
+        _sql_buf_free(sqlb, NULL);
+        return;
+    }
+
+    if (_sql.tail)
+        _sql.tail->next = sqlb;
+    else
+        _sql.head = sqlb;
+    _sql.tail = sqlb;
+    if (++_sql.queued > _sql_stats.queue_peak)
+        _sql_stats.queue_peak = _sql.queued;
+
+#ifdef NETSNMP_SQL_WRITER_THREAD
+    if (SQL_WRITER_RUNNING())
+        pthread_cond_signal(&_sql_cond);
+#endif
+    /** save queue if size is > max */
+    flush = !SQL_WRITER_RUNNING() && _sql.queued >= _sql.queue_max;
+    SQL_UNLOCK();
+
+    if (flush)
+        _sql_flush(1);
+    else if (!SQL_WRITER_RUNNING() && 0 == _sql.flush_alarm_id) {
+        /** write what has queued up by then in one batch */
+        struct timeval delay;
+
+        delay.tv_sec = 0;
+        delay.tv_usec = SQL_FLUSH_DELAY_MS * 1000;
+        _sql.flush_alarm_id = snmp_alarm_register_hr(delay, 0,
+                                                     _sql_flush_alarm, NULL);
     }
-    ITERATOR_RELEASE(it);
+}
+
+/*
+ * sql trap handler
+ */
+int
+mysql_handler(netsnmp_pdu           *pdu,
+              netsnmp_transport     *transport,
+              netsnmp_trapd_handler *handler)
+{
+    sql_buf     *sqlb;
+    int          old_format, rc;
+
+    DEBUGMSGTL(("sql:handler", "called\n"));
+
+#ifdef NETSNMP_SQL_WRITER_THREAD
+    _sql_writer_start();
+#endif
+
+    /** allocate a buffer to save data */
+    sqlb = _sql_buf_get();
+    if (NULL == sqlb) {
+        snmp_log(LOG_ERR, "Could not allocate trap sql buffer\n");
+        return syslog_handler( pdu, transport, handler );
+    }
+
+    /** save OID output format and change to numeric */
+    old_format = netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID,
+                                    NETSNMP_DS_LIB_OID_OUTPUT_FORMAT);
+    netsnmp_ds_set_int(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_OID_OUTPUT_FORMAT,
+                       NETSNMP_OID_OUTPUT_NUMERIC);
+
+
+    rc = _sql_save_trap_info(sqlb, pdu, transport);
+    rc = _sql_save_varbind_info(sqlb, pdu);
+
+    /** restore previous OID output format */
+    netsnmp_ds_set_int(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_OID_OUTPUT_FORMAT,
+                       old_format);
+
+    /** insert into queue */
+    _sql_enqueue(sqlb);
+
+    return rc;
+}
+
+/*
+ * the delayed flush of the traps queued since the first one arrived
+ */
+static void
+_sql_flush_alarm(u_int clientreg, void *clientarg)
+{
+    _sql.flush_alarm_id = 0;
+    if (SQL_WRITER_RUNNING())
+        return;
+    _sql_flush(1);
 }
 
 /*
@@ -1112,45 +2397,23 @@ _sql_save(sql_buf *sqlb, void *dontcare)
 static void
 _sql_process_queue(u_int dontcare, void *meeither)
 {
-    int        rc;
-
-    /** bail if the queue is empty */
-    if( 0 == CONTAINER_SIZE(_sql.queue))
+#ifdef NETSNMP_SQL_WRITER_THREAD
+    /** the writer thread does the work, once it is running */
+    _sql_writer_start();
+    if (SQL_WRITER_RUNNING())
         return;
+#endif
 
-    DEBUGMSGT(("sql:process", "processing %d queued traps\n",
-               (int)CONTAINER_SIZE(_sql.queue)));
+    DEBUGMSGT(("sql:process", "processing %u queued traps\n", _sql.queued));
 
     /*
-     * if we don't have a database connection, try to reconnect. We
-     * don't care if we fail - traps will be logged in that case.
+     * if we don't have a database connection, _sql_flush() tries to
+     * reconnect. We don't care if we fail - traps will be spooled or
+     * logged in that case.
      */
-    if (0 == _sql.connected) {
-        DEBUGMSGT(("sql:process", "no sql connection; reconnecting\n"));
-        (void) netsnmp_mysql_connect();
-    }
-
-    int sql_has_connected = _sql.connected;
-
-    CONTAINER_FOR_EACH(_sql.queue, (netsnmp_container_obj_func*)_sql_save,
-                       NULL);
-
-    if (_sql.connected) {
-        rc = mysql_commit(_sql.conn);
-        if (rc) { /* nuts... now what? */
-            netsnmp_sql_error("commit failed");
-            CONTAINER_FOR_EACH(_sql.queue,
-                               (netsnmp_container_obj_func*)_sql_log,
-                               NULL);
-        }
-    }
-
-    if (!sql_has_connected || _sql.connected) {
-        CONTAINER_CLEAR(_sql.queue, (netsnmp_container_obj_func*)_sql_buf_free,
-                        NULL);
-    }
+    _sql_flush(1);
 }
 
 #else
 int unused;	/* Suppress "empty translation unit" warning */
-#endif /* NETSNMP_USE_MYSQL */
+#endif /* NETSNMP_USE_MYSQL || NETSNMP_USE_SQLITE */
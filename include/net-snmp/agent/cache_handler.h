@@ -67,6 +67,19 @@ extern          "C" {
         oid *rootoid;
         int  rootoid_len;
 
+        /*
+         * Bumped by every load, so that users of the cached data can
+         * tell when their own derived state has gone stale.
+         */
+        u_int    generation;
+
+        /*
+         * For NETSNMP_CACHE_RELOAD_IN_BACKGROUND, and statistics
+         */
+        struct netsnmp_cache_reload_s *reload;  /* load in progress */
+        u_int    load_time;     /* of the last load (in ms) */
+        u_int    stale_served;  /* requests answered while reloading */
+        u_int    stale_age;     /* how long expired, when last served (ms) */
     };
 
 
@@ -99,6 +112,7 @@ extern          "C" {
                          const oid * rootoid, int rootoid_len);
     int netsnmp_cache_remove(netsnmp_cache *cache);
     int netsnmp_cache_free(netsnmp_cache *cache);
+    void netsnmp_cache_empty(netsnmp_cache *cache);
 
     netsnmp_mib_handler *
     netsnmp_cache_handler_get(netsnmp_cache* cache);
@@ -120,6 +134,7 @@ extern          "C" {
 #define NETSNMP_CACHE_PRELOAD                               0x0010
 #define NETSNMP_CACHE_AUTO_RELOAD                           0x0020
 #define NETSNMP_CACHE_RESET_TIMER_ON_USE                    0x0040
+#define NETSNMP_CACHE_RELOAD_IN_BACKGROUND                  0x0080
 
 #define NETSNMP_CACHE_HINT_HANDLER_ARGS                     0x1000
 
@@ -28,6 +28,7 @@
 #define NETSNMP_DS_AGENT_NO_CACHING     8       /* 1 = disable netsnmp_cache */
 #define NETSNMP_DS_AGENT_STRICT_DISMAN  9       /* 1 = "correct" object ordering */
 #define NETSNMP_DS_AGENT_DONT_RETAIN_NOTIFICATIONS 10   /* 1 = disable trap logging */
+#define NETSNMP_DS_AGENT_USE_EPOLL      11      /* 1 = wait for events with epoll */
 #define NETSNMP_DS_AGENT_DONT_LOG_TCPWRAPPERS_CONNECTS 12   /* 1 = disable logging */
 #define NETSNMP_DS_APP_DONT_LOG         NETSNMP_DS_AGENT_DONT_RETAIN_NOTIFICATIONS /* compat */
 #define NETSNMP_DS_AGENT_SKIPNFSINHOSTRESOURCES    13   /* 1 = don't store NFS entries in hrStorageTable */
@@ -55,6 +56,7 @@
 #define NETSNMP_DS_SMUX_SOCKET    5     /* ip:port socket addr */
 #define NETSNMP_DS_NOTIF_LOG_CTX  6     /* "" | "snmptrapd" */
 #define NETSNMP_DS_AGENT_TRAP_ADDR      7     /* used as v1 trap agent address */
+#define NETSNMP_DS_AGENT_PROC_NET_DIR   8     /* read tcp(6) here, not via sock_diag */
 
 /*
  * integers 
@@ -77,4 +79,5 @@
 #define NETSNMP_DS_AGENT_AVG_BULKVARBINDSIZE 15 /* avg varbind size estimate */
 #define NETSNMP_DS_AGENT_PDU_STATS_MAX       16 /* size of top N array*/
 #define NETSNMP_DS_AGENT_PDU_STATS_THRESHOLD 17 /* minimum threshold time */
+#define NETSNMP_DS_AGENT_WORKER_THREADS 18 /* threads serving UDP requests */
 #endif
@@ -309,6 +309,21 @@ extern          "C" {
 
     int             netsnmp_agent_listen_on(const char *port);
 
+    /*
+     * Worker threads serving the UDP NSAPs (agentWorkerThreads).  The main
+     * loop releases the agent while it waits for events, and handlers
+     * registered with HANDLER_CAN_THREADSAFE run without the agent lock.
+     */
+    struct netsnmp_handler_registration_s;
+
+    void            netsnmp_agent_workers_release(void);
+    void            netsnmp_agent_workers_acquire(void);
+    int             netsnmp_agent_epoll_wait(struct timeval *timeout);
+    int             netsnmp_agent_unlock_for_handler(const struct
+                                                     netsnmp_handler_registration_s
+                                                     *reginfo, int mode);
+    void            netsnmp_agent_relock_after_handler(void);
+
     void
         netsnmp_agent_add_list_data(netsnmp_agent_request_info *agent,
                                     netsnmp_data_list *node);
@@ -107,6 +107,10 @@ extern          "C" {
            (these two fields may change/disappear without warning) */
         Netsnmp_First_Data_Point *get_row_indexes;
         netsnmp_variable_list *indexes;
+
+        /** Sorted index of the rows, if enabled with
+            netsnmp_iterator_index_enable().  Private to the helper. */
+        struct netsnmp_iterator_index_s *row_index;
     } netsnmp_iterator_info;
 
 #define TABLE_ITERATOR_NAME "table_iterator"
@@ -126,6 +130,9 @@ extern          "C" {
     int netsnmp_register_table_iterator(netsnmp_handler_registration *reginfo,
                                         netsnmp_iterator_info *iinfo);
     void  netsnmp_iterator_delete_table(netsnmp_iterator_info *iinfo);
+    int   netsnmp_iterator_index_enable(netsnmp_iterator_info *iinfo,
+                                        int timeout);
+    void  netsnmp_iterator_index_invalidate(netsnmp_iterator_info *iinfo);
 
     void *netsnmp_extract_iterator_context(netsnmp_request_info *);
     void   netsnmp_insert_iterator_context(netsnmp_request_info *, void *);
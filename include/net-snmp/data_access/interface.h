@@ -54,6 +54,14 @@ extern          "C" {
  * be automatically calculated later.
  */
 #define NETSNMP_INTERFACE_FLAGS_CALCULATE_UCAST         0x00200000
+/* The per-interface IP parameters (retransmit and reachable time, IPv6
+ * forwarding) have not been read yet. Platforms where they are costly to
+ * fetch for every interface set this flag when loading the interface and
+ * leave the reading to netsnmp_access_interface_entry_ip_params_get(),
+ * which callers must use before looking at the HAS_V4_RETRANSMIT,
+ * HAS_V6_RETRANSMIT, HAS_V6_REACHABLE and HAS_V6_FORWARDING flags.
+ */
+#define NETSNMP_INTERFACE_FLAGS_IP_PARAMS_PENDING       0x00400000
 
 /*************************************************************
  * constants for enums for the MIB node
@@ -294,6 +302,7 @@ int netsnmp_access_interface_entry_copy(netsnmp_interface_entry * lhs,
  */
 void netsnmp_access_interface_entry_guess_speed(netsnmp_interface_entry *);
 void netsnmp_access_interface_entry_overrides(netsnmp_interface_entry *);
+void netsnmp_access_interface_entry_ip_params_get(netsnmp_interface_entry *);
 
 
 netsnmp_conf_if_list *
@@ -51,6 +51,13 @@ extern "C" {
          */
         int32_t         hrSWRunPerfCPU;
         int32_t         hrSWRunPerfMem;
+
+        /*
+         * used by the arch code to recognise a process on
+         * NETSNMP_SWRUN_UPDATE loads
+         */
+        unsigned long long start_time;
+        u_int           load_count;
         
     } netsnmp_swrun_entry;
 
@@ -82,6 +89,8 @@ extern "C" {
 
     netsnmp_swrun_entry *
     netsnmp_swrun_entry_create(int32_t swIndex);
+    netsnmp_swrun_entry *
+    netsnmp_swrun_entry_get_by_index(netsnmp_container *container, oid index);
 
     void netsnmp_swrun_entry_free(netsnmp_swrun_entry *entry);
 
@@ -97,7 +106,9 @@ extern "C" {
 #define NETSNMP_SWRUN_NOFLAGS            0x00000000
 #define NETSNMP_SWRUN_ALL_OR_NONE        0x00000001
 #define NETSNMP_SWRUN_DONT_FREE_ITEMS    0x00000002
-/*#define NETSNMP_SWRUN_xx                0x00000004 */
+/* update the entries already in the container (only if the arch supports it) */
+#define NETSNMP_SWRUN_UPDATE             0x00000004
+/*#define NETSNMP_SWRUN_xx                0x00000008 */
 
 #ifdef  __cplusplus
 }
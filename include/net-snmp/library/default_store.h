@@ -130,6 +130,7 @@ extern          "C" {
 #define NETSNMP_DS_LIB_RETRIES             15
 #define NETSNMP_DS_LIB_MSG_SEND_MAX        16 /* global max response size */
 #define NETSNMP_DS_LIB_FILTER_TYPE         17 /* 0=NONE, 1=whitelist, -1=blacklist */
+#define NETSNMP_DS_LIB_SERVER_UDP_BATCH    18 /* datagrams per recvmmsg() */
 #define NETSNMP_DS_LIB_MAX_INT_ID          48 /* match NETSNMP_DS_MAX_SUBIDS */
     
     /*
@@ -185,6 +186,7 @@ extern          "C" {
 #define NETSNMP_DS_LIB_OUTPUT_PRECISION  35
 #define NETSNMP_DS_LIB_TLS_MIN_VERSION   36
 #define NETSNMP_DS_LIB_TLS_MAX_VERSION   37
+#define NETSNMP_DS_LIB_MIB_CACHE_DIR     38 /* where to keep MIB caches */
 #define NETSNMP_DS_LIB_MAX_STR_ID        48 /* match NETSNMP_DS_MAX_SUBIDS */
 
     /*
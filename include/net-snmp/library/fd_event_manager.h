@@ -128,6 +128,50 @@ void netsnmp_dispatch_external_events2(int *count,
                                        netsnmp_large_fd_set *readfds,
                                        netsnmp_large_fd_set *writefds,
                                        netsnmp_large_fd_set *exceptfds);
+
+/*
+ * epoll Event Loop
+ *
+ * Description:
+ *   An alternative to the select() based functions above for event loops
+ *   that serve many file descriptors.  Once netsnmp_epoll_init() has
+ *   succeeded, the sockets of all sessions in the session list and all
+ *   fds registered through register_readfd() and friends are kept in an
+ *   epoll set as they come and go.  netsnmp_epoll_wait() then replaces
+ *   the netsnmp_external_event_info2() / select() /
+ *   netsnmp_dispatch_external_events2() / snmp_read2() sequence: it waits
+ *   for at most *timeout (forever if timeout is NULL), calls the callbacks
+ *   of the registered fds that are ready and reads the sessions whose
+ *   socket is ready.  The timeout is still obtained from
+ *   snmp_select_info2(), which accepts a NULL fdset for this purpose.
+ *   netsnmp_epoll_ready() only does the waiting and leaves the events to
+ *   a following netsnmp_epoll_wait(), for callers that drop locks while
+ *   they wait.
+ *
+ * Return Value:
+ *   netsnmp_epoll_init() returns 0 on success and -1 if epoll is not
+ *   available, in which case the caller should keep using select().
+ *   netsnmp_epoll_wait() returns the number of ready fds, 0 on timeout
+ *   and -1 on error with errno set, like select().  netsnmp_epoll_ready()
+ *   returns a positive number if any fd is ready, otherwise likewise.
+ */
+NETSNMP_IMPORT
+int  netsnmp_epoll_init(void);
+NETSNMP_IMPORT
+void netsnmp_epoll_shutdown(void);
+NETSNMP_IMPORT
+int  netsnmp_epoll_is_active(void);
+NETSNMP_IMPORT
+int  netsnmp_epoll_ready(struct timeval *timeout);
+NETSNMP_IMPORT
+int  netsnmp_epoll_wait(struct timeval *timeout);
+
+/* Re-synchronise the epoll interest in fd [internal]. */
+void netsnmp_epoll_update_fd(int fd);
+/* Session list hooks for the epoll event loop, in snmp_api.c [internal]. */
+int  netsnmp_sess_sock_in_use(int sock);
+void netsnmp_sess_epoll_register(void);
+
 #ifdef __cplusplus
 }
 #endif
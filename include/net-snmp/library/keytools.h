@@ -29,6 +29,13 @@ extern          "C" {
                                 const u_char * P, size_t pplen,
                                 u_char * Ku, size_t * kulen);
 
+    NETSNMP_IMPORT
+    void            netsnmp_ku_cache_set_size(int size);
+    NETSNMP_IMPORT
+    void            netsnmp_ku_cache_clear(void);
+    NETSNMP_IMPORT
+    void            netsnmp_ku_cache_get_stats(u_int *hits, u_int *misses);
+
     NETSNMP_IMPORT
     int             generate_kul(const oid * hashtype, u_int hashtype_len,
                                  const u_char * engineID, size_t engineID_len,
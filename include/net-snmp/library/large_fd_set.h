@@ -111,6 +111,7 @@ int    netsnmp_large_fd_is_set(SOCKET fd, netsnmp_large_fd_set *fdset);
 void   netsnmp_large_fd_setfd( int fd, netsnmp_large_fd_set *fdset);
 void   netsnmp_large_fd_clr(   int fd, netsnmp_large_fd_set *fdset);
 int    netsnmp_large_fd_is_set(int fd, netsnmp_large_fd_set *fdset);
+int    netsnmp_large_fd_set_next(int fd, netsnmp_large_fd_set *fdset);
 
 #endif
 
@@ -38,8 +38,20 @@ extern          "C" {
 #define MT_LIB_MESSAGEID   3
 #define MT_LIB_SESSIONID   4
 #define MT_LIB_TRANSID     5
+#define MT_LIB_SCAPI       6    /* cached crypto key state */
+#define MT_LIB_KEYTOOLS    7    /* master key cache */
+#define MT_LIB_MIBPRINT    8    /* last printed OID prefix */
+#define MT_LIB_ENGINETIME  9    /* remote engine times (lcd_time) */
+#define MT_LIB_LOGGING     10   /* log handlers and debug tokens */
 
-#define MT_LIB_MAXIMUM     6    /* must be one greater than the last one */
+#define MT_LIB_MAXIMUM     11   /* must be one greater than the last one */
+
+/*
+ * Lock resource identifiers for application resources
+ * (fewer than MT_LIB_MAXIMUM)
+ */
+#define MT_APP_AGENT       1    /* agent request processing */
+#define MT_APP_TRAPD       2    /* snmptrapd worker threads: VACM, resolver */
 
 
 #if defined(NETSNMP_REENTRANT) || defined(WIN32)
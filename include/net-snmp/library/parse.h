@@ -212,6 +212,10 @@ SOFTWARE.
     NETSNMP_IMPORT
     struct tree    *find_tree_node(const char *, int);
     NETSNMP_IMPORT
+    struct tree    *find_tree_child(struct tree *, u_long);
+    NETSNMP_IMPORT
+    unsigned int    get_tree_generation(void);
+    NETSNMP_IMPORT
     const char     *get_tc_descriptor(int);
     NETSNMP_IMPORT
     const char     *get_tc_description(int);
@@ -227,6 +231,10 @@ SOFTWARE.
     NETSNMP_IMPORT
     struct module  *find_module(int);
     void            adopt_orphans(void);
+    int             netsnmp_mib_cache_load(const char *file,
+                                           const char *key);
+    void            netsnmp_mib_cache_save(const char *file,
+                                           const char *key);
     NETSNMP_IMPORT
     char           *snmp_mib_toggle_options(char *options);
     NETSNMP_IMPORT
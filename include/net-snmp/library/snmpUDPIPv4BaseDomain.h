@@ -29,6 +29,10 @@ extern          "C" {
  * Prototypes
  */
 
+    /*
+     * A non-zero local opens a server; NETSNMP_TSPEC_REUSEPORT may be
+     * or-ed into it to let several servers share the port.
+     */
     netsnmp_transport *
     netsnmp_udpipv4base_transport(const struct netsnmp_ep *ep, int local);
 
@@ -180,6 +180,8 @@ typedef struct request_list {
 
 #define SNMP_DETAIL_SIZE        512
 
+#define SNMP_FLAGS_PDU_ARENA       0x2000 /* parse received varbinds into an arena */
+#define SNMP_FLAGS_OWN_THREAD      0x1000 /* read by its own thread, not snmp_read() */
 #define SNMP_FLAGS_UDP_BROADCAST   0x800
 #define SNMP_FLAGS_RESP_CALLBACK   0x400      /* Additional callback on response */
 #define SNMP_FLAGS_USER_CREATED    0x200      /* USM user has been created */
@@ -315,6 +317,36 @@ typedef struct request_list {
 
     NETSNMP_IMPORT void snmp_free_var_internals(netsnmp_variable_list *);     /* frees contents only */
 
+    /*
+     * PDU arenas.  Once enabled on a PDU, snmp_pdu_parse() carves the
+     * varbinds and any values too large for their inline buffers out of a
+     * few large chunks, which snmp_free_pdu() releases in one go.  Varbinds
+     * taken from such a PDU must be cloned if they are to outlive it.
+     */
+#define NETSNMP_VARBIND_ARENA_STRUCT 0x01  /* the varbind lives in an arena */
+#define NETSNMP_VARBIND_ARENA_VALUE  0x02  /* val points into an arena */
+
+    NETSNMP_IMPORT int  netsnmp_pdu_arena_enable(netsnmp_pdu *pdu);
+    NETSNMP_IMPORT void *netsnmp_pdu_arena_alloc(netsnmp_pdu *pdu, size_t size);
+    NETSNMP_IMPORT void netsnmp_pdu_arena_release(netsnmp_pdu *pdu);
+    NETSNMP_IMPORT void netsnmp_pdu_arena_get_stats(const netsnmp_pdu *pdu,
+                                                    u_int *chunks,
+                                                    size_t *used);
+
+    /*
+     * Notification fan-out.  The varbind list of a PDU about to be sent to
+     * many destinations can be encoded once; copies made with
+     * netsnmp_clone_pdu_encoded() share those bytes instead of the
+     * varbinds, so only the headers and the security wrapper are built
+     * for each destination.  The encoding must be released before the
+     * varbinds of the original PDU are changed.
+     */
+    NETSNMP_IMPORT int  netsnmp_pdu_encode_varbinds(netsnmp_pdu *pdu);
+    NETSNMP_IMPORT void netsnmp_pdu_share_encoded_varbinds(netsnmp_pdu *to,
+                                                          const netsnmp_pdu *from);
+    NETSNMP_IMPORT void netsnmp_pdu_release_encoded_varbinds(netsnmp_pdu *pdu);
+    NETSNMP_IMPORT size_t netsnmp_pdu_encoded_varbinds_len(const netsnmp_pdu *pdu);
+
 
     /*
      * This routine must be supplied by the application:
@@ -75,6 +75,8 @@ extern          "C" {
 
     netsnmp_pdu    *snmp_split_pdu(netsnmp_pdu *, int skipCount,
                                    int copyCount);
+    NETSNMP_IMPORT
+    netsnmp_pdu    *netsnmp_clone_pdu_encoded(netsnmp_pdu *pdu);
 
     unsigned long   snmp_varbind_len(netsnmp_pdu *pdu);
     NETSNMP_IMPORT
@@ -57,6 +57,7 @@ extern          "C" {
 #define		NETSNMP_TRANSPORT_FLAG_OPENED	 0x20  /* f_open called */
 #define		NETSNMP_TRANSPORT_FLAG_SHARED	 0x40
 #define		NETSNMP_TRANSPORT_FLAG_HOSTNAME	 0x80  /* for fmtaddr hook */
+#define		NETSNMP_TRANSPORT_FLAG_RECV_PENDING 0x100 /* f_recv queued */
 
 /*  The standard SNMP domains.  */
 
@@ -116,6 +117,7 @@ typedef struct netsnmp_tmStateReference_s {
 
 #define NETSNMP_TSPEC_LOCAL                     0x01 /* 1=server, 0=client */
 #define NETSNMP_TSPEC_PREBOUND                  0x02 /* 1=bound by systemd, 0=needs bind in the library */
+#define NETSNMP_TSPEC_REUSEPORT                 0x04 /* 1=servers may share the port (SO_REUSEPORT) */
 
 struct netsnmp_container_s; /* forward decl */
 typedef struct netsnmp_tdomain_spec_s {
@@ -218,6 +220,10 @@ typedef struct netsnmp_transport_s {
     void           (*f_get_taddr)(struct netsnmp_transport_s *t,
                                   void **addr, size_t *addr_len);
 
+    /* recvmmsg()/sendmmsg() state of UDP server transports [internal];
+       a single allocation released by netsnmp_transport_free() */
+    struct netsnmp_udpbase_batch_s *batch;
+
 } netsnmp_transport;
 
 typedef struct netsnmp_transport_list_s {
@@ -82,6 +82,9 @@ extern          "C" {
         void           *usmDHUserPrivKeyChange;
         struct usmUser *next;
         struct usmUser *prev;
+        /* transform state kept across messages, see sc_cache_new() */
+        struct netsnmp_sc_cache_s *sc_cache;
+        struct usmUser *hashNext;   /* chain in the user lookup index */
     };
 
 #define USMUSER_FLAG_KEEP_MASTER_KEY             0x01
@@ -13,4 +13,17 @@ static int __did_plan = 0;
 
 #define PLAN(number) do { printf("1..%d\n", number); __did_plan = 1; } while (0)
 
+/* Tests that print how long their work took measure it with this: pass
+   the start time, taken with netsnmp_get_monotonic_clock(), and get the
+   microseconds since. */
+NETSNMP_STATIC_INLINE long
+test_elapsed_us(const struct timeval *start)
+{
+    struct timeval now;
+
+    netsnmp_get_monotonic_clock(&now);
+    return (now.tv_sec - start->tv_sec) * 1000000 +
+        (now.tv_usec - start->tv_usec);
+}
+
 #endif /* NETSNMP_LIBRARY_TESTING_H */
@@ -139,6 +139,12 @@ extern          "C" {
     void            vacm_destroyViewEntry(const char *, oid *, size_t);
     NETSNMP_IMPORT
     void            vacm_destroyAllViewEntries(void);
+    NETSNMP_IMPORT
+    void            vacm_viewEntriesChanged(void);
+    /*
+     * To be called after changing the mask or type of an existing
+     * viewEntry, for the next checks to see the change.
+     */
 
 #define VACM_MODE_FIND                0
 #define VACM_MODE_IGNORE_MASK         1
@@ -267,6 +273,11 @@ extern          "C" {
                                             const char *viewName,
                                             oid * viewSubtree,
                                             size_t viewSubtreeLen, int mode);
+    NETSNMP_IMPORT
+    int    netsnmp_view_subtree_check(struct vacm_viewEntry *head,
+                                      const char *viewName,
+                                      oid * viewSubtree,
+                                      size_t viewSubtreeLen);
 
     NETSNMP_IMPORT
     int    netsnmp_vacm_simple_usm_add(const char *user, int rw, int authLevel,
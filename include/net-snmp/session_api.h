@@ -267,6 +267,14 @@ extern          "C" {
     NETSNMP_IMPORT
     int             snmp_sess_read2(struct session_list *,
                                     netsnmp_large_fd_set *);
+    /*
+     * Decodes a datagram received on the session's transport without
+     * calling the session callback; may be called from several threads.
+     */
+    NETSNMP_IMPORT
+    netsnmp_pdu    *snmp_sess_parse_packet(struct session_list *,
+                                           void *opaque, int olength,
+                                           u_char *packet, int length);
     NETSNMP_IMPORT
     void            snmp_sess_timeout(struct session_list *);
     NETSNMP_IMPORT
@@ -130,6 +130,8 @@ typedef struct variable_list {
    /** callback to free above */
    void            (*dataFreeHook)(void *);    
    int             index;
+   /** NETSNMP_VARBIND_ARENA_* bits: storage owned by the PDU's arena */
+   u_char          flags;
 } netsnmp_variable_list;
 
 
@@ -241,6 +243,12 @@ typedef struct snmp_pdu {
     int             range_subid;
     
     void           *securityStateRef;
+
+    /** opt-in arena backing the varbinds of a received PDU, or NULL */
+    struct netsnmp_pdu_arena_s *arena;
+
+    /** varbind list encoded once for several destinations, or NULL */
+    struct netsnmp_encoded_varbinds_s *encoded_vars;
 } netsnmp_pdu;
 
 
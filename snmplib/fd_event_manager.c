@@ -9,6 +9,15 @@
 #include <net-snmp/library/fd_event_manager.h>
 #include <net-snmp/library/snmp_logging.h>
 #include <net-snmp/library/large_fd_set.h>
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <errno.h>
+#include <limits.h>
+#include <string.h>
 
 netsnmp_feature_child_of(fd_event_manager, libnetsnmp);
 
@@ -38,6 +47,7 @@ register_readfd(int fd, void (*func) (int, void *), void *data)
         external_readfd_data[external_readfdlen] = data;
         external_readfdlen++;
         DEBUGMSGTL(("fd_event_manager:register_readfd", "registered fd %d\n", fd));
+        netsnmp_epoll_update_fd(fd);
         return FD_REGISTERED_OK;
     } else {
         snmp_log(LOG_CRIT, "register_readfd: too many file descriptors\n");
@@ -58,6 +68,7 @@ register_writefd(int fd, void (*func) (int, void *), void *data)
         external_writefd_data[external_writefdlen] = data;
         external_writefdlen++;
         DEBUGMSGTL(("fd_event_manager:register_writefd", "registered fd %d\n", fd));
+        netsnmp_epoll_update_fd(fd);
         return FD_REGISTERED_OK;
     } else {
         snmp_log(LOG_CRIT,
@@ -79,6 +90,7 @@ register_exceptfd(int fd, void (*func) (int, void *), void *data)
         external_exceptfd_data[external_exceptfdlen] = data;
         external_exceptfdlen++;
         DEBUGMSGTL(("fd_event_manager:register_exceptfd", "registered fd %d\n", fd));
+        netsnmp_epoll_update_fd(fd);
         return FD_REGISTERED_OK;
     } else {
         snmp_log(LOG_CRIT,
@@ -105,6 +117,7 @@ unregister_readfd(int fd)
             }
             DEBUGMSGTL(("fd_event_manager:unregister_readfd", "unregistered fd %d\n", fd));
             external_fd_unregistered = 1;
+            netsnmp_epoll_update_fd(fd);
             return FD_UNREGISTERED_OK;
         }
     }
@@ -129,6 +142,7 @@ unregister_writefd(int fd)
             }
             DEBUGMSGTL(("fd_event_manager:unregister_writefd", "unregistered fd %d\n", fd));
             external_fd_unregistered = 1;
+            netsnmp_epoll_update_fd(fd);
             return FD_UNREGISTERED_OK;
         }
     }
@@ -154,6 +168,7 @@ unregister_exceptfd(int fd)
             DEBUGMSGTL(("fd_event_manager:unregister_exceptfd", "unregistered fd %d\n",
                         fd));
             external_fd_unregistered = 1;
+            netsnmp_epoll_update_fd(fd);
             return FD_UNREGISTERED_OK;
         }
     }
@@ -292,6 +307,236 @@ void netsnmp_dispatch_external_events2(int *count,
       }
   }
 }
+
+#ifdef HAVE_SYS_EPOLL_H
+/*
+ * epoll event loop.  The interest set of an fd is recomputed from scratch
+ * whenever a session or an external registration for it comes or goes, so
+ * that an fd shared by several users, or closed and reused, is watched
+ * for exactly the events somebody still wants.
+ */
+#define NETSNMP_EPOLL_MAX_EVENTS 256
+
+static int epoll_fd = -1;
+static netsnmp_large_fd_set epoll_readfds;
+
+static int
+_epoll_find(const int *fds, int len, int fd)
+{
+    int             i;
+
+    for (i = 0; i < len; i++)
+        if (fds[i] == fd)
+            return i;
+    return -1;
+}
+
+void
+netsnmp_epoll_update_fd(int fd)
+{
+    struct epoll_event ev;
+
+    if (epoll_fd < 0 || fd < 0)
+        return;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.data.fd = fd;
+    if (_epoll_find(external_readfd, external_readfdlen, fd) >= 0 ||
+        netsnmp_sess_sock_in_use(fd))
+        ev.events |= EPOLLIN;
+    if (_epoll_find(external_writefd, external_writefdlen, fd) >= 0)
+        ev.events |= EPOLLOUT;
+    if (_epoll_find(external_exceptfd, external_exceptfdlen, fd) >= 0)
+        ev.events |= EPOLLPRI;
+
+    if (ev.events == 0) {
+        /* closed fds have already been dropped by the kernel */
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_DEL, fd, &ev) == 0)
+            DEBUGMSGTL(("fd_event_manager:epoll", "removed fd %d\n", fd));
+        return;
+    }
+    if (epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &ev) < 0 &&
+        (errno != ENOENT || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &ev) < 0)) {
+        snmp_log(LOG_ERR, "epoll_ctl(%d): %s\n", fd, strerror(errno));
+        return;
+    }
+    DEBUGMSGTL(("fd_event_manager:epoll", "watching fd %d for 0x%x\n", fd,
+                (unsigned)ev.events));
+}
+
+int
+netsnmp_epoll_init(void)
+{
+    int             i;
+
+    if (epoll_fd >= 0)
+        return 0;
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        snmp_log(LOG_ERR, "epoll_create1: %s\n", strerror(errno));
+        return -1;
+    }
+    if (epoll_readfds.lfs_setsize == 0) {
+        netsnmp_large_fd_set_init(&epoll_readfds, FD_SETSIZE);
+        NETSNMP_LARGE_FD_ZERO(&epoll_readfds);
+    }
+
+    for (i = 0; i < external_readfdlen; i++)
+        netsnmp_epoll_update_fd(external_readfd[i]);
+    for (i = 0; i < external_writefdlen; i++)
+        netsnmp_epoll_update_fd(external_writefd[i]);
+    for (i = 0; i < external_exceptfdlen; i++)
+        netsnmp_epoll_update_fd(external_exceptfd[i]);
+    netsnmp_sess_epoll_register();
+    DEBUGMSGTL(("fd_event_manager:epoll", "using epoll fd %d\n", epoll_fd));
+    return 0;
+}
+
+void
+netsnmp_epoll_shutdown(void)
+{
+    if (epoll_fd < 0)
+        return;
+    close(epoll_fd);
+    epoll_fd = -1;
+}
+
+int
+netsnmp_epoll_is_active(void)
+{
+    return epoll_fd >= 0;
+}
+
+static int
+_epoll_timeout_ms(const struct timeval *timeout)
+{
+    if (timeout == NULL)
+        return -1;
+    if (timeout->tv_sec < 0)
+        return 0;
+    if (timeout->tv_sec >= INT_MAX / 1000 - 1)
+        return INT_MAX;
+    return timeout->tv_sec * 1000 + (timeout->tv_usec + 999) / 1000;
+}
+
+int
+netsnmp_epoll_ready(struct timeval *timeout)
+{
+    struct epoll_event event;
+
+    if (epoll_fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+    /* level-triggered, so the events stay pending */
+    return epoll_wait(epoll_fd, &event, 1, _epoll_timeout_ms(timeout));
+}
+
+int
+netsnmp_epoll_wait(struct timeval *timeout)
+{
+    struct epoll_event events[NETSNMP_EPOLL_MAX_EVENTS];
+    int             count, i, j, fd, ms, sessions = 0;
+
+    if (epoll_fd < 0) {
+        errno = EBADF;
+        return -1;
+    }
+
+    ms = _epoll_timeout_ms(timeout);
+    count = epoll_wait(epoll_fd, events, NETSNMP_EPOLL_MAX_EVENTS, ms);
+    DEBUGMSGTL(("fd_event_manager:epoll", "epoll_wait(%d ms) returned %d\n",
+                ms, count));
+    if (count <= 0)
+        return count;
+
+    /*
+     * Like select(), report errors and hangups as readable and writable.
+     * External callbacks run first and, as with
+     * netsnmp_dispatch_external_events2(), take the fd away from
+     * snmp_read2().  The registrations are looked up again for every
+     * event since a callback may (un)register fds.
+     */
+    for (i = 0; i < count; i++) {
+        uint32_t        ev = events[i].events;
+        int             handled = 0;
+
+        fd = events[i].data.fd;
+        if (ev & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            if ((j = _epoll_find(external_readfd, external_readfdlen,
+                                 fd)) >= 0) {
+                DEBUGMSGTL(("fd_event_manager:netsnmp_epoll_wait",
+                            "readfd[%d] = %d\n", j, fd));
+                external_readfdfunc[j] (fd, external_readfd_data[j]);
+                handled = 1;
+            }
+        }
+        if (ev & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+            if ((j = _epoll_find(external_writefd, external_writefdlen,
+                                 fd)) >= 0) {
+                DEBUGMSGTL(("fd_event_manager:netsnmp_epoll_wait",
+                            "writefd[%d] = %d\n", j, fd));
+                external_writefdfunc[j] (fd, external_writefd_data[j]);
+            }
+        }
+        if (ev & EPOLLPRI) {
+            if ((j = _epoll_find(external_exceptfd, external_exceptfdlen,
+                                 fd)) >= 0) {
+                DEBUGMSGTL(("fd_event_manager:netsnmp_epoll_wait",
+                            "exceptfd[%d] = %d\n", j, fd));
+                external_exceptfdfunc[j] (fd, external_exceptfd_data[j]);
+            }
+        }
+        if (!handled && (ev & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+            NETSNMP_LARGE_FD_SET(fd, &epoll_readfds);
+            sessions++;
+        }
+    }
+
+    if (sessions) {
+        snmp_read2(&epoll_readfds);
+        for (i = 0; i < count; i++)
+            NETSNMP_LARGE_FD_CLR(events[i].data.fd, &epoll_readfds);
+    }
+    return count;
+}
+#else  /* !HAVE_SYS_EPOLL_H */
+void
+netsnmp_epoll_update_fd(int fd)
+{
+}
+
+int
+netsnmp_epoll_init(void)
+{
+    return -1;
+}
+
+void
+netsnmp_epoll_shutdown(void)
+{
+}
+
+int
+netsnmp_epoll_is_active(void)
+{
+    return 0;
+}
+
+int
+netsnmp_epoll_ready(struct timeval *timeout)
+{
+    errno = ENOSYS;
+    return -1;
+}
+
+int
+netsnmp_epoll_wait(struct timeval *timeout)
+{
+    errno = ENOSYS;
+    return -1;
+}
+#endif /* !HAVE_SYS_EPOLL_H */
 #else  /*  !NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER */
 netsnmp_feature_unused(fd_event_manager);
 #endif /*  !NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER */
@@ -400,23 +400,17 @@ void
 printU64(char *buf, /* char [I64CHARSZ+1]; */
          const struct counter64 *pu64)
 {
-    struct counter64 u64a;
-    struct counter64 u64b;
-
+    uint64_t        u64 = ((uint64_t) (pu64->high & 0xffffffff) << 32) |
+        (pu64->low & 0xffffffff);
     char            aRes[I64CHARSZ + 1];
-    unsigned int    u;
-    int             j;
-
-    u64a = *pu64;
-    aRes[I64CHARSZ] = 0;
-    for (j = 0; j < I64CHARSZ; j++) {
-        divBy10(u64a, &u64b, &u);
-        aRes[(I64CHARSZ - 1) - j] = (char) ('0' + u);
-        u64a = u64b;
-        if (isZeroU64(&u64a))
-            break;
-    }
-    strcpy(buf, &aRes[(I64CHARSZ - 1) - j]);
+    char           *cp = &aRes[I64CHARSZ];
+
+    *cp = 0;
+    do {
+        *--cp = (char) ('0' + u64 % 10);
+        u64 /= 10;
+    } while (u64);
+    strcpy(buf, cp);
 }
 
 /** Convert a signed 64-bit number to ASCII. */
@@ -69,6 +69,7 @@
 
 #include <net-snmp/library/snmp_secmod.h>
 #include <net-snmp/library/snmpusm.h>
+#include <net-snmp/library/mt_support.h>
 
 netsnmp_feature_child_of(usm_support, libnetsnmp);
 netsnmp_feature_child_of(usm_keytools, usm_support);
@@ -108,9 +109,9 @@ netsnmp_feature_child_of(usm_keytools, usm_support);
  *	 cause an error to be returned.
  *	 (Punt this check to the cmdline apps?  XXX)
  */
-int
-generate_Ku(const oid * hashtype, u_int hashtype_len,
-            const u_char * P, size_t pplen, u_char * Ku, size_t * kulen)
+static int
+_generate_Ku(const oid * hashtype, u_int hashtype_len,
+             const u_char * P, size_t pplen, u_char * Ku, size_t * kulen)
 #if defined(NETSNMP_USE_INTERNAL_MD5) || defined(NETSNMP_USE_OPENSSL) || defined(NETSNMP_USE_INTERNAL_CRYPTO)
 {
     int             rval = SNMPERR_SUCCESS,
@@ -301,7 +302,7 @@ generate_Ku(const oid * hashtype, u_int hashtype_len,
 #endif
     return rval;
 
-}                               /* end generate_Ku() */
+}                               /* end _generate_Ku() */
 #elif defined(NETSNMP_USE_PKCS11)
 {
     int             rval = SNMPERR_SUCCESS, auth_type;;
@@ -346,10 +347,176 @@ generate_Ku(const oid * hashtype, u_int hashtype_len,
   generate_Ku_quit:
 
     return rval;
-}                               /* end generate_Ku() */
+}                               /* end _generate_Ku() */
 #else
 _KEYTOOLS_NOT_AVAILABLE
 #endif                          /* internal or openssl */
+
+/*
+ * Cache of master keys, keyed by hash transform and a digest of the
+ * passphrase, so that sessions sharing a passphrase only pay for the
+ * passphrase expansion once.  The least recently used entry is evicted
+ * when the cache is full; evicted entries are wiped.
+ */
+#define KU_CACHE_DEFAULT_SIZE   16
+#define KU_CACHE_KEY_LEN        BYTESIZE(SNMP_TRANS_AUTHLEN_HMAC384SHA512)
+
+struct ku_cache_entry {
+    int             auth_type;
+    size_t          pplen;
+    u_char          digest[KU_CACHE_KEY_LEN];
+    size_t          digest_len;
+    u_char          Ku[KU_CACHE_KEY_LEN];
+    size_t          kulen;
+    u_int           last_used;  /* 0 if the entry is free */
+};
+
+static struct ku_cache_entry *ku_cache = NULL;
+static int      ku_cache_size = KU_CACHE_DEFAULT_SIZE;
+static u_int    ku_cache_clock = 0;
+static u_int    ku_cache_hits = 0;
+static u_int    ku_cache_misses = 0;
+
+static struct ku_cache_entry *
+_ku_cache_find(int auth_type, size_t pplen, const u_char *digest,
+               size_t digest_len)
+{
+    int             i;
+
+    for (i = 0; ku_cache && i < ku_cache_size; i++) {
+        struct ku_cache_entry *e = &ku_cache[i];
+
+        if (e->last_used && e->auth_type == auth_type &&
+            e->pplen == pplen && e->digest_len == digest_len &&
+            memcmp(e->digest, digest, digest_len) == 0)
+            return e;
+    }
+    return NULL;
+}
+
+static void
+_ku_cache_add(int auth_type, size_t pplen, const u_char *digest,
+              size_t digest_len, const u_char *Ku, size_t kulen)
+{
+    struct ku_cache_entry *e, *victim = NULL;
+    int             i;
+
+    if (ku_cache_size <= 0 || kulen > KU_CACHE_KEY_LEN ||
+        digest_len > KU_CACHE_KEY_LEN)
+        return;
+    if (ku_cache == NULL) {
+        ku_cache = calloc(ku_cache_size, sizeof(*ku_cache));
+        if (ku_cache == NULL)
+            return;
+    }
+    if (_ku_cache_find(auth_type, pplen, digest, digest_len))
+        return;                 /* added by another thread meanwhile */
+    for (i = 0; i < ku_cache_size; i++) {
+        e = &ku_cache[i];
+        if (victim == NULL || e->last_used < victim->last_used)
+            victim = e;
+    }
+    SNMP_ZERO(victim, sizeof(*victim));
+    victim->auth_type = auth_type;
+    victim->pplen = pplen;
+    memcpy(victim->digest, digest, digest_len);
+    victim->digest_len = digest_len;
+    memcpy(victim->Ku, Ku, kulen);
+    victim->kulen = kulen;
+    victim->last_used = ++ku_cache_clock;
+}
+
+static void
+_ku_cache_wipe(void)
+{
+    if (ku_cache) {
+        SNMP_ZERO(ku_cache, ku_cache_size * sizeof(*ku_cache));
+        SNMP_FREE(ku_cache);
+    }
+}
+
+/**
+ * Sets the number of master keys that generate_Ku() remembers.  A size of
+ * 0 disables the cache.  Cached keys are wiped.
+ */
+void
+netsnmp_ku_cache_set_size(int size)
+{
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_KEYTOOLS);
+    _ku_cache_wipe();
+    ku_cache_size = size < 0 ? 0 : size;
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_KEYTOOLS);
+}
+
+/**
+ * Wipes all cached master keys and resets the statistics.
+ */
+void
+netsnmp_ku_cache_clear(void)
+{
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_KEYTOOLS);
+    _ku_cache_wipe();
+    ku_cache_hits = ku_cache_misses = 0;
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_KEYTOOLS);
+}
+
+/**
+ * Returns the number of generate_Ku() calls answered from and missing in
+ * the master key cache.
+ */
+void
+netsnmp_ku_cache_get_stats(u_int *hits, u_int *misses)
+{
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_KEYTOOLS);
+    if (hits)
+        *hits = ku_cache_hits;
+    if (misses)
+        *misses = ku_cache_misses;
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_KEYTOOLS);
+}
+
+int
+generate_Ku(const oid * hashtype, u_int hashtype_len,
+            const u_char * P, size_t pplen, u_char * Ku, size_t * kulen)
+{
+    struct ku_cache_entry *e;
+    u_char          digest[KU_CACHE_KEY_LEN];
+    size_t          digest_len = sizeof(digest);
+    int             auth_type, rval;
+
+    if (ku_cache_size <= 0 || !hashtype || !P || !Ku || !kulen ||
+        pplen < USM_LENGTH_P_MIN)
+        return _generate_Ku(hashtype, hashtype_len, P, pplen, Ku, kulen);
+
+    auth_type = sc_get_authtype(hashtype, hashtype_len);
+    if (auth_type < 0 ||
+        sc_hash_type(auth_type, P, pplen, digest, &digest_len) !=
+        SNMPERR_SUCCESS)
+        return _generate_Ku(hashtype, hashtype_len, P, pplen, Ku, kulen);
+
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_KEYTOOLS);
+    e = _ku_cache_find(auth_type, pplen, digest, digest_len);
+    if (e && e->kulen <= *kulen) {
+        memcpy(Ku, e->Ku, e->kulen);
+        *kulen = e->kulen;
+        e->last_used = ++ku_cache_clock;
+        ku_cache_hits++;
+        snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_KEYTOOLS);
+        memset(digest, 0, sizeof(digest));
+        return SNMPERR_SUCCESS;
+    }
+    ku_cache_misses++;
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_KEYTOOLS);
+
+    rval = _generate_Ku(hashtype, hashtype_len, P, pplen, Ku, kulen);
+    if (rval == SNMPERR_SUCCESS) {
+        snmp_res_lock(MT_LIBRARY_ID, MT_LIB_KEYTOOLS);
+        _ku_cache_add(auth_type, pplen, digest, digest_len, Ku, *kulen);
+        snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_KEYTOOLS);
+    }
+    memset(digest, 0, sizeof(digest));
+    return rval;
+}                               /* end generate_Ku() */
 /*******************************************************************-o-******
  * generate_kul
  *
@@ -144,6 +144,42 @@ netsnmp_large_fd_is_set(int fd, netsnmp_large_fd_set * fdset)
             LFD_ISSET(fd, fdset->lfs_setptr));
 }
 
+/**
+ * Find the lowest file descriptor >= fd that is set in *fdset.
+ *
+ * @return That file descriptor or -1 if there is none.
+ */
+int
+netsnmp_large_fd_set_next(int fd, netsnmp_large_fd_set * fdset)
+{
+    enum { nfdbits = 8 * sizeof(fdset->lfs_setptr->fds_bits[0]) };
+    const NETSNMP_FD_MASK_TYPE *fds_array;
+    unsigned long long mask, valid;
+    unsigned        i, n;
+
+    if (fd < 0)
+        fd = 0;
+    if ((unsigned)fd >= fdset->lfs_setsize)
+        return -1;
+
+    fds_array = fdset->lfs_setptr->fds_bits;
+    n = (fdset->lfs_setsize + nfdbits - 1) / nfdbits;
+    valid = nfdbits < 64 ? (1ULL << nfdbits) - 1 : ~0ULL;
+    i = fd / nfdbits;
+    mask = (fds_array[i] & valid) & (~0ULL << (fd % nfdbits));
+    while (mask == 0) {
+        if (++i >= n)
+            return -1;
+        mask = fds_array[i] & valid;
+    }
+    fd = i * nfdbits;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        fd++;
+    }
+    return (unsigned)fd < fdset->lfs_setsize ? fd : -1;
+}
+
 #endif
 
 void
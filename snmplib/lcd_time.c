@@ -120,7 +120,9 @@ get_enginetime(const u_char * engineID,
         QUITFUN(SNMPERR_GENERR, get_enginetime_quit);
     }
 
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_ENGINETIME);
     if (!(e = search_enginetime_list(engineID, engineID_len))) {
+        snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_ENGINETIME);
         QUITFUN(SNMPERR_GENERR, get_enginetime_quit);
     }
 #ifdef LCD_TIME_SYNC_OPT
@@ -134,6 +136,7 @@ get_enginetime(const u_char * engineID,
 #ifdef LCD_TIME_SYNC_OPT
     }
 #endif
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_ENGINETIME);
 
     if (timediff > (int) (ENGINETIME_MAX - *engine_time)) {
         *engine_time = (timediff - (ENGINETIME_MAX - *engine_time));
@@ -216,7 +219,9 @@ get_enginetime_ex(u_char * engineID,
         QUITFUN(SNMPERR_GENERR, get_enginetime_ex_quit);
     }
 
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_ENGINETIME);
     if (!(e = search_enginetime_list(engineID, engineID_len))) {
+        snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_ENGINETIME);
         QUITFUN(SNMPERR_GENERR, get_enginetime_ex_quit);
     }
 #ifdef LCD_TIME_SYNC_OPT
@@ -230,6 +235,7 @@ get_enginetime_ex(u_char * engineID,
 #ifdef LCD_TIME_SYNC_OPT
     }
 #endif
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_ENGINETIME);
 
     if (timediff > (int) (ENGINETIME_MAX - *engine_time)) {
         *engine_time = (timediff - (ENGINETIME_MAX - *engine_time));
@@ -266,6 +272,7 @@ void free_enginetime(unsigned char *engineID, size_t engineID_len)
     if (rval < 0)
 	return;
 
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_ENGINETIME);
     e = etimelist[rval];
 
     while (e != NULL) {
@@ -274,6 +281,7 @@ void free_enginetime(unsigned char *engineID, size_t engineID_len)
 	SNMP_FREE(e);
 	e = etimelist[rval];
     }
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_ENGINETIME);
 
 }
 
@@ -297,6 +305,7 @@ void free_etimelist(void)
      Enginetime e = NULL;
      Enginetime nextE = NULL;
 
+     snmp_res_lock(MT_LIBRARY_ID, MT_LIB_ENGINETIME);
      for( ; index < ETIMELIST_SIZE; ++index)
      {
            e = etimelist[index];
@@ -311,6 +320,7 @@ void free_etimelist(void)
 
            etimelist[index] = NULL;
      }
+     snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_ENGINETIME);
      return;
 }
 
@@ -359,8 +369,10 @@ set_enginetime(const u_char * engineID,
      * Store the given <engine_time, engineboot> tuple in the record
      * for engineID.  Create a new record if necessary.
      */
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_ENGINETIME);
     if (!(e = search_enginetime_list(engineID, engineID_len))) {
         if ((iindex = hash_engineID(engineID, engineID_len)) < 0) {
+            snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_ENGINETIME);
             QUITFUN(SNMPERR_GENERR, set_enginetime_quit);
         }
 
@@ -384,6 +396,7 @@ set_enginetime(const u_char * engineID,
         e->engineBoot = engineboot;
         e->lastReceivedEngineTime = snmpv3_local_snmpEngineTime();
     }
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_ENGINETIME);
 
     e = NULL;                   /* Indicates a successful update. */
 
@@ -119,6 +119,7 @@ netsnmp_feature_child_of(mib_to_asn_type, mib_api);
 static char    *uptimeString(u_long, char *, size_t);
 
 #ifndef NETSNMP_DISABLE_MIB_LOADING
+struct oid_memo;
 static struct tree *_get_realloc_symbol(const oid * objid, size_t objidlen,
                                         struct tree *subtree,
                                         u_char ** buf, size_t * buf_len,
@@ -126,7 +127,8 @@ static struct tree *_get_realloc_symbol(const oid * objid, size_t objidlen,
                                         int allow_realloc,
                                         int *buf_overflow,
                                         struct index_list *in_dices,
-                                        size_t * end_of_known);
+                                        size_t * end_of_known,
+                                        struct oid_memo *memo);
 
 static int      print_tree_node(u_char ** buf, size_t * buf_len,
                                 size_t * out_len, int allow_realloc,
@@ -159,6 +161,39 @@ static struct tree *tree_top;
 
 NETSNMP_IMPORT struct tree *Mib;
 struct tree    *Mib;            /* Backwards compatibility */
+
+/*
+ * The resolved prefixes of recently printed OIDs.  Walks and traps print
+ * long runs of OIDs that differ only in their last few sub-identifiers, so
+ * netsnmp_sprint_realloc_objid_tree() resumes the tree lookup below the
+ * longest prefix already resolved instead of starting at the root.  Each
+ * recorded level is the node for name[i], the index list in effect below
+ * it and the length of the text printed up to and including its trailing
+ * '.'.  A slot is only valid for the tree generation and the output
+ * format it was built with.
+ */
+#define OID_MEMO_SLOTS  2
+#define OID_MEMO_TEXT   256
+
+struct oid_memo {
+    unsigned int    generation;
+    int             output_format;
+    unsigned int    stamp;          /* last use, 0 if the slot is empty */
+    size_t          depth;
+    oid             name[MAX_OID_LEN];
+    struct tree    *node[MAX_OID_LEN];
+    struct index_list *in_dices[MAX_OID_LEN];
+    size_t          text_len[MAX_OID_LEN];
+    u_char          text[OID_MEMO_TEXT];
+};
+
+static struct oid_memo oid_memo[OID_MEMO_SLOTS];
+static unsigned int oid_memo_clock;
+
+/* The module name printed last, for NETSNMP_OID_OUTPUT_MODULE. */
+static unsigned int module_memo_generation;
+static int      module_memo_modid = -1;
+static char     module_memo_name[256];
 #endif /* NETSNMP_DISABLE_MIB_LOADING */
 
 static char     Standard_Prefix[] = ".1.3.6.1.2.1";
@@ -251,6 +286,48 @@ uptimeString(u_long timeticks, char *buf, size_t buflen)
 
 
 
+/**
+ * @internal
+ * Converts an unsigned value to decimal, without going through sprintf().
+ * The digits are written to the end of buf.
+ *
+ * @param buf      Buffer of at least 21 characters.
+ * @param buf_len  Size of buf.
+ * @param val      The value to convert.
+ *
+ * @return A pointer to the NUL-terminated string inside buf.
+ */
+static char *
+_sprint_ulong(char *buf, size_t buf_len, u_long val)
+{
+    char           *cp = buf + buf_len;
+
+    *--cp = '\0';
+    do {
+        *--cp = '0' + val % 10;
+        val /= 10;
+    } while (val);
+    return cp;
+}
+
+/**
+ * @internal
+ * Signed counterpart of _sprint_ulong().
+ */
+static char *
+_sprint_long(char *buf, size_t buf_len, long val)
+{
+    char           *cp;
+
+    if (val >= 0)
+        return _sprint_ulong(buf, buf_len, val);
+    cp = _sprint_ulong(buf, buf_len, 0 - (u_long) val);
+    *--cp = '-';
+    return cp;
+}
+
+static const char hex_digits[] = "0123456789ABCDEF";
+
 /**
  * @internal
  * Prints the character pointed to if in human-readable ASCII range,
@@ -296,6 +373,7 @@ _sprint_hexstring_line(u_char ** buf, size_t * buf_len, size_t * out_len,
 {
     const u_char   *tp;
     const u_char   *cp2 = cp;
+    u_char         *op;
     size_t          lenleft = line_len;
 
     /*
@@ -310,17 +388,13 @@ _sprint_hexstring_line(u_char ** buf, size_t * buf_len, size_t * out_len,
     /*
      * .... and display the hex values themselves....
      */
-    for (; lenleft >= 8; lenleft-=8) {
-        sprintf((char *) (*buf + *out_len),
-                "%02X %02X %02X %02X %02X %02X %02X %02X ", cp[0], cp[1],
-                cp[2], cp[3], cp[4], cp[5], cp[6], cp[7]);
-        *out_len += strlen((char *) (*buf + *out_len));
-        cp       += 8;
-    }
-    for (; lenleft > 0; lenleft--) {
-        sprintf((char *) (*buf + *out_len), "%02X ", *cp++);
-        *out_len += strlen((char *) (*buf + *out_len));
+    for (op = *buf + *out_len; lenleft > 0; lenleft--) {
+        *op++ = hex_digits[*cp >> 4];
+        *op++ = hex_digits[*cp++ & 0xf];
+        *op++ = ' ';
     }
+    *op = '\0';
+    *out_len = op - *buf;
 
     /*
      * .... plus (optionally) do the same for the ASCII equivalent.
@@ -1184,19 +1258,23 @@ sprint_realloc_timeticks(u_char ** buf, size_t * buf_len, size_t * out_len,
 
     if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_NUMERIC_TIMETICKS)) {
         char            str[32];
-        snprintf(str, sizeof(str), "%lu", *(u_long *) var->val.integer);
-        if (!snmp_strcat
-            (buf, buf_len, out_len, allow_realloc, (const u_char *) str)) {
+        if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc,
+                          _sprint_ulong(str, sizeof(str),
+                                        *(u_long *) var->val.integer))) {
             return 0;
         }
         return 1;
     }
     if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT)) {
-        char            str[32];
-        snprintf(str, sizeof(str), "Timeticks: (%lu) ",
-                 *(u_long *) var->val.integer);
-        if (!snmp_strcat
-            (buf, buf_len, out_len, allow_realloc, (const u_char *) str)) {
+        char            str[48], *cp;
+
+        /* "Timeticks: (%lu) " */
+        cp = _sprint_ulong(str, sizeof(str) - 2,
+                           *(u_long *) var->val.integer);
+        memcpy(str + sizeof(str) - 3, ") ", 3);
+        cp -= 12;
+        memcpy(cp, "Timeticks: (", 12);
+        if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc, cp)) {
             return 0;
         }
     }
@@ -1383,10 +1461,9 @@ sprint_realloc_integer(u_char ** buf, size_t * buf_len, size_t * out_len,
             }
         } else {
             char            str[32];
-            snprintf(str, sizeof(str), "%ld", *var->val.integer);
-            if (!snmp_strcat
-                (buf, buf_len, out_len, allow_realloc,
-                 (const u_char *) str)) {
+            if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc,
+                              _sprint_long(str, sizeof(str),
+                                           *var->val.integer))) {
                 return 0;
             }
         }
@@ -1397,15 +1474,18 @@ sprint_realloc_integer(u_char ** buf, size_t * buf_len, size_t * out_len,
             return 0;
         }
     } else {
-        char            str[32];
-        snprintf(str, sizeof(str), "(%ld)", *var->val.integer);
+        char            str[32], *cp;
+
+        cp = _sprint_long(str, sizeof(str) - 1, *var->val.integer);
+        memcpy(str + sizeof(str) - 2, ")", 2);
+        *--cp = '(';
         if (!snmp_strcat
             (buf, buf_len, out_len, allow_realloc,
              (const u_char *) enum_string)) {
             return 0;
         }
         if (!snmp_strcat
-            (buf, buf_len, out_len, allow_realloc, (const u_char *) str)) {
+            (buf, buf_len, out_len, allow_realloc, (const u_char *) cp)) {
             return 0;
         }
     }
@@ -1480,10 +1560,9 @@ sprint_realloc_uinteger(u_char ** buf, size_t * buf_len, size_t * out_len,
             }
         } else {
             char            str[32];
-            snprintf(str, sizeof(str), "%lu", *var->val.integer);
-            if (!snmp_strcat
-                (buf, buf_len, out_len, allow_realloc,
-                 (const u_char *) str)) {
+            if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc,
+                              _sprint_ulong(str, sizeof(str),
+                                            *var->val.integer))) {
                 return 0;
             }
         }
@@ -1494,15 +1573,18 @@ sprint_realloc_uinteger(u_char ** buf, size_t * buf_len, size_t * out_len,
             return 0;
         }
     } else {
-        char            str[32];
-        snprintf(str, sizeof(str), "(%lu)", *var->val.integer);
+        char            str[32], *cp;
+
+        cp = _sprint_ulong(str, sizeof(str) - 1, *var->val.integer);
+        memcpy(str + sizeof(str) - 2, ")", 2);
+        *--cp = '(';
         if (!snmp_strcat
             (buf, buf_len, out_len, allow_realloc,
              (const u_char *) enum_string)) {
             return 0;
         }
         if (!snmp_strcat
-            (buf, buf_len, out_len, allow_realloc, (const u_char *) str)) {
+            (buf, buf_len, out_len, allow_realloc, (const u_char *) cp)) {
             return 0;
         }
     }
@@ -1573,9 +1655,9 @@ sprint_realloc_gauge(u_char ** buf, size_t * buf_len, size_t * out_len,
             return 0;
         }
     } else {
-        sprintf(tmp, "%u", (unsigned int)(*var->val.integer & 0xffffffff));
-        if (!snmp_strcat
-            (buf, buf_len, out_len, allow_realloc, (const u_char *) tmp)) {
+        if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc,
+                          _sprint_ulong(tmp, sizeof(tmp),
+                                        *var->val.integer & 0xffffffff))) {
             return 0;
         }
     }
@@ -1637,9 +1719,9 @@ sprint_realloc_counter(u_char ** buf, size_t * buf_len, size_t * out_len,
             return 0;
         }
     }
-    sprintf(tmp, "%u", (unsigned int)(*var->val.integer & 0xffffffff));
-    if (!snmp_strcat
-        (buf, buf_len, out_len, allow_realloc, (const u_char *) tmp)) {
+    if (!snmp_cstrcat(buf, buf_len, out_len, allow_realloc,
+                      _sprint_ulong(tmp, sizeof(tmp),
+                                    *var->val.integer & 0xffffffff))) {
         return 0;
     }
     if (units) {
@@ -1771,10 +1853,21 @@ sprint_realloc_ipaddress(u_char ** buf, size_t * buf_len, size_t * out_len,
             return 0;
         }
     }
-    if (ip)
-        sprintf((char *) (*buf + *out_len), "%d.%d.%d.%d",
-                                            ip[0], ip[1], ip[2], ip[3]);
-    *out_len += strlen((char *) (*buf + *out_len));
+    if (ip) {
+        u_char         *op = *buf + *out_len;
+        char            tmp[8], *cp;
+        int             i;
+
+        for (i = 0; i < 4; i++) {
+            if (i)
+                *op++ = '.';
+            for (cp = _sprint_ulong(tmp, sizeof(tmp), ip[i]); *cp; )
+                *op++ = *cp++;
+        }
+        *op = '\0';
+        *out_len = op - *buf;
+    } else
+        *(*buf + *out_len) = '\0';
     return 1;
 }
 
@@ -2506,6 +2599,8 @@ register_mib_handlers(void)
                        NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIB_WARNINGS);
     netsnmp_ds_register_premib(ASN_BOOLEAN, "snmp", "mibReplaceWithLatest",
                        NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIB_REPLACE);
+    netsnmp_ds_register_premib(ASN_OCTET_STR, "snmp", "mibCacheDir",
+                       NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIB_CACHE_DIR);
 #endif
 
     netsnmp_ds_register_premib(ASN_BOOLEAN, "snmp", "printNumericEnums",
@@ -2691,27 +2786,73 @@ netsnmp_fixup_mib_directory(void)
 
 }
 
-/**
- * Initialises the mib reader.
- *
- * Reads in all settings from the environment.
+/*
+ * Returns the name of the MIB cache file for the current MIB settings and
+ * sets *key to a description of these settings, or returns NULL if no
+ * cache should be used.
  */
-void
-netsnmp_init_mib(void)
+static char    *
+mib_cache_file(char **key)
+{
+    const char     *dir, *mibs, *mibfiles, *cp;
+    const char     *default_mibfiles = "";
+    char           *file;
+    u_int           hash = 2166136261U;
+
+    *key = NULL;
+    dir = netsnmp_ds_get_string(NETSNMP_DS_LIBRARY_ID,
+                                NETSNMP_DS_LIB_MIB_CACHE_DIR);
+    if (!dir || !*dir)
+        return NULL;
+    /* a cache would hide the parser warnings */
+    if (netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_MIB_WARNINGS))
+        return NULL;
+#ifdef NETSNMP_DEFAULT_MIBFILES
+    default_mibfiles = NETSNMP_DEFAULT_MIBFILES;
+#endif
+    mibs = netsnmp_getenv("MIBS");
+    mibfiles = netsnmp_getenv("MIBFILES");
+    if (asprintf(key, "%s\nMIBDIRS=%s\nMIBS%s%s\nMIBFILES%s%s\n"
+                 "DEFAULT_MIBS=%s\nDEFAULT_MIBFILES=%s\n"
+                 "OPTIONS=%d%d%d%d%d\n", PACKAGE_VERSION,
+                 netsnmp_get_mib_directory(),
+                 mibs ? "=" : (confmibs ? ":" : ""),
+                 mibs ? mibs : (confmibs ? confmibs : ""),
+                 mibfiles ? "=" : "", mibfiles ? mibfiles : "",
+                 NETSNMP_DEFAULT_MIBS, default_mibfiles,
+                 netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                        NETSNMP_DS_LIB_MIB_ERRORS),
+                 netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                        NETSNMP_DS_LIB_SAVE_MIB_DESCRS),
+                 netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                        NETSNMP_DS_LIB_MIB_COMMENT_TERM),
+                 netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                        NETSNMP_DS_LIB_MIB_PARSE_LABEL),
+                 netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                        NETSNMP_DS_LIB_MIB_REPLACE)) < 0) {
+        *key = NULL;
+        return NULL;
+    }
+    for (cp = *key; *cp; cp++)
+        hash = (hash ^ (u_char) *cp) * 16777619U;
+    if (asprintf(&file, "%s/mibcache-%08x", dir, hash) < 0) {
+        SNMP_FREE(*key);
+        return NULL;
+    }
+    return file;
+}
+
+/*
+ * Reads the MIB directories and the MIB modules and files to load
+ * according to the environment and the configuration.
+ */
+static void
+read_configured_mibs(void)
 {
-    const char     *prefix;
     char           *env_var, *entry;
-    PrefixListPtr   pp = &mib_prefixes[0];
     char           *st = NULL;
 
-    if (Mib)
-        return;
-    netsnmp_init_mib_internals();
-
-    /*
-     * Initialise the MIB directory/ies 
-     */
-    netsnmp_fixup_mib_directory();
     env_var = strdup(netsnmp_get_mib_directory());
     if (!env_var)
         return;
@@ -2832,6 +2973,38 @@ netsnmp_init_mib(void)
         }
         SNMP_FREE(env_var);
     }
+}
+
+/**
+ * Initialises the mib reader.
+ *
+ * Reads in all settings from the environment.
+ */
+void
+netsnmp_init_mib(void)
+{
+    const char     *prefix;
+    char           *env_var;
+    PrefixListPtr   pp = &mib_prefixes[0];
+    char           *cache_file, *cache_key;
+
+    if (Mib)
+        return;
+    netsnmp_init_mib_internals();
+
+    /*
+     * Initialise the MIB directory/ies 
+     */
+    netsnmp_fixup_mib_directory();
+
+    cache_file = mib_cache_file(&cache_key);
+    if (!cache_file || netsnmp_mib_cache_load(cache_file, cache_key) != 0) {
+        read_configured_mibs();
+        if (cache_file)
+            netsnmp_mib_cache_save(cache_file, cache_key);
+    }
+    SNMP_FREE(cache_file);
+    SNMP_FREE(cache_key);
 
     prefix = netsnmp_getenv("PREFIX");
 
@@ -3161,6 +3334,116 @@ netsnmp_sprint_realloc_objid_tree(u_char ** buf, size_t * buf_len,
                                  buf_overflow, objid, objidlen);
 }
 #else
+/*
+ * Copies the longest recorded prefix of objid into memo, leaving at least
+ * its last sub-identifier to be looked up.  memo->depth is 0 if no slot
+ * matches.
+ */
+static void
+_oid_memo_lookup(struct oid_memo *memo, const oid * objid, size_t objidlen)
+{
+    struct oid_memo *mp, *best = NULL;
+    size_t          n, depth = 0;
+    int             i;
+
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_MIBPRINT);
+    for (i = 0; i < OID_MEMO_SLOTS; i++) {
+        mp = &oid_memo[i];
+        if (!mp->stamp || mp->generation != memo->generation ||
+            mp->output_format != memo->output_format)
+            continue;
+        for (n = 0; n < mp->depth && n + 1 < objidlen &&
+             mp->name[n] == objid[n]; n++)
+            ;
+        if (n > depth) {
+            best = mp;
+            depth = n;
+        }
+    }
+    if (best) {
+        best->stamp = ++oid_memo_clock;
+        memcpy(memo->name, objid, depth * sizeof(oid));
+        memcpy(memo->node, best->node, depth * sizeof(struct tree *));
+        memcpy(memo->in_dices, best->in_dices,
+               depth * sizeof(struct index_list *));
+        memcpy(memo->text_len, best->text_len, depth * sizeof(size_t));
+        memcpy(memo->text, best->text, best->text_len[depth - 1]);
+    }
+    memo->depth = depth;
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_MIBPRINT);
+}
+
+/*
+ * Records the levels resolved while printing an OID, whose text is in
+ * tbuf.  They replace the slot they extend or else the least recently
+ * used one.
+ */
+static void
+_oid_memo_store(const struct oid_memo *memo, size_t reused,
+                const u_char * tbuf)
+{
+    struct oid_memo *mp, *slot = NULL;
+    size_t          len;
+    int             i;
+
+    if (memo->depth == 0 || memo->depth == reused)
+        return;
+    len = memo->text_len[memo->depth - 1];
+
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_MIBPRINT);
+    for (i = 0; i < OID_MEMO_SLOTS; i++) {
+        mp = &oid_memo[i];
+        if (reused && mp->stamp && mp->depth == reused &&
+            mp->generation == memo->generation &&
+            mp->output_format == memo->output_format &&
+            memcmp(mp->name, memo->name, reused * sizeof(oid)) == 0) {
+            slot = mp;
+            break;
+        }
+        if (!slot || mp->stamp < slot->stamp)
+            slot = mp;
+    }
+    slot->generation = memo->generation;
+    slot->output_format = memo->output_format;
+    slot->stamp = ++oid_memo_clock;
+    slot->depth = memo->depth;
+    memcpy(slot->name, memo->name, memo->depth * sizeof(oid));
+    memcpy(slot->node, memo->node, memo->depth * sizeof(struct tree *));
+    memcpy(slot->in_dices, memo->in_dices,
+           memo->depth * sizeof(struct index_list *));
+    memcpy(slot->text_len, memo->text_len, memo->depth * sizeof(size_t));
+    memcpy(slot->text, tbuf, len);
+    /*
+     * An extended index may have replaced the last '.' by a '['. 
+     */
+    slot->text[len - 1] = '.';
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_MIBPRINT);
+}
+
+/*
+ * module_name(), remembering the last module looked up.
+ */
+static char *
+_oid_memo_module_name(int modid, char *cp)
+{
+    unsigned int    generation = get_tree_generation();
+
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_MIBPRINT);
+    if (module_memo_name[0] && module_memo_modid == modid &&
+        module_memo_generation == generation) {
+        strcpy(cp, module_memo_name);
+    } else {
+        module_name(modid, cp);
+        if (strlen(cp) < sizeof(module_memo_name)) {
+            strcpy(module_memo_name, cp);
+            module_memo_modid = modid;
+            module_memo_generation = generation;
+        }
+    }
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_MIBPRINT);
+    return cp;
+}
+
 struct tree    *
 netsnmp_sprint_realloc_objid_tree(u_char ** buf, size_t * buf_len,
                                   size_t * out_len, int allow_realloc,
@@ -3170,21 +3453,40 @@ netsnmp_sprint_realloc_objid_tree(u_char ** buf, size_t * buf_len,
     u_char         *tbuf = NULL, *cp = NULL;
     size_t          tbuf_len = 512, tout_len = 0;
     struct tree    *subtree = tree_head;
-    size_t          midpoint_offset = 0;
+    struct index_list *in_dices = NULL;
+    size_t          midpoint_offset = 0, reused = 0;
     int             tbuf_overflow = 0;
     int             output_format;
+    struct oid_memo memo;
 
-    if ((tbuf = calloc(tbuf_len, 1)) == NULL) {
+    output_format = netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_OID_OUTPUT_FORMAT);
+    memo.generation = get_tree_generation();
+    memo.output_format = output_format;
+    memo.depth = 0;
+
+    if ((tbuf = malloc(tbuf_len)) == NULL) {
         tbuf_overflow = 1;
     } else {
         *tbuf = '.';
         tout_len = 1;
+        if (objid && objidlen > 1)
+            _oid_memo_lookup(&memo, objid, objidlen);
+        if (memo.depth) {
+            reused = memo.depth;
+            tout_len = memo.text_len[reused - 1];
+            memcpy(tbuf, memo.text, tout_len);
+            subtree = memo.node[reused - 1]->child_list;
+            in_dices = memo.in_dices[reused - 1];
+        }
+        tbuf[tout_len] = '\0';
     }
 
-    subtree = _get_realloc_symbol(objid, objidlen, subtree,
-                                  &tbuf, &tbuf_len, &tout_len,
-                                  allow_realloc, &tbuf_overflow, NULL,
-                                  &midpoint_offset);
+    subtree = _get_realloc_symbol(objid + reused, objidlen - reused,
+                                  subtree, &tbuf, &tbuf_len, &tout_len,
+                                  allow_realloc, &tbuf_overflow, in_dices,
+                                  &midpoint_offset, tbuf ? &memo : NULL);
+    if (subtree == NULL && reused)
+        subtree = memo.node[reused - 1];
 
     if (tbuf_overflow) {
         if (!*buf_overflow) {
@@ -3194,8 +3496,8 @@ netsnmp_sprint_realloc_objid_tree(u_char ** buf, size_t * buf_len,
         SNMP_FREE(tbuf);
         return subtree;
     }
+    _oid_memo_store(&memo, reused, tbuf);
 
-    output_format = netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_OID_OUTPUT_FORMAT);
     if (0 == output_format) {
         output_format = NETSNMP_OID_OUTPUT_MODULE;
     }
@@ -3232,7 +3534,7 @@ netsnmp_sprint_realloc_objid_tree(u_char ** buf, size_t * buf_len,
         if ((NETSNMP_OID_OUTPUT_MODULE == output_format)
             && cp > tbuf) {
             char            modbuf[256] = { 0 }, *mod =
-                module_name(subtree->modid, modbuf);
+                _oid_memo_module_name(subtree->modid, modbuf);
 
             /*
              * Don't add the module ID if it's just numeric (i.e. we couldn't look
@@ -4035,12 +4337,14 @@ dump_realloc_oid_to_inetaddress(const int addr_type, const oid * objid, size_t o
             (addr_type == IPV4Z && objidlen != 8))
             return 2;
 
-        len = snprintf(p, end - p, "%" NETSNMP_PRIo "u.%" NETSNMP_PRIo "u."
-                      "%" NETSNMP_PRIo "u.%" NETSNMP_PRIo "u",
-                      objid[0], objid[1], objid[2], objid[3]);
-        p += len;
-        if (p >= end)
-            return 2;
+        for (i = 0; i < 4; i++) {
+            char            tmp[8], *cp;
+
+            if (i)
+                *p++ = '.';
+            for (cp = _sprint_ulong(tmp, sizeof(tmp), objid[i]); *cp; )
+                *p++ = *cp++;
+        }
         if (addr_type == IPV4Z) {
             zc = (unsigned char*)&zone;
             zc[0] = objid[4];
@@ -4062,13 +4366,11 @@ dump_realloc_oid_to_inetaddress(const int addr_type, const oid * objid, size_t o
             (addr_type == IPV6Z && objidlen != 20))
             return 2;
 
-        len = 0;
         for (i = 0; i < 16; i ++) {
-            len = snprintf(p, end - p, "%s%02" NETSNMP_PRIo "x", i ? ":" : "",
-                           objid[i]);
-            p += len;
-            if (p >= end)
-                return 2;
+            if (i)
+                *p++ = ':';
+            *p++ = "0123456789abcdef"[objid[i] >> 4];
+            *p++ = "0123456789abcdef"[objid[i] & 0xf];
         }
 
         if (addr_type == IPV6Z) {
@@ -4176,7 +4478,7 @@ void
 _oid_finish_printing(const oid * objid, size_t objidlen,
                      u_char ** buf, size_t * buf_len, size_t * out_len,
                      int allow_realloc, int *buf_overflow) {
-    char            intbuf[64];
+    char            intbuf[64], *cp;
     if (*buf != NULL && *(*buf + *out_len - 1) != '.') {
         if (!*buf_overflow && !snmp_strcat(buf, buf_len, out_len,
                                            allow_realloc,
@@ -4185,11 +4487,12 @@ _oid_finish_printing(const oid * objid, size_t objidlen,
         }
     }
 
+    intbuf[sizeof(intbuf) - 1] = '\0';
     while (objidlen-- > 0) {    /* output rest of name, uninterpreted */
-        sprintf(intbuf, "%" NETSNMP_PRIo "u.", *objid++);
-        if (!*buf_overflow && !snmp_strcat(buf, buf_len, out_len,
-                                           allow_realloc,
-                                           (const u_char *) intbuf)) {
+        cp = _sprint_ulong(intbuf, sizeof(intbuf) - 1, *objid++);
+        intbuf[sizeof(intbuf) - 2] = '.';
+        if (!*buf_overflow && !snmp_cstrcat(buf, buf_len, out_len,
+                                            allow_realloc, cp)) {
             *buf_overflow = 1;
         }
     }
@@ -4226,78 +4529,77 @@ _get_realloc_symbol_octet_string(size_t numids, const oid * objid,
   }
 }
 
+/*
+ * Prints the labels of the nodes matching objid below subtree, followed by
+ * whatever is left of objid as index values or plain numbers, and returns
+ * the deepest node found.  Each node followed by a '.' is recorded in memo
+ * (if not NULL), starting at memo->depth.
+ */
 static struct tree *
 _get_realloc_symbol(const oid * objid, size_t objidlen,
                     struct tree *subtree,
                     u_char ** buf, size_t * buf_len, size_t * out_len,
                     int allow_realloc, int *buf_overflow,
-                    struct index_list *in_dices, size_t * end_of_known)
+                    struct index_list *in_dices, size_t * end_of_known,
+                    struct oid_memo *memo)
 {
     struct tree    *return_tree = NULL;
     int             extended_index =
         netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_EXTENDED_INDEX);
     int             output_format =
         netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_OID_OUTPUT_FORMAT);
-    char            intbuf[64];
+    char            intbuf[64], *cp;
     struct tree    *orgtree = subtree;
 
     if (!objid || !buf) {
         return NULL;
     }
 
-    for (; subtree; subtree = subtree->next_peer) {
-        if (*objid == subtree->subid) {
-	    while (subtree->next_peer && subtree->next_peer->subid == *objid)
-		subtree = subtree->next_peer;
-            if (subtree->indexes) {
-                in_dices = subtree->indexes;
-            } else if (subtree->augments) {
-                struct tree    *tp2 =
-                    find_tree_node(subtree->augments, -1);
-                if (tp2) {
-                    in_dices = tp2->indexes;
-                }
-            }
-
-            if (!strncmp(subtree->label, ANON, ANON_LEN) ||
-                (NETSNMP_OID_OUTPUT_NUMERIC == output_format)) {
-                sprintf(intbuf, "%lu", subtree->subid);
-                if (!*buf_overflow && !snmp_strcat(buf, buf_len, out_len,
-                                                   allow_realloc,
-                                                   (const u_char *)
-                                                   intbuf)) {
-                    *buf_overflow = 1;
-                }
-            } else {
-                if (!*buf_overflow && !snmp_strcat(buf, buf_len, out_len,
-                                                   allow_realloc,
-                                                   (const u_char *)
-                                                   subtree->label)) {
-                    *buf_overflow = 1;
-                }
+    while (subtree && (subtree = find_tree_child(subtree, *objid)) != NULL) {
+        return_tree = subtree;
+        if (subtree->indexes) {
+            in_dices = subtree->indexes;
+        } else if (subtree->augments) {
+            struct tree    *tp2 =
+                find_tree_node(subtree->augments, -1);
+            if (tp2) {
+                in_dices = tp2->indexes;
             }
+        }
 
-            if (objidlen > 1) {
-                if (!*buf_overflow && !snmp_strcat(buf, buf_len, out_len,
-                                                   allow_realloc,
-                                                   (const u_char *) ".")) {
-                    *buf_overflow = 1;
-                }
+        if (!strncmp(subtree->label, ANON, ANON_LEN) ||
+            (NETSNMP_OID_OUTPUT_NUMERIC == output_format)) {
+            cp = _sprint_ulong(intbuf, sizeof(intbuf), subtree->subid);
+        } else {
+            cp = subtree->label;
+        }
+        if (!*buf_overflow && !snmp_cstrcat(buf, buf_len, out_len,
+                                            allow_realloc, cp)) {
+            *buf_overflow = 1;
+        }
 
-                return_tree = _get_realloc_symbol(objid + 1, objidlen - 1,
-                                                  subtree->child_list,
-                                                  buf, buf_len, out_len,
-                                                  allow_realloc,
-                                                  buf_overflow, in_dices,
-                                                  end_of_known);
-            }
+        if (objidlen <= 1)
+            return return_tree;
 
-            if (return_tree != NULL) {
-                return return_tree;
-            } else {
-                return subtree;
-            }
+        if (!*buf_overflow && !snmp_strcat(buf, buf_len, out_len,
+                                           allow_realloc,
+                                           (const u_char *) ".")) {
+            *buf_overflow = 1;
+        }
+        if (memo && !*buf_overflow && memo->depth < MAX_OID_LEN &&
+            *out_len < OID_MEMO_TEXT) {
+            memo->name[memo->depth] = *objid;
+            memo->node[memo->depth] = subtree;
+            memo->in_dices[memo->depth] = in_dices;
+            memo->text_len[memo->depth] = *out_len;
+            memo->depth++;
+        } else {
+            memo = NULL;
         }
+
+        objid++;
+        objidlen--;
+        orgtree = subtree = subtree->child_list;
     }
 
     if (end_of_known) {
@@ -4309,11 +4611,11 @@ _get_realloc_symbol(const oid * objid, size_t objidlen,
      */
 
     if (orgtree && in_dices && objidlen > 0) {
-	sprintf(intbuf, "%" NETSNMP_PRIo "u.", *objid);
+	cp = _sprint_ulong(intbuf, sizeof(intbuf) - 1, *objid);
+	memcpy(intbuf + sizeof(intbuf) - 2, ".", 2);
 	if (!*buf_overflow
-	    && !snmp_strcat(buf, buf_len, out_len,
-			    allow_realloc,
-			    (const u_char *) intbuf)) {
+	    && !snmp_cstrcat(buf, buf_len, out_len,
+			     allow_realloc, cp)) {
 	    *buf_overflow = 1;
 	}
 	objid++;
@@ -4496,20 +4798,21 @@ _get_realloc_symbol(const oid * objid, size_t objidlen,
                         *buf_overflow = 1;
                     }
                 } else {
-                    sprintf(intbuf, "%" NETSNMP_PRIo "u", *objid);
                     if (!*buf_overflow
-                        && !snmp_strcat(buf, buf_len, out_len,
-                                        allow_realloc,
-                                        (const u_char *) intbuf)) {
+                        && !snmp_cstrcat(buf, buf_len, out_len,
+                                         allow_realloc,
+                                         _sprint_ulong(intbuf,
+                                                       sizeof(intbuf),
+                                                       *objid))) {
                         *buf_overflow = 1;
                     }
                 }
             } else {
-                sprintf(intbuf, "%" NETSNMP_PRIo "u", *objid);
-                if (!*buf_overflow && !snmp_strcat(buf, buf_len, out_len,
-                                                   allow_realloc,
-                                                   (const u_char *)
-                                                   intbuf)) {
+                if (!*buf_overflow && !snmp_cstrcat(buf, buf_len, out_len,
+                                                    allow_realloc,
+                                                    _sprint_ulong(intbuf,
+                                                                  sizeof(intbuf),
+                                                                  *objid))) {
                     *buf_overflow = 1;
                 }
             }
@@ -4568,7 +4871,7 @@ _get_realloc_symbol(const oid * objid, size_t objidlen,
             } else {
                 _get_realloc_symbol(objid, numids, NULL, buf, buf_len,
                                     out_len, allow_realloc, buf_overflow,
-                                    NULL, NULL);
+                                    NULL, NULL, NULL);
             }
             objid += (numids);
             objidlen -= (numids);
@@ -4577,15 +4880,24 @@ _get_realloc_symbol(const oid * objid, size_t objidlen,
         case TYPE_IPADDR:
             if (objidlen < 4)
                 goto finish_it;
-            sprintf(intbuf, "%" NETSNMP_PRIo "u.%" NETSNMP_PRIo "u."
-                    "%" NETSNMP_PRIo "u.%" NETSNMP_PRIo "u",
-                    objid[0], objid[1], objid[2], objid[3]);
-            objid += 4;
-            objidlen -= 4;
-            if (!*buf_overflow && !snmp_strcat(buf, buf_len, out_len,
-                                               allow_realloc,
-                                               (const u_char *) intbuf)) {
-                *buf_overflow = 1;
+            {
+                char            addr[4 * 21], *op = addr;
+                int             i;
+
+                for (i = 0; i < 4; i++) {
+                    if (i)
+                        *op++ = '.';
+                    for (cp = _sprint_ulong(intbuf, sizeof(intbuf),
+                                            objid[i]); *cp; )
+                        *op++ = *cp++;
+                }
+                *op = '\0';
+                objid += 4;
+                objidlen -= 4;
+                if (!*buf_overflow && !snmp_cstrcat(buf, buf_len, out_len,
+                                                    allow_realloc, addr)) {
+                    *buf_overflow = 1;
+                }
             }
             break;
 
@@ -4645,7 +4957,7 @@ _get_realloc_symbol(const oid * objid, size_t objidlen,
     _oid_finish_printing(objid, objidlen,
                          buf, buf_len, out_len,
                          allow_realloc, buf_overflow);
-    return NULL;
+    return return_tree;
 }
 
 struct tree    *
@@ -4653,16 +4965,11 @@ get_tree(const oid * objid, size_t objidlen, struct tree *subtree)
 {
     struct tree    *return_tree = NULL;
 
-    for (; subtree; subtree = subtree->next_peer) {
-        if (*objid == subtree->subid)
-            goto found;
-    }
-
-    return NULL;
+    if (subtree)
+        subtree = find_tree_child(subtree, *objid);
+    if (subtree == NULL)
+        return NULL;
 
-  found:
-    while (subtree->next_peer && subtree->next_peer->subid == *objid)
-	subtree = subtree->next_peer;
     if (objidlen > 1)
         return_tree =
             get_tree(objid + 1, objidlen - 1, subtree->child_list);
@@ -5369,8 +5676,7 @@ _add_strings_to_oid(void *tp, char *cp,
             subid = strtoul(cp, &ecp, 0);
             if (*ecp)
                 goto bad_id;
-            while (tp2 && tp2->subid != subid)
-                tp2 = tp2->next_peer;
+            tp2 = find_tree_child(tp2, subid);
         } else {
             while (tp2 && strcmp(tp2->label, fcp))
                 tp2 = tp2->next_peer;
@@ -24,6 +24,12 @@ static mutex_type s_res[MT_MAX_IDS][MT_LIB_MAXIMUM];  /* locking structures */
 static mutex_type *
 _mt_res(int groupID, int resourceID)
 {
+    /*
+     * Logging takes a lock and may run before init_snmp(), so make sure
+     * the (recursive) mutexes exist before the first one is handed out.
+     */
+    snmp_res_init();
+
     if (groupID < 0) {
 	return 0;
     }
@@ -56,23 +62,41 @@ snmp_res_init_mutex(mutex_type *mutex)
     return rc;
 }
 
-int
-snmp_res_init(void)
+static int s_res_rc;
+
+static void
+_mt_res_init_once(void)
 {
     int ii, jj, rc = 0;
-    mutex_type *mutex;
 
     for (jj = 0; (0 == rc) && (jj < MT_MAX_IDS); jj++) {
 	for (ii = 0; (0 == rc) && (ii < MT_LIB_MAXIMUM); ii++) {
-	    mutex = _mt_res(jj, ii);
-	    if (!mutex) {
-		continue;
-	    }
-	    rc = snmp_res_init_mutex(mutex);
+	    rc = snmp_res_init_mutex(&s_res[jj][ii]);
 	}
     }
+    s_res_rc = rc;
+}
 
-    return rc;
+/*
+ * Safe to call more than once: the mutexes are only set up the first time.
+ */
+int
+snmp_res_init(void)
+{
+#ifdef HAVE_PTHREAD_H
+    static pthread_once_t s_res_once = PTHREAD_ONCE_INIT;
+
+    pthread_once(&s_res_once, _mt_res_init_once);
+#else
+    static int      s_res_done;
+
+    if (!s_res_done) {
+        s_res_done = 1;
+        _mt_res_init_once();
+    }
+#endif
+
+    return s_res_rc;
 }
 
 int
@@ -280,7 +280,7 @@ struct tok {
     const char     *name;       /* token name */
     int             len;        /* length not counting nul */
     int             token;      /* value */
-    int             hash;       /* hash of name */
+    unsigned int    hash;       /* hash of name */
     struct tok     *next;       /* pointer to next in hash table */
 };
 
@@ -525,13 +525,29 @@ char gMibNames[STRINGMAX];
 #define HASHSIZE        32
 #define BUCKET(x)       (x & (HASHSIZE-1))
 
+/*
+ * Case-insensitive FNV-1a, so that label_compare() may be strcasecmp().
+ * get_token() computes it incrementally.
+ */
+#define NAME_HASH_INIT      2166136261U
+#define NAME_HASH_STEP(h, c) \
+    (((h) ^ (unsigned char)tolower((unsigned char)(c))) * 16777619U)
+
+/*
+ * The node (by parent label) and tree (by label) hash tables are sized
+ * for the number of entries: nbuckets for the nodes of the module being
+ * linked in, tbuckets grows with the tree.
+ */
 #define NHASHSIZE    128
-#define NBUCKET(x)   (x & (NHASHSIZE-1))
+#define NBUCKET(x)   ((x) & (nbuckets_size-1))
+#define TBUCKET(x)   ((x) & (tbuckets_size-1))
 
 static struct tok *buckets[HASHSIZE];
 
-static struct node *nbuckets[NHASHSIZE];
-static struct tree *tbuckets[NHASHSIZE];
+static struct node **nbuckets;
+static int      nbuckets_size;
+static struct tree **tbuckets;
+static int      tbuckets_size, tbuckets_count;
 static struct module *module_head = NULL;
 
 static struct node *orphan_nodes = NULL;
@@ -553,10 +569,11 @@ static void     dump_module_list(void);
 static int      get_token(FILE *, char *, int);
 static int      parseQuoteString(FILE *, char *, int);
 static int      tossObjectIdentifier(FILE *);
-static int      name_hash(const char *);
+static unsigned int name_hash(const char *);
 static void     init_node_hash(struct node *);
 static void     print_error(const char *, const char *, int);
 static void     free_tree(struct tree *);
+static void     child_index_flush(void);
 static void     free_partial_tree(struct tree *, int);
 static void     free_node(struct node *);
 static void     build_translation_table(void);
@@ -599,6 +616,7 @@ static struct range_list *copy_ranges(struct range_list *);
 static struct enum_list *copy_enums(struct enum_list *);
 
 static u_int    compute_match(const char *search_base, const char *key);
+static void     mib_cache_dep(const char *path, int is_dir);
 
 void
 snmp_mib_toggle_options_usage(const char *lead, FILE * outf)
@@ -681,19 +699,63 @@ snmp_mib_toggle_options(char *options)
     return NULL;
 }
 
-static int
+static unsigned int
 name_hash(const char *name)
 {
-    int             hash = 0;
+    unsigned int    hash = NAME_HASH_INIT;
     const char     *cp;
 
     if (!name)
         return 0;
     for (cp = name; *cp; cp++)
-        hash += tolower((unsigned char)(*cp));
+        hash = NAME_HASH_STEP(hash, *cp);
     return (hash);
 }
 
+/*
+ * Hash a tree node by its label, doubling the table whenever it holds as
+ * many nodes as buckets.  Rehashing keeps the relative order of nodes
+ * with the same label, which find_tree_node() depends on.
+ */
+static void
+tbucket_insert(struct tree *tp)
+{
+    unsigned int    hash;
+
+    if (tbuckets_count >= tbuckets_size) {
+        int             new_size = tbuckets_size ? 2 * tbuckets_size : NHASHSIZE;
+        struct tree   **new_buckets, **tails, *otp, *next;
+        int             i;
+
+        new_buckets = calloc(new_size, sizeof(*new_buckets));
+        tails = calloc(new_size, sizeof(*tails));
+        if (new_buckets && tails) {
+            for (i = 0; i < tbuckets_size; i++)
+                for (otp = tbuckets[i]; otp; otp = next) {
+                    next = otp->next;
+                    hash = name_hash(otp->label) & (new_size - 1);
+                    otp->next = NULL;
+                    if (tails[hash])
+                        tails[hash]->next = otp;
+                    else
+                        new_buckets[hash] = otp;
+                    tails[hash] = otp;
+                }
+            free(tbuckets);
+            tbuckets = new_buckets;
+            tbuckets_size = new_size;
+        } else
+            free(new_buckets);
+        free(tails);
+        if (!tbuckets_size)
+            return;
+    }
+    hash = TBUCKET(name_hash(tp->label));
+    tp->next = tbuckets[hash];
+    tbuckets[hash] = tp;
+    tbuckets_count++;
+}
+
 void
 netsnmp_init_mib_internals(void)
 {
@@ -726,8 +788,11 @@ netsnmp_init_mib_internals(void)
     module_map[max_modc].next = NULL;
     module_map_head = module_map;
 
-    memset(nbuckets, 0, sizeof(nbuckets));
-    memset(tbuckets, 0, sizeof(tbuckets));
+    if (nbuckets)
+        memset(nbuckets, 0, nbuckets_size * sizeof(*nbuckets));
+    if (tbuckets)
+        memset(tbuckets, 0, tbuckets_size * sizeof(*tbuckets));
+    tbuckets_count = 0;
     tc_alloc = TC_INCR;
     tclist = calloc(tc_alloc, sizeof(struct tc));
     build_translation_table();
@@ -749,9 +814,24 @@ static void
 init_node_hash(struct node *nodes)
 {
     struct node    *np, *nextp;
-    int             hash;
-
-    memset(nbuckets, 0, sizeof(nbuckets));
+    int             hash, count, size;
+
+    for (np = nodes, count = 0; np; np = np->next)
+        count++;
+    for (size = NHASHSIZE; size < count; size *= 2)
+        ;
+    if (size != nbuckets_size) {
+        struct node   **new_buckets = realloc(nbuckets,
+                                              size * sizeof(*nbuckets));
+
+        if (new_buckets) {
+            nbuckets = new_buckets;
+            nbuckets_size = size;
+        }
+    }
+    if (!nbuckets)
+        return;
+    memset(nbuckets, 0, nbuckets_size * sizeof(*nbuckets));
     for (np = nodes; np;) {
         nextp = np->next;
         hash = NBUCKET(name_hash(np->parent));
@@ -762,6 +842,7 @@ init_node_hash(struct node *nodes)
 }
 
 static int      erroneousMibs = 0;
+static int      mib_cache_dirty;        /* diagnostics while reading MIBs */
 
 netsnmp_feature_child_of(parse_get_error_count, netsnmp_unused);
 #ifndef NETSNMP_FEATURE_REMOVE_PARSE_GET_ERROR_COUNT
@@ -780,6 +861,7 @@ print_error(const char *str, const char *token, int type)
     if (!netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
                                 NETSNMP_DS_LIB_MIB_ERRORS))
 	return;
+    mib_cache_dirty = 1;
     DEBUGMSGTL(("parse-mibs", "\n"));
     if (type == ENDOFFILE)
         snmp_log(LOG_ERR, "%s (EOF): At line %d in %s\n", str, mibLine,
@@ -794,6 +876,7 @@ print_error(const char *str, const char *token, int type)
 static void
 print_module_not_found(const char *cp)
 {
+    mib_cache_dirty = 1;
     if (first_err_module) {
         snmp_log(LOG_ERR, "MIB search path: %s\n",
                            netsnmp_get_mib_directory());
@@ -826,8 +909,13 @@ alloc_node(int modid)
 static void
 unlink_tbucket(struct tree *tp)
 {
-    int             hash = NBUCKET(name_hash(tp->label));
-    struct tree    *otp = NULL, *ntp = tbuckets[hash];
+    int             hash;
+    struct tree    *otp = NULL, *ntp;
+
+    if (!tbuckets)
+        return;
+    hash = TBUCKET(name_hash(tp->label));
+    ntp = tbuckets[hash];
 
     while (ntp && ntp != tp) {
         otp = ntp;
@@ -839,6 +927,8 @@ unlink_tbucket(struct tree *tp)
         otp->next = ntp->next;
     else
         tbuckets[hash] = tp->next;
+    if (ntp)
+        tbuckets_count--;
 }
 
 static void
@@ -846,6 +936,7 @@ unlink_tree(struct tree *tp)
 {
     struct tree    *otp = NULL, *ntp = tp->parent;
 
+    child_index_flush();
     if (!ntp) {                 /* this tree has no parent */
         DEBUGMSGTL(("unlink_tree", "Tree node %s has no parent\n",
                     tp->label));
@@ -869,12 +960,21 @@ unlink_tree(struct tree *tp)
         tree_head = tp->next_peer;
 }
 
+/*
+ * Bumped with every child index flush and whenever the data of a node is
+ * freed, so that callers caching tree nodes or their labels, enums and
+ * indexes can tell that the tree has changed under them.
+ */
+static unsigned int tree_generation;
+
 static void
 free_partial_tree(struct tree *tp, int keep_label)
 {
     if (!tp)
         return;
 
+    tree_generation++;
+
     /*
      * remove the data from this tree node 
      */
@@ -902,6 +1002,7 @@ free_tree(struct tree *Tree)
     if (!Tree)
         return;
 
+    child_index_flush();
     unlink_tbucket(Tree);
     free_partial_tree(Tree, FALSE);
     if (Tree->module_list != &Tree->modid)
@@ -1155,7 +1256,6 @@ init_tree_roots(void)
 {
     struct tree    *tp, *lasttp;
     int             base_modid;
-    int             hash;
 
     base_modid = which_module("SNMPv2-SMI");
     if (base_modid == -1)
@@ -1176,9 +1276,7 @@ init_tree_roots(void)
     tp->subid = 2;
     tp->tc_index = -1;
     set_function(tp);           /* from mib.c */
-    hash = NBUCKET(name_hash(tp->label));
-    tp->next = tbuckets[hash];
-    tbuckets[hash] = tp;
+    tbucket_insert(tp);
     lasttp = tp;
     root_imports[0].label = strdup(tp->label);
     root_imports[0].modid = base_modid;
@@ -1197,9 +1295,7 @@ init_tree_roots(void)
     tp->subid = 0;
     tp->tc_index = -1;
     set_function(tp);           /* from mib.c */
-    hash = NBUCKET(name_hash(tp->label));
-    tp->next = tbuckets[hash];
-    tbuckets[hash] = tp;
+    tbucket_insert(tp);
     lasttp = tp;
     root_imports[1].label = strdup(tp->label);
     root_imports[1].modid = base_modid;
@@ -1218,14 +1314,13 @@ init_tree_roots(void)
     tp->subid = 1;
     tp->tc_index = -1;
     set_function(tp);           /* from mib.c */
-    hash = NBUCKET(name_hash(tp->label));
-    tp->next = tbuckets[hash];
-    tbuckets[hash] = tp;
+    tbucket_insert(tp);
     lasttp = tp;
     root_imports[2].label = strdup(tp->label);
     root_imports[2].modid = base_modid;
 
     tree_head = tp;
+    child_index_flush();
 }
 
 #ifdef STRICT_MIB_PARSEING
@@ -1241,10 +1336,10 @@ find_tree_node(const char *name, int modid)
     struct tree    *tp, *headtp;
     int             count, *int_p;
 
-    if (!name || !*name)
+    if (!name || !*name || !tbuckets)
         return (NULL);
 
-    headtp = tbuckets[NBUCKET(name_hash(name))];
+    headtp = tbuckets[TBUCKET(name_hash(name))];
     for (tp = headtp; tp; tp = tp->next) {
         if (tp->label && !label_compare(tp->label, name)) {
 
@@ -1261,6 +1356,183 @@ find_tree_node(const char *name, int modid)
     return (NULL);
 }
 
+/*
+ * Long sibling lists get an index, sorted by sub-identifier, the first
+ * time find_tree_child() has to search past their first CHILD_INDEX_MIN
+ * nodes.  The indexes are kept in a hash table keyed by the first sibling
+ * and are all dropped as soon as the shape of the tree changes.
+ */
+#define CHILD_INDEX_MIN 16
+
+struct child_index {
+    struct tree    *list;       /* first sibling, NULL if unused */
+    struct tree   **children;   /* sorted by subid */
+    int             count;
+};
+
+struct child_entry {
+    struct tree    *tp;
+    int             pos;
+};
+
+static struct child_index *child_index;
+static int      child_index_size, child_index_count;
+
+static void
+child_index_flush(void)
+{
+    int             i;
+
+    tree_generation++;
+    if (!child_index)
+        return;
+    for (i = 0; i < child_index_size; i++)
+        free(child_index[i].children);
+    SNMP_FREE(child_index);
+    child_index_size = child_index_count = 0;
+}
+
+static int
+child_entry_compare(const void *p1, const void *p2)
+{
+    const struct child_entry *e1 = p1, *e2 = p2;
+
+    if (e1->tp->subid != e2->tp->subid)
+        return e1->tp->subid < e2->tp->subid ? -1 : 1;
+    return e1->pos - e2->pos;
+}
+
+static struct child_index *
+child_index_slot(struct child_index *table, int size, struct tree *list)
+{
+    unsigned int    i = ((size_t) list >> 4) * 2654435761U;
+
+    for (i &= size - 1; table[i].list && table[i].list != list;
+         i = (i + 1) & (size - 1))
+        ;
+    return &table[i];
+}
+
+/*
+ * Index the sibling list starting at list.  Like the linear search, the
+ * index yields the last node of the first run of siblings with a given
+ * sub-identifier.
+ */
+static struct child_index *
+child_index_get(struct tree *list)
+{
+    struct child_index *ci;
+    struct child_entry *entries;
+    struct tree    *tp;
+    int             i, n;
+
+    if (child_index) {
+        ci = child_index_slot(child_index, child_index_size, list);
+        if (ci->list)
+            return ci;
+    }
+    if (2 * (child_index_count + 1) > child_index_size) {
+        int             new_size = child_index_size ?
+            2 * child_index_size : 64;
+        struct child_index *new_index = calloc(new_size, sizeof(*new_index));
+
+        if (!new_index)
+            return NULL;
+        for (i = 0; i < child_index_size; i++)
+            if (child_index[i].list)
+                *child_index_slot(new_index, new_size,
+                                  child_index[i].list) = child_index[i];
+        free(child_index);
+        child_index = new_index;
+        child_index_size = new_size;
+    }
+
+    for (n = 0, tp = list; tp; tp = tp->next_peer)
+        n++;
+    entries = malloc(n * sizeof(*entries));
+    if (!entries)
+        return NULL;
+    for (n = 0, tp = list; tp; tp = tp->next_peer) {
+        if (n && entries[n - 1].tp->subid == tp->subid) {
+            entries[n - 1].tp = tp;
+            continue;
+        }
+        entries[n].tp = tp;
+        entries[n].pos = n;
+        n++;
+    }
+    qsort(entries, n, sizeof(*entries), child_entry_compare);
+
+    ci = child_index_slot(child_index, child_index_size, list);
+    ci->children = malloc(n * sizeof(*ci->children));
+    if (!ci->children) {
+        free(entries);
+        return NULL;
+    }
+    for (i = 0, ci->count = 0; i < n; i++)
+        if (!ci->count ||
+            ci->children[ci->count - 1]->subid != entries[i].tp->subid)
+            ci->children[ci->count++] = entries[i].tp;
+    ci->list = list;
+    child_index_count++;
+    free(entries);
+    return ci;
+}
+
+/*
+ * Returns a number that changes whenever nodes are added to, removed
+ * from or replaced in the MIB tree.
+ */
+unsigned int
+get_tree_generation(void)
+{
+    return tree_generation;
+}
+
+/*
+ * Find the node with sub-identifier subid among list and its next peers.
+ * If several consecutive siblings share subid, the last of them is
+ * returned.
+ */
+struct tree    *
+find_tree_child(struct tree *list, u_long subid)
+{
+    struct child_index *ci;
+    struct tree    *tp;
+    int             n, lo, hi, mid;
+
+    for (tp = list, n = 0; tp && n < CHILD_INDEX_MIN;
+         tp = tp->next_peer, n++)
+        if (tp->subid == subid)
+            goto found;
+    if (!tp)
+        return NULL;
+
+    ci = child_index_get(list);
+    if (ci) {
+        for (lo = 0, hi = ci->count - 1; lo <= hi;) {
+            mid = (lo + hi) / 2;
+            if (ci->children[mid]->subid == subid)
+                return ci->children[mid];
+            if (ci->children[mid]->subid < subid)
+                lo = mid + 1;
+            else
+                hi = mid - 1;
+        }
+        return NULL;
+    }
+
+    for (; tp; tp = tp->next_peer)
+        if (tp->subid == subid)
+            goto found;
+    return NULL;
+
+  found:
+    while (tp->next_peer && tp->next_peer->subid == subid)
+        tp = tp->next_peer;
+    return tp;
+}
+
 /*
  * computes a value which represents how close name1 is to name2.
  * * high scores mean a worse match.
@@ -1383,6 +1655,7 @@ merge_anon_children(struct tree *tp1, struct tree *tp2)
 {
     struct tree    *child1, *child2, *previous;
 
+    child_index_flush();
     for (child1 = tp1->child_list; child1;) {
 
         for (child2 = tp2->child_list, previous = NULL;
@@ -1478,7 +1751,6 @@ do_subtree(struct tree *root, struct node **nodes)
     struct tree    *xroot = root;
     struct node    *np, **headp;
     struct node    *oldnp = NULL, *child_list = NULL, *childp = NULL;
-    int             hash;
     int            *int_p;
 
     while (xroot->next_peer && xroot->next_peer->subid == root->subid) {
@@ -1489,6 +1761,8 @@ do_subtree(struct tree *root, struct node **nodes)
         xroot = xroot->next_peer;
     }
 
+    if (!nbuckets)
+        return;
     tp = root;
     headp = &nbuckets[NBUCKET(name_hash(tp->label))];
     /*
@@ -1601,9 +1875,8 @@ do_subtree(struct tree *root, struct node **nodes)
             otp->next_peer = tp;
         else
             xxroot->child_list = tp;
-        hash = NBUCKET(name_hash(tp->label));
-        tp->next = tbuckets[hash];
-        tbuckets[hash] = tp;
+        child_index_flush();
+        tbucket_insert(tp);
         do_subtree(tp, nodes);
 
         if (anon_tp) {
@@ -1672,9 +1945,7 @@ do_subtree(struct tree *root, struct node **nodes)
                 /*
                  * hash in anon_tp in its new place 
                  */
-                hash = NBUCKET(name_hash(anon_tp->label));
-                anon_tp->next = tbuckets[hash];
-                tbuckets[hash] = anon_tp;
+                tbucket_insert(anon_tp);
 
                 /*
                  * unlink and destroy tp 
@@ -1741,11 +2012,13 @@ do_linkup(struct module *mp, struct node *np)
             continue;
         tp = find_tree_node(mip->label, mip->modid);
         if (!tp) {
-	    if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIB_ERRORS))
+	    if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIB_ERRORS)) {
+                mib_cache_dirty = 1;
                 snmp_log(LOG_WARNING,
                          "Did not find '%s' in module %s (%s)\n",
                          mip->label, module_name(mip->modid, modbuf),
                          File);
+            }
             continue;
         }
         do_subtree(tp, &np);
@@ -1769,7 +2042,7 @@ do_linkup(struct module *mp, struct node *np)
      */
     oldp = orphan_nodes;
     do {
-        for (i = 0; i < NHASHSIZE; i++)
+        for (i = 0; i < nbuckets_size; i++)
             for (onp = nbuckets[i]; onp; onp = onp->next) {
                 struct node    *op = NULL;
                 int             hash = NBUCKET(name_hash(onp->label));
@@ -1821,7 +2094,7 @@ do_linkup(struct module *mp, struct node *np)
      * complain about left over nodes 
      */
     for (np = orphan_nodes; np && np->next; np = np->next);     /* find the end of the orphan list */
-    for (i = 0; i < NHASHSIZE; i++)
+    for (i = 0; i < nbuckets_size; i++)
         if (nbuckets[i]) {
             if (orphan_nodes)
                 onp = np->next = nbuckets[i];
@@ -3923,6 +4196,7 @@ read_module_internal(const char *name)
                     rval = MODULE_NOT_FOUND;
                 else
                     rval = MODULE_LOAD_FAILED;
+                mib_cache_dirty = 1;
                 snmp_log_perror(mp->file);
                 return rval;
             }
@@ -3966,7 +4240,7 @@ adopt_orphans(void)
 
     while (adopted) {
         adopted = 0;
-        for (i = 0; i < NHASHSIZE; i++)
+        for (i = 0; i < nbuckets_size; i++)
             if (nbuckets[i]) {
                 for (np = nbuckets[i]; np != NULL; np = np->next) {
                     tp = find_tree_node(np->parent, -1);
@@ -4001,7 +4275,7 @@ adopt_orphans(void)
      * Report on outstanding orphans
      *    and link them back into the orphan list
      */
-    for (i = 0; i < NHASHSIZE; i++)
+    for (i = 0; i < nbuckets_size; i++)
         if (nbuckets[i]) {
             if (orphan_nodes)
                 onp = np->next = nbuckets[i];
@@ -4148,7 +4422,7 @@ int
 netsnmp_unload_module(const char *name)
 {
     struct module  *mp;
-    int             modID = -1;
+    int             modID = -1, i;
 
     for (mp = module_head; mp; mp = mp->next)
         if (!label_compare(mp->name, name)) {
@@ -4162,6 +4436,16 @@ netsnmp_unload_module(const char *name)
         return MODULE_NOT_FOUND;
     }
     unload_module_by_ID(modID, tree_head);
+    /*
+     * Free the import list now: once the module is marked as unloaded,
+     * no_imports no longer tells how long the list is.
+     */
+    if (mp->imports && mp->imports != root_imports) {
+        for (i = 0; i < mp->no_imports; i++)
+            free(mp->imports[i].label);
+        free(mp->imports);
+        mp->imports = NULL;
+    }
     mp->no_imports = -1;        /* mark as unloaded */
     return MODULE_LOADED_OK;    /* Well, you know what I mean! */
 }
@@ -4226,8 +4510,11 @@ unload_all_mibs(void)
     tc_alloc = 0;
 
     memset(buckets, 0, sizeof(buckets));
-    memset(nbuckets, 0, sizeof(nbuckets));
-    memset(tbuckets, 0, sizeof(tbuckets));
+    child_index_flush();
+    SNMP_FREE(nbuckets);
+    nbuckets_size = 0;
+    SNMP_FREE(tbuckets);
+    tbuckets_size = tbuckets_count = 0;
 
     for (i = 0; i < sizeof(root_imports) / sizeof(root_imports[0]); i++) {
         SNMP_FREE(root_imports[i].label);
@@ -4660,14 +4947,14 @@ get_token(FILE *const fp, char *const token, const int maxtlen)
 {
     int             ch, ch_next;
     char           *cp;
-    int             hash;
+    unsigned int    hash;
     struct tok     *tp;
     int             too_long;
     enum { bdigits, xdigits, other } seenSymbols;
 
 fetch_next_token:
     cp = token;
-    hash = 0;
+    hash = NAME_HASH_INIT;
     too_long = 0;
     /*
      * skip all white space 
@@ -4825,10 +5112,10 @@ fetch_next_token:
          */
         if (!is_labelchar(ch))
             return LABEL;
-        hash += tolower(ch);
+        hash = NAME_HASH_STEP(hash, ch);
       more:
         while (is_labelchar(ch_next = netsnmp_getc(fp))) {
-            hash += tolower(ch_next);
+            hash = NAME_HASH_STEP(hash, ch_next);
             if (cp - token < maxtlen - 1)
                 *cp++ = ch_next;
             else
@@ -4853,7 +5140,7 @@ fetch_next_token:
                 return ENDOFFILE;
             if (isalnum(ch_next)) {
                 *cp++ = ch_next;
-                hash += tolower(ch_next);
+                hash = NAME_HASH_STEP(hash, ch_next);
                 goto more;
             }
         }
@@ -4885,7 +5172,9 @@ add_mibfile(const char* tmpstr, const char* d_name)
     /*
      * which module is this 
      */
+    mib_cache_dep(tmpstr, 0);
     if ((fp = fopen(tmpstr, "r")) == NULL) {
+        mib_cache_dirty = 1;
         snmp_log_perror(tmpstr);
         return 1;
     }
@@ -5000,6 +5289,7 @@ add_mibdir(const char *dirname)
 
     DEBUGMSGTL(("parse-mibs", "Scanning directory %s\n", dirname));
 
+    mib_cache_dep(dirname, 1);
     filename_count = scan_directory(&filenames, dirname);
 
     if (filename_count >= 0) {
@@ -5029,8 +5319,10 @@ read_mib(const char *filename)
     FILE           *fp;
     char            token[MAXTOKEN];
 
+    mib_cache_dep(filename, 0);
     fp = fopen(filename, "r");
     if (fp == NULL) {
+        mib_cache_dirty = 1;
         snmp_log_perror(filename);
         return NULL;
     }
@@ -5038,6 +5330,7 @@ read_mib(const char *filename)
     File = filename;
     DEBUGMSGTL(("parse-mibs", "Parsing file: %s...\n", filename));
     if (get_token(fp, token, MAXTOKEN) != LABEL) {
+	    mib_cache_dirty = 1;
 	    snmp_log(LOG_ERR, "Failed to parse MIB file %s\n", filename);
 	    fclose(fp);
 	    return NULL;
@@ -5079,6 +5372,947 @@ read_all_mibs(void)
 }
 
 
+/*
+ * Binary MIB cache.
+ *
+ * netsnmp_init_mib() may save what it has read to a cache file and
+ * restore it on later runs instead of parsing all MIB files again. The
+ * file holds the module list, the textual conventions, the tree and the
+ * order of the tree name hash chains, with all references stored as
+ * indexes, so it can be used regardless of where it is mapped or read.
+ * Since modules may still be loaded and unloaded afterwards, loading the
+ * cache rebuilds the usual heap structures from it.
+ *
+ * A cache is only used if it was made for the same key (the MIB search
+ * path, the modules to load and the parser options), and none of the MIB
+ * directories and files that were scanned to make it has changed since.
+ * It is not written if reading the MIBs produced any diagnostics, so that
+ * these are not lost on later runs.
+ */
+#define MIB_CACHE_MAGIC     0x4e534d43  /* "NSMC" */
+#define MIB_CACHE_VERSION   3
+
+/*
+ * Times are in nanoseconds where the system has them. The change time is
+ * kept as well, since package managers set the modification time of the
+ * files they install to the (older) time the package was built.
+ */
+struct mib_cache_dep {
+    char           *path;
+    int             is_dir;
+    uint64_t        mtime, ctime;
+    uint64_t        size;
+};
+
+static struct mib_cache_dep *mib_cache_deps;
+static int      mib_cache_ndeps, mib_cache_deps_alloc;
+static int      mib_cache_recording;
+
+struct mib_cache_buf {
+    u_char         *data;
+    size_t          len, size;
+    int             error;
+};
+
+struct mib_cache_reader {
+    const u_char   *p, *end;
+    int             error;
+};
+
+#define MIB_CACHE_NSEC      ((uint64_t)1000000000)
+
+/* A missing file or directory has size (uint64_t)-1. */
+static void
+mib_cache_stat(const char *path, int is_dir, struct mib_cache_dep *dep)
+{
+    struct stat     st;
+
+    if (stat(path, &st) < 0) {
+        dep->mtime = dep->ctime = 0;
+        dep->size = (uint64_t)-1;
+        return;
+    }
+    dep->mtime = (uint64_t)st.st_mtime * MIB_CACHE_NSEC;
+    dep->ctime = (uint64_t)st.st_ctime * MIB_CACHE_NSEC;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+    dep->mtime += st.st_mtim.tv_nsec;
+    dep->ctime += st.st_ctim.tv_nsec;
+#endif
+    dep->size = is_dir ? 0 : st.st_size;
+}
+
+/*
+ * Note a MIB directory or file that the result of reading the MIBs
+ * depends on.
+ */
+static void
+mib_cache_dep(const char *path, int is_dir)
+{
+    struct mib_cache_dep *dep;
+
+    if (!mib_cache_recording)
+        return;
+    if (mib_cache_ndeps == mib_cache_deps_alloc) {
+        int             alloc = mib_cache_deps_alloc ?
+            2 * mib_cache_deps_alloc : 128;
+
+        dep = realloc(mib_cache_deps, alloc * sizeof(*dep));
+        if (!dep) {
+            mib_cache_dirty = 1;
+            return;
+        }
+        mib_cache_deps = dep;
+        mib_cache_deps_alloc = alloc;
+    }
+    dep = &mib_cache_deps[mib_cache_ndeps];
+    dep->path = strdup(path);
+    if (!dep->path) {
+        mib_cache_dirty = 1;
+        return;
+    }
+    dep->is_dir = is_dir;
+    mib_cache_stat(path, is_dir, dep);
+    mib_cache_ndeps++;
+}
+
+static void
+mib_cache_stop(void)
+{
+    int             i;
+
+    for (i = 0; i < mib_cache_ndeps; i++)
+        free(mib_cache_deps[i].path);
+    SNMP_FREE(mib_cache_deps);
+    mib_cache_ndeps = mib_cache_deps_alloc = 0;
+    mib_cache_recording = 0;
+}
+
+static u_int
+mib_cache_checksum(const u_char *data, size_t len)
+{
+    u_int           sum = 2166136261U, word;
+    size_t          i;
+
+    for (i = 0; i + sizeof(word) <= len; i += sizeof(word)) {
+        memcpy(&word, data + i, sizeof(word));
+        sum = (sum ^ word) * 16777619U;
+    }
+    for (; i < len; i++)
+        sum = (sum ^ data[i]) * 16777619U;
+    return sum;
+}
+
+static void
+mib_cache_put(struct mib_cache_buf *b, const void *p, size_t n)
+{
+    if (b->error)
+        return;
+    if (b->len + n > b->size) {
+        size_t          size = b->size ? 2 * b->size : 65536;
+        u_char         *data;
+
+        while (size < b->len + n)
+            size *= 2;
+        data = realloc(b->data, size);
+        if (!data) {
+            b->error = 1;
+            return;
+        }
+        b->data = data;
+        b->size = size;
+    }
+    memcpy(b->data + b->len, p, n);
+    b->len += n;
+}
+
+static void
+mib_cache_put_int(struct mib_cache_buf *b, int value)
+{
+    mib_cache_put(b, &value, sizeof(value));
+}
+
+static void
+mib_cache_put_u64(struct mib_cache_buf *b, uint64_t value)
+{
+    mib_cache_put(b, &value, sizeof(value));
+}
+
+static void
+mib_cache_put_str(struct mib_cache_buf *b, const char *s)
+{
+    int             len = s ? strlen(s) : -1;
+
+    mib_cache_put_int(b, len);
+    if (s)
+        mib_cache_put(b, s, len + 1);
+}
+
+static void
+mib_cache_put_node_lists(struct mib_cache_buf *b, struct enum_list *ep,
+                         struct range_list *rp)
+{
+    int             n;
+    struct enum_list *e;
+    struct range_list *r;
+
+    for (n = 0, e = ep; e; e = e->next)
+        n++;
+    mib_cache_put_int(b, n);
+    for (e = ep; e; e = e->next) {
+        mib_cache_put_int(b, e->value);
+        mib_cache_put_str(b, e->label);
+    }
+    for (n = 0, r = rp; r; r = r->next)
+        n++;
+    mib_cache_put_int(b, n);
+    for (r = rp; r; r = r->next) {
+        mib_cache_put_int(b, r->low);
+        mib_cache_put_int(b, r->high);
+    }
+}
+
+static void
+mib_cache_get(struct mib_cache_reader *r, void *p, size_t n)
+{
+    if (r->error || (size_t)(r->end - r->p) < n) {
+        r->error = 1;
+        memset(p, 0, n);
+        return;
+    }
+    memcpy(p, r->p, n);
+    r->p += n;
+}
+
+static int
+mib_cache_get_int(struct mib_cache_reader *r)
+{
+    int             value;
+
+    mib_cache_get(r, &value, sizeof(value));
+    return value;
+}
+
+static uint64_t
+mib_cache_get_u64(struct mib_cache_reader *r)
+{
+    uint64_t        value;
+
+    mib_cache_get(r, &value, sizeof(value));
+    return value;
+}
+
+/* Returns a pointer to a string in the cache, or NULL. */
+static const char *
+mib_cache_peek_str(struct mib_cache_reader *r)
+{
+    int             len = mib_cache_get_int(r);
+    const char     *s;
+
+    if (r->error || len == -1)
+        return NULL;
+    if (len < 0 || r->end - r->p <= len || r->p[len] != '\0') {
+        r->error = 1;
+        return NULL;
+    }
+    s = (const char *) r->p;
+    r->p += len + 1;
+    return s;
+}
+
+static char    *
+mib_cache_get_str(struct mib_cache_reader *r)
+{
+    const char     *s = mib_cache_peek_str(r);
+    char           *copy;
+
+    if (!s)
+        return NULL;
+    copy = strdup(s);
+    if (!copy)
+        r->error = 1;
+    return copy;
+}
+
+/* Returns a sane element count, or 0 and sets an error. */
+static int
+mib_cache_get_count(struct mib_cache_reader *r, size_t min_size)
+{
+    int             n = mib_cache_get_int(r);
+
+    if (n < 0 || (size_t)(r->end - r->p) / (min_size ? min_size : 1) <
+        (size_t)n) {
+        r->error = 1;
+        return 0;
+    }
+    return n;
+}
+
+static void
+mib_cache_get_node_lists(struct mib_cache_reader *r,
+                         struct enum_list **ep, struct range_list **rp)
+{
+    int             i, n;
+
+    n = mib_cache_get_count(r, 2 * sizeof(int));
+    for (i = 0; i < n && !r->error; i++) {
+        *ep = calloc(1, sizeof(struct enum_list));
+        if (!*ep) {
+            r->error = 1;
+            break;
+        }
+        (*ep)->value = mib_cache_get_int(r);
+        (*ep)->label = mib_cache_get_str(r);
+        ep = &(*ep)->next;
+    }
+    n = mib_cache_get_count(r, 2 * sizeof(int));
+    for (i = 0; i < n && !r->error; i++) {
+        *rp = calloc(1, sizeof(struct range_list));
+        if (!*rp) {
+            r->error = 1;
+            break;
+        }
+        (*rp)->low = mib_cache_get_int(r);
+        (*rp)->high = mib_cache_get_int(r);
+        rp = &(*rp)->next;
+    }
+}
+
+static void
+mib_cache_put_tree(struct mib_cache_buf *b, struct tree *tp,
+                   struct tree **nodes, int parent, int *count)
+{
+    struct index_list *ip;
+    struct varbind_list *vp;
+    int             self, i, n;
+
+    for (; tp; tp = tp->next_peer) {
+        self = (*count)++;
+        if (nodes)
+            nodes[self] = tp;
+        mib_cache_put_int(b, parent);
+        mib_cache_put_str(b, tp->label);
+        mib_cache_put_u64(b, tp->subid);
+        mib_cache_put_int(b, tp->modid);
+        mib_cache_put_int(b, tp->number_modules);
+        mib_cache_put_int(b, tp->module_list != &tp->modid);
+        if (tp->module_list != &tp->modid)
+            for (i = 0; i < tp->number_modules; i++)
+                mib_cache_put_int(b, tp->module_list[i]);
+        mib_cache_put_int(b, tp->tc_index);
+        mib_cache_put_int(b, tp->type);
+        mib_cache_put_int(b, tp->access);
+        mib_cache_put_int(b, tp->status);
+        mib_cache_put_node_lists(b, tp->enums, tp->ranges);
+        for (n = 0, ip = tp->indexes; ip; ip = ip->next)
+            n++;
+        mib_cache_put_int(b, n);
+        for (ip = tp->indexes; ip; ip = ip->next) {
+            mib_cache_put_str(b, ip->ilabel);
+            mib_cache_put_int(b, ip->isimplied);
+        }
+        mib_cache_put_str(b, tp->augments);
+        for (n = 0, vp = tp->varbinds; vp; vp = vp->next)
+            n++;
+        mib_cache_put_int(b, n);
+        for (vp = tp->varbinds; vp; vp = vp->next)
+            mib_cache_put_str(b, vp->vblabel);
+        mib_cache_put_str(b, tp->hint);
+        mib_cache_put_str(b, tp->units);
+        mib_cache_put_str(b, tp->description);
+        mib_cache_put_str(b, tp->reference);
+        mib_cache_put_str(b, tp->defaultValue);
+        mib_cache_put_tree(b, tp->child_list, nodes, self, count);
+    }
+}
+
+struct mib_cache_index {
+    struct tree    *tp;
+    int             index;
+};
+
+static int
+mib_cache_index_compare(const void *a, const void *b)
+{
+    const struct mib_cache_index *ia = a, *ib = b;
+
+    return ia->tp < ib->tp ? -1 : ia->tp > ib->tp;
+}
+
+static int
+mib_cache_count_tree(struct tree *tp)
+{
+    int             n = 0;
+
+    for (; tp; tp = tp->next_peer)
+        n += 1 + mib_cache_count_tree(tp->child_list);
+    return n;
+}
+
+/*
+ * Save what netsnmp_init_mib() has read since an unsuccessful
+ * netsnmp_mib_cache_load() to the cache file <file>.
+ */
+void
+netsnmp_mib_cache_save(const char *file, const char *key)
+{
+    struct mib_cache_buf b;
+    struct mib_cache_index *idx = NULL, k, *found;
+    struct tree   **nodes = NULL, *tp;
+    struct module  *mp;
+    struct module_import *mip;
+    char           *tmpfile = NULL;
+    FILE           *fp;
+    time_t          now = time(NULL);
+    int             i, n, count;
+
+    if (!mib_cache_recording)
+        return;
+    memset(&b, 0, sizeof(b));
+
+    if (mib_cache_dirty || orphan_nodes || gLoop) {
+        DEBUGMSGTL(("parse-mibs", "Not saving MIB cache %s: reading the "
+                    "MIBs produced diagnostics\n", file));
+        goto out;
+    }
+    for (i = 0; i < mib_cache_ndeps; i++)
+        if (mib_cache_deps[i].mtime / MIB_CACHE_NSEC + 1 >= (uint64_t)now) {
+            /* it might still change within the same time stamp */
+            DEBUGMSGTL(("parse-mibs", "Not saving MIB cache %s: %s has "
+                        "just been modified\n", file,
+                        mib_cache_deps[i].path));
+            goto out;
+        }
+
+    mib_cache_put_int(&b, MIB_CACHE_MAGIC);
+    mib_cache_put_int(&b, MIB_CACHE_VERSION);
+    mib_cache_put_str(&b, key);
+
+    mib_cache_put_int(&b, mib_cache_ndeps);
+    for (i = 0; i < mib_cache_ndeps; i++) {
+        mib_cache_put_str(&b, mib_cache_deps[i].path);
+        mib_cache_put_int(&b, mib_cache_deps[i].is_dir);
+        mib_cache_put_u64(&b, mib_cache_deps[i].mtime);
+        mib_cache_put_u64(&b, mib_cache_deps[i].ctime);
+        mib_cache_put_u64(&b, mib_cache_deps[i].size);
+    }
+
+    mib_cache_put_int(&b, max_module);
+    mib_cache_put_int(&b, anonymous);
+    for (i = 0; i < NUMBER_OF_ROOT_NODES; i++)
+        mib_cache_put_int(&b, root_imports[i].modid);
+
+    for (n = 0, mp = module_head; mp; mp = mp->next)
+        n++;
+    mib_cache_put_int(&b, n);
+    for (mp = module_head; mp; mp = mp->next) {
+        mib_cache_put_str(&b, mp->name);
+        mib_cache_put_str(&b, mp->file);
+        mib_cache_put_int(&b, mp->modid);
+        mib_cache_put_int(&b, mp->no_imports);
+        if (mp->imports == root_imports) {
+            mib_cache_put_int(&b, 1);
+        } else if (mp->imports && mp->no_imports > 0) {
+            mib_cache_put_int(&b, 2);
+            for (i = 0, mip = mp->imports; i < mp->no_imports; i++, mip++) {
+                mib_cache_put_str(&b, mip->label);
+                mib_cache_put_int(&b, mip->modid);
+            }
+        } else {
+            mib_cache_put_int(&b, 0);
+        }
+    }
+
+    for (n = tc_alloc; n > 0 && tclist[n - 1].type == 0; n--)
+        ;
+    mib_cache_put_int(&b, tc_alloc);
+    mib_cache_put_int(&b, n);
+    for (i = 0; i < n; i++) {
+        mib_cache_put_int(&b, tclist[i].type);
+        mib_cache_put_int(&b, tclist[i].modid);
+        mib_cache_put_str(&b, tclist[i].descriptor);
+        mib_cache_put_str(&b, tclist[i].hint);
+        mib_cache_put_node_lists(&b, tclist[i].enums, tclist[i].ranges);
+        mib_cache_put_str(&b, tclist[i].description);
+    }
+
+    /* the tree in depth first order, each node referring to its parent */
+    n = mib_cache_count_tree(tree_head);
+    nodes = malloc((n + 1) * sizeof(*nodes));
+    idx = malloc((n + 1) * sizeof(*idx));
+    if (!nodes || !idx)
+        goto out;
+    mib_cache_put_int(&b, n);
+    count = 0;
+    mib_cache_put_tree(&b, tree_head, nodes, -1, &count);
+
+    /* the order of the name hash chains */
+    for (i = 0; i < n; i++) {
+        idx[i].tp = nodes[i];
+        idx[i].index = i;
+    }
+    qsort(idx, n, sizeof(*idx), mib_cache_index_compare);
+    mib_cache_put_int(&b, tbuckets_size);
+    for (i = 0; i < tbuckets_size; i++) {
+        for (count = 0, tp = tbuckets[i]; tp; tp = tp->next)
+            count++;
+        mib_cache_put_int(&b, count);
+        for (tp = tbuckets[i]; tp; tp = tp->next) {
+            k.tp = tp;
+            found = bsearch(&k, idx, n, sizeof(*idx),
+                            mib_cache_index_compare);
+            if (!found) {
+                DEBUGMSGTL(("parse-mibs", "Not saving MIB cache %s: %s "
+                            "is not in the tree\n", file, tp->label));
+                goto out;
+            }
+            mib_cache_put_int(&b, found->index);
+        }
+    }
+    mib_cache_put_int(&b, MIB_CACHE_MAGIC);
+    if (b.error)
+        goto out;
+    mib_cache_put_int(&b, mib_cache_checksum(b.data, b.len));
+    if (b.error)
+        goto out;
+
+    /* write a new file and move it into place */
+    mkdirhier(file, NETSNMP_AGENT_DIRECTORY_MODE, 1);
+    if (asprintf(&tmpfile, "%s.%ld", file, (long)getpid()) < 0) {
+        tmpfile = NULL;
+        goto out;
+    }
+    fp = fopen(tmpfile, "wb");
+    if (!fp) {
+        DEBUGMSGTL(("parse-mibs", "Cannot create MIB cache %s: %s\n",
+                    tmpfile, strerror(errno)));
+        goto out;
+    }
+    if (fwrite(b.data, 1, b.len, fp) != b.len) {
+        fclose(fp);
+        unlink(tmpfile);
+        goto out;
+    }
+    if (fclose(fp) != 0 || rename(tmpfile, file) != 0) {
+        unlink(tmpfile);
+        goto out;
+    }
+    DEBUGMSGTL(("parse-mibs", "Saved MIB cache %s: %d nodes, %lu bytes\n",
+                file, n, (unsigned long)b.len));
+
+  out:
+    free(idx);
+    free(nodes);
+    free(tmpfile);
+    free(b.data);
+    mib_cache_stop();
+}
+
+static void
+mib_cache_free_modules(struct module *mp)
+{
+    struct module  *next;
+    int             i;
+
+    for (; mp; mp = next) {
+        next = mp->next;
+        if (mp->imports && mp->imports != root_imports) {
+            for (i = 0; i < mp->no_imports; i++)
+                free(mp->imports[i].label);
+            free(mp->imports);
+        }
+        free(mp->name);
+        free(mp->file);
+        free(mp);
+    }
+}
+
+static void
+mib_cache_free_tcs(struct tc *tcs, int n)
+{
+    int             i;
+
+    for (i = 0; i < n; i++) {
+        free_enums(&tcs[i].enums);
+        free_ranges(&tcs[i].ranges);
+        free(tcs[i].descriptor);
+        free(tcs[i].hint);
+        free(tcs[i].description);
+    }
+    free(tcs);
+}
+
+static void
+mib_cache_free_nodes(struct tree **nodes, int n)
+{
+    int             i;
+
+    for (i = 0; i < n; i++) {
+        if (!nodes[i])
+            continue;
+        free_partial_tree(nodes[i], FALSE);
+        if (nodes[i]->module_list != &nodes[i]->modid)
+            free(nodes[i]->module_list);
+        free(nodes[i]);
+    }
+    free(nodes);
+}
+
+/*
+ * Can a module id read from the cache be used as one? -1 stands for a
+ * module that was not found.
+ */
+#define MIB_CACHE_MODID_OK(modid, max)  ((modid) >= -1 && (modid) < (max))
+
+/*
+ * Read a tree node. Its module ids must be below <max_module>, and its
+ * textual convention one of the <ntcs> ones in <tcs>.
+ */
+static struct tree *
+mib_cache_get_node(struct mib_cache_reader *r, int max_module,
+                   const struct tc *tcs, int ntcs)
+{
+    struct tree    *tp;
+    struct index_list **ip;
+    struct varbind_list **vp;
+    int             i, n;
+
+    tp = calloc(1, sizeof(struct tree));
+    if (!tp) {
+        r->error = 1;
+        return NULL;
+    }
+    tp->module_list = &tp->modid;
+    tp->label = mib_cache_get_str(r);
+    tp->subid = mib_cache_get_u64(r);
+    tp->modid = mib_cache_get_int(r);
+    tp->number_modules = mib_cache_get_int(r);
+    if (mib_cache_get_int(r)) {
+        n = tp->number_modules;
+        if (n <= 0 || (size_t)(r->end - r->p) / sizeof(int) < (size_t)n) {
+            r->error = 1;
+            return tp;
+        }
+        tp->module_list = malloc(n * sizeof(int));
+        if (!tp->module_list) {
+            tp->module_list = &tp->modid;
+            r->error = 1;
+            return tp;
+        }
+        for (i = 0; i < n; i++) {
+            tp->module_list[i] = mib_cache_get_int(r);
+            if (!MIB_CACHE_MODID_OK(tp->module_list[i], max_module))
+                r->error = 1;
+        }
+    } else if (tp->number_modules != 1) {
+        r->error = 1;
+    }
+    if (!MIB_CACHE_MODID_OK(tp->modid, max_module))
+        r->error = 1;
+    tp->tc_index = mib_cache_get_int(r);
+    if (tp->tc_index != -1 &&
+        (tp->tc_index < 0 || tp->tc_index >= ntcs ||
+         !tcs[tp->tc_index].descriptor))
+        r->error = 1;
+    tp->type = mib_cache_get_int(r);
+    tp->access = mib_cache_get_int(r);
+    tp->status = mib_cache_get_int(r);
+    mib_cache_get_node_lists(r, &tp->enums, &tp->ranges);
+    n = mib_cache_get_count(r, 2 * sizeof(int));
+    for (i = 0, ip = &tp->indexes; i < n && !r->error; i++) {
+        *ip = calloc(1, sizeof(struct index_list));
+        if (!*ip) {
+            r->error = 1;
+            break;
+        }
+        (*ip)->ilabel = mib_cache_get_str(r);
+        (*ip)->isimplied = mib_cache_get_int(r);
+        ip = &(*ip)->next;
+    }
+    tp->augments = mib_cache_get_str(r);
+    n = mib_cache_get_count(r, sizeof(int));
+    for (i = 0, vp = &tp->varbinds; i < n && !r->error; i++) {
+        *vp = calloc(1, sizeof(struct varbind_list));
+        if (!*vp) {
+            r->error = 1;
+            break;
+        }
+        (*vp)->vblabel = mib_cache_get_str(r);
+        vp = &(*vp)->next;
+    }
+    tp->hint = mib_cache_get_str(r);
+    tp->units = mib_cache_get_str(r);
+    tp->description = mib_cache_get_str(r);
+    tp->reference = mib_cache_get_str(r);
+    tp->defaultValue = mib_cache_get_str(r);
+    if (!tp->label)
+        r->error = 1;
+    else
+        set_function(tp);
+    return tp;
+}
+
+/*
+ * Restore what netsnmp_init_mib() read on an earlier run from the cache
+ * file <file>, if it was made for <key> and is still valid.
+ * Returns 0 on success. Otherwise nothing has been changed, and the MIB
+ * directories and files read from now on are noted for
+ * netsnmp_mib_cache_save().
+ */
+int
+netsnmp_mib_cache_load(const char *file, const char *key)
+{
+    struct mib_cache_reader r;
+    struct module  *modules = NULL, **mpp = &modules, *mp;
+    struct tc      *tcs = NULL;
+    struct tree   **nodes = NULL, **last_child = NULL, *roots = NULL;
+    struct tree    *last_root = NULL, *tp, *next, **new_tbuckets = NULL;
+    char           *seen = NULL;
+    u_char         *data = NULL;
+    const char     *s;
+    FILE           *fp;
+    struct stat     st;
+    struct mib_cache_dep dep, cur;
+    u_int           checksum;
+    int             root_modids[NUMBER_OF_ROOT_NODES];
+    int             new_max_module, new_anonymous, new_tc_alloc = 0, ntcs;
+    int             new_tbuckets_size, new_tbuckets_count;
+    int             i, j, n, count, parent, is_dir;
+
+    mib_cache_stop();
+    mib_cache_dirty = 0;
+
+    /* only a fresh tree can be replaced by the cached one */
+    netsnmp_init_mib_internals();
+    if (module_head || max_module || !tree_head)
+        return -1;
+    for (tp = tree_head; tp; tp = tp->next_peer)
+        if (tp->child_list)
+            return -1;
+    mib_cache_recording = 1;
+
+    memset(&r, 0, sizeof(r));
+    fp = fopen(file, "rb");
+    if (!fp) {
+        DEBUGMSGTL(("parse-mibs", "No MIB cache %s\n", file));
+        return -1;
+    }
+    if (fstat(fileno(fp), &st) < 0 || st.st_size <= 0 ||
+        !(data = malloc(st.st_size)) ||
+        fread(data, 1, st.st_size, fp) != (size_t)st.st_size) {
+        fclose(fp);
+        free(data);
+        return -1;
+    }
+    fclose(fp);
+    if (st.st_size < (off_t)sizeof(checksum))
+        goto fail;
+    r.p = data;
+    r.end = data + st.st_size - sizeof(checksum);
+    memcpy(&checksum, r.end, sizeof(checksum));
+    if (mib_cache_checksum(data, r.end - data) != checksum) {
+        DEBUGMSGTL(("parse-mibs", "MIB cache %s is corrupt\n", file));
+        goto fail;
+    }
+
+    if (mib_cache_get_int(&r) != MIB_CACHE_MAGIC ||
+        mib_cache_get_int(&r) != MIB_CACHE_VERSION ||
+        !(s = mib_cache_peek_str(&r)) || strcmp(s, key) != 0) {
+        DEBUGMSGTL(("parse-mibs", "MIB cache %s is for other settings\n",
+                    file));
+        goto fail;
+    }
+
+    /* have any of the MIB directories and files changed? */
+    n = mib_cache_get_count(&r, 3 * sizeof(int));
+    for (i = 0; i < n; i++) {
+        s = mib_cache_peek_str(&r);
+        is_dir = mib_cache_get_int(&r);
+        dep.mtime = mib_cache_get_u64(&r);
+        dep.ctime = mib_cache_get_u64(&r);
+        dep.size = mib_cache_get_u64(&r);
+        if (!s || r.error)
+            goto fail;
+        mib_cache_stat(s, is_dir, &cur);
+        if (cur.mtime != dep.mtime || cur.ctime != dep.ctime ||
+            cur.size != dep.size) {
+            DEBUGMSGTL(("parse-mibs", "MIB cache %s is out of date: %s "
+                        "has changed\n", file, s));
+            goto fail;
+        }
+    }
+
+    new_max_module = mib_cache_get_int(&r);
+    new_anonymous = mib_cache_get_int(&r);
+    if (new_max_module < 0)
+        goto fail;
+    for (i = 0; i < NUMBER_OF_ROOT_NODES; i++) {
+        root_modids[i] = mib_cache_get_int(&r);
+        if (!MIB_CACHE_MODID_OK(root_modids[i], new_max_module))
+            goto fail;
+    }
+
+    n = mib_cache_get_count(&r, 4 * sizeof(int));
+    for (i = 0; i < n && !r.error; i++) {
+        mp = calloc(1, sizeof(struct module));
+        if (!mp)
+            goto fail;
+        *mpp = mp;
+        mpp = &mp->next;
+        mp->name = mib_cache_get_str(&r);
+        mp->file = mib_cache_get_str(&r);
+        mp->modid = mib_cache_get_int(&r);
+        mp->no_imports = mib_cache_get_int(&r);
+        if (mp->modid < 0 || mp->modid >= new_max_module)
+            goto fail;
+        switch (mib_cache_get_int(&r)) {
+        case 0:
+            break;
+        case 1:
+            mp->imports = root_imports;
+            break;
+        case 2:
+            count = mp->no_imports;
+            if (count <= 0 ||
+                (size_t)(r.end - r.p) / (2 * sizeof(int)) < (size_t)count)
+                goto fail;
+            mp->imports = calloc(count, sizeof(struct module_import));
+            if (!mp->imports)
+                goto fail;
+            for (j = 0; j < count; j++) {
+                mp->imports[j].label = mib_cache_get_str(&r);
+                mp->imports[j].modid = mib_cache_get_int(&r);
+                if (!MIB_CACHE_MODID_OK(mp->imports[j].modid,
+                                        new_max_module))
+                    goto fail;
+            }
+            break;
+        default:
+            goto fail;
+        }
+        if (!mp->name || !mp->file)
+            goto fail;
+    }
+
+    new_tc_alloc = mib_cache_get_int(&r);
+    ntcs = mib_cache_get_count(&r, 6 * sizeof(int));
+    if (r.error || new_tc_alloc < ntcs || new_tc_alloc <= 0)
+        goto fail;
+    tcs = calloc(new_tc_alloc, sizeof(struct tc));
+    if (!tcs)
+        goto fail;
+    for (i = 0; i < ntcs && !r.error; i++) {
+        tcs[i].type = mib_cache_get_int(&r);
+        tcs[i].modid = mib_cache_get_int(&r);
+        if (!MIB_CACHE_MODID_OK(tcs[i].modid, new_max_module))
+            goto fail;
+        tcs[i].descriptor = mib_cache_get_str(&r);
+        tcs[i].hint = mib_cache_get_str(&r);
+        mib_cache_get_node_lists(&r, &tcs[i].enums, &tcs[i].ranges);
+        tcs[i].description = mib_cache_get_str(&r);
+    }
+
+    n = mib_cache_get_count(&r, 20 * sizeof(int));
+    if (r.error || n == 0)
+        goto fail;
+    nodes = calloc(n, sizeof(*nodes));
+    last_child = calloc(n, sizeof(*last_child));
+    seen = calloc(n, 1);
+    if (!nodes || !last_child || !seen)
+        goto fail;
+    for (i = 0; i < n && !r.error; i++) {
+        parent = mib_cache_get_int(&r);
+        if (parent < -1 || parent >= i)
+            goto fail;
+        tp = nodes[i] = mib_cache_get_node(&r, new_max_module, tcs, ntcs);
+        if (r.error)
+            goto fail;
+        if (parent == -1) {
+            if (last_root)
+                last_root->next_peer = tp;
+            else
+                roots = tp;
+            last_root = tp;
+        } else {
+            tp->parent = nodes[parent];
+            if (last_child[parent])
+                last_child[parent]->next_peer = tp;
+            else
+                nodes[parent]->child_list = tp;
+            last_child[parent] = tp;
+        }
+    }
+
+    new_tbuckets_size = mib_cache_get_count(&r, sizeof(int));
+    if (r.error || new_tbuckets_size < NHASHSIZE ||
+        (new_tbuckets_size & (new_tbuckets_size - 1)))
+        goto fail;
+    new_tbuckets = calloc(new_tbuckets_size, sizeof(*new_tbuckets));
+    if (!new_tbuckets)
+        goto fail;
+    for (i = 0, new_tbuckets_count = 0; i < new_tbuckets_size; i++) {
+        struct tree   **tpp = &new_tbuckets[i];
+
+        count = mib_cache_get_count(&r, sizeof(int));
+        for (j = 0; j < count && !r.error; j++) {
+            int             index = mib_cache_get_int(&r);
+
+            if (index < 0 || index >= n || seen[index] ||
+                (name_hash(nodes[index]->label) &
+                 (new_tbuckets_size - 1)) != i)
+                goto fail;
+            seen[index] = 1;
+            *tpp = nodes[index];
+            tpp = &nodes[index]->next;
+            new_tbuckets_count++;
+        }
+        *tpp = NULL;
+    }
+    if (mib_cache_get_int(&r) != MIB_CACHE_MAGIC || r.error)
+        goto fail;
+
+    /* replace the initial tree roots and tables by the cached ones */
+    for (tp = tree_head; tp; tp = next) {
+        next = tp->next_peer;
+        free_partial_tree(tp, FALSE);
+        free(tp);
+    }
+    tree_head = roots;
+    child_index_flush();
+    free(tbuckets);
+    tbuckets = new_tbuckets;
+    tbuckets_size = new_tbuckets_size;
+    tbuckets_count = new_tbuckets_count;
+    mib_cache_free_tcs(tclist, tc_alloc);
+    tclist = tcs;
+    tc_alloc = new_tc_alloc;
+    module_head = modules;
+    max_module = new_max_module;
+    anonymous = new_anonymous;
+    for (i = 0; i < NUMBER_OF_ROOT_NODES; i++)
+        root_imports[i].modid = root_modids[i];
+
+    DEBUGMSGTL(("parse-mibs", "Loaded MIB cache %s: %d nodes\n", file, n));
+    free(last_child);
+    free(seen);
+    free(nodes);
+    free(data);
+    mib_cache_stop();
+    return 0;
+
+  fail:
+    DEBUGMSGTL(("parse-mibs", "Not using MIB cache %s\n", file));
+    mib_cache_free_modules(modules);
+    free(new_tbuckets);
+    if (tcs)
+        mib_cache_free_tcs(tcs, new_tc_alloc);
+    if (nodes)
+        mib_cache_free_nodes(nodes, n);
+    free(last_child);
+    free(seen);
+    free(data);
+    return -1;
+}
+
 #ifdef TEST
 int main(int argc, char *argv[])
 {
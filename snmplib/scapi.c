@@ -73,6 +73,7 @@ netsnmp_feature_child_of(usm_scapi, usm_support);
 #include <net-snmp/library/scapi.h>
 #include <net-snmp/library/mib.h>
 #include <net-snmp/library/transform_oids.h>
+#include <net-snmp/library/mt_support.h>
 
 #ifdef NETSNMP_USE_INTERNAL_CRYPTO
 #include <net-snmp/library/openssl_md5.h>
@@ -693,6 +694,227 @@ sc_get_openssl_privfn(int priv_type)
 }
 #endif /* openssl */
 
+/*
+ * Key state cache.
+ *
+ * The HMAC context keeps the hash state after the inner and outer pads of
+ * the key, so that each message only costs the hash of the message
+ * itself.  The cipher context keeps the expanded key schedule and only
+ * gets a new IV for each message.  A state is taken out of the cache while
+ * it is in use; a concurrent user of the same cache builds its own.
+ */
+#if defined(NETSNMP_USE_OPENSSL) && defined(HAVE_HMAC_CTX_NEW)
+#define NETSNMP_SC_CACHE_HMAC 1
+#endif
+#if defined(NETSNMP_USE_OPENSSL) && defined(HAVE_AES)
+#define NETSNMP_SC_CACHE_AES 1
+#endif
+
+struct sc_cache_state {
+    int             type;
+    u_char         *key;
+    u_int           keylen;
+#ifdef NETSNMP_SC_CACHE_HMAC
+    HMAC_CTX       *hmac;
+#endif
+#ifdef NETSNMP_SC_CACHE_AES
+    EVP_CIPHER_CTX *cipher;
+#endif
+};
+
+struct netsnmp_sc_cache_s {
+    int             refcnt;
+    struct sc_cache_state *hmac;
+    struct sc_cache_state *encrypt;
+    struct sc_cache_state *decrypt;
+};
+
+static void
+_sc_cache_state_free(struct sc_cache_state *state)
+{
+    if (!state)
+        return;
+#ifdef NETSNMP_SC_CACHE_HMAC
+    if (state->hmac)
+        HMAC_CTX_free(state->hmac);
+#endif
+#ifdef NETSNMP_SC_CACHE_AES
+    if (state->cipher)
+        EVP_CIPHER_CTX_free(state->cipher);
+#endif
+    if (state->key) {
+        SNMP_ZERO(state->key, state->keylen);
+        free(state->key);
+    }
+    free(state);
+}
+
+/*
+ * Takes the state out of a cache slot.  Returns NULL, and frees the state,
+ * if it was built for another transform or key.
+ */
+static struct sc_cache_state *
+_sc_cache_take(struct sc_cache_state **slot, int type,
+               const u_char *key, u_int keylen)
+{
+    struct sc_cache_state *state;
+
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SCAPI);
+    state = *slot;
+    *slot = NULL;
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SCAPI);
+
+    if (state && (state->type != type || state->keylen != keylen ||
+                  memcmp(state->key, key, keylen) != 0)) {
+        _sc_cache_state_free(state);
+        state = NULL;
+    }
+    return state;
+}
+
+static void
+_sc_cache_put(struct sc_cache_state **slot, struct sc_cache_state *state)
+{
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SCAPI);
+    if (*slot == NULL) {
+        *slot = state;
+        state = NULL;
+    }
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SCAPI);
+    _sc_cache_state_free(state);
+}
+
+static struct sc_cache_state *
+_sc_cache_state_new(int type, const u_char *key, u_int keylen)
+{
+    struct sc_cache_state *state = calloc(1, sizeof(*state));
+
+    if (!state)
+        return NULL;
+    state->type = type;
+    state->keylen = keylen;
+    state->key = netsnmp_memdup(key, keylen);
+    if (!state->key) {
+        free(state);
+        return NULL;
+    }
+    return state;
+}
+
+/**
+ * Allocates an empty key state cache with one reference.
+ */
+netsnmp_sc_cache *
+sc_cache_new(void)
+{
+    netsnmp_sc_cache *cache = calloc(1, sizeof(*cache));
+
+    if (cache)
+        cache->refcnt = 1;
+    return cache;
+}
+
+/**
+ * Adds a reference to a key state cache.
+ */
+netsnmp_sc_cache *
+sc_cache_ref(netsnmp_sc_cache *cache)
+{
+    if (cache) {
+        snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SCAPI);
+        cache->refcnt++;
+        snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SCAPI);
+    }
+    return cache;
+}
+
+/**
+ * Drops a reference to a key state cache, freeing it with the last one.
+ */
+void
+sc_cache_free(netsnmp_sc_cache *cache)
+{
+    int             refcnt;
+
+    if (!cache)
+        return;
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SCAPI);
+    refcnt = --cache->refcnt;
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SCAPI);
+    if (refcnt > 0)
+        return;
+    _sc_cache_state_free(cache->hmac);
+    _sc_cache_state_free(cache->encrypt);
+    _sc_cache_state_free(cache->decrypt);
+    free(cache);
+}
+
+#ifdef NETSNMP_SC_CACHE_HMAC
+static int
+_sc_cache_hmac(netsnmp_sc_cache *cache, int auth_type, const EVP_MD *hashfn,
+               const u_char *key, u_int keylen,
+               const u_char *message, u_int msglen,
+               u_char *MAC, unsigned int *maclen)
+{
+    struct sc_cache_state *state;
+    int             ok;
+
+    state = _sc_cache_take(&cache->hmac, auth_type, key, keylen);
+    if (state) {
+        ok = HMAC_Init_ex(state->hmac, NULL, 0, NULL, NULL);
+    } else {
+        state = _sc_cache_state_new(auth_type, key, keylen);
+        if (!state)
+            return SNMPERR_GENERR;
+        state->hmac = HMAC_CTX_new();
+        ok = state->hmac &&
+            HMAC_Init_ex(state->hmac, key, keylen, hashfn, NULL);
+    }
+    ok = ok && HMAC_Update(state->hmac, message, msglen) &&
+        HMAC_Final(state->hmac, MAC, maclen);
+    if (!ok) {
+        _sc_cache_state_free(state);
+        return SNMPERR_GENERR;
+    }
+    _sc_cache_put(&cache->hmac, state);
+    return SNMPERR_SUCCESS;
+}
+#endif /* NETSNMP_SC_CACHE_HMAC */
+
+#ifdef NETSNMP_SC_CACHE_AES
+static int
+_sc_cache_aes(netsnmp_sc_cache *cache, int enc, int priv_type,
+              const EVP_CIPHER *cipher, const u_char *key, u_int keylen,
+              const u_char *iv, const u_char *in, u_int inlen,
+              u_char *out, int *outlen)
+{
+    struct sc_cache_state **slot = enc ? &cache->encrypt : &cache->decrypt;
+    struct sc_cache_state *state;
+    int             ok, len = 0, len2 = 0;
+
+    state = _sc_cache_take(slot, priv_type, key, keylen);
+    if (state) {
+        ok = EVP_CipherInit_ex(state->cipher, NULL, NULL, NULL, iv, enc);
+    } else {
+        state = _sc_cache_state_new(priv_type, key, keylen);
+        if (!state)
+            return SNMPERR_GENERR;
+        state->cipher = EVP_CIPHER_CTX_new();
+        ok = state->cipher &&
+            EVP_CipherInit_ex(state->cipher, cipher, NULL, key, iv, enc);
+    }
+    ok = ok && EVP_CipherUpdate(state->cipher, out, &len, in, inlen) &&
+        EVP_CipherFinal_ex(state->cipher, out + len, &len2);
+    if (!ok) {
+        _sc_cache_state_free(state);
+        return SNMPERR_GENERR;
+    }
+    *outlen = len + len2;
+    _sc_cache_put(slot, state);
+    return SNMPERR_SUCCESS;
+}
+#endif /* NETSNMP_SC_CACHE_AES */
+
 
 /*******************************************************************-o-******
  * sc_generate_keyed_hash
@@ -726,6 +948,21 @@ sc_generate_keyed_hash(const oid * authtypeOID, size_t authtypeOIDlen,
                        const u_char * key, u_int keylen,
                        const u_char * message, u_int msglen,
                        u_char * MAC, size_t * maclen)
+{
+    return sc_generate_keyed_hash2(NULL, authtypeOID, authtypeOIDlen,
+                                   key, keylen, message, msglen, MAC, maclen);
+}
+
+/*
+ * As sc_generate_keyed_hash(), reusing the key state kept in cache if
+ * cache is not NULL.
+ */
+int
+sc_generate_keyed_hash2(netsnmp_sc_cache * cache,
+                        const oid * authtypeOID, size_t authtypeOIDlen,
+                        const u_char * key, u_int keylen,
+                        const u_char * message, u_int msglen,
+                        u_char * MAC, size_t * maclen)
 #if  defined(NETSNMP_USE_INTERNAL_MD5) || defined(NETSNMP_USE_OPENSSL) || defined(NETSNMP_USE_PKCS11) || defined(NETSNMP_USE_INTERNAL_CRYPTO)
 {
     int             rval = SNMPERR_SUCCESS, auth_type;
@@ -781,6 +1018,13 @@ sc_generate_keyed_hash(const oid * authtypeOID, size_t authtypeOIDlen,
         QUITFUN(SNMPERR_GENERR, sc_generate_keyed_hash_quit);
     }
 
+#ifdef NETSNMP_SC_CACHE_HMAC
+    if (cache) {
+        rval = _sc_cache_hmac(cache, auth_type, hashfn, key, keylen,
+                              message, msglen, buf, &buf_len);
+        QUITFUN(rval, sc_generate_keyed_hash_quit);
+    } else
+#endif
     HMAC(hashfn, key, keylen, message, msglen, buf, &buf_len);
     if (buf_len != properlength) {
         QUITFUN(rval, sc_generate_keyed_hash_quit);
@@ -855,7 +1099,7 @@ sc_generate_keyed_hash(const oid * authtypeOID, size_t authtypeOIDlen,
   sc_generate_keyed_hash_quit:
     memset(buf, 0, SNMP_MAXBUF_SMALL);
     return rval;
-}                               /* end sc_generate_keyed_hash() */
+}                               /* end sc_generate_keyed_hash2() */
 
 #else
                 _SCAPI_NOT_CONFIGURED
@@ -1076,6 +1320,21 @@ sc_check_keyed_hash(const oid * authtypeOID, size_t authtypeOIDlen,
                     const u_char * key, u_int keylen,
                     const u_char * message, u_int msglen,
                     const u_char * MAC, u_int maclen)
+{
+    return sc_check_keyed_hash2(NULL, authtypeOID, authtypeOIDlen,
+                                key, keylen, message, msglen, MAC, maclen);
+}
+
+/*
+ * As sc_check_keyed_hash(), reusing the key state kept in cache if
+ * cache is not NULL.
+ */
+int
+sc_check_keyed_hash2(netsnmp_sc_cache * cache,
+                     const oid * authtypeOID, size_t authtypeOIDlen,
+                     const u_char * key, u_int keylen,
+                     const u_char * message, u_int msglen,
+                     const u_char * MAC, u_int maclen)
 #if defined(NETSNMP_USE_INTERNAL_MD5) || defined(NETSNMP_USE_OPENSSL) || defined(NETSNMP_USE_PKCS11) || defined(NETSNMP_USE_INTERNAL_CRYPTO)
 {
     int             rval = SNMPERR_SUCCESS, auth_type, auth_size;
@@ -1117,8 +1376,9 @@ sc_check_keyed_hash(const oid * authtypeOID, size_t authtypeOIDlen,
      * the result with the given MAC which may be shorter than
      * the full hash length.
      */
-    rval = sc_generate_keyed_hash(authtypeOID, authtypeOIDlen, key, keylen,
-                                  message, msglen, buf, &buf_len);
+    rval = sc_generate_keyed_hash2(cache, authtypeOID, authtypeOIDlen,
+                                   key, keylen, message, msglen,
+                                   buf, &buf_len);
     QUITFUN(rval, sc_check_keyed_hash_quit);
 
     if (maclen > msglen) {
@@ -1134,7 +1394,7 @@ sc_check_keyed_hash(const oid * authtypeOID, size_t authtypeOIDlen,
 
     return rval;
 
-}                               /* end sc_check_keyed_hash() */
+}                               /* end sc_check_keyed_hash2() */
 
 #else
 _SCAPI_NOT_CONFIGURED
@@ -1170,6 +1430,22 @@ sc_encrypt(const oid * privtype, size_t privtypelen,
            u_char * iv, u_int ivlen,
            const u_char * plaintext, u_int ptlen,
            u_char * ciphertext, size_t * ctlen)
+{
+    return sc_encrypt2(NULL, privtype, privtypelen, key, keylen, iv, ivlen,
+                       plaintext, ptlen, ciphertext, ctlen);
+}
+
+/*
+ * As sc_encrypt(), reusing the key state kept in cache if cache is not
+ * NULL.
+ */
+int
+sc_encrypt2(netsnmp_sc_cache * cache,
+            const oid * privtype, size_t privtypelen,
+            u_char * key, u_int keylen,
+            u_char * iv, u_int ivlen,
+            const u_char * plaintext, u_int ptlen,
+            u_char * ciphertext, size_t * ctlen)
 #if defined(NETSNMP_USE_OPENSSL) || defined(NETSNMP_USE_INTERNAL_CRYPTO)
 {
     int             rval = SNMPERR_SUCCESS;
@@ -1315,6 +1591,18 @@ sc_encrypt(const oid * privtype, size_t privtypelen,
         }
 
         memcpy(my_iv, iv, ivlen);
+#ifdef NETSNMP_SC_CACHE_AES
+        if (cache) {
+            rc = _sc_cache_aes(cache, 1, pai->type, cipher, key, keylen,
+                               my_iv, plaintext, ptlen, ciphertext, &enclen);
+            if (rc != SNMPERR_SUCCESS) {
+                DEBUGMSGTL(("scapi:encrypt", "openssl error: cached\n"));
+                QUITFUN(SNMPERR_GENERR, sc_encrypt_quit);
+            }
+            *ctlen = enclen;
+            goto sc_encrypt_quit;
+        }
+#endif
         /*
          * encrypt the data 
          */
@@ -1365,7 +1653,7 @@ sc_encrypt(const oid * privtype, size_t privtypelen,
 #endif
     return rval;
 
-}                               /* end sc_encrypt() */
+}                               /* end sc_encrypt2() */
 #elif defined(NETSNMP_USE_PKCS11)
 {
     int             rval = SNMPERR_SUCCESS, priv_type
@@ -1455,6 +1743,22 @@ sc_decrypt(const oid * privtype, size_t privtypelen,
            u_char * iv, u_int ivlen,
            u_char * ciphertext, u_int ctlen,
            u_char * plaintext, size_t * ptlen)
+{
+    return sc_decrypt2(NULL, privtype, privtypelen, key, keylen, iv, ivlen,
+                       ciphertext, ctlen, plaintext, ptlen);
+}
+
+/*
+ * As sc_decrypt(), reusing the key state kept in cache if cache is not
+ * NULL.
+ */
+int
+sc_decrypt2(netsnmp_sc_cache * cache,
+            const oid * privtype, size_t privtypelen,
+            u_char * key, u_int keylen,
+            u_char * iv, u_int ivlen,
+            u_char * ciphertext, u_int ctlen,
+            u_char * plaintext, size_t * ptlen)
 #if defined(NETSNMP_USE_OPENSSL) || defined(NETSNMP_USE_INTERNAL_CRYPTO)
 {
 
@@ -1537,6 +1841,16 @@ sc_decrypt(const oid * privtype, size_t privtypelen,
             QUITFUN(SNMPERR_GENERR, sc_decrypt_quit);
 
         memcpy(my_iv, iv, ivlen);
+#ifdef NETSNMP_SC_CACHE_AES
+        if (cache) {
+            rc = _sc_cache_aes(cache, 0, pai->type, cipher, key, keylen,
+                               my_iv, ciphertext, ctlen, plaintext, &len);
+            if (rc != SNMPERR_SUCCESS)
+                QUITFUN(SNMPERR_GENERR, sc_decrypt_quit);
+            *ptlen = ctlen;
+            goto sc_decrypt_quit;
+        }
+#endif
         /*
          * decrypt the data
          */
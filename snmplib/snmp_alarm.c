@@ -53,10 +53,195 @@
 #include <net-snmp/library/callback.h>
 #include <net-snmp/library/snmp_alarm.h>
 
-static struct snmp_alarm *thealarms = NULL;
+/*
+ * Pending alarms are kept in a binary min-heap ordered by their next
+ * expiry time, so that the next alarm to fire can be found in constant
+ * time and (re)scheduled in O(log n).  All registered alarms, including
+ * the one that is being run by run_alarms(), are additionally kept in a
+ * hash table indexed by clientreg, chained through snmp_alarm.next.
+ */
+static struct snmp_alarm **sa_heap = NULL;
+static size_t   sa_heap_len = 0;
+static size_t   sa_heap_size = 0;
+static struct snmp_alarm **sa_hash = NULL;
+static size_t   sa_hash_size = 0;
+static size_t   sa_count = 0;
 static int      start_alarms = 0;
 static unsigned int regnum = 1;
 
+#define SA_NOT_QUEUED ((size_t)-1)
+
+/*
+ * Heap ordering: earliest t_nextM first, ties broken by registration
+ * order so that alarms due at the same time fire in the order they were
+ * registered in.
+ */
+static int
+sa_before(const struct snmp_alarm *a, const struct snmp_alarm *b)
+{
+    if (timercmp(&a->t_nextM, &b->t_nextM, !=))
+        return timercmp(&a->t_nextM, &b->t_nextM, <);
+    return a->clientreg < b->clientreg;
+}
+
+static void
+sa_heap_set(size_t i, struct snmp_alarm *a)
+{
+    sa_heap[i] = a;
+    a->heap_index = i;
+}
+
+static void
+sa_heap_sift_up(size_t i)
+{
+    struct snmp_alarm *a = sa_heap[i];
+
+    while (i > 0) {
+        size_t parent = (i - 1) / 2;
+
+        if (!sa_before(a, sa_heap[parent]))
+            break;
+        sa_heap_set(i, sa_heap[parent]);
+        i = parent;
+    }
+    sa_heap_set(i, a);
+}
+
+static void
+sa_heap_sift_down(size_t i)
+{
+    struct snmp_alarm *a = sa_heap[i];
+
+    for (;;) {
+        size_t child = 2 * i + 1;
+
+        if (child >= sa_heap_len)
+            break;
+        if (child + 1 < sa_heap_len &&
+            sa_before(sa_heap[child + 1], sa_heap[child]))
+            child++;
+        if (!sa_before(sa_heap[child], a))
+            break;
+        sa_heap_set(i, sa_heap[child]);
+        i = child;
+    }
+    sa_heap_set(i, a);
+}
+
+static int
+sa_heap_insert(struct snmp_alarm *a)
+{
+    if (sa_heap_len == sa_heap_size) {
+        size_t new_size = sa_heap_size ? 2 * sa_heap_size : 16;
+        struct snmp_alarm **new_heap;
+
+        new_heap = realloc(sa_heap, new_size * sizeof(*new_heap));
+        if (new_heap == NULL)
+            return -1;
+        sa_heap = new_heap;
+        sa_heap_size = new_size;
+    }
+    sa_heap_set(sa_heap_len++, a);
+    sa_heap_sift_up(a->heap_index);
+    return 0;
+}
+
+static void
+sa_heap_remove(struct snmp_alarm *a)
+{
+    size_t i = a->heap_index;
+    struct snmp_alarm *last;
+
+    if (i == SA_NOT_QUEUED)
+        return;
+    netsnmp_assert(i < sa_heap_len && sa_heap[i] == a);
+    a->heap_index = SA_NOT_QUEUED;
+    last = sa_heap[--sa_heap_len];
+    if (last == a)
+        return;
+    sa_heap_set(i, last);
+    if (i > 0 && sa_before(last, sa_heap[(i - 1) / 2]))
+        sa_heap_sift_up(i);
+    else
+        sa_heap_sift_down(i);
+}
+
+/*
+ * (Re)position an alarm in the heap after its t_nextM has been changed.
+ * Alarms that are being run are not queued; run_alarms() takes care of
+ * them once their callback has returned.
+ */
+static void
+sa_heap_update(struct snmp_alarm *a)
+{
+    if (a->flags & SA_FIRED)
+        return;
+    if (a->heap_index == SA_NOT_QUEUED) {
+        if (sa_heap_insert(a) < 0)
+            snmp_log(LOG_ERR, "snmp_alarm: out of memory queueing alarm %d\n",
+                     a->clientreg);
+        return;
+    }
+    sa_heap_remove(a);
+    sa_heap_insert(a);
+}
+
+static int
+sa_hash_grow(void)
+{
+    size_t new_size = sa_hash_size ? 2 * sa_hash_size : 64;
+    struct snmp_alarm **new_hash, *a, *next;
+    size_t i;
+
+    new_hash = calloc(new_size, sizeof(*new_hash));
+    if (new_hash == NULL)
+        return -1;
+    for (i = 0; i < sa_hash_size; i++) {
+        for (a = sa_hash[i]; a != NULL; a = next) {
+            next = a->next;
+            a->next = new_hash[a->clientreg & (new_size - 1)];
+            new_hash[a->clientreg & (new_size - 1)] = a;
+        }
+    }
+    free(sa_hash);
+    sa_hash = new_hash;
+    sa_hash_size = new_size;
+    return 0;
+}
+
+static int
+sa_hash_add(struct snmp_alarm *a)
+{
+    struct snmp_alarm **bucket;
+
+    if (sa_count >= sa_hash_size && sa_hash_grow() < 0 && sa_hash == NULL)
+        return -1;
+    bucket = &sa_hash[a->clientreg & (sa_hash_size - 1)];
+    a->next = *bucket;
+    *bucket = a;
+    sa_count++;
+    return 0;
+}
+
+static struct snmp_alarm *
+sa_hash_unlink(unsigned int clientreg)
+{
+    struct snmp_alarm *a, **prevNext;
+
+    if (sa_hash == NULL)
+        return NULL;
+    prevNext = &sa_hash[clientreg & (sa_hash_size - 1)];
+    for (a = *prevNext; a != NULL; prevNext = &a->next, a = a->next) {
+        if (a->clientreg == clientreg) {
+            *prevNext = a->next;
+            a->next = NULL;
+            sa_count--;
+            return a;
+        }
+    }
+    return NULL;
+}
+
 int
 init_alarm_post_config(int majorid, int minorid, void *serverarg,
                        void *clientarg)
@@ -95,14 +280,18 @@ sa_update_entry(struct snmp_alarm *a)
                 DEBUGMSGTL(("snmp_alarm",
                             "update_entry: illegal interval specified\n"));
                 snmp_alarm_unregister(a->clientreg);
+                return;
             }
         } else {
             /*
              * Single time call, remove it.  
              */
             snmp_alarm_unregister(a->clientreg);
+            return;
         }
     }
+    if (timerisset(&a->t_nextM))
+        sa_heap_update(a);
 }
 
 /**
@@ -121,16 +310,10 @@ sa_update_entry(struct snmp_alarm *a)
 void
 snmp_alarm_unregister(unsigned int clientreg)
 {
-    struct snmp_alarm *sa_ptr, **prevNext = &thealarms;
-
-    for (sa_ptr = thealarms;
-         sa_ptr != NULL && sa_ptr->clientreg != clientreg;
-         sa_ptr = sa_ptr->next) {
-        prevNext = &(sa_ptr->next);
-    }
+    struct snmp_alarm *sa_ptr = sa_hash_unlink(clientreg);
 
     if (sa_ptr != NULL) {
-        *prevNext = sa_ptr->next;
+        sa_heap_remove(sa_ptr);
         DEBUGMSGTL(("snmp_alarm", "unregistered alarm %d\n", 
 		    sa_ptr->clientreg));
         /*
@@ -155,26 +338,29 @@ void
 snmp_alarm_unregister_all(void)
 {
   struct snmp_alarm *sa_ptr, *sa_tmp;
+  size_t i;
 
-  for (sa_ptr = thealarms; sa_ptr != NULL; sa_ptr = sa_tmp) {
-    sa_tmp = sa_ptr->next;
-    free(sa_ptr);
+  for (i = 0; i < sa_hash_size; i++) {
+    for (sa_ptr = sa_hash[i]; sa_ptr != NULL; sa_ptr = sa_tmp) {
+      sa_tmp = sa_ptr->next;
+      free(sa_ptr);
+    }
   }
   DEBUGMSGTL(("snmp_alarm", "ALL alarms unregistered\n"));
-  thealarms = NULL;
+  free(sa_hash);
+  sa_hash = NULL;
+  sa_hash_size = 0;
+  sa_count = 0;
+  free(sa_heap);
+  sa_heap = NULL;
+  sa_heap_len = 0;
+  sa_heap_size = 0;
 }  
 
 struct snmp_alarm *
 sa_find_next(void)
 {
-    struct snmp_alarm *a, *lowest = NULL;
-
-    for (a = thealarms; a != NULL; a = a->next)
-        if (!(a->flags & SA_FIRED)
-            && (lowest == NULL || timercmp(&a->t_nextM, &lowest->t_nextM, <)))
-            lowest = a;
-
-    return lowest;
+    return sa_heap_len > 0 ? sa_heap[0] : NULL;
 }
 
 NETSNMP_IMPORT struct snmp_alarm *sa_find_specific(unsigned int clientreg);
@@ -182,7 +368,11 @@ struct snmp_alarm *
 sa_find_specific(unsigned int clientreg)
 {
     struct snmp_alarm *sa_ptr;
-    for (sa_ptr = thealarms; sa_ptr != NULL; sa_ptr = sa_ptr->next) {
+
+    if (sa_hash == NULL)
+        return NULL;
+    for (sa_ptr = sa_hash[clientreg & (sa_hash_size - 1)]; sa_ptr != NULL;
+         sa_ptr = sa_ptr->next) {
         if (sa_ptr->clientreg == clientreg) {
             return sa_ptr;
         }
@@ -209,6 +399,7 @@ run_alarms(void)
             return;
 
         clientreg = a->clientreg;
+        sa_heap_remove(a);
         a->flags |= SA_FIRED;
         DEBUGMSGTL(("snmp_alarm", "run alarm %d\n", clientreg));
         (*(a->thecallback)) (clientreg, a->clientarg);
@@ -417,34 +608,38 @@ unsigned int
 snmp_alarm_register_hr(struct timeval t, unsigned int flags,
                        SNMPAlarmCallback * cb, void *cd)
 {
-    struct snmp_alarm **s = NULL;
-
-    for (s = &(thealarms); *s != NULL; s = &((*s)->next));
+    struct snmp_alarm *s;
 
-    *s = SNMP_MALLOC_STRUCT(snmp_alarm);
-    if (*s == NULL) {
+    s = SNMP_MALLOC_STRUCT(snmp_alarm);
+    if (s == NULL) {
         return 0;
     }
 
-    (*s)->t = t;
-    (*s)->flags = flags;
-    (*s)->clientarg = cd;
-    (*s)->thecallback = cb;
-    (*s)->clientreg = regnum++;
-    (*s)->next = NULL;
+    s->t = t;
+    s->flags = flags;
+    s->clientarg = cd;
+    s->thecallback = cb;
+    s->clientreg = regnum++;
+    s->next = NULL;
+    s->heap_index = SA_NOT_QUEUED;
+
+    if (sa_hash_add(s) < 0) {
+        free(s);
+        return 0;
+    }
 
-    sa_update_entry(*s);
+    sa_update_entry(s);
 
     DEBUGMSGTL(("snmp_alarm",
                 "registered alarm %d, t = %ld.%03ld, flags=0x%02x\n",
-                (*s)->clientreg, (long) (*s)->t.tv_sec, (long)((*s)->t.tv_usec / 1000),
-                (*s)->flags));
+                s->clientreg, (long) s->t.tv_sec, (long)(s->t.tv_usec / 1000),
+                s->flags));
 
     if (start_alarms) {
         set_an_alarm();
     }
 
-    return (*s)->clientreg;
+    return s->clientreg;
 }
 
 /**
@@ -471,6 +666,7 @@ snmp_alarm_reset(unsigned int clientreg)
         a->t_nextM.tv_sec = 0;
         a->t_nextM.tv_usec = 0;
         NETSNMP_TIMERADD(&t_now, &a->t, &a->t_nextM);
+        sa_heap_update(a);
         return 0;
     }
     DEBUGMSGTL(("snmp_alarm_reset", "alarm %d not found\n",
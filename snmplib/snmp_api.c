@@ -47,6 +47,7 @@ SOFTWARE.
 
 #include <stdio.h>
 #include <ctype.h>
+#include <stddef.h>
 #ifdef HAVE_STDLIB_H
 #include <stdlib.h>
 #endif
@@ -125,6 +126,7 @@ SOFTWARE.
 #include <net-snmp/library/container.h>
 #include <net-snmp/library/snmp_secmod.h>
 #include <net-snmp/library/large_fd_set.h>
+#include <net-snmp/library/fd_event_manager.h>
 #ifdef NETSNMP_SECMOD_USM
 #include <net-snmp/library/snmpusm.h>
 #endif
@@ -844,6 +846,9 @@ register_default_handlers(void)
     netsnmp_ds_register_config(ASN_INTEGER, "snmp", "sendMessageMaxSize",
                                NETSNMP_DS_LIBRARY_ID,
                                NETSNMP_DS_LIB_MSG_SEND_MAX);
+    netsnmp_ds_register_config(ASN_INTEGER, "snmp", "serverUDPBatch",
+                               NETSNMP_DS_LIBRARY_ID,
+                               NETSNMP_DS_LIB_SERVER_UDP_BATCH);
     netsnmp_ds_register_config(ASN_BOOLEAN, "snmp", "noPersistentLoad",
 		      NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_DISABLE_PERSISTENT_LOAD);
     netsnmp_ds_register_config(ASN_BOOLEAN, "snmp", "noPersistentSave",
@@ -1006,6 +1011,401 @@ snmp_shutdown(const char *type)
     _init_snmp_init_done = 0;
 }
 
+/*
+ * Index over the Sessions list, so that a session can be found from its
+ * session_list pointer, its netsnmp_session pointer, its socket or its
+ * paramName without walking the whole list.  One entry exists per session
+ * in the list; the entry also records the list predecessor so that
+ * sessions can be unlinked in constant time.  Protected by MT_LIB_SESSION
+ * together with Sessions.  If the index cannot be allocated, sess_index
+ * stays NULL and all lookups fall back to walking the list.
+ */
+struct session_index_entry {
+    struct session_list *slp;
+    struct session_list *prev;  /* predecessor in Sessions */
+    int             sock;       /* socket this entry is hashed under */
+    unsigned int    read_gen;   /* last snmp_read2() pass that read it */
+    int             name_hashed; /* whether linked into a by_name chain */
+    size_t          name_bucket; /* by_name chain the entry is linked into */
+    struct session_index_entry *next_slp;
+    struct session_index_entry *next_sess;
+    struct session_index_entry *next_sock;
+    struct session_index_entry *next_name;
+};
+
+struct session_index {
+    struct session_index_entry **by_slp;
+    struct session_index_entry **by_sess;
+    struct session_index_entry **by_sock;
+    struct session_index_entry **by_name;
+    size_t          size;       /* number of buckets, a power of two */
+    size_t          count;
+};
+
+static struct session_index *sess_index = NULL;
+static unsigned int sess_read_gen = 0;
+
+static size_t
+_sess_hash_ptr(const void *p, size_t size)
+{
+    size_t          h = (size_t)p;
+
+    h ^= h >> 4;
+    h ^= h >> 12;
+    return h & (size - 1);
+}
+
+static size_t
+_sess_hash_name(const char *name, size_t size)
+{
+    size_t          h = 5381;
+
+    while (*name)
+        h = h * 33 + (unsigned char)*name++;
+    return h & (size - 1);
+}
+
+static size_t
+_sess_hash_sock(int sock, size_t size)
+{
+    return (size_t)sock & (size - 1);
+}
+
+static void
+_sess_index_free(struct session_index *si)
+{
+    size_t          i;
+    struct session_index_entry *e, *next;
+
+    if (si == NULL)
+        return;
+    for (i = 0; i < si->size; i++) {
+        for (e = si->by_slp[i]; e; e = next) {
+            next = e->next_slp;
+            free(e);
+        }
+    }
+    free(si->by_slp);
+    free(si->by_sess);
+    free(si->by_sock);
+    free(si->by_name);
+    free(si);
+}
+
+static struct session_index_entry *
+_sess_index_find(const struct session_list *slp)
+{
+    struct session_index_entry *e;
+
+    for (e = sess_index->by_slp[_sess_hash_ptr(slp, sess_index->size)]; e;
+         e = e->next_slp)
+        if (e->slp == slp)
+            return e;
+    return NULL;
+}
+
+/*
+ * Append an entry to the tail of its chains, so that entries in a chain
+ * keep the order of the Sessions list when the index is rebuilt.
+ */
+static void
+_sess_index_link_tail(struct session_index *si, struct session_index_entry *e)
+{
+    struct session_index_entry **pp;
+
+    for (pp = &si->by_slp[_sess_hash_ptr(e->slp, si->size)]; *pp;
+         pp = &(*pp)->next_slp)
+        ;
+    *pp = e;
+    for (pp = &si->by_sess[_sess_hash_ptr(e->slp->session, si->size)]; *pp;
+         pp = &(*pp)->next_sess)
+        ;
+    *pp = e;
+    if (e->sock >= 0) {
+        for (pp = &si->by_sock[_sess_hash_sock(e->sock, si->size)]; *pp;
+             pp = &(*pp)->next_sock)
+            ;
+        *pp = e;
+    }
+}
+
+/*
+ * (Re)build an index of the given size from the Sessions list.  Name
+ * chains are populated lazily by snmp_sess_lookup_by_name(), since a
+ * paramName may be assigned after the session has been opened.
+ */
+static struct session_index *
+_sess_index_build(size_t size)
+{
+    struct session_index *si;
+    struct session_index_entry *e, *old;
+    struct session_list *slp, *prev = NULL;
+
+    si = calloc(1, sizeof(*si));
+    if (si == NULL)
+        return NULL;
+    si->size = size;
+    si->by_slp = calloc(size, sizeof(*si->by_slp));
+    si->by_sess = calloc(size, sizeof(*si->by_sess));
+    si->by_sock = calloc(size, sizeof(*si->by_sock));
+    si->by_name = calloc(size, sizeof(*si->by_name));
+    if (!si->by_slp || !si->by_sess || !si->by_sock || !si->by_name) {
+        _sess_index_free(si);
+        return NULL;
+    }
+
+    for (slp = Sessions; slp; prev = slp, slp = slp->next) {
+        e = calloc(1, sizeof(*e));
+        if (e == NULL) {
+            _sess_index_free(si);
+            return NULL;
+        }
+        e->slp = slp;
+        e->prev = prev;
+        e->sock = slp->transport ? slp->transport->sock : -1;
+        if (sess_index && (old = _sess_index_find(slp)) != NULL)
+            e->read_gen = old->read_gen;
+        _sess_index_link_tail(si, e);
+        si->count++;
+    }
+    return si;
+}
+
+/*
+ * Add the session at the head of Sessions to the index.
+ */
+static void
+_sess_index_add_head(struct session_list *slp)
+{
+    struct session_index_entry *e, *next_e;
+    size_t          h;
+
+    if (sess_index == NULL || sess_index->count >= sess_index->size) {
+        size_t          size = sess_index ? 2 * sess_index->size : 64;
+        struct session_index *si;
+
+        while (size <= (sess_index ? sess_index->count : 0))
+            size *= 2;
+        si = _sess_index_build(size);
+        _sess_index_free(sess_index);
+        sess_index = si;
+        /* the new index already contains slp */
+        if (sess_index && (e = _sess_index_find(slp)) != NULL)
+            e->read_gen = sess_read_gen;
+        return;
+    }
+
+    e = calloc(1, sizeof(*e));
+    if (e == NULL) {
+        _sess_index_free(sess_index);
+        sess_index = NULL;
+        return;
+    }
+    e->slp = slp;
+    e->prev = NULL;
+    e->sock = slp->transport ? slp->transport->sock : -1;
+    e->read_gen = sess_read_gen;
+    if (slp->next && (next_e = _sess_index_find(slp->next)) != NULL)
+        next_e->prev = slp;
+
+    h = _sess_hash_ptr(slp, sess_index->size);
+    e->next_slp = sess_index->by_slp[h];
+    sess_index->by_slp[h] = e;
+    h = _sess_hash_ptr(slp->session, sess_index->size);
+    e->next_sess = sess_index->by_sess[h];
+    sess_index->by_sess[h] = e;
+    if (e->sock >= 0) {
+        h = _sess_hash_sock(e->sock, sess_index->size);
+        e->next_sock = sess_index->by_sock[h];
+        sess_index->by_sock[h] = e;
+    }
+    sess_index->count++;
+}
+
+static void
+_sess_index_unlink_sock(struct session_index_entry *e)
+{
+    struct session_index_entry **pp;
+
+    if (e->sock < 0)
+        return;
+    for (pp = &sess_index->by_sock[_sess_hash_sock(e->sock, sess_index->size)];
+         *pp; pp = &(*pp)->next_sock) {
+        if (*pp == e) {
+            *pp = e->next_sock;
+            break;
+        }
+    }
+    e->next_sock = NULL;
+    e->sock = -1;
+}
+
+static void
+_sess_index_unlink_name(struct session_index_entry *e)
+{
+    struct session_index_entry **pp;
+
+    if (!e->name_hashed)
+        return;
+    for (pp = &sess_index->by_name[e->name_bucket]; *pp;
+         pp = &(*pp)->next_name) {
+        if (*pp == e) {
+            *pp = e->next_name;
+            break;
+        }
+    }
+    e->next_name = NULL;
+    e->name_hashed = 0;
+}
+
+/*
+ * Tell the epoll event loop, if it is in use, that the set of sessions
+ * reading from sock may have changed.
+ */
+static void
+_sess_epoll_update(int sock)
+{
+#if !defined(NETSNMP_FEATURE_REMOVE_FD_EVENT_MANAGER) && defined(HAVE_SYS_EPOLL_H)
+    if (sock >= 0)
+        netsnmp_epoll_update_fd(sock);
+#endif
+}
+
+/*
+ * Re-hash a session under its current socket if it has changed since the
+ * session was indexed.
+ */
+static void
+_sess_index_update_sock(struct session_list *slp)
+{
+    struct session_index_entry *e;
+    int             sock, old_sock;
+    size_t          h;
+
+    if (sess_index == NULL || (e = _sess_index_find(slp)) == NULL)
+        return;
+    sock = slp->transport ? slp->transport->sock : -1;
+    if (sock == e->sock)
+        return;
+    old_sock = e->sock;
+    _sess_index_unlink_sock(e);
+    if (sock >= 0) {
+        e->sock = sock;
+        h = _sess_hash_sock(sock, sess_index->size);
+        e->next_sock = sess_index->by_sock[h];
+        sess_index->by_sock[h] = e;
+    }
+    _sess_epoll_update(old_sock);
+    _sess_epoll_update(sock);
+}
+
+/*
+ * Unlink a session from Sessions and from the index.
+ */
+static void
+_sess_list_remove(struct session_list *slp)
+{
+    struct session_index_entry *e, *next_e, **pp;
+    struct session_list *prev;
+    int             sock = slp->transport ? slp->transport->sock : -1;
+    int             old_sock;
+
+    if (sess_index == NULL || (e = _sess_index_find(slp)) == NULL) {
+        struct session_list **prevNext;
+
+        for (prevNext = &Sessions; *prevNext; prevNext = &(*prevNext)->next) {
+            if (*prevNext == slp) {
+                *prevNext = slp->next;
+                break;
+            }
+        }
+        _sess_epoll_update(sock);
+        return;
+    }
+
+    prev = e->prev;
+    if (prev)
+        prev->next = slp->next;
+    else
+        Sessions = slp->next;
+    if (slp->next && (next_e = _sess_index_find(slp->next)) != NULL)
+        next_e->prev = prev;
+
+    for (pp = &sess_index->by_slp[_sess_hash_ptr(slp, sess_index->size)];
+         *pp; pp = &(*pp)->next_slp) {
+        if (*pp == e) {
+            *pp = e->next_slp;
+            break;
+        }
+    }
+    for (pp = &sess_index->by_sess[_sess_hash_ptr(slp->session,
+                                                  sess_index->size)];
+         *pp; pp = &(*pp)->next_sess) {
+        if (*pp == e) {
+            *pp = e->next_sess;
+            break;
+        }
+    }
+    old_sock = e->sock;
+    _sess_index_unlink_sock(e);
+    _sess_index_unlink_name(e);
+    sess_index->count--;
+    free(e);
+    _sess_epoll_update(sock);
+    if (old_sock != sock)
+        _sess_epoll_update(old_sock);
+}
+
+/*
+ * Returns whether a session in the Sessions list reads from sock.  Used by
+ * the epoll event loop to decide which sockets to watch.  Sessions that are
+ * read by a thread of their own do not count.
+ */
+int
+netsnmp_sess_sock_in_use(int sock)
+{
+    struct session_index_entry *e;
+    struct session_list *slp;
+    int             in_use = 0;
+
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SESSION);
+    if (sess_index != NULL) {
+        for (e = sess_index->by_sock[_sess_hash_sock(sock, sess_index->size)];
+             e; e = e->next_sock) {
+            if (e->slp->transport && e->slp->transport->sock == sock &&
+                !(e->slp->session->flags & SNMP_FLAGS_OWN_THREAD)) {
+                in_use = 1;
+                break;
+            }
+        }
+    } else {
+        for (slp = Sessions; slp; slp = slp->next) {
+            if (slp->transport && slp->transport->sock == sock &&
+                !(slp->session->flags & SNMP_FLAGS_OWN_THREAD)) {
+                in_use = 1;
+                break;
+            }
+        }
+    }
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SESSION);
+    return in_use;
+}
+
+/*
+ * Add the sockets of all sessions to the epoll event loop.
+ */
+void
+netsnmp_sess_epoll_register(void)
+{
+    struct session_list *slp;
+
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SESSION);
+    for (slp = Sessions; slp; slp = slp->next)
+        if (slp->transport)
+            _sess_epoll_update(slp->transport->sock);
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SESSION);
+}
+
 /*
  * inserts session into session list
  */
@@ -1017,6 +1417,9 @@ void  snmp_session_insert(struct session_list *slp)
     snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SESSION);
     slp->next = Sessions;
     Sessions = slp;
+    _sess_index_add_head(slp);
+    if (slp->transport)
+        _sess_epoll_update(slp->transport->sock);
     snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SESSION);
 }
 
@@ -2031,26 +2434,39 @@ snmp_sess_close(struct session_list *slp)
     return 1;
 }
 
+/*
+ * Find the list entry of a session in Sessions.  Call with MT_LIB_SESSION
+ * held.
+ */
+static struct session_list *
+_sess_find_by_session(const netsnmp_session *session)
+{
+    struct session_index_entry *e;
+    struct session_list *slp;
+
+    if (sess_index == NULL) {
+        for (slp = Sessions; slp; slp = slp->next)
+            if (slp->session == session)
+                return slp;
+        return NULL;
+    }
+    for (e = sess_index->by_sess[_sess_hash_ptr(session, sess_index->size)];
+         e; e = e->next_sess)
+        if (e->slp->session == session)
+            return e->slp;
+    return NULL;
+}
+
 int
 snmp_close(netsnmp_session * session)
 {
-    struct session_list *slp = NULL, *oslp = NULL;
+    struct session_list *slp = NULL;
 
     {                           /*MTCRITICAL_RESOURCE */
         snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SESSION);
-        if (Sessions && Sessions->session == session) { /* If first entry */
-            slp = Sessions;
-            Sessions = slp->next;
-        } else {
-            for (slp = Sessions; slp; slp = slp->next) {
-                if (slp->session == session) {
-                    if (oslp)   /* if we found entry that points here */
-                        oslp->next = slp->next; /* link around this entry */
-                    break;
-                }
-                oslp = slp;
-            }
-        }
+        slp = _sess_find_by_session(session);
+        if (slp)
+            _sess_list_remove(slp);
         snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SESSION);
     }                           /*END MTCRITICAL_RESOURCE */
     if (slp == NULL) {
@@ -2067,7 +2483,7 @@ snmp_close_sessions(void)
     snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SESSION);
     while (Sessions) {
         slp = Sessions;
-        Sessions = Sessions->next;
+        _sess_list_remove(slp);
         snmp_sess_close(slp);
     }
     snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SESSION);
@@ -3227,6 +3643,158 @@ snmp_build(u_char ** pkt, size_t * pkt_len, size_t * offset,
     return rc;
 }
 
+/*
+ * Notification fan-out.  The encoded varbind list is shared, reference
+ * counted, by a PDU and the copies made of it for each destination.  The
+ * bytes are what the build functions below would produce for the varbinds
+ * with the current encoding direction.  A copy may be freed by another
+ * thread than the one that made it, so the count is updated atomically.
+ */
+struct netsnmp_encoded_varbinds_s {
+    int             refcount;
+    size_t          len;
+    u_char         *data;
+};
+
+/**
+ * Encodes the varbind list of a PDU, so that it can be sent to several
+ * destinations without encoding the varbinds again.
+ *
+ * @return SNMPERR_SUCCESS, or an error if the varbinds cannot be encoded
+ *         (the PDU is then sent as usual).
+ */
+int
+netsnmp_pdu_encode_varbinds(netsnmp_pdu *pdu)
+{
+    struct netsnmp_encoded_varbinds_s *ev;
+    netsnmp_variable_list *vp;
+    u_char         *buf = NULL, *start = NULL, *cp;
+    size_t          buf_len = SNMP_MIN_MAX_LEN, left, len = 0;
+
+    if (pdu == NULL)
+        return SNMPERR_GENERR;
+    netsnmp_pdu_release_encoded_varbinds(pdu);
+
+#ifdef NETSNMP_USE_REVERSE_ASNENCODING
+    if (netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                               NETSNMP_DS_LIB_REVERSE_ENCODE)) {
+        netsnmp_variable_list **vps;
+        int             i, count = 0;
+
+        for (vp = pdu->variables; vp; vp = vp->next_variable)
+            count++;
+        vps = malloc((count + 1) * sizeof(*vps));
+        buf = malloc(buf_len);
+        if (vps == NULL || buf == NULL) {
+            free(vps);
+            free(buf);
+            return SNMPERR_MALLOC;
+        }
+        for (vp = pdu->variables, i = 0; vp; vp = vp->next_variable)
+            vps[i++] = vp;
+        for (i = count - 1; i >= 0; i--) {
+            vp = vps[i];
+            if (!snmp_realloc_rbuild_var_op(&buf, &buf_len, &len, 1,
+                                            vp->name, &vp->name_length,
+                                            vp->type,
+                                            (u_char *) vp->val.string,
+                                            vp->val_len))
+                break;
+        }
+        free(vps);
+        if (i >= 0) {
+            free(buf);
+            return SNMPERR_BAD_ASN1_BUILD;
+        }
+        start = buf + buf_len - len;
+    } else
+#endif /* NETSNMP_USE_REVERSE_ASNENCODING */
+    {
+        for (;;) {
+            cp = realloc(buf, buf_len);
+            if (cp == NULL) {
+                free(buf);
+                return SNMPERR_MALLOC;
+            }
+            buf = cp;
+            left = buf_len;
+            for (vp = pdu->variables; vp && cp; vp = vp->next_variable)
+                cp = snmp_build_var_op(cp, vp->name, &vp->name_length,
+                                       vp->type, vp->val_len,
+                                       vp->val.string, &left);
+            if (cp != NULL)
+                break;
+            /* out of room, or a varbind that cannot be encoded */
+            if (buf_len >= SNMP_MAX_RCV_MSG_SIZE) {
+                free(buf);
+                return SNMPERR_BAD_ASN1_BUILD;
+            }
+            buf_len *= 2;
+        }
+        start = buf;
+        len = cp - buf;
+    }
+
+    ev = malloc(sizeof(*ev) + len);
+    if (ev == NULL) {
+        free(buf);
+        return SNMPERR_MALLOC;
+    }
+    ev->refcount = 1;
+    ev->len = len;
+    ev->data = (u_char *) (ev + 1);
+    memcpy(ev->data, start, len);
+    free(buf);
+    pdu->encoded_vars = ev;
+    DEBUGMSGTL(("snmp_pdu_encode_varbinds", "%" NETSNMP_PRIz "u bytes\n",
+                len));
+    return SNMPERR_SUCCESS;
+}
+
+/**
+ * Makes a PDU use the encoded varbind list of another one.
+ */
+void
+netsnmp_pdu_share_encoded_varbinds(netsnmp_pdu *to, const netsnmp_pdu *from)
+{
+    if (to->encoded_vars == from->encoded_vars)
+        return;
+    netsnmp_pdu_release_encoded_varbinds(to);
+    to->encoded_vars = from->encoded_vars;
+    if (to->encoded_vars)
+#if defined(NETSNMP_REENTRANT) && defined(__GNUC__)
+        __sync_add_and_fetch(&to->encoded_vars->refcount, 1);
+#else
+        to->encoded_vars->refcount++;
+#endif
+}
+
+/**
+ * Drops a PDU's reference to its encoded varbind list.
+ */
+void
+netsnmp_pdu_release_encoded_varbinds(netsnmp_pdu *pdu)
+{
+    struct netsnmp_encoded_varbinds_s *ev = pdu->encoded_vars;
+
+    pdu->encoded_vars = NULL;
+#if defined(NETSNMP_REENTRANT) && defined(__GNUC__)
+    if (ev && __sync_sub_and_fetch(&ev->refcount, 1) == 0)
+#else
+    if (ev && --ev->refcount == 0)
+#endif
+        free(ev);
+}
+
+/**
+ * @return the length of a PDU's encoded varbind list, 0 if it has none.
+ */
+size_t
+netsnmp_pdu_encoded_varbinds_len(const netsnmp_pdu *pdu)
+{
+    return pdu->encoded_vars ? pdu->encoded_vars->len : 0;
+}
+
 /*
  * on error, returns NULL (likely an encoding problem). 
  */
@@ -3374,7 +3942,8 @@ snmp_pdu_build(const netsnmp_pdu *pdu, u_char * cp, size_t * out_length)
      * Store variable-bindings 
      */
     DEBUGDUMPSECTION("send", "VarBindList");
-    for (vp = pdu->variables; vp; vp = vp->next_variable) {
+    for (vp = pdu->encoded_vars ? NULL : pdu->variables; vp;
+         vp = vp->next_variable) {
         /*
          * if estimated getbulk response size exceeded packet max size,
          * processing was stopped before bulk cache was filled and type
@@ -3409,6 +3978,15 @@ snmp_pdu_build(const netsnmp_pdu *pdu, u_char * cp, size_t * out_length)
         }
         save_vp = vp;
     }
+    if (pdu->encoded_vars) {
+        DEBUGDUMPSECTION("send", "encoded VarBinds");
+        if (*out_length < pdu->encoded_vars->len)
+            return NULL;
+        memcpy(cp, pdu->encoded_vars->data, pdu->encoded_vars->len);
+        cp += pdu->encoded_vars->len;
+        *out_length -= pdu->encoded_vars->len;
+        DEBUGINDENTLESS();
+    }
     DEBUGINDENTLESS();
 
     /** did we run out of room? (should only happen for bulk reponses) */
@@ -3454,8 +4032,18 @@ snmp_pdu_realloc_rbuild(u_char ** pkt, size_t * pkt_len, size_t * offset,
     int             i, wrapped = 0, notdone, final, rc = 0;
 
     DEBUGMSGTL(("snmp_pdu_realloc_rbuild", "starting\n"));
-    for (vp = pdu->variables, i = VPCACHE_SIZE - 1; vp;
-         vp = vp->next_variable, i--) {
+    if (pdu->encoded_vars) {
+        DEBUGDUMPSECTION("send", "encoded VarBinds");
+        while (*pkt_len - *offset < pdu->encoded_vars->len)
+            if (!asn_realloc(pkt, pkt_len))
+                return 0;
+        *offset += pdu->encoded_vars->len;
+        memcpy(*pkt + *pkt_len - *offset, pdu->encoded_vars->data,
+               pdu->encoded_vars->len);
+        DEBUGINDENTLESS();
+    }
+    for (vp = pdu->encoded_vars ? NULL : pdu->variables,
+         i = VPCACHE_SIZE - 1; vp; vp = vp->next_variable, i--) {
         /*
          * if estimated getbulk response size exceeded packet max size,
          * processing was stopped before bulk cache was filled and type
@@ -4570,6 +5158,149 @@ snmp_parse(struct session_list *slp, netsnmp_session *pss,
     return rc;
 }
 
+/*
+ * PDU arenas.  A received PDU may carry an arena from which its varbinds
+ * and their larger values are carved.  The arena is a list of chunks,
+ * newest first, each handed out by bumping an offset; chunk sizes double
+ * so that even a large GETBULK response only needs a handful of them.
+ */
+struct netsnmp_pdu_arena_s {
+    struct netsnmp_pdu_arena_s *next;   /* older chunks */
+    size_t          size;               /* usable bytes in this chunk */
+    size_t          used;
+    u_int           chunks;             /* chunks up to and including this */
+    size_t          total;              /* bytes handed out, ditto */
+};
+
+#define PDU_ARENA_ALIGN(n)  (((n) + 15) & ~(size_t)15)
+#define PDU_ARENA_HDR       PDU_ARENA_ALIGN(sizeof(struct netsnmp_pdu_arena_s))
+#define PDU_ARENA_MIN_CHUNK (16 * 1024)
+#define PDU_ARENA_MAX_CHUNK (64 * 1024)  /* below malloc's mmap threshold */
+
+static struct netsnmp_pdu_arena_s *
+_pdu_arena_chunk(struct netsnmp_pdu_arena_s *prev, size_t need)
+{
+    struct netsnmp_pdu_arena_s *chunk;
+    size_t          size = PDU_ARENA_MIN_CHUNK;
+
+    if (prev && prev->size < PDU_ARENA_MAX_CHUNK)
+        size = prev->size * 2;
+    else if (prev)
+        size = prev->size;
+    if (size < need)
+        size = PDU_ARENA_ALIGN(need);
+
+    chunk = malloc(PDU_ARENA_HDR + size);
+    if (chunk == NULL)
+        return NULL;
+    chunk->next = prev;
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->chunks = prev ? prev->chunks + 1 : 1;
+    chunk->total = prev ? prev->total : 0;
+    return chunk;
+}
+
+/**
+ * Attaches an arena to a PDU that is about to be parsed.
+ *
+ * @return SNMPERR_SUCCESS, or SNMPERR_MALLOC if no memory is available.
+ */
+int
+netsnmp_pdu_arena_enable(netsnmp_pdu *pdu)
+{
+    if (pdu->arena)
+        return SNMPERR_SUCCESS;
+    pdu->arena = _pdu_arena_chunk(NULL, 0);
+    return pdu->arena ? SNMPERR_SUCCESS : SNMPERR_MALLOC;
+}
+
+/**
+ * Allocates uninitialised memory that lives until the PDU is freed.
+ *
+ * @return the memory, or NULL if the PDU has no arena or none is left.
+ */
+void *
+netsnmp_pdu_arena_alloc(netsnmp_pdu *pdu, size_t size)
+{
+    struct netsnmp_pdu_arena_s *chunk = pdu->arena;
+    void           *p;
+
+    if (chunk == NULL)
+        return NULL;
+    size = PDU_ARENA_ALIGN(size);
+    if (chunk->size - chunk->used < size) {
+        chunk = _pdu_arena_chunk(chunk, size);
+        if (chunk == NULL)
+            return NULL;
+        pdu->arena = chunk;
+    }
+    p = (u_char *) chunk + PDU_ARENA_HDR + chunk->used;
+    chunk->used += size;
+    chunk->total += size;
+    return p;
+}
+
+/**
+ * Frees all memory handed out by a PDU's arena, and the arena itself.
+ */
+void
+netsnmp_pdu_arena_release(netsnmp_pdu *pdu)
+{
+    struct netsnmp_pdu_arena_s *chunk, *next;
+
+    for (chunk = pdu->arena; chunk; chunk = next) {
+        next = chunk->next;
+        free(chunk);
+    }
+    pdu->arena = NULL;
+}
+
+/**
+ * Reports the number of chunks in a PDU's arena and the bytes handed out.
+ */
+void
+netsnmp_pdu_arena_get_stats(const netsnmp_pdu *pdu, u_int *chunks,
+                            size_t *used)
+{
+    if (chunks)
+        *chunks = pdu->arena ? pdu->arena->chunks : 0;
+    if (used)
+        *used = pdu->arena ? pdu->arena->total : 0;
+}
+
+/*
+ * Varbind storage for snmp_pdu_parse(): from the arena if the PDU has
+ * one, from the heap otherwise.
+ */
+static netsnmp_variable_list *
+_snmp_pdu_new_var(netsnmp_pdu *pdu)
+{
+    netsnmp_variable_list *vp;
+
+    if (pdu->arena == NULL)
+        return SNMP_MALLOC_TYPEDEF(netsnmp_variable_list);
+    vp = netsnmp_pdu_arena_alloc(pdu, sizeof(*vp));
+    if (vp) {
+        /* name_loc and buf are written by the parser before use */
+        memset(vp, 0, offsetof(netsnmp_variable_list, name_loc));
+        vp->data = NULL;
+        vp->dataFreeHook = NULL;
+        vp->index = 0;
+        vp->flags = NETSNMP_VARBIND_ARENA_STRUCT;
+    }
+    return vp;
+}
+
+static void *
+_snmp_pdu_new_val(netsnmp_pdu *pdu, netsnmp_variable_list *vp, size_t len)
+{
+    if (pdu->arena == NULL)
+        return malloc(len);
+    vp->flags |= NETSNMP_VARBIND_ARENA_VALUE;
+    return netsnmp_pdu_arena_alloc(pdu, len);
+}
+
 int
 snmp_pdu_parse(netsnmp_pdu *pdu, u_char * data, size_t * length)
 {
@@ -4720,18 +5451,17 @@ snmp_pdu_parse(netsnmp_pdu *pdu, u_char * data, size_t * length)
      * get each varBind sequence 
      */
     while ((int) *length > 0) {
-        vp = SNMP_MALLOC_TYPEDEF(netsnmp_variable_list);
+        vp = _snmp_pdu_new_var(pdu);
         if (NULL == vp)
             goto fail;
 
+        vp->name = vp->name_loc;
         vp->name_length = MAX_OID_LEN;
         DEBUGDUMPSECTION("recv", "VarBind");
-        data = snmp_parse_var_op(data, objid, &vp->name_length, &vp->type,
-                                 &vp->val_len, &var_val, length);
+        data = snmp_parse_var_op(data, vp->name_loc, &vp->name_length,
+                                 &vp->type, &vp->val_len, &var_val, length);
         if (data == NULL)
             goto fail;
-        if (snmp_set_var_objid(vp, objid, vp->name_length))
-            goto fail;
 
         len = SNMP_MAX_PACKET_LEN;
         DEBUGDUMPHEADER("recv", "Value");
@@ -4808,7 +5538,7 @@ snmp_pdu_parse(netsnmp_pdu *pdu, u_char * data, size_t * length)
             if (vp->val_len < sizeof(vp->buf)) {
                 vp->val.string = (u_char *) vp->buf;
             } else {
-                vp->val.string = (u_char *) malloc(vp->val_len);
+                vp->val.string = _snmp_pdu_new_val(pdu, vp, vp->val_len);
             }
             if (vp->val.string == NULL) {
                 goto fail;
@@ -4824,9 +5554,10 @@ snmp_pdu_parse(netsnmp_pdu *pdu, u_char * data, size_t * length)
             if (!p)
                 goto fail;
             vp->val_len *= sizeof(oid);
-            vp->val.objid = netsnmp_memdup(objid, vp->val_len);
+            vp->val.objid = _snmp_pdu_new_val(pdu, vp, vp->val_len);
             if (vp->val.objid == NULL)
                 goto fail;
+            memcpy(vp->val.objid, objid, vp->val_len);
             break;
         case SNMP_NOSUCHOBJECT:
         case SNMP_NOSUCHINSTANCE:
@@ -4834,7 +5565,7 @@ snmp_pdu_parse(netsnmp_pdu *pdu, u_char * data, size_t * length)
         case ASN_NULL:
             break;
         case ASN_BIT_STR:
-            vp->val.bitstring = (u_char *) malloc(vp->val_len);
+            vp->val.bitstring = _snmp_pdu_new_val(pdu, vp, vp->val_len);
             if (vp->val.bitstring == NULL) {
                 goto fail;
             }
@@ -5471,8 +6202,13 @@ snmp_free_var_internals(netsnmp_variable_list * var)
 
     if (var->name != var->name_loc)
         SNMP_FREE(var->name);
-    if (var->val.string != var->buf)
-        SNMP_FREE(var->val.string);
+    if (var->val.string != var->buf) {
+        if (var->flags & NETSNMP_VARBIND_ARENA_VALUE)
+            var->val.string = NULL;
+        else
+            SNMP_FREE(var->val.string);
+    }
+    var->flags &= ~NETSNMP_VARBIND_ARENA_VALUE;
     if (var->data) {
         if (var->dataFreeHook) {
             var->dataFreeHook(var->data);
@@ -5487,7 +6223,8 @@ void
 snmp_free_var(netsnmp_variable_list * var)
 {
     snmp_free_var_internals(var);
-    free(var);
+    if (var && !(var->flags & NETSNMP_VARBIND_ARENA_STRUCT))
+        free(var);
 }
 
 void
@@ -5519,6 +6256,8 @@ snmp_free_pdu(netsnmp_pdu *pdu)
         (*sptr->pdu_free)(pdu);
 
     snmp_free_varbind(pdu->variables);
+    netsnmp_pdu_arena_release(pdu);
+    netsnmp_pdu_release_encoded_varbinds(pdu);
     free(pdu->enterprise);
     free(pdu->community);
     free(pdu->contextEngineID);
@@ -5646,6 +6385,11 @@ _sess_process_packet_parse_pdu(struct session_list *slp, netsnmp_session * sp,
       pdu->flags |= UCD_MSG_FLAG_TUNNELED;
   }
 
+  if ((sp->flags & SNMP_FLAGS_PDU_ARENA) &&
+      netsnmp_pdu_arena_enable(pdu) != SNMPERR_SUCCESS) {
+    DEBUGMSGTL(("sess_process_packet", "no arena, parsing onto the heap\n"));
+  }
+
   if (isp->hook_parse) {
     ret = isp->hook_parse(sp, pdu, packetptr, length);
   } else {
@@ -5933,7 +6677,46 @@ void
 snmp_read2(netsnmp_large_fd_set * fdset)
 {
     struct session_list *slp;
+#if defined(cygwin) || !defined(HAVE_WINSOCK_H)
+    struct session_index_entry *e;
+    int             fd;
+#endif
+
     snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SESSION);
+#if defined(cygwin) || !defined(HAVE_WINSOCK_H)
+    if (sess_index != NULL) {
+        /*
+         * Only visit the sessions whose socket is ready, looking them up
+         * through the socket index.  Several sessions may share a socket;
+         * they are read in list order, and each one at most once per pass.
+         * The chain is rescanned after each read since the callbacks may
+         * have opened or closed sessions.
+         */
+        ++sess_read_gen;
+        for (fd = netsnmp_large_fd_set_next(0, fdset); fd >= 0;
+             fd = netsnmp_large_fd_set_next(fd + 1, fdset)) {
+            while (sess_index != NULL) {
+                for (e = sess_index->by_sock[_sess_hash_sock(fd,
+                                                    sess_index->size)];
+                     e; e = e->next_sock) {
+                    if (e->sock == fd && e->read_gen != sess_read_gen &&
+                        e->slp->transport && e->slp->transport->sock == fd)
+                        break;
+                }
+                if (e == NULL)
+                    break;
+                e->read_gen = sess_read_gen;
+                snmp_sess_read2(e->slp, fdset);
+            }
+            if (sess_index == NULL)
+                break;
+        }
+        if (fd < 0) {
+            snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SESSION);
+            return;
+        }
+    }
+#endif
     for (slp = Sessions; slp; slp = slp->next) {
         snmp_sess_read2(slp, fdset);
     }
@@ -6134,20 +6917,30 @@ _sess_read(struct session_list *slp, netsnmp_large_fd_set * fdset)
 
     if (!(transport->flags & NETSNMP_TRANSPORT_FLAG_STREAM)) {
         snmp_rcv_packet rcvp;
-        memset(&rcvp, 0x0, sizeof(rcvp));
 
-        /** read the packet */
-        rc = _sess_read_dgram_packet(slp, fdset, &rcvp);
-        if (-1 == rc) /* protocol error */
-            return -1;
-        else if (-2 == rc) /* no packet to process */
-            return 0;
+        /*
+         * A transport that read several datagrams at once hands them out
+         * one per call and flags the remainder; the socket may not become
+         * readable again, so process them all now.
+         */
+        do {
+            memset(&rcvp, 0x0, sizeof(rcvp));
+
+            /** read the packet */
+            rc = _sess_read_dgram_packet(slp, fdset, &rcvp);
+            if (-1 == rc) /* protocol error */
+                return -1;
+            else if (-2 == rc) { /* no packet to process */
+                rc = 0;
+                continue;
+            }
 
-        rc = _sess_process_packet(slp, sp, isp, transport,
-                                  rcvp.opaque, rcvp.olength,
-                                  rcvp.packet, rcvp.packet_len);
-        SNMP_FREE(rcvp.packet);
-        /** opaque is freed in _sess_process_packet */
+            rc = _sess_process_packet(slp, sp, isp, transport,
+                                      rcvp.opaque, rcvp.olength,
+                                      rcvp.packet, rcvp.packet_len);
+            SNMP_FREE(rcvp.packet);
+            /** opaque is freed in _sess_process_packet */
+        } while (transport->flags & NETSNMP_TRANSPORT_FLAG_RECV_PENDING);
         return rc;
     }
 
@@ -6423,6 +7216,59 @@ snmp_sess_read2(struct session_list *slp, netsnmp_large_fd_set * fdset)
     return rc;
 }
 
+/**
+ * Decodes a datagram that was received on the transport of a session
+ * without passing it to the session's callback, as snmp_sess_read() does
+ * up to that point.  Several threads may decode packets of the same
+ * session at once: each call works on a private copy of the session, so
+ * that errors and any report it sends back do not touch the shared one.
+ *
+ * @param slp     the session the packet was received for
+ * @param opaque  transport data returned by netsnmp_transport_recv();
+ *                freed or handed over to the PDU in all cases
+ * @param olength length of opaque
+ * @param packet  the packet; left to the caller
+ * @param length  length of the packet
+ *
+ * @return the PDU, to be freed by the caller, or NULL if the packet was
+ *         dropped.
+ */
+netsnmp_pdu *
+snmp_sess_parse_packet(struct session_list *slp, void *opaque, int olength,
+                       u_char *packet, int length)
+{
+    struct session_list shadow;
+    netsnmp_session session;
+    struct snmp_internal_session internal;
+    netsnmp_pdu    *pdu;
+
+    if (slp == NULL || slp->session == NULL || slp->internal == NULL ||
+        slp->transport == NULL) {
+        SNMP_FREE(opaque);
+        return NULL;
+    }
+
+    session = *slp->session;
+    session.s_snmp_errno = 0;
+    session.s_errno = 0;
+    internal = *slp->internal;
+    internal.requests = internal.requestsEnd = NULL;
+    internal.packet = NULL;
+    internal.packet_len = internal.packet_size = 0;
+    internal.obuf = internal.opacket = NULL;
+    internal.obuf_size = internal.opacket_len = 0;
+    shadow.next = NULL;
+    shadow.session = &session;
+    shadow.transport = slp->transport;
+    shadow.internal = &internal;
+
+    pdu = _sess_process_packet_parse_pdu(&shadow, &session, &internal,
+                                         slp->transport, opaque, olength,
+                                         packet, length);
+    SNMP_FREE(internal.obuf);
+    return pdu;
+}
+
 
 /**
  * Returns info about what snmp requires from a select statement.
@@ -6520,7 +7366,8 @@ snmp_sess_select_info2(struct session_list *slp, int *numfds, netsnmp_large_fd_s
  *   and MSVC), do not use the value written into *numfds.
  * @param[in,out] fdset   A large file descriptor set to which all file
  *   descriptors will be added that are associated with one of the examined
- *   sessions.
+ *   sessions.  May be NULL if only the timeout is wanted, e.g. because the
+ *   sockets are watched through netsnmp_epoll_wait().
  * @param[in,out] timeout On input, if *block = 1, the maximum time the caller
  *   will block while waiting for Net-SNMP activity. On output, if this function
  *   has set *block to 0, the maximum time the caller is allowed to wait before
@@ -6570,6 +7417,14 @@ snmp_sess_select_info2_flags(struct session_list *sessp, int *numfds,
             continue;
         }
 
+        if (sessp == NULL && (slp->session->flags & SNMP_FLAGS_OWN_THREAD)) {
+            /*
+             * Read by a thread of its own.
+             */
+            DEBUGMSG(("sess_select", "own thread "));
+            continue;
+        }
+
         if (slp->transport->sock == -1) {
             /*
              * This session was marked for deletion.  
@@ -6586,11 +7441,18 @@ snmp_sess_select_info2_flags(struct session_list *sessp, int *numfds,
         }
 
         DEBUGMSG(("sess_select", "%d ", slp->transport->sock));
-        if ((slp->transport->sock + 1) > *numfds) {
-            *numfds = (slp->transport->sock + 1);
+        if (sessp == NULL) {
+            /* keep the socket index in sync with the transport */
+            snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SESSION);
+            _sess_index_update_sock(slp);
+            snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SESSION);
+        }
+        if (fdset != NULL) {
+            if ((slp->transport->sock + 1) > *numfds) {
+                *numfds = (slp->transport->sock + 1);
+            }
+            NETSNMP_LARGE_FD_SET(slp->transport->sock, fdset);
         }
-
-        NETSNMP_LARGE_FD_SET(slp->transport->sock, fdset);
         if (slp->internal != NULL && slp->internal->requests) {
             /*
              * Found another session with outstanding requests.  
@@ -7780,11 +8642,7 @@ snmp_sess_pointer(netsnmp_session * session)
     struct session_list *slp;
 
     snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SESSION);
-    for (slp = Sessions; slp; slp = slp->next) {
-        if (slp->session == session) {
-            break;
-        }
-    }
+    slp = _sess_find_by_session(session);
     snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SESSION);
 
     if (slp == NULL) {
@@ -7821,9 +8679,13 @@ snmp_sess_session_lookup(struct session_list *sessp)
     struct session_list *slp;
 
     snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SESSION);
-    for (slp = Sessions; slp; slp = slp->next) {
-        if (slp == sessp) {
-            break;
+    if (sess_index != NULL) {
+        slp = _sess_index_find(sessp) ? sessp : NULL;
+    } else {
+        for (slp = Sessions; slp; slp = slp->next) {
+            if (slp == sessp) {
+                break;
+            }
         }
     }
     snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SESSION);
@@ -7840,14 +8702,41 @@ snmp_sess_session_lookup(struct session_list *sessp)
 netsnmp_session *
 snmp_sess_lookup_by_name(const char *paramName)
 {
-    struct session_list *slp;
+    struct session_list *slp = NULL;
+    struct session_index_entry *e;
+    size_t          h = 0;
 
     snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SESSION);
-    for (slp = Sessions; slp; slp = slp->next) {
-        if (NULL == slp->session->paramName)
-            continue;
-        if (strcmp(paramName, slp->session->paramName)  == 0)
-            break;
+    /*
+     * paramName may be set after a session has been opened, so the name
+     * index only caches earlier results: entries are verified on a hit,
+     * and a miss falls back to walking the list.
+     */
+    if (sess_index != NULL) {
+        h = _sess_hash_name(paramName, sess_index->size);
+        for (e = sess_index->by_name[h]; e; e = e->next_name) {
+            if (e->slp->session->paramName &&
+                strcmp(paramName, e->slp->session->paramName) == 0) {
+                slp = e->slp;
+                break;
+            }
+        }
+    }
+    if (slp == NULL) {
+        for (slp = Sessions; slp; slp = slp->next) {
+            if (NULL == slp->session->paramName)
+                continue;
+            if (strcmp(paramName, slp->session->paramName)  == 0)
+                break;
+        }
+        if (slp && sess_index != NULL &&
+            (e = _sess_index_find(slp)) != NULL) {
+            _sess_index_unlink_name(e);
+            e->name_hashed = 1;
+            e->name_bucket = h;
+            e->next_name = sess_index->by_name[h];
+            sess_index->by_name[h] = e;
+        }
     }
     snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SESSION);
 
@@ -7887,6 +8776,9 @@ snmp_sess_transport_set(struct session_list *slp, netsnmp_transport *t)
 {
     if (slp != NULL) {
         slp->transport = t;
+        snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SESSION);
+        _sess_index_update_sock(slp);
+        snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SESSION);
     }
 }
 
@@ -7919,8 +8811,13 @@ u_int
 snmp_increment_statistic(int which)
 {
     if (which >= 0 && which < NETSNMP_STAT_MAX_STATS) {
+#if defined(NETSNMP_REENTRANT) && defined(__GNUC__)
+        /* bumped by threads decoding messages in parallel */
+        return __sync_add_and_fetch(&statistics[which], 1);
+#else
         statistics[which]++;
         return statistics[which];
+#endif
     }
     return 0;
 }
@@ -7929,8 +8826,12 @@ u_int
 snmp_increment_statistic_by(int which, int count)
 {
     if (which >= 0 && which < NETSNMP_STAT_MAX_STATS) {
+#if defined(NETSNMP_REENTRANT) && defined(__GNUC__)
+        return __sync_add_and_fetch(&statistics[which], count);
+#else
         statistics[which] += count;
         return statistics[which];
+#endif
     }
     return 0;
 }
@@ -7939,7 +8840,11 @@ u_int
 snmp_get_statistic(int which)
 {
     if (which >= 0 && which < NETSNMP_STAT_MAX_STATS)
+#if defined(NETSNMP_REENTRANT) && defined(__GNUC__)
+        return __sync_add_and_fetch(&statistics[which], 0);
+#else
         return statistics[which];
+#endif
     return 0;
 }
 
@@ -260,6 +260,7 @@ snmp_clone_var(netsnmp_variable_list * var, netsnmp_variable_list * newvar)
     newvar->data = NULL;
     newvar->dataFreeHook = NULL;
     newvar->index = 0;
+    newvar->flags = 0;
 
     /*
      * Clone the object identifier and the value.
@@ -337,11 +338,13 @@ snmp_reset_var_buffers(netsnmp_variable_list * var)
             var->name_length = 0;
         }
         if (var->val.string != var->buf) {
-            if (NULL != var->val.string)
+            if (NULL != var->val.string &&
+                !(var->flags & NETSNMP_VARBIND_ARENA_VALUE))
                 free(var->val.string);
             var->val.string = var->buf;
             var->val_len = 0;
         }
+        var->flags &= ~NETSNMP_VARBIND_ARENA_VALUE;
         var = var->next_variable;
     }
 }
@@ -381,6 +384,8 @@ _clone_pdu_header(netsnmp_pdu *pdu)
     newpdu->contextEngineID = NULL;
     newpdu->contextName = NULL;
     newpdu->transport_data = NULL;
+    newpdu->arena = NULL;
+    newpdu->encoded_vars = NULL;
 
     /*
      * copy buffers individually. If any copy fails, all are freed. 
@@ -592,6 +597,29 @@ snmp_clone_pdu(netsnmp_pdu *pdu)
 }
 
 
+/*
+ * Clones a PDU whose varbind list was encoded by
+ * netsnmp_pdu_encode_varbinds().  The clone shares the encoding and
+ * carries no variables of its own; a PDU without an encoding is cloned
+ * with all of its variables.
+ *
+ * Returns a pointer to the cloned PDU if successful.
+ * Returns 0 if failure
+ */
+netsnmp_pdu    *
+netsnmp_clone_pdu_encoded(netsnmp_pdu *pdu)
+{
+    netsnmp_pdu    *newpdu;
+
+    if (!pdu || !pdu->encoded_vars)
+        return snmp_clone_pdu(pdu);
+    newpdu = _clone_pdu_header(pdu);
+    if (newpdu)
+        netsnmp_pdu_share_encoded_varbinds(newpdu, pdu);
+    return newpdu;
+}
+
+
 /*
  * This function will clone a PDU including some of its variables.
  *
@@ -808,9 +836,11 @@ snmp_set_var_value(netsnmp_variable_list * vars,
      * xxx-rks: why the unconditional free? why not use existing
      * memory, if len < vars->val_len ?
      */
-    if (vars->val.string && vars->val.string != vars->buf) {
+    if (vars->val.string && vars->val.string != vars->buf &&
+        !(vars->flags & NETSNMP_VARBIND_ARENA_VALUE)) {
         free(vars->val.string);
     }
+    vars->flags &= ~NETSNMP_VARBIND_ARENA_VALUE;
     vars->val.string = NULL;
     vars->val_len = 0;
 
@@ -106,9 +106,11 @@ debug_config_register_tokens(const char *configtoken, char *tokens);
 void
 debug_indent_reset(void)
 {
-    if (debugindent != 0)
+    /* no store if already reset: packets may be parsed in several threads */
+    if (debugindent != 0) {
         DEBUGMSGTL(("dump_indent","indent reset from %d\n", debugindent));
-    debugindent = 0;
+        debugindent = 0;
+    }
 }
 
 void
@@ -192,6 +194,7 @@ debug_register_tokens(const char *tokens)
     newp = strdup(tokens);      /* strtok_r messes it up */
     if (!newp)
         return;
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_LOGGING);
     cp = strtok_r(newp, DEBUG_TOKEN_DELIMITER, &st);
     while (cp) {
         if (strlen(cp) < MAX_DEBUG_TOKEN_LEN) {
@@ -215,6 +218,7 @@ debug_register_tokens(const char *tokens)
         }
         cp = strtok_r(NULL, DEBUG_TOKEN_DELIMITER, &st);
     }
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_LOGGING);
     free(newp);
 }
 
@@ -332,6 +336,7 @@ debug_is_token_registered(const char *token)
 void
 debugmsg(const char *token, const char *format, ...)
 {
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_LOGGING);
     if (debug_is_token_registered(token) == SNMPERR_SUCCESS) {
 	va_list         debugargs;
 
@@ -339,6 +344,7 @@ debugmsg(const char *token, const char *format, ...)
 	snmp_vlog(debug_log_level, format, debugargs);
 	va_end(debugargs);
     }
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_LOGGING);
 }
 
 void
@@ -1290,6 +1290,13 @@ snmp_log_string(int priority, const char *str)
 #endif /* NETSNMP_FEATURE_REMOVE_LOGGING_STDIO */
     netsnmp_log_handler *logh;
 
+    /*
+     * Helper threads (traphandle workers, background cache reloads) log
+     * too; serialise them with the main loop.  The lock is recursive, so
+     * a handler that logs again does not deadlock.
+     */
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_LOGGING);
+
     /*
      * We've got to be able to log messages *somewhere*!
      * If you don't want stderr logging, then enable something else.
@@ -1303,6 +1310,7 @@ snmp_log_string(int priority, const char *str)
         log_handler_stdouterr( &lh, priority, str );
 #endif /* NETSNMP_FEATURE_REMOVE_LOGGING_STDIO */
 
+        snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_LOGGING);
         return;
     }
 #ifndef NETSNMP_FEATURE_REMOVE_LOGGING_STDIO
@@ -1330,6 +1338,7 @@ snmp_log_string(int priority, const char *str)
         if (logh->enabled && (priority >= logh->pri_max))
             logh->handler( logh, priority, str );
     }
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_LOGGING);
 }
 
 /* ==================================================== */
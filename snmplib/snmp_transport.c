@@ -242,6 +242,7 @@ netsnmp_transport_free(netsnmp_transport *t)
     SNMP_FREE(t->local);
     SNMP_FREE(t->remote);
     SNMP_FREE(t->data);
+    SNMP_FREE(t->batch);
     netsnmp_transport_free(t->base_transport);
 
     SNMP_FREE(t);
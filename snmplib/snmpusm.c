@@ -74,6 +74,7 @@
 #include <net-snmp/library/snmp_secmod.h>
 #include <net-snmp/library/snmpusm.h>
 #include <net-snmp/library/transform_oids.h>
+#include <net-snmp/library/mt_support.h>
 #include <net-snmp/library/snmp_enum.h>
 
 #ifdef HAVE_OPENSSL_DH_H
@@ -100,6 +101,7 @@ struct usmStateReference {
     u_char         *usr_priv_key;
     size_t          usr_priv_key_length;
     u_int           usr_sec_level;
+    netsnmp_sc_cache *usr_sc_cache;
 };
 
 const oid usmNoAuthProtocol[10] = { NETSNMP_USMAUTH_BASE_OID,
@@ -233,6 +235,141 @@ static struct usmUser *noNameUser = NULL;
  */
 static struct usmUser *userList = NULL;
 
+/*
+ * Hash index over userList, keyed by (engineID, name) and chained through
+ * usmUser.hashNext.  userList itself stays sorted for usmUserTable
+ * GETNEXT processing.  If the index cannot be allocated, lookups walk the
+ * list as before.
+ */
+#define USM_USER_HASH_MIN 64
+static struct usmUser **userHash = NULL;
+static size_t   userHashSize = 0;
+static size_t   userHashCount = 0;
+
+static size_t
+usm_user_hash(const u_char *engineID, size_t engineIDLen,
+              const char *name, size_t nameLen)
+{
+    size_t          h = 5381, i;
+
+    for (i = 0; engineID && i < engineIDLen; i++)
+        h = h * 33 + engineID[i];
+    h = h * 33 + 0xff;
+    for (i = 0; i < nameLen; i++)
+        h = h * 33 + (u_char)name[i];
+    return h;
+}
+
+static size_t
+usm_user_bucket(const struct usmUser *user, size_t size)
+{
+    return usm_user_hash(user->engineID, user->engineIDLen, user->name,
+                         strlen(user->name)) & (size - 1);
+}
+
+/*
+ * Returns 1 if user is the one with the given engineID and name, using the
+ * same rules as the list walk in usm_get_user_from_list().
+ */
+static int
+usm_user_matches(const struct usmUser *user, const u_char *engineID,
+                 size_t engineIDLen, const char *name, size_t nameLen)
+{
+    return user->name && strlen(user->name) == nameLen &&
+        memcmp(user->name, name, nameLen) == 0 &&
+        user->engineIDLen == engineIDLen &&
+        ((user->engineID == NULL && engineID == NULL) ||
+         (user->engineID != NULL && engineID != NULL &&
+          memcmp(user->engineID, engineID, engineIDLen) == 0));
+}
+
+/*
+ * (Re)build the index from userList, so that users added while no table
+ * could be allocated get indexed as well.  Returns 0 on success.
+ */
+static int
+usm_user_hash_rebuild(size_t size)
+{
+    struct usmUser **table, *user;
+    size_t          count = 0, bucket;
+
+    for (user = userList; user; user = user->next)
+        count++;
+    while (size <= count)
+        size *= 2;
+    table = calloc(size, sizeof(*table));
+    if (table == NULL)
+        return -1;
+    count = 0;
+    for (user = userList; user; user = user->next) {
+        if (user->name == NULL)
+            continue;
+        bucket = usm_user_bucket(user, size);
+        user->hashNext = table[bucket];
+        table[bucket] = user;
+        count++;
+    }
+    free(userHash);
+    userHash = table;
+    userHashSize = size;
+    userHashCount = count;
+    return 0;
+}
+
+/* user must already be on userList */
+static void
+usm_user_hash_add(struct usmUser *user)
+{
+    size_t          bucket;
+
+    if (user->name == NULL)
+        return;
+    if (userHash == NULL || userHashCount >= userHashSize) {
+        if (usm_user_hash_rebuild(userHashSize ? userHashSize * 2 :
+                                  USM_USER_HASH_MIN) == 0)
+            return;
+        /* keep using the current table, if any, with longer chains */
+        if (userHash == NULL)
+            return;
+    }
+    bucket = usm_user_bucket(user, userHashSize);
+    user->hashNext = userHash[bucket];
+    userHash[bucket] = user;
+    userHashCount++;
+}
+
+static void
+usm_user_hash_remove(struct usmUser *user)
+{
+    struct usmUser **pp;
+
+    if (userHash == NULL || user->name == NULL)
+        return;
+    for (pp = &userHash[usm_user_bucket(user, userHashSize)]; *pp;
+         pp = &(*pp)->hashNext) {
+        if (*pp == user) {
+            *pp = user->hashNext;
+            user->hashNext = NULL;
+            userHashCount--;
+            return;
+        }
+    }
+}
+
+static struct usmUser *
+usm_user_hash_find(const u_char *engineID, size_t engineIDLen,
+                   const char *name, size_t nameLen)
+{
+    struct usmUser *user;
+
+    user = userHash[usm_user_hash(engineID, engineIDLen, name, nameLen) &
+                    (userHashSize - 1)];
+    for (; user; user = user->hashNext)
+        if (usm_user_matches(user, engineID, engineIDLen, name, nameLen))
+            return user;
+    return NULL;
+}
+
 /*
  * Set a given field of the secStateRef.
  *
@@ -337,10 +474,39 @@ usm_free_usmStateReference(void *old)
         SNMP_ZERO(ref->usr_priv_key, ref->usr_priv_key_length);
         SNMP_FREE(ref->usr_priv_key);
     }
+    sc_cache_free(ref->usr_sc_cache);
 
     SNMP_FREE(ref);
 }                               /* end usm_free_usmStateReference() */
 
+/*
+ * Returns the transform state cache of a user, creating it on first use.
+ * The cache checks the key it was built for on every use, so it stays
+ * valid when the user's keys are changed.
+ */
+static netsnmp_sc_cache *
+usm_get_user_sc_cache(struct usmUser *user)
+{
+    netsnmp_sc_cache *cache, *new_cache;
+
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SCAPI);
+    cache = user->sc_cache;
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SCAPI);
+    if (cache)
+        return cache;
+
+    new_cache = sc_cache_new();
+    snmp_res_lock(MT_LIBRARY_ID, MT_LIB_SCAPI);
+    if (user->sc_cache == NULL) {
+        user->sc_cache = new_cache;
+        new_cache = NULL;
+    }
+    cache = user->sc_cache;
+    snmp_res_unlock(MT_LIBRARY_ID, MT_LIB_SCAPI);
+    sc_cache_free(new_cache);
+    return cache;
+}
+
 struct usmUser *
 usm_get_userList(void)
 {
@@ -431,6 +597,7 @@ usm_clone_usmStateReference(struct usmStateReference *from,
         *to = NULL;
         return -1;
     }
+    cloned_usmStateRef->usr_sc_cache = sc_cache_ref(from->usr_sc_cache);
 
     return 0;
 
@@ -479,6 +646,15 @@ usm_get_user_from_list(const u_char *engineID, size_t engineIDLen,
 {
     struct usmUser *ptr;
 
+    if (puserList == userList && userHash != NULL) {
+        ptr = usm_user_hash_find(engineID, engineIDLen, name, nameLen);
+        if (ptr) {
+            DEBUGMSGTL(("usm", "match on user %s\n", ptr->name));
+            return ptr;
+        }
+        goto not_found;
+    }
+
     for (ptr = puserList; ptr != NULL; ptr = ptr->next) {
         if (ptr->name && strlen(ptr->name) == nameLen &&
             memcmp(ptr->name, name, nameLen) == 0) {
@@ -498,6 +674,7 @@ usm_get_user_from_list(const u_char *engineID, size_t engineIDLen,
         }
     }
 
+  not_found:
     /*
      * return "" user used to facilitate engineID discovery
      */
@@ -640,8 +817,10 @@ usm_add_user(struct usmUser *user)
 {
     struct usmUser *uptr;
     uptr = usm_add_user_to_list(user, userList);
-    if (uptr != NULL)
+    if (uptr != NULL) {
         userList = uptr;
+        usm_user_hash_add(user);
+    }
     return uptr;
 }
 
@@ -694,6 +873,8 @@ usm_remove_usmUser_from_list(struct usmUser *user, struct usmUser **ppuserList)
     if (nptr == *ppuserList)    /* we're the head of the list, need to change
                                  * * the head to the next user */
         *ppuserList = nptr->next;
+    if (ppuserList == &userList)
+        usm_user_hash_remove(nptr);
     return SNMPERR_SUCCESS;
 }                               /* end usm_remove_usmUser_from_list() */
 
@@ -745,6 +926,8 @@ usm_free_user(struct usmUser *user)
     if (user == NULL)
         return NULL;
 
+    usm_user_hash_remove(user);
+
     SNMP_FREE(user->engineID);
     SNMP_FREE(user->name);
     SNMP_FREE(user->secName);
@@ -773,6 +956,9 @@ usm_free_user(struct usmUser *user)
         SNMP_FREE(user->privKeyKu);
     }
 
+    sc_cache_free(user->sc_cache);
+    user->sc_cache = NULL;
+
 #ifdef NETSNMP_USE_OPENSSL
     if (user->usmDHUserAuthKeyChange)
     {
@@ -1490,6 +1676,7 @@ usm_generate_out_msg(int msgProcModel,  /* (UNUSED) */
     u_int           thePrivKeyLength = 0;
     const oid      *thePrivProtocol = NULL;
     u_int           thePrivProtocolLength = 0;
+    netsnmp_sc_cache *theScCache = NULL;
     int             theSecLevel = 0;    /* No defined const for bad
                                          * value (other then err).
                                          */
@@ -1521,6 +1708,7 @@ usm_generate_out_msg(int msgProcModel,  /* (UNUSED) */
         thePrivKey = ref->usr_priv_key;
         thePrivKeyLength = ref->usr_priv_key_length;
         theSecLevel = ref->usr_sec_level;
+        theScCache = ref->usr_sc_cache;
     }
 
     /*
@@ -1553,6 +1741,7 @@ usm_generate_out_msg(int msgProcModel,  /* (UNUSED) */
             thePrivProtocolLength = user->privProtocolLen;
             thePrivKey = user->privKey;
             thePrivKeyLength = user->privKeyLen;
+            theScCache = usm_get_user_sc_cache(user);
         } else {
             /*
              * unknown users can not do authentication (obviously) 
@@ -1682,11 +1871,11 @@ usm_generate_out_msg(int msgProcModel,  /* (UNUSED) */
         }
 #endif
 
-        if (sc_encrypt(thePrivProtocol, thePrivProtocolLength,
-                       thePrivKey, thePrivKeyLength,
-                       salt, salt_length,
-                       scopedPdu, scopedPduLen,
-                       &ptr[dataOffset], &encrypted_length)
+        if (sc_encrypt2(theScCache, thePrivProtocol, thePrivProtocolLength,
+                        thePrivKey, thePrivKeyLength,
+                        salt, salt_length,
+                        scopedPdu, scopedPduLen,
+                        &ptr[dataOffset], &encrypted_length)
             != SNMP_ERR_NOERROR) {
             DEBUGMSGTL(("usm", "encryption error.\n"));
             return SNMPERR_USM_ENCRYPTIONERROR;
@@ -1854,9 +2043,10 @@ usm_generate_out_msg(int msgProcModel,  /* (UNUSED) */
             return SNMPERR_USM_GENERICERROR;
         }
 
-        if (sc_generate_keyed_hash(theAuthProtocol, theAuthProtocolLength,
-                                   theAuthKey, theAuthKeyLength,
-                                   ptr, ptr_len, temp_sig, &temp_sig_len)
+        if (sc_generate_keyed_hash2(theScCache,
+                                    theAuthProtocol, theAuthProtocolLength,
+                                    theAuthKey, theAuthKeyLength,
+                                    ptr, ptr_len, temp_sig, &temp_sig_len)
             != SNMP_ERR_NOERROR) {
             /*
              * FIX temp_sig_len defined?!
@@ -1981,6 +2171,7 @@ usm_rgenerate_out_msg(int msgProcModel, /* (UNUSED) */
     u_int           thePrivKeyLength = 0;
     const oid      *thePrivProtocol = NULL;
     u_int           thePrivProtocolLength = 0;
+    netsnmp_sc_cache *theScCache = NULL;
     int             theSecLevel = 0;    /* No defined const for bad
                                          * value (other then err). */
     size_t          salt_length = 0, save_salt_length = 0;
@@ -2017,6 +2208,7 @@ usm_rgenerate_out_msg(int msgProcModel, /* (UNUSED) */
         thePrivKey = ref->usr_priv_key;
         thePrivKeyLength = ref->usr_priv_key_length;
         theSecLevel = ref->usr_sec_level;
+        theScCache = ref->usr_sc_cache;
     }
 
     /*
@@ -2049,6 +2241,7 @@ usm_rgenerate_out_msg(int msgProcModel, /* (UNUSED) */
             thePrivProtocolLength = user->privProtocolLen;
             thePrivKey = user->privKey;
             thePrivKeyLength = user->privKeyLen;
+            theScCache = usm_get_user_sc_cache(user);
         } else {
             /*
              * unknown users can not do authentication (obviously) 
@@ -2159,11 +2352,11 @@ usm_rgenerate_out_msg(int msgProcModel, /* (UNUSED) */
         }
 #endif
 
-        if (sc_encrypt(thePrivProtocol, thePrivProtocolLength,
-                       thePrivKey, thePrivKeyLength,
-                       salt, salt_length,
-                       scopedPdu, scopedPduLen,
-                       ciphertext, &ciphertextlen) != SNMP_ERR_NOERROR) {
+        if (sc_encrypt2(theScCache, thePrivProtocol, thePrivProtocolLength,
+                        thePrivKey, thePrivKeyLength,
+                        salt, salt_length,
+                        scopedPdu, scopedPduLen,
+                        ciphertext, &ciphertextlen) != SNMP_ERR_NOERROR) {
             DEBUGMSGTL(("usm", "encryption error.\n"));
             SNMP_FREE(ciphertext);
             return SNMPERR_USM_ENCRYPTIONERROR;
@@ -2374,10 +2567,11 @@ usm_rgenerate_out_msg(int msgProcModel, /* (UNUSED) */
             return SNMPERR_USM_GENERICERROR;
         }
 
-        if (sc_generate_keyed_hash(theAuthProtocol, theAuthProtocolLength,
-                                   theAuthKey, theAuthKeyLength,
-                                   proto_msg, proto_msg_len,
-                                   temp_sig, &temp_sig_len)
+        if (sc_generate_keyed_hash2(theScCache,
+                                    theAuthProtocol, theAuthProtocolLength,
+                                    theAuthKey, theAuthKeyLength,
+                                    proto_msg, proto_msg_len,
+                                    temp_sig, &temp_sig_len)
             != SNMP_ERR_NOERROR) {
             SNMP_FREE(temp_sig);
             DEBUGMSGTL(("usm", "Signing failed.\n"));
@@ -3109,10 +3303,11 @@ usm_process_in_msg(int msgProcModel,    /* (UNUSED) */
      */
     if (secLevel == SNMP_SEC_LEVEL_AUTHNOPRIV
         || secLevel == SNMP_SEC_LEVEL_AUTHPRIV) {
-        if (sc_check_keyed_hash(user->authProtocol, user->authProtocolLen,
-                                user->authKey, user->authKeyLen,
-                                wholeMsg, wholeMsgLen,
-                                signature, signature_length)
+        if (sc_check_keyed_hash2(usm_get_user_sc_cache(user),
+                                 user->authProtocol, user->authProtocolLen,
+                                 user->authKey, user->authKeyLen,
+                                 wholeMsg, wholeMsgLen,
+                                 signature, signature_length)
             != SNMP_ERR_NOERROR) {
             DEBUGMSGTL(("usm", "Verification failed.\n"));
             snmp_increment_statistic(STAT_USMSTATSWRONGDIGESTS);
@@ -3168,6 +3363,8 @@ usm_process_in_msg(int msgProcModel,    /* (UNUSED) */
         error = SNMPERR_USM_GENERICERROR;
         goto err;
     }
+    sc_cache_free((*secStateRef)->usr_sc_cache);
+    (*secStateRef)->usr_sc_cache = sc_cache_ref(usm_get_user_sc_cache(user));
 
 
     /*
@@ -3277,10 +3474,11 @@ usm_process_in_msg(int msgProcModel,    /* (UNUSED) */
             dump_chunk("usm/dump", "IV + Encrypted form:", iv, iv_length);
         }
 #endif
-        if (sc_decrypt(user->privProtocol, user->privProtocolLen,
-                       user->privKey, user->privKeyLen,
-                       iv, iv_length,
-                       value_ptr, remaining, *scopedPdu, scopedPduLen)
+        if (sc_decrypt2(usm_get_user_sc_cache(user),
+                        user->privProtocol, user->privProtocolLen,
+                        user->privKey, user->privKeyLen,
+                        iv, iv_length,
+                        value_ptr, remaining, *scopedPdu, scopedPduLen)
             != SNMP_ERR_NOERROR) {
             DEBUGMSGTL(("usm", "%s\n", "Failed decryption."));
             snmp_increment_statistic(STAT_USMSTATSDECRYPTIONERRORS);
@@ -3936,6 +4134,9 @@ clear_user_list(void)
 	tmp = next;
     }
     userList = NULL;
+    SNMP_FREE(userHash);
+    userHashSize = 0;
+    userHashCount = 0;
 
 }
 
@@ -4960,6 +5161,13 @@ snmpv3_privtype_conf(const char *word, char *cptr)
     DEBUGMSGTL(("snmpv3", "set default privacy type: %s\n", cptr));
 }
 
+static void
+usm_ku_cache_size_conf(const char *word, char *cptr)
+{
+    netsnmp_ku_cache_set_size(atoi(cptr));
+    DEBUGMSGTL(("snmpv3", "set master key cache size: %s\n", cptr));
+}
+
 const oid      *
 get_default_privtype(size_t * len)
 {
@@ -5105,6 +5313,8 @@ init_usm(void)
 
     register_config_handler("snmp", "defAuthType", snmpv3_authtype_conf,
                             NULL, "MD5|SHA|SHA-512|SHA-384|SHA-256|SHA-224");
+    register_config_handler("snmp", "kuCacheSize", usm_ku_cache_size_conf,
+                            NULL, "NUM");
     register_config_handler("snmp", "defPrivType", snmpv3_privtype_conf,
                             NULL,
                             "DES"
@@ -5147,4 +5357,5 @@ shutdown_usm(void)
 {
     free_etimelist();
     clear_user_list();
+    netsnmp_ku_cache_clear();
 }
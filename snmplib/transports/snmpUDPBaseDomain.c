@@ -10,6 +10,10 @@
  * distributed with the Net-SNMP package.
  */
 
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE             /* recvmmsg() and sendmmsg() */
+#endif
+
 #include <net-snmp/net-snmp-config.h>
 
 #include <net-snmp/types.h>
@@ -133,6 +137,39 @@ static LPFN_WSARECVMSG pfWSARecvMsg;
 static LPFN_WSASENDMSG pfWSASendMsg;
 #endif
 
+#if !defined(WIN32)
+/*
+ * Extract the destination (local) address and interface of a received
+ * datagram from its ancillary data.
+ */
+static void
+_udpbase_parse_cmsg(struct msghdr *msg, struct sockaddr *dstip, int *if_index)
+{
+    struct cmsghdr *cm;
+
+    for (cm = CMSG_FIRSTHDR(msg); cm != NULL; cm = CMSG_NXTHDR(msg, cm)) {
+#if defined(HAVE_IP_PKTINFO)
+        if (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_PKTINFO) {
+            struct in_pktinfo* src = (struct in_pktinfo *)CMSG_DATA(cm);
+            netsnmp_assert(dstip->sa_family == AF_INET);
+            ((struct sockaddr_in*)dstip)->sin_addr = src->ipi_addr;
+            *if_index = src->ipi_ifindex;
+            DEBUGMSGTL(("udpbase:recv",
+                        "got destination (local) addr %s, iface %d\n",
+                        inet_ntoa(src->ipi_addr), *if_index));
+        }
+#elif defined(HAVE_IP_RECVDSTADDR)
+        if (cm->cmsg_level == IPPROTO_IP && cm->cmsg_type == IP_RECVDSTADDR) {
+            struct in_addr* src = (struct in_addr *)CMSG_DATA(cm);
+            ((struct sockaddr_in*)dstip)->sin_addr = *src;
+            DEBUGMSGTL(("netsnmp_udp", "got destination (local) addr %s\n",
+                        inet_ntoa(*src)));
+        }
+#endif
+    }
+}
+#endif /* !defined(WIN32) */
+
 int
 netsnmp_udpbase_recvfrom(int s, void *buf, int len, struct sockaddr *from,
                          socklen_t *fromlen, struct sockaddr *dstip,
@@ -142,7 +179,6 @@ netsnmp_udpbase_recvfrom(int s, void *buf, int len, struct sockaddr *from,
 #if !defined(WIN32)
     struct iovec iov;
     char cmsg[CMSG_SPACE(cmsg_data_size)];
-    struct cmsghdr *cm;
     struct msghdr msg;
 
     iov.iov_base = buf;
@@ -198,26 +234,7 @@ netsnmp_udpbase_recvfrom(int s, void *buf, int len, struct sockaddr *from,
     }
 
 #if !defined(WIN32)
-    for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm)) {
-#if defined(HAVE_IP_PKTINFO)
-        if (cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_PKTINFO) {
-            struct in_pktinfo* src = (struct in_pktinfo *)CMSG_DATA(cm);
-            netsnmp_assert(dstip->sa_family == AF_INET);
-            ((struct sockaddr_in*)dstip)->sin_addr = src->ipi_addr;
-            *if_index = src->ipi_ifindex;
-            DEBUGMSGTL(("udpbase:recv",
-                        "got destination (local) addr %s, iface %d\n",
-                        inet_ntoa(src->ipi_addr), *if_index));
-        }
-#elif defined(HAVE_IP_RECVDSTADDR)
-        if (cm->cmsg_level == IPPROTO_IP && cm->cmsg_type == IP_RECVDSTADDR) {
-            struct in_addr* src = (struct in_addr *)CMSG_DATA(cm);
-            ((struct sockaddr_in*)dstip)->sin_addr = *src;
-            DEBUGMSGTL(("netsnmp_udp", "got destination (local) addr %s\n",
-                        inet_ntoa(*src)));
-        }
-#endif
-    }
+    _udpbase_parse_cmsg(&msg, dstip, if_index);
 #else /* !defined(WIN32) */
     for (cm = WSA_CMSG_FIRSTHDR(&msg); cm; cm = WSA_CMSG_NXTHDR(&msg, cm)) {
         if (cm->cmsg_level == IPPROTO_IP && cm->cmsg_type == IP_PKTINFO) {
@@ -235,6 +252,40 @@ netsnmp_udpbase_recvfrom(int s, void *buf, int len, struct sockaddr *from,
 }
 
 #if !defined(WIN32)
+/*
+ * Whether the socket has been bound to a device (e.g. by 'vrf exec'), in
+ * which case no IP_PKTINFO must be passed when sending.
+ */
+static int
+_udpbase_bound_to_device(int fd, int if_index)
+{
+#ifdef HAVE_SO_BINDTODEVICE
+    char          iface[IFNAMSIZ];
+    socklen_t     ifacelen = IFNAMSIZ;
+
+    /*
+     * For asymmetric multihomed users, we only set ifindex to 0 to
+     * let kernel handle return if there was no iface bound to the
+     * socket.
+     */
+    if (getsockopt(fd, SOL_SOCKET, SO_BINDTODEVICE, iface,
+                   &ifacelen) != 0)  {
+        DEBUGMSGTL(("udpbase:sendto",
+                    "getsockopt SO_BINDTODEVICE failed: %s\n",
+                    strerror(errno)));
+    } else if (ifacelen == 0) {
+        DEBUGMSGTL(("udpbase:sendto",
+                    "sendto: SO_BINDTODEVICE not set\n"));
+    } else {
+        DEBUGMSGTL(("udpbase:sendto",
+                    "sendto: SO_BINDTODEVICE dev=%s using ifindex=%d\n",
+                    iface, if_index));
+        return TRUE;
+    }
+#endif /* HAVE_SO_BINDTODEVICE */
+    return FALSE;
+}
+
 int netsnmp_udpbase_sendto_unix(int fd, const struct in_addr *srcip,
                                 int if_index, const struct sockaddr *remote,
                                 const void *data, int len)
@@ -243,8 +294,6 @@ int netsnmp_udpbase_sendto_unix(int fd, const struct in_addr *srcip,
     struct msghdr m = { NULL };
     char          cmsg[CMSG_SPACE(cmsg_data_size)];
     int           rc;
-    char          iface[IFNAMSIZ];
-    socklen_t     ifacelen = IFNAMSIZ;
 
     iov.iov_base = NETSNMP_REMOVE_CONST(void *, data);
     iov.iov_len  = len;
@@ -273,27 +322,7 @@ int netsnmp_udpbase_sendto_unix(int fd, const struct in_addr *srcip,
         cm->cmsg_type = IP_PKTINFO;
 
         memset(&ipi, 0, sizeof(ipi));
-#ifdef HAVE_SO_BINDTODEVICE
-        /*
-         * For asymmetric multihomed users, we only set ifindex to 0 to
-         * let kernel handle return if there was no iface bound to the
-         * socket.
-         */
-        if (getsockopt(fd, SOL_SOCKET, SO_BINDTODEVICE, iface,
-                       &ifacelen) != 0)  {
-            DEBUGMSGTL(("udpbase:sendto",
-                        "getsockopt SO_BINDTODEVICE failed: %s\n",
-                        strerror(errno)));
-        } else if (ifacelen == 0) {
-            DEBUGMSGTL(("udpbase:sendto",
-                        "sendto: SO_BINDTODEVICE not set\n"));
-        } else {
-            DEBUGMSGTL(("udpbase:sendto",
-                        "sendto: SO_BINDTODEVICE dev=%s using ifindex=%d\n",
-                        iface, if_index));
-            use_sendto = TRUE;
-        }
-#endif /* HAVE_SO_BINDTODEVICE */
+        use_sendto = _udpbase_bound_to_device(fd, if_index);
 
 #ifdef HAVE_STRUCT_IN_PKTINFO_IPI_SPEC_DST
         DEBUGMSGTL(("udpbase:sendto", "sending from %s\n",
@@ -418,6 +447,283 @@ int netsnmp_udpbase_sendto(int fd, const struct in_addr *srcip, int if_index,
 }
 #endif /* HAVE_IP_PKTINFO || HAVE_IP_RECVDSTADDR */
 
+#if defined(netsnmp_udpbase_recvfrom_sendto_defined) && !defined(WIN32) && \
+    defined(HAVE_RECVMMSG) && defined(HAVE_SENDMMSG)
+#define NETSNMP_UDPBASE_BATCH
+
+/*
+ * Server transports read up to 'size' datagrams with one recvmmsg() call.
+ * The first one is handed out by the f_recv call that read the batch, the
+ * others by the following f_recv calls, for which the transport carries
+ * NETSNMP_TRANSPORT_FLAG_RECV_PENDING.  Datagrams sent while the batch is
+ * being processed, i.e. the responses, are queued and sent with one
+ * sendmmsg() call when the last datagram of the batch is handed out.
+ *
+ * All state lives in a single allocation, so that netsnmp_transport_free()
+ * can release it without knowing about it.
+ */
+#define NETSNMP_UDPBASE_BATCH_DEFAULT 16
+#define NETSNMP_UDPBASE_BATCH_MAX     1024
+
+struct netsnmp_udpbase_batch_s {
+    int             size;       /* number of datagrams per batch */
+    size_t          bufsize;    /* bytes per datagram buffer */
+    int             rx_count;   /* datagrams read by the last recvmmsg() */
+    int             rx_next;    /* next datagram to hand out */
+    int             tx_count;   /* datagrams waiting for sendmmsg() */
+    struct mmsghdr *rx_msgs;
+    struct iovec   *rx_iov;
+    netsnmp_indexed_addr_pair *rx_addr;
+    char           *rx_cmsg;
+    u_char         *rx_buf;
+    struct mmsghdr *tx_msgs;
+    struct iovec   *tx_iov;
+    netsnmp_indexed_addr_pair *tx_addr;
+    char           *tx_cmsg;
+    u_char         *tx_buf;
+};
+
+#define UDPBASE_CMSG_SPACE  CMSG_SPACE(cmsg_data_size)
+#define UDPBASE_ALIGN(n)    (((n) + 15) & ~(size_t)15)
+
+static struct netsnmp_udpbase_batch_s *
+_udpbase_batch_alloc(int size, size_t bufsize)
+{
+    struct netsnmp_udpbase_batch_s *b;
+    size_t          msgs, iov, addr, cmsg, bufs, off;
+    char           *p;
+
+    msgs = UDPBASE_ALIGN(size * sizeof(struct mmsghdr));
+    iov = UDPBASE_ALIGN(size * sizeof(struct iovec));
+    addr = UDPBASE_ALIGN(size * sizeof(netsnmp_indexed_addr_pair));
+    cmsg = UDPBASE_ALIGN(size * UDPBASE_CMSG_SPACE);
+    bufs = UDPBASE_ALIGN(size * bufsize);
+
+    off = UDPBASE_ALIGN(sizeof(*b));
+    p = malloc(off + 2 * (msgs + iov + addr + cmsg + bufs));
+    if (p == NULL)
+        return NULL;
+    b = (struct netsnmp_udpbase_batch_s *)p;
+    memset(b, 0, sizeof(*b));
+    b->size = size;
+    b->bufsize = bufsize;
+    b->rx_msgs = (struct mmsghdr *)(p + off);  off += msgs;
+    b->rx_iov = (struct iovec *)(p + off);     off += iov;
+    b->rx_addr = (netsnmp_indexed_addr_pair *)(p + off); off += addr;
+    b->rx_cmsg = p + off;                      off += cmsg;
+    b->rx_buf = (u_char *)(p + off);           off += bufs;
+    b->tx_msgs = (struct mmsghdr *)(p + off);  off += msgs;
+    b->tx_iov = (struct iovec *)(p + off);     off += iov;
+    b->tx_addr = (netsnmp_indexed_addr_pair *)(p + off); off += addr;
+    b->tx_cmsg = p + off;                      off += cmsg;
+    b->tx_buf = (u_char *)(p + off);
+    return b;
+}
+
+/*
+ * Returns the batch state of t, allocating it on first use, or NULL if t
+ * does not read in batches.
+ */
+static struct netsnmp_udpbase_batch_s *
+_udpbase_batch_get(netsnmp_transport *t)
+{
+    int             size;
+
+    if (t->batch != NULL)
+        return t->batch;
+    /* only plain UDP server transports; tunnels call f_recv themselves */
+    if (t->local == NULL || t->f_recv != netsnmp_udpbase_recv ||
+        t->msgMaxSize == 0)
+        return NULL;
+    size = netsnmp_ds_get_int(NETSNMP_DS_LIBRARY_ID,
+                              NETSNMP_DS_LIB_SERVER_UDP_BATCH);
+    if (size == 0)
+        size = NETSNMP_UDPBASE_BATCH_DEFAULT;
+    if (size <= 1)
+        return NULL;
+    if (size > NETSNMP_UDPBASE_BATCH_MAX)
+        size = NETSNMP_UDPBASE_BATCH_MAX;
+    t->batch = _udpbase_batch_alloc(size, t->msgMaxSize);
+    DEBUGMSGTL(("udpbase:batch", "fd %d: batches of %d datagrams%s\n",
+                t->sock, size, t->batch ? "" : " (allocation failed)"));
+    return t->batch;
+}
+
+/*
+ * Send the queued datagrams.  Whatever sendmmsg() does not accept is
+ * passed to netsnmp_udpbase_sendto() one by one, which knows how to work
+ * around source addresses the kernel refuses.
+ */
+static void
+_udpbase_batch_flush(netsnmp_transport *t)
+{
+    struct netsnmp_udpbase_batch_s *b = t->batch;
+    int             i, rc, sent = 0, use_pktinfo;
+
+    if (b == NULL || b->tx_count == 0)
+        return;
+
+    use_pktinfo = !_udpbase_bound_to_device(t->sock, 0);
+    for (i = 0; i < b->tx_count; i++) {
+        struct msghdr  *m = &b->tx_msgs[i].msg_hdr;
+        const netsnmp_indexed_addr_pair *ap = &b->tx_addr[i];
+
+        memset(m, 0, sizeof(*m));
+        m->msg_name = NETSNMP_REMOVE_CONST(struct sockaddr *,
+                                           &ap->remote_addr.sa);
+        m->msg_namelen = sizeof(struct sockaddr_in);
+        m->msg_iov = &b->tx_iov[i];
+        m->msg_iovlen = 1;
+        if (use_pktinfo && ap->local_addr.sin.sin_addr.s_addr != INADDR_ANY) {
+            char           *cmsg = b->tx_cmsg + i * UDPBASE_CMSG_SPACE;
+            struct cmsghdr *cm;
+
+            memset(cmsg, 0, UDPBASE_CMSG_SPACE);
+            m->msg_control = cmsg;
+            m->msg_controllen = UDPBASE_CMSG_SPACE;
+            cm = CMSG_FIRSTHDR(m);
+            cm->cmsg_len = CMSG_LEN(cmsg_data_size);
+#if defined(HAVE_IP_PKTINFO)
+            cm->cmsg_level = SOL_IP;
+            cm->cmsg_type = IP_PKTINFO;
+#ifdef HAVE_STRUCT_IN_PKTINFO_IPI_SPEC_DST
+            {
+                struct in_pktinfo ipi;
+
+                memset(&ipi, 0, sizeof(ipi));
+                ipi.ipi_spec_dst = ap->local_addr.sin.sin_addr;
+                memcpy(CMSG_DATA(cm), &ipi, sizeof(ipi));
+            }
+#endif
+#elif defined(HAVE_IP_SENDSRCADDR)
+            cm->cmsg_level = IPPROTO_IP;
+            cm->cmsg_type = IP_SENDSRCADDR;
+            memcpy(CMSG_DATA(cm), &ap->local_addr.sin.sin_addr,
+                   sizeof(struct in_addr));
+#endif
+        }
+    }
+
+    while (sent < b->tx_count) {
+        rc = sendmmsg(t->sock, b->tx_msgs + sent, b->tx_count - sent,
+                      MSG_DONTWAIT);
+        if (rc > 0) {
+            sent += rc;
+            continue;
+        }
+        if (rc < 0 && errno == EINTR)
+            continue;
+        rc = netsnmp_udpbase_sendto(t->sock,
+                                    &b->tx_addr[sent].local_addr.sin.sin_addr,
+                                    b->tx_addr[sent].if_index,
+                                    &b->tx_addr[sent].remote_addr.sa,
+                                    b->tx_iov[sent].iov_base,
+                                    b->tx_iov[sent].iov_len);
+        if (rc < 0)
+            DEBUGMSGTL(("udpbase:batch", "sendto error, rc %d (errno %d)\n",
+                        rc, errno));
+        sent++;
+    }
+    DEBUGMSGTL(("udpbase:batch", "fd %d: sent %d datagrams\n", t->sock,
+                b->tx_count));
+    b->tx_count = 0;
+}
+
+/*
+ * Queue a datagram for _udpbase_batch_flush().  Returns FALSE if it must
+ * be sent right away instead.
+ */
+static int
+_udpbase_batch_queue(netsnmp_transport *t,
+                     const netsnmp_indexed_addr_pair *addr_pair,
+                     const void *buf, int size)
+{
+    struct netsnmp_udpbase_batch_s *b = t->batch;
+    u_char         *slot;
+
+    if (b == NULL || !(t->flags & NETSNMP_TRANSPORT_FLAG_RECV_PENDING) ||
+        size < 0 || (size_t)size > b->bufsize ||
+        addr_pair->remote_addr.sa.sa_family != AF_INET)
+        return FALSE;
+    if (b->tx_count == b->size)
+        _udpbase_batch_flush(t);
+    slot = b->tx_buf + b->tx_count * b->bufsize;
+    memcpy(slot, buf, size);
+    b->tx_iov[b->tx_count].iov_base = slot;
+    b->tx_iov[b->tx_count].iov_len = size;
+    b->tx_addr[b->tx_count] = *addr_pair;
+    b->tx_count++;
+    return TRUE;
+}
+
+/*
+ * Hand out the next datagram, reading a new batch if none is queued.
+ */
+static int
+_udpbase_batch_recv(netsnmp_transport *t, void *buf, int size,
+                    netsnmp_indexed_addr_pair *addr_pair)
+{
+    struct netsnmp_udpbase_batch_s *b = t->batch;
+    netsnmp_sockaddr_storage local;
+    socklen_t       local_len = sizeof(local);
+    int             i, n, len;
+
+    if (b->rx_next < b->rx_count) {
+        i = b->rx_next++;
+        len = b->rx_msgs[i].msg_len;
+        if (len > size)
+            len = size;
+        memcpy(buf, b->rx_iov[i].iov_base, len);
+        *addr_pair = b->rx_addr[i];
+        if (b->rx_next == b->rx_count) {
+            /* responses to this one are sent directly */
+            t->flags &= ~NETSNMP_TRANSPORT_FLAG_RECV_PENDING;
+            _udpbase_batch_flush(t);
+        }
+        return len;
+    }
+
+    /* the first datagram goes straight into the caller's buffer */
+    for (i = 0; i < b->size; i++) {
+        struct msghdr  *m = &b->rx_msgs[i].msg_hdr;
+
+        b->rx_iov[i].iov_base = i ? b->rx_buf + i * b->bufsize : buf;
+        b->rx_iov[i].iov_len = i ? b->bufsize : (size_t)size;
+        memset(m, 0, sizeof(*m));
+        memset(&b->rx_addr[i], 0, sizeof(b->rx_addr[i]));
+        m->msg_name = &b->rx_addr[i].remote_addr;
+        m->msg_namelen = sizeof(b->rx_addr[i].remote_addr);
+        m->msg_iov = &b->rx_iov[i];
+        m->msg_iovlen = 1;
+        m->msg_control = b->rx_cmsg + i * UDPBASE_CMSG_SPACE;
+        m->msg_controllen = UDPBASE_CMSG_SPACE;
+    }
+    b->rx_count = b->rx_next = 0;
+    n = recvmmsg(t->sock, b->rx_msgs, b->size, MSG_DONTWAIT, NULL);
+    if (n <= 0)
+        return -1;
+    DEBUGMSGTL(("udpbase:batch", "fd %d: received %d datagrams\n", t->sock,
+                n));
+
+    /* Get the local port number for use in diagnostic messages */
+    if (getsockname(t->sock, &local.sa, &local_len) != 0)
+        memset(&local, 0, sizeof(local));
+    for (i = 0; i < n; i++) {
+        b->rx_addr[i].local_addr = local;
+        _udpbase_parse_cmsg(&b->rx_msgs[i].msg_hdr,
+                            &b->rx_addr[i].local_addr.sa,
+                            &b->rx_addr[i].if_index);
+    }
+
+    *addr_pair = b->rx_addr[0];
+    b->rx_count = n;
+    b->rx_next = 1;
+    if (n > 1)
+        t->flags |= NETSNMP_TRANSPORT_FLAG_RECV_PENDING;
+    return b->rx_msgs[0].msg_len;
+}
+#endif /* NETSNMP_UDPBASE_BATCH */
+
 /*
  * You can write something into opaque that will subsequently get passed back 
  * to your send function if you like.  For instance, you might want to
@@ -443,6 +749,14 @@ netsnmp_udpbase_recv(netsnmp_transport *t, void *buf, int size,
             from = &addr_pair->remote_addr.sa;
 
 	while (rc < 0) {
+#ifdef NETSNMP_UDPBASE_BATCH
+            if (_udpbase_batch_get(t) != NULL) {
+                rc = _udpbase_batch_recv(t, buf, size, addr_pair);
+                if (rc < 0 && errno != EINTR)
+                    break;
+                continue;
+            }
+#endif /* NETSNMP_UDPBASE_BATCH */
 #ifdef netsnmp_udpbase_recvfrom_sendto_defined
             socklen_t local_addr_len = sizeof(addr_pair->local_addr);
             rc = netsnmp_udp_recvfrom(t->sock, buf, size, from, &fromlen,
@@ -512,6 +826,10 @@ netsnmp_udpbase_send(netsnmp_transport *t, const void *buf, int size,
                         size, buf, str, t->sock));
             free(str);
         }
+#ifdef NETSNMP_UDPBASE_BATCH
+        if (_udpbase_batch_queue(t, addr_pair, buf, size))
+            return size;
+#endif /* NETSNMP_UDPBASE_BATCH */
 	while (rc < 0) {
 #ifdef netsnmp_udpbase_recvfrom_sendto_defined
             rc = netsnmp_udp_sendto(t->sock,
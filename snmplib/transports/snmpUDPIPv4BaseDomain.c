@@ -148,6 +148,15 @@ netsnmp_udpipv4base_transport_socket(int flags)
         return -1;
 
     _netsnmp_udp_sockopt_set(sock, local);
+#ifdef SO_REUSEPORT
+    if (local && (flags & NETSNMP_TSPEC_REUSEPORT)) {
+        int             one = 1;
+
+        DEBUGMSGTL(("socket:option", "setting socket option SO_REUSEPORT\n"));
+        setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, (void *) &one,
+                   sizeof(one));
+    }
+#endif
 
     return sock;
 }
@@ -273,7 +282,7 @@ netsnmp_udpipv4base_transport_with_source(const struct netsnmp_ep *ep,
 
     if (local) {
         bind_addr = ep;
-        flags |= NETSNMP_TSPEC_LOCAL;
+        flags |= NETSNMP_TSPEC_LOCAL | (local & NETSNMP_TSPEC_REUSEPORT);
 
 #ifndef NETSNMP_NO_SYSTEMD
         /*
@@ -334,6 +343,8 @@ netsnmp_udpipv4base_tspec_transport(netsnmp_tdomain_spec *tspec)
         return NULL;
 
     local = tspec->flags & NETSNMP_TSPEC_LOCAL;
+    if (local)
+        local |= tspec->flags & NETSNMP_TSPEC_REUSEPORT;
 
     /** get address from target */
     if (!netsnmp_sockaddr_in3(&addr, tspec->target, tspec->default_target))
@@ -1145,6 +1145,291 @@ vacm_is_configured(void)
     return 1;
 }
 
+/*
+ * The entries of viewList, compiled into an OID trie per view for the
+ * checks the agent makes for every variable of every request.  A
+ * sub-identifier ignored by the view mask is a wildcard edge of the trie.
+ * The tries are rebuilt by the first check after the view entries changed.
+ */
+struct view_node {
+    oid             subid;
+    struct view_node **children;        /* sorted by subid */
+    int             num_children, max_children;
+    struct view_node *wildcard;
+    struct vacm_viewEntry *entry;       /* the entry netsnmp_view_get()
+                                         * prefers among those ending here */
+    int             entry_order;        /* its position in viewList */
+    unsigned int    types_here;         /* types of the entries ending here */
+    unsigned int    types_below;        /* ... and further down */
+};
+
+struct view_trie {
+    char            viewName[VACMSTRINGLEN];    /* length in [0] */
+    struct view_node *root;
+};
+
+#define VIEW_TYPE_BIT(type)     (1U << ((unsigned int) (type) & 31))
+
+/* wildcards followed at once before falling back to a scan of viewList */
+#define VIEW_TRIE_MAX_ACTIVE    64
+
+static struct view_trie *view_tries;
+static int      num_view_tries, max_view_tries;
+static int      view_tries_state;       /* 0: stale, 1: built, -1: failed */
+
+static void
+view_node_free(struct view_node *node)
+{
+    int             i;
+
+    if (node == NULL)
+        return;
+    for (i = 0; i < node->num_children; i++)
+        view_node_free(node->children[i]);
+    view_node_free(node->wildcard);
+    free(node->children);
+    free(node);
+}
+
+static void
+view_tries_free(void)
+{
+    int             i;
+
+    for (i = 0; i < num_view_tries; i++)
+        view_node_free(view_tries[i].root);
+    SNMP_FREE(view_tries);
+    num_view_tries = max_view_tries = 0;
+    view_tries_state = 0;
+}
+
+static struct view_node *
+view_node_child(struct view_node *node, oid subid, int create)
+{
+    struct view_node *child, **children;
+    int             lo = 0, hi = node->num_children - 1, mid;
+
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        if (node->children[mid]->subid == subid)
+            return node->children[mid];
+        if (node->children[mid]->subid < subid)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    if (!create)
+        return NULL;
+
+    if (node->num_children == node->max_children) {
+        children = realloc(node->children, (node->max_children ?
+                                            2 * node->max_children : 4) *
+                           sizeof(*children));
+        if (children == NULL)
+            return NULL;
+        node->children = children;
+        node->max_children = node->max_children ? 2 * node->max_children : 4;
+    }
+    child = calloc(1, sizeof(*child));
+    if (child == NULL)
+        return NULL;
+    child->subid = subid;
+    memmove(node->children + lo + 1, node->children + lo,
+            (node->num_children - lo) * sizeof(*children));
+    node->children[lo] = child;
+    node->num_children++;
+    return child;
+}
+
+static unsigned int
+view_node_summarize(struct view_node *node)
+{
+    int             i;
+
+    node->types_below = 0;
+    for (i = 0; i < node->num_children; i++)
+        node->types_below |= view_node_summarize(node->children[i]);
+    if (node->wildcard)
+        node->types_below |= view_node_summarize(node->wildcard);
+    return node->types_here | node->types_below;
+}
+
+static int
+view_tries_build(void)
+{
+    struct vacm_viewEntry *vp;
+    struct view_trie *trie = NULL;
+    struct view_node *node;
+    size_t          pos;
+    int             order, i;
+
+    view_tries_free();
+    for (vp = viewList, order = 0; vp; vp = vp->next, order++) {
+        if (trie == NULL ||
+            memcmp(trie->viewName, vp->viewName, vp->viewName[0] + 1) != 0) {
+            /*
+             * viewList is sorted by name, and the tries are looked up by
+             * binary search
+             */
+            if (trie && memcmp(trie->viewName, vp->viewName,
+                               vp->viewName[0] + 1) > 0)
+                goto fail;
+            if (num_view_tries == max_view_tries) {
+                trie = realloc(view_tries, (max_view_tries ?
+                                            2 * max_view_tries : 16) *
+                               sizeof(*trie));
+                if (trie == NULL)
+                    goto fail;
+                view_tries = trie;
+                max_view_tries = max_view_tries ? 2 * max_view_tries : 16;
+            }
+            trie = &view_tries[num_view_tries];
+            memcpy(trie->viewName, vp->viewName, sizeof(trie->viewName));
+            trie->root = calloc(1, sizeof(struct view_node));
+            if (trie->root == NULL)
+                goto fail;
+            num_view_tries++;
+        }
+
+        node = trie->root;
+        for (pos = 0; node && pos < vp->viewSubtreeLen - 1; pos++) {
+            if (VIEW_MASK(vp, pos / 8, 0x80 >> (pos % 8)) != 0)
+                node = view_node_child(node, vp->viewSubtree[pos + 1], 1);
+            else {
+                if (node->wildcard == NULL)
+                    node->wildcard = calloc(1, sizeof(struct view_node));
+                node = node->wildcard;
+            }
+        }
+        if (node == NULL)
+            goto fail;
+        node->types_here |= VIEW_TYPE_BIT(vp->viewType);
+        if (node->entry == NULL
+            || snmp_oid_compare(vp->viewSubtree + 1, vp->viewSubtreeLen - 1,
+                                node->entry->viewSubtree + 1,
+                                node->entry->viewSubtreeLen - 1) > 0) {
+            node->entry = vp;
+            node->entry_order = order;
+        }
+    }
+    for (i = 0; i < num_view_tries; i++)
+        view_node_summarize(view_tries[i].root);
+    DEBUGMSGTL(("vacm:viewTrie", "%d entries in %d views\n", order,
+                num_view_tries));
+    view_tries_state = 1;
+    return 0;
+
+  fail:
+    snmp_log(LOG_WARNING, "vacm: scanning the view entries for each check\n");
+    view_tries_free();
+    view_tries_state = -1;
+    return -1;
+}
+
+/*
+ * Finds the trie of a view, setting *root to NULL if there is no such
+ * view.  Returns -1 if the view entries are to be scanned instead.
+ */
+static int
+view_trie_find(const char *viewName, struct view_node **root)
+{
+    char            view[VACMSTRINGLEN];
+    int             glen, lo, hi, mid, cmp;
+
+    glen = (int) strlen(viewName);
+    if (glen > VACM_MAX_STRING)
+        return -1;
+    if (view_tries_state == 0)
+        view_tries_build();
+    if (view_tries_state < 0)
+        return -1;
+    view[0] = glen;
+    memcpy(view + 1, viewName, glen);
+
+    *root = NULL;
+    lo = 0;
+    hi = num_view_tries - 1;
+    while (lo <= hi) {
+        mid = (lo + hi) / 2;
+        cmp = memcmp(view_tries[mid].viewName, view, glen + 1);
+        if (cmp == 0) {
+            *root = view_tries[mid].root;
+            break;
+        }
+        if (cmp < 0)
+            lo = mid + 1;
+        else
+            hi = mid - 1;
+    }
+    return 0;
+}
+
+/*
+ * Finds the entry netsnmp_view_get() would find for name, and the types
+ * of the entries longer than name that match all of it.  Returns -1 if
+ * too many wildcards match at once.
+ */
+static int
+view_trie_match(struct view_node *root, const oid * name, size_t len,
+                struct vacm_viewEntry **entry, unsigned int *types_longer)
+{
+    struct view_node *active[2][VIEW_TRIE_MAX_ACTIVE];
+    struct view_node *node, *child, *best;
+    int             num_active = 1, num_next, cur = 0, i, cmp;
+    size_t          pos;
+
+    *entry = root->entry;
+    *types_longer = 0;
+    active[0][0] = root;
+    for (pos = 0; pos < len; pos++) {
+        num_next = 0;
+        for (i = 0; i < num_active; i++) {
+            node = active[cur][i];
+            child = view_node_child(node, name[pos], 0);
+            if (child) {
+                if (num_next == VIEW_TRIE_MAX_ACTIVE)
+                    return -1;
+                active[!cur][num_next++] = child;
+            }
+            if (node->wildcard) {
+                if (num_next == VIEW_TRIE_MAX_ACTIVE)
+                    return -1;
+                active[!cur][num_next++] = node->wildcard;
+            }
+        }
+        if (num_next == 0)
+            return 0;
+        cur = !cur;
+        num_active = num_next;
+
+        /*
+         * a longer entry wins, then the lexicographically greater one,
+         * then the first one in viewList
+         */
+        best = NULL;
+        for (i = 0; i < num_active; i++) {
+            node = active[cur][i];
+            if (node->entry == NULL)
+                continue;
+            if (best == NULL) {
+                best = node;
+                continue;
+            }
+            cmp = snmp_oid_compare(node->entry->viewSubtree + 1,
+                                   node->entry->viewSubtreeLen - 1,
+                                   best->entry->viewSubtree + 1,
+                                   best->entry->viewSubtreeLen - 1);
+            if (cmp > 0 || (cmp == 0 && node->entry_order < best->entry_order))
+                best = node;
+        }
+        if (best)
+            *entry = best->entry;
+    }
+    for (i = 0; i < num_active; i++)
+        *types_longer |= active[cur][i]->types_below;
+    return 0;
+}
+
 /*
  * backwards compatability
  */
@@ -1152,6 +1437,17 @@ struct vacm_viewEntry *
 vacm_getViewEntry(const char *viewName,
                   oid * viewSubtree, size_t viewSubtreeLen, int mode)
 {
+    struct view_node *root;
+    struct vacm_viewEntry *vp = NULL;
+    unsigned int    types;
+
+    if (mode == VACM_MODE_FIND && view_trie_find(viewName, &root) == 0 &&
+        (root == NULL ||
+         view_trie_match(root, viewSubtree, viewSubtreeLen, &vp,
+                         &types) == 0)) {
+        DEBUGMSGTL(("vacm:getView", ", %s\n", (vp) ? "found" : "none"));
+        return vp;
+    }
     return netsnmp_view_get( viewList, viewName, viewSubtree, viewSubtreeLen,
                              mode);
 }
@@ -1160,14 +1456,43 @@ int
 vacm_checkSubtree(const char *viewName,
                   oid * viewSubtree, size_t viewSubtreeLen)
 {
-    return netsnmp_view_subtree_check( viewList, viewName, viewSubtree,
-                                       viewSubtreeLen);
+    struct view_node *root;
+    struct vacm_viewEntry *vp = NULL;
+    unsigned int    types = 0;
+
+    if (view_trie_find(viewName, &root) < 0 ||
+        (root != NULL &&
+         view_trie_match(root, viewSubtree, viewSubtreeLen, &vp,
+                         &types) < 0))
+        return netsnmp_view_subtree_check( viewList, viewName, viewSubtree,
+                                           viewSubtreeLen);
+
+    /*
+     * as netsnmp_view_subtree_check(): the entries longer than the subtree
+     * must all be of the type of the entry including it, if any, or else
+     * excluded
+     */
+    if ((types & (types - 1)) != 0
+        || (types != 0 && vp == NULL
+            && types != VIEW_TYPE_BIT(SNMP_VIEW_EXCLUDED))
+        || (types != 0 && vp != NULL
+            && types != VIEW_TYPE_BIT(vp->viewType))) {
+        DEBUGMSGTL(("vacm:checkSubtree", ", %s\n", "unknown"));
+        return VACM_SUBTREE_UNKNOWN;
+    }
+    if (vp && vp->viewType != SNMP_VIEW_EXCLUDED) {
+        DEBUGMSGTL(("vacm:checkSubtree", ", %s\n", "included"));
+        return VACM_SUCCESS;
+    }
+    DEBUGMSGTL(("vacm:checkSubtree", ", %s\n", "excluded"));
+    return VACM_NOTINVIEW;
 }
 
 struct vacm_viewEntry *
 vacm_createViewEntry(const char *viewName,
                      oid * viewSubtree, size_t viewSubtreeLen)
 {
+    view_tries_state = 0;
     return netsnmp_view_create( &viewList, viewName, viewSubtree,
                                 viewSubtreeLen);
 }
@@ -1176,15 +1501,23 @@ void
 vacm_destroyViewEntry(const char *viewName,
                       oid * viewSubtree, size_t viewSubtreeLen)
 {
+    view_tries_state = 0;
     netsnmp_view_destroy( &viewList, viewName, viewSubtree, viewSubtreeLen);
 }
 
 void
 vacm_destroyAllViewEntries(void)
 {
+    view_tries_free();
     netsnmp_view_clear( &viewList );
 }
 
+void
+vacm_viewEntriesChanged(void)
+{
+    view_tries_state = 0;
+}
+
 /*
  * vacm simple api
  */
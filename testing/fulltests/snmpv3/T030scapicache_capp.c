@@ -0,0 +1,143 @@
+/*
+ * HEADER Testing cached SCAPI transform state
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/testing.h>
+
+#define NUM_MSGS  50
+#define NUM_BENCH 20000
+
+static u_char   msg[512];
+
+static void
+fill(u_char *buf, size_t len, unsigned int seed)
+{
+    size_t          i;
+
+    for (i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = seed >> 16;
+    }
+}
+
+static int
+check_hash(netsnmp_sc_cache *cache, const u_char *key, u_int keylen,
+           const u_char *buf, u_int buflen)
+{
+    u_char          mac1[64], mac2[64];
+    size_t          len1 = 12, len2 = 12;
+
+    if (sc_generate_keyed_hash(usmHMACSHA1AuthProtocol,
+                               OID_LENGTH(usmHMACSHA1AuthProtocol),
+                               key, keylen, buf, buflen, mac1, &len1) ||
+        sc_generate_keyed_hash2(cache, usmHMACSHA1AuthProtocol,
+                                OID_LENGTH(usmHMACSHA1AuthProtocol),
+                                key, keylen, buf, buflen, mac2, &len2))
+        return 0;
+    return len1 == len2 && memcmp(mac1, mac2, len1) == 0 &&
+        sc_check_keyed_hash2(cache, usmHMACSHA1AuthProtocol,
+                             OID_LENGTH(usmHMACSHA1AuthProtocol),
+                             key, keylen, buf, buflen, mac1, len1) == 0;
+}
+
+#ifdef HAVE_AES
+static int
+check_cipher(netsnmp_sc_cache *cache, u_char *key, u_char *iv,
+             const u_char *buf, u_int buflen)
+{
+    u_char          ct1[sizeof(msg)], ct2[sizeof(msg)], pt[sizeof(msg)];
+    size_t          len1 = sizeof(ct1), len2 = sizeof(ct2), ptlen = sizeof(pt);
+
+    if (sc_encrypt(usmAESPrivProtocol, OID_LENGTH(usmAESPrivProtocol),
+                   key, 16, iv, 16, buf, buflen, ct1, &len1) ||
+        sc_encrypt2(cache, usmAESPrivProtocol, OID_LENGTH(usmAESPrivProtocol),
+                    key, 16, iv, 16, buf, buflen, ct2, &len2) ||
+        sc_decrypt2(cache, usmAESPrivProtocol, OID_LENGTH(usmAESPrivProtocol),
+                    key, 16, iv, 16, ct2, len2, pt, &ptlen))
+        return 0;
+    return len1 == len2 && memcmp(ct1, ct2, len1) == 0 &&
+        ptlen == buflen && memcmp(pt, buf, buflen) == 0;
+}
+#endif
+
+int
+main(int argc, char *argv[])
+{
+    netsnmp_sc_cache *cache, *ref;
+    u_char          key[20], key2[20], iv[16], mac[20];
+    size_t          maclen;
+    struct timeval  start;
+    long            plain_us, cached_us;
+    int             i, bad;
+
+    cache = sc_cache_new();
+    OKF(cache != NULL, ("cache allocated"));
+    if (cache == NULL)
+        return 1;
+    fill(key, sizeof(key), 1);
+    fill(key2, sizeof(key2), 2);
+
+    /* Cached and uncached transforms agree, also when the key changes. */
+    for (i = 0, bad = 0; i < NUM_MSGS; i++) {
+        fill(msg, sizeof(msg), 100 + i);
+        if (!check_hash(cache, (i & 8) ? key2 : key, sizeof(key), msg,
+                        16 + i * 7))
+            bad++;
+    }
+    OKF(bad == 0, ("%d of %d HMAC results differ", bad, NUM_MSGS));
+
+    msg[0] ^= 1;
+    maclen = 12;
+    sc_generate_keyed_hash2(cache, usmHMACSHA1AuthProtocol,
+                            OID_LENGTH(usmHMACSHA1AuthProtocol),
+                            key, sizeof(key), msg, 64, mac, &maclen);
+    msg[0] ^= 1;
+    OKF(sc_check_keyed_hash2(cache, usmHMACSHA1AuthProtocol,
+                             OID_LENGTH(usmHMACSHA1AuthProtocol),
+                             key, sizeof(key), msg, 64, mac, maclen) != 0,
+        ("modified message is rejected"));
+
+#ifdef HAVE_AES
+    for (i = 0, bad = 0; i < NUM_MSGS; i++) {
+        fill(msg, sizeof(msg), 200 + i);
+        fill(iv, sizeof(iv), 300 + i);
+        if (!check_cipher(cache, (i & 4) ? key2 : key, iv, msg, 1 + i * 9))
+            bad++;
+    }
+    OKF(bad == 0, ("%d of %d AES results differ", bad, NUM_MSGS));
+#endif
+
+    /* The cache lives on until its last reference is dropped. */
+    ref = sc_cache_ref(cache);
+    OKF(ref == cache, ("cache referenced"));
+    sc_cache_free(cache);
+    OKF(check_hash(ref, key, sizeof(key), msg, 100),
+        ("cache usable through remaining reference"));
+
+    /* The cache saves setting up the HMAC key for every message. */
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < NUM_BENCH; i++) {
+        maclen = 12;
+        sc_generate_keyed_hash(usmHMACSHA1AuthProtocol,
+                               OID_LENGTH(usmHMACSHA1AuthProtocol),
+                               key, sizeof(key), msg, 128, mac, &maclen);
+    }
+    plain_us = test_elapsed_us(&start);
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < NUM_BENCH; i++) {
+        maclen = 12;
+        sc_generate_keyed_hash2(ref, usmHMACSHA1AuthProtocol,
+                                OID_LENGTH(usmHMACSHA1AuthProtocol),
+                                key, sizeof(key), msg, 128, mac, &maclen);
+    }
+    cached_us = test_elapsed_us(&start);
+    printf("# %d HMAC-SHA1 signatures: uncached %ld us, cached %ld us\n",
+           NUM_BENCH, plain_us, cached_us);
+    sc_cache_free(ref);
+
+    if (__did_plan == 0)
+        PLAN(__test_counter);
+    return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * HEADER Testing the master key cache
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/keytools.h>
+#include <net-snmp/library/testing.h>
+
+static const char *passphrases[] = {
+    "maplesyrup", "maplesyrup2", "another pass phrase",
+};
+
+static int
+generate(const oid *hashtype, u_int hashtype_len, const char *P,
+         u_char *Ku, size_t *kulen)
+{
+    *kulen = SNMP_MAXBUF_SMALL;
+    return generate_Ku(hashtype, hashtype_len, (const u_char *)P, strlen(P),
+                       Ku, kulen);
+}
+
+int
+main(int argc, char *argv[])
+{
+    u_char          ref[3][SNMP_MAXBUF_SMALL], Ku[SNMP_MAXBUF_SMALL];
+    size_t          reflen[3], kulen;
+    u_int           hits, misses;
+    struct timeval  start;
+    long            miss_us, hit_us;
+    int             i, bad;
+
+    /* Reference keys, computed without the cache. */
+    netsnmp_ku_cache_set_size(0);
+    for (i = 0; i < 3; i++)
+        generate(usmHMACSHA1AuthProtocol,
+                 OID_LENGTH(usmHMACSHA1AuthProtocol), passphrases[i],
+                 ref[i], &reflen[i]);
+    netsnmp_ku_cache_get_stats(&hits, &misses);
+    OKF(hits == 0 && misses == 0, ("disabled cache is not used"));
+
+    netsnmp_ku_cache_set_size(2);
+    for (i = 0, bad = 0; i < 6; i++) {
+        if (generate(usmHMACSHA1AuthProtocol,
+                     OID_LENGTH(usmHMACSHA1AuthProtocol), passphrases[i % 2],
+                     Ku, &kulen) != SNMPERR_SUCCESS ||
+            kulen != reflen[i % 2] || memcmp(Ku, ref[i % 2], kulen) != 0)
+            bad++;
+    }
+    OKF(bad == 0, ("%d keys differ", bad));
+    netsnmp_ku_cache_get_stats(&hits, &misses);
+    OKF(hits == 4 && misses == 2, ("%u hits, %u misses", hits, misses));
+
+    /* The hash transform is part of the key. */
+    generate(usmHMACMD5AuthProtocol, OID_LENGTH(usmHMACMD5AuthProtocol),
+             passphrases[0], Ku, &kulen);
+    OKF(kulen == 16, ("MD5 key is not taken from the cache"));
+
+    /* The least recently used entry is evicted. */
+    netsnmp_ku_cache_clear();
+    generate(usmHMACSHA1AuthProtocol, OID_LENGTH(usmHMACSHA1AuthProtocol),
+             passphrases[0], Ku, &kulen);
+    generate(usmHMACSHA1AuthProtocol, OID_LENGTH(usmHMACSHA1AuthProtocol),
+             passphrases[1], Ku, &kulen);
+    generate(usmHMACSHA1AuthProtocol, OID_LENGTH(usmHMACSHA1AuthProtocol),
+             passphrases[0], Ku, &kulen);
+    generate(usmHMACSHA1AuthProtocol, OID_LENGTH(usmHMACSHA1AuthProtocol),
+             passphrases[2], Ku, &kulen);
+    OKF(kulen == reflen[2] && memcmp(Ku, ref[2], kulen) == 0,
+        ("third pass phrase"));
+    generate(usmHMACSHA1AuthProtocol, OID_LENGTH(usmHMACSHA1AuthProtocol),
+             passphrases[0], Ku, &kulen);
+    netsnmp_ku_cache_get_stats(&hits, &misses);
+    OKF(hits == 2 && misses == 3, ("%u hits, %u misses after eviction",
+                                   hits, misses));
+
+    /* Short pass phrases are still refused. */
+    kulen = sizeof(Ku);
+    OKF(generate_Ku(usmHMACSHA1AuthProtocol,
+                    OID_LENGTH(usmHMACSHA1AuthProtocol),
+                    (const u_char *)"short", 5, Ku, &kulen) != SNMPERR_SUCCESS,
+        ("short pass phrase is refused"));
+
+    netsnmp_ku_cache_clear();
+    netsnmp_get_monotonic_clock(&start);
+    generate(usmHMACSHA1AuthProtocol, OID_LENGTH(usmHMACSHA1AuthProtocol),
+             passphrases[1], Ku, &kulen);
+    miss_us = test_elapsed_us(&start);
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < 100; i++)
+        generate(usmHMACSHA1AuthProtocol,
+                 OID_LENGTH(usmHMACSHA1AuthProtocol), passphrases[1],
+                 Ku, &kulen);
+    hit_us = test_elapsed_us(&start);
+    printf("# generate_Ku(): %ld us uncached, %ld us for 100 cached calls\n",
+           miss_us, hit_us);
+
+    if (__did_plan == 0)
+        PLAN(__test_counter);
+    return 0;
+}
@@ -507,6 +507,7 @@ CONFIGAPP() {
 #
 # common to STARTAGENT and STARTTRAPD
 # log command to "invoked" file
+# the program stays in the foreground unless DAEMONIZE=1
 #
 STARTPROG() {
     if [ "x$DYNAMIC_ANALYZER" != "x" ]; then
@@ -523,7 +524,9 @@ STARTPROG() {
     if test -f $CFG_FILE; then
 	COMMAND="$COMMAND -C -c $CFG_FILE"
     fi
-    COMMAND="$COMMAND -f"
+    if [ "x$DAEMONIZE" != "x1" ]; then
+	COMMAND="$COMMAND -f"
+    fi
     if [ "x$PORT_SPEC" != "x" ]; then
         COMMAND="$COMMAND $PORT_SPEC"
     fi
@@ -43,4 +43,18 @@ OKF(netsnmp_large_fd_set_resize(&fds, 1000) == 1, ("resizing to 1000"));
     }
 }
 
+#if defined(cygwin) || !defined(HAVE_WINSOCK_H)
+NETSNMP_LARGE_FD_ZERO(&fds);
+OKF(netsnmp_large_fd_set_next(0, &fds) == -1, ("empty set has no next"));
+NETSNMP_LARGE_FD_SET(0, &fds);
+NETSNMP_LARGE_FD_SET(63, &fds);
+NETSNMP_LARGE_FD_SET(64, &fds);
+NETSNMP_LARGE_FD_SET(999, &fds);
+OKF(netsnmp_large_fd_set_next(0, &fds) == 0, ("next from 0"));
+OKF(netsnmp_large_fd_set_next(1, &fds) == 63, ("next from 1"));
+OKF(netsnmp_large_fd_set_next(64, &fds) == 64, ("next from 64"));
+OKF(netsnmp_large_fd_set_next(65, &fds) == 999, ("next from 65"));
+OKF(netsnmp_large_fd_set_next(1000, &fds) == -1, ("next past the end"));
+#endif
+
 netsnmp_large_fd_set_cleanup(&fds);
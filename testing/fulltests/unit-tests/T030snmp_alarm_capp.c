@@ -0,0 +1,179 @@
+/*
+ * HEADER Testing snmp_alarm scheduling order and unregistration
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/snmp_alarm.h>
+#include <net-snmp/library/testing.h>
+
+NETSNMP_IMPORT struct snmp_alarm *sa_find_specific(unsigned int clientreg);
+
+#define NUM_ALARMS   1000
+#define NUM_PENDING  10000      /* alarms waiting during the benchmark */
+#define NUM_DISPATCH 20000
+
+static unsigned int fired[NUM_ALARMS];
+static int      nfired;
+static int      out_of_order;
+static struct timeval last_nextM;
+static unsigned int victim;
+
+static void
+record_alarm(unsigned int clientreg, void *clientarg)
+{
+    struct snmp_alarm *a = sa_find_specific(clientreg);
+
+    if (a == NULL || timercmp(&a->t_nextM, &last_nextM, <))
+        out_of_order++;
+    if (a)
+        last_nextM = a->t_nextM;
+    if (nfired < NUM_ALARMS)
+        fired[nfired] = clientreg;
+    nfired++;
+}
+
+static void
+count_alarm(unsigned int clientreg, void *clientarg)
+{
+    nfired++;
+}
+
+static void
+self_unregister(unsigned int clientreg, void *clientarg)
+{
+    nfired++;
+    snmp_alarm_unregister(clientreg);
+}
+
+static void
+unregister_victim(unsigned int clientreg, void *clientarg)
+{
+    nfired++;
+    snmp_alarm_unregister(victim);
+}
+
+static void
+wait_a_bit(void)
+{
+    struct timeval tv = { 0, 20000 };
+
+    select(0, NULL, NULL, NULL, &tv);
+}
+
+static void
+reset_counters(void)
+{
+    nfired = 0;
+    out_of_order = 0;
+    timerclear(&last_nextM);
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned int regs[NUM_ALARMS];
+    struct timeval t, start;
+    long us;
+    int i, found;
+
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_ALARM_DONT_USE_SIG, 1);
+
+    /* Many one-shot alarms fire in expiry order and are then removed. */
+    reset_counters();
+    for (i = 0; i < NUM_ALARMS; i++) {
+        t.tv_sec = 0;
+        t.tv_usec = 1 + (i * 7919) % 5000;
+        regs[i] = snmp_alarm_register_hr(t, 0, record_alarm, NULL);
+    }
+    OKF(regs[0] != 0 && regs[NUM_ALARMS - 1] != 0, ("registration"));
+    wait_a_bit();
+    run_alarms();
+    OKF(nfired == NUM_ALARMS, ("%d of %d alarms fired", nfired, NUM_ALARMS));
+    OKF(out_of_order == 0, ("%d alarms fired out of order", out_of_order));
+    OKF(sa_find_next() == NULL, ("one-shot alarms have been removed"));
+
+    /* Unregistered alarms do not fire. */
+    reset_counters();
+    for (i = 0; i < NUM_ALARMS; i++) {
+        t.tv_sec = 0;
+        t.tv_usec = 1 + (i * 7919) % 5000;
+        regs[i] = snmp_alarm_register_hr(t, 0, record_alarm, NULL);
+    }
+    for (i = 0; i < NUM_ALARMS; i += 2)
+        snmp_alarm_unregister(regs[i]);
+    wait_a_bit();
+    run_alarms();
+    OKF(nfired == NUM_ALARMS / 2, ("%d of %d alarms fired", nfired,
+                                   NUM_ALARMS / 2));
+    OKF(out_of_order == 0, ("%d alarms fired out of order", out_of_order));
+    for (i = 0, found = 0; i < nfired && i < NUM_ALARMS; i++)
+        if (((fired[i] - regs[0]) & 1) == 0)
+            found++;
+    OKF(found == 0, ("%d unregistered alarms fired", found));
+
+    /* Repeating alarms may unregister themselves and each other. */
+    reset_counters();
+    t.tv_sec = 0;
+    t.tv_usec = 1;
+    snmp_alarm_register_hr(t, SA_REPEAT, self_unregister, NULL);
+    t.tv_usec = 10000;
+    snmp_alarm_register_hr(t, SA_REPEAT, unregister_victim, NULL);
+    victim = snmp_alarm_register(3600, SA_REPEAT, record_alarm, NULL);
+    wait_a_bit();
+    run_alarms();
+    OKF(nfired == 2, ("%d callbacks ran", nfired));
+    OKF(sa_find_specific(victim) == NULL, ("victim alarm was unregistered"));
+    OKF(sa_find_next() != NULL &&
+        sa_find_next()->thecallback == unregister_victim,
+        ("repeating alarm has been rescheduled"));
+
+    /* snmp_alarm_reset() reorders the alarm. */
+    t.tv_sec = 1;
+    t.tv_usec = 0;
+    regs[0] = snmp_alarm_register_hr(t, SA_REPEAT, record_alarm, NULL);
+    t.tv_sec = 0;
+    t.tv_usec = 100000;
+    regs[1] = snmp_alarm_register_hr(t, SA_REPEAT, record_alarm, NULL);
+    snmp_alarm_unregister(sa_find_next()->clientreg);
+    OKF(sa_find_next() && sa_find_next()->clientreg == regs[1],
+        ("shortest interval is first"));
+    sa_find_specific(regs[0])->t.tv_sec = 0;
+    snmp_alarm_reset(regs[0]);
+    OKF(sa_find_next() && sa_find_next()->clientreg == regs[0],
+        ("reset alarm moved to the front"));
+
+    snmp_alarm_unregister_all();
+    OKF(sa_find_next() == NULL, ("all alarms unregistered"));
+    OKF(sa_find_specific(regs[1]) == NULL, ("lookup after unregister_all"));
+
+    /*
+     * Registering and dispatching one alarm while many others wait, as a
+     * busy agent does: the cost should not grow with the number waiting.
+     */
+    t.tv_sec = 3600;
+    t.tv_usec = 0;
+    for (i = 0; i < NUM_PENDING; i++)
+        snmp_alarm_register_hr(t, SA_REPEAT, record_alarm, NULL);
+    reset_counters();
+    timerclear(&t);
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < NUM_DISPATCH; i++) {
+        snmp_alarm_register_hr(t, 0, count_alarm, NULL);
+        run_alarms();
+    }
+    us = test_elapsed_us(&start);
+    OKF(nfired == NUM_DISPATCH, ("%d of %d alarms dispatched among %d "
+                                 "pending", nfired, NUM_DISPATCH,
+                                 NUM_PENDING));
+    OKF(sa_find_next() && sa_find_next()->thecallback == record_alarm,
+        ("pending alarms left waiting"));
+    printf("# %d dispatches with %d pending alarms: %ld us, %.2f us each\n",
+           NUM_DISPATCH, NUM_PENDING, us, (double) us / NUM_DISPATCH);
+    snmp_alarm_unregister_all();
+
+    if (__did_plan == 0)
+        PLAN(__test_counter);
+    return 0;
+}
@@ -0,0 +1,316 @@
+/*
+ * HEADER Testing the epoll event loop
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/fd_event_manager.h>
+#include <net-snmp/library/large_fd_set.h>
+#include <net-snmp/library/testing.h>
+
+#ifdef HAVE_SYS_EPOLL_H
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#define NUM_READY 4             /* sessions made ready per loop iteration */
+#define NUM_LOOPS 100
+
+static const int bench_sessions[] = { 10, 1000, 10000 };
+
+static int      pipe_reads;
+static int      pdus_received;
+static int      fd_reads;
+static netsnmp_large_fd_set readfds, writefds, exceptfds;
+
+static void
+drain_pipe(int fd, void *data)
+{
+    char            c;
+
+    if (read(fd, &c, 1) == 1)
+        pipe_reads++;
+}
+
+static int
+server_callback(int op, netsnmp_session *session, int reqid,
+                netsnmp_pdu *pdu, void *magic)
+{
+    if (op == NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE)
+        pdus_received++;
+    return 1;
+}
+
+static int
+send_get(netsnmp_session *client)
+{
+    static const oid sysUpTime[] = { 1, 3, 6, 1, 2, 1, 1, 3, 0 };
+    netsnmp_pdu    *pdu = snmp_pdu_create(SNMP_MSG_GET);
+
+    snmp_add_null_var(pdu, sysUpTime, OID_LENGTH(sysUpTime));
+    if (snmp_send(client, pdu) == 0) {
+        snmp_free_pdu(pdu);
+        return 0;
+    }
+    return 1;
+}
+
+static int
+fd_recv(netsnmp_transport *t, void *buf, int size, void **opaque,
+        int *olength)
+{
+    int             rc = recv(t->sock, buf, size, 0);
+
+    *opaque = NULL;
+    *olength = 0;
+    if (rc > 0)
+        fd_reads++;
+    return rc;
+}
+
+static int
+fd_close(netsnmp_transport *t)
+{
+    int             rc = t->sock >= 0 ? close(t->sock) : 0;
+
+    t->sock = -1;
+    return rc;
+}
+
+/* Adds a session that reads datagrams from fd. */
+static netsnmp_session *
+add_fd_session(int fd)
+{
+    netsnmp_transport *t;
+    netsnmp_session sess;
+
+    if (fd < 0)
+        return NULL;
+    t = SNMP_MALLOC_TYPEDEF(netsnmp_transport);
+    if (t == NULL) {
+        close(fd);
+        return NULL;
+    }
+    t->sock = fd;
+    t->msgMaxSize = SNMP_MAX_MSG_SIZE;
+    t->f_recv = fd_recv;
+    t->f_close = fd_close;
+    snmp_sess_init(&sess);
+    return snmp_add(&sess, t, NULL, NULL);
+}
+
+/* One iteration of the select() loop of snmpd, without waiting. */
+static void
+select_loop_once(void)
+{
+    struct timeval  tv;
+    int             numfds = 0, block = 0, count;
+
+    NETSNMP_LARGE_FD_ZERO(&readfds);
+    NETSNMP_LARGE_FD_ZERO(&writefds);
+    NETSNMP_LARGE_FD_ZERO(&exceptfds);
+    snmp_select_info2(&numfds, &readfds, &tv, &block);
+    netsnmp_external_event_info2(&numfds, &readfds, &writefds, &exceptfds);
+    tv.tv_sec = 0;
+    tv.tv_usec = 0;
+    count = netsnmp_large_fd_set_select(numfds, &readfds, &writefds,
+                                        &exceptfds, &tv);
+    if (count > 0) {
+        netsnmp_dispatch_external_events2(&count, &readfds, &writefds,
+                                          &exceptfds);
+        if (count > 0)
+            snmp_read2(&readfds);
+    }
+}
+
+/*
+ * Times loop iterations with n sessions open, NUM_READY of which have a
+ * datagram waiting, through the select() loop and through epoll.  The
+ * idle sessions are unconnected datagram sockets, which never become
+ * readable; the ready ones are socketpairs.
+ */
+static void
+bench(int n)
+{
+    int             pairs[NUM_READY][2];
+    struct timeval  start, tv;
+    long            select_us, epoll_us;
+    int             i, r, loop, opened = 0, select_reads;
+
+    for (i = 0, r = 0; i < n; i++) {
+        if (r < NUM_READY && i % (n / NUM_READY) == 0) {
+            if (socketpair(AF_UNIX, SOCK_DGRAM, 0, pairs[r]) != 0)
+                break;
+            if (add_fd_session(pairs[r][0]) == NULL) {
+                close(pairs[r][1]);
+                break;
+            }
+            r++;
+        } else if (add_fd_session(socket(AF_UNIX, SOCK_DGRAM, 0)) == NULL)
+            break;
+        opened++;
+    }
+
+    if (opened == n && r == NUM_READY) {
+        fd_reads = 0;
+        netsnmp_get_monotonic_clock(&start);
+        for (loop = 0; loop < NUM_LOOPS; loop++) {
+            for (i = 0; i < NUM_READY; i++)
+                if (write(pairs[i][1], "x", 1) != 1)
+                    break;
+            select_loop_once();
+        }
+        select_us = test_elapsed_us(&start);
+        select_reads = fd_reads;
+
+        netsnmp_epoll_init();
+        fd_reads = 0;
+        netsnmp_get_monotonic_clock(&start);
+        for (loop = 0; loop < NUM_LOOPS; loop++) {
+            for (i = 0; i < NUM_READY; i++)
+                if (write(pairs[i][1], "x", 1) != 1)
+                    break;
+            tv.tv_sec = 0;
+            tv.tv_usec = 0;
+            netsnmp_epoll_wait(&tv);
+        }
+        epoll_us = test_elapsed_us(&start);
+        netsnmp_epoll_shutdown();
+
+        OKF(select_reads == NUM_LOOPS * NUM_READY &&
+            fd_reads == NUM_LOOPS * NUM_READY,
+            ("%d sessions: %d and %d of %d datagrams read", n, select_reads,
+             fd_reads, NUM_LOOPS * NUM_READY));
+        printf("# %d sessions, %d ready: select loop %.1f us, "
+               "epoll loop %.1f us\n", n, NUM_READY,
+               (double) select_us / NUM_LOOPS,
+               (double) epoll_us / NUM_LOOPS);
+    } else
+        OKF(0, ("%d of %d sessions opened", opened, n));
+
+    snmp_close_sessions();
+    for (i = 0; i < r; i++)
+        close(pairs[i][1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct rlimit   rl;
+    struct timeval  tv;
+    struct sockaddr_in sin;
+    socklen_t       sinlen = sizeof(sin);
+    netsnmp_transport *t;
+    netsnmp_session sess, *server, *client;
+    static u_char   community[] = "public";
+    char            peer[64];
+    int             fds[2], count, i;
+
+    netsnmp_tdomain_init();
+
+    OKF(netsnmp_epoll_init() == 0, ("epoll initialised"));
+    OKF(netsnmp_epoll_is_active(), ("epoll is active"));
+
+    /* Callbacks registered with the fd event manager are dispatched. */
+    OKF(pipe(fds) == 0, ("pipe"));
+    register_readfd(fds[0], drain_pipe, NULL);
+    OKF(write(fds[1], "x", 1) == 1, ("write to pipe"));
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+    count = netsnmp_epoll_wait(&tv);
+    OKF(count == 1, ("one fd ready (%d)", count));
+    OKF(pipe_reads == 1, ("read callback ran %d times", pipe_reads));
+
+    tv.tv_sec = 0;
+    tv.tv_usec = 10000;
+    count = netsnmp_epoll_wait(&tv);
+    OKF(count == 0, ("timeout once drained (%d)", count));
+
+    /* Unregistered fds are no longer watched. */
+    unregister_readfd(fds[0]);
+    OKF(write(fds[1], "x", 1) == 1, ("write to pipe"));
+    count = netsnmp_epoll_wait(&tv);
+    OKF(count == 0 && pipe_reads == 1, ("unregistered fd ignored (%d)",
+                                        count));
+    close(fds[0]);
+    close(fds[1]);
+
+    /* Sessions opened after netsnmp_epoll_init() are read. */
+    t = netsnmp_transport_open_server("snmp", "udp:127.0.0.1:0");
+    OKF(t != NULL, ("server transport"));
+    if (t == NULL)
+        return 1;
+    snmp_sess_init(&sess);
+    sess.callback = server_callback;
+    server = snmp_add(&sess, t, NULL, NULL);
+    OKF(server != NULL, ("server session"));
+    OKF(getsockname(t->sock, (struct sockaddr *)&sin, &sinlen) == 0,
+        ("server port"));
+
+    snmp_sess_init(&sess);
+    snprintf(peer, sizeof(peer), "udp:127.0.0.1:%d", ntohs(sin.sin_port));
+    sess.peername = peer;
+    sess.version = SNMP_VERSION_2c;
+    sess.community = community;
+    sess.community_len = sizeof(community) - 1;
+    client = snmp_open(&sess);
+    OKF(client != NULL, ("client session"));
+
+    OKF(send_get(client), ("send request"));
+    tv.tv_sec = 1;
+    tv.tv_usec = 0;
+    count = netsnmp_epoll_wait(&tv);
+    OKF(count == 1, ("server socket ready (%d)", count));
+    OKF(pdus_received == 1, ("server received %d PDUs", pdus_received));
+
+    /* Closed sessions are dropped from the epoll set. */
+    snmp_close(server);
+    OKF(send_get(client), ("send request"));
+    tv.tv_sec = 0;
+    tv.tv_usec = 10000;
+    count = netsnmp_epoll_wait(&tv);
+    OKF(count <= 1 && pdus_received == 1,
+        ("closed session not read (%d)", count));
+
+    snmp_close(client);
+    netsnmp_epoll_shutdown();
+    OKF(!netsnmp_epoll_is_active(), ("epoll shut down"));
+
+    /* Both loops read the ready sessions among many idle ones. */
+    netsnmp_large_fd_set_init(&readfds, FD_SETSIZE);
+    netsnmp_large_fd_set_init(&writefds, FD_SETSIZE);
+    netsnmp_large_fd_set_init(&exceptfds, FD_SETSIZE);
+    for (i = 0; i < (int) (sizeof(bench_sessions) / sizeof(bench_sessions[0]));
+         i++) {
+        count = bench_sessions[i] + NUM_READY + 64;
+        if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < (rlim_t) count &&
+            rl.rlim_max >= (rlim_t) count) {
+            rl.rlim_cur = count;
+            setrlimit(RLIMIT_NOFILE, &rl);
+        }
+        if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < (rlim_t) count) {
+            printf("# %d sessions skipped: %lu files allowed\n",
+                   bench_sessions[i], (unsigned long) rl.rlim_cur);
+            continue;
+        }
+        bench(bench_sessions[i]);
+    }
+    netsnmp_large_fd_set_cleanup(&readfds);
+    netsnmp_large_fd_set_cleanup(&writefds);
+    netsnmp_large_fd_set_cleanup(&exceptfds);
+
+    if (__did_plan == 0)
+        PLAN(__test_counter);
+    return 0;
+}
+#else
+int
+main(int argc, char *argv[])
+{
+    OK(netsnmp_epoll_init() == -1, "epoll is not available");
+    if (__did_plan == 0)
+        PLAN(__test_counter);
+    return 0;
+}
+#endif
@@ -0,0 +1,103 @@
+/*
+ * HEADER Testing batched UDP receive and send
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/snmpUDPBaseDomain.h>
+#include <net-snmp/library/testing.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#define NUM_DGRAMS 5
+
+static int
+pending_replies(int s)
+{
+    char            buf[64];
+    int             n = 0;
+
+    while (recv(s, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+        n++;
+    return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct sockaddr_in sin;
+    socklen_t       sinlen = sizeof(sin);
+    netsnmp_transport *t;
+    struct timeval  tv = { 0, 20000 };
+    char            buf[64], expect[16];
+    void           *opaque;
+    int             olength, s, i, len, bad = 0, pending = 0;
+
+    netsnmp_tdomain_init();
+
+    t = netsnmp_transport_open_server("snmp", "udp:127.0.0.1:0");
+    OKF(t != NULL, ("server transport"));
+    if (t == NULL)
+        return 1;
+    OKF(getsockname(t->sock, (struct sockaddr *)&sin, &sinlen) == 0,
+        ("server port"));
+
+    s = socket(AF_INET, SOCK_DGRAM, 0);
+    OKF(s >= 0, ("client socket"));
+    for (i = 0; i < NUM_DGRAMS; i++) {
+        snprintf(buf, sizeof(buf), "request %d", i);
+        sendto(s, buf, strlen(buf), 0, (struct sockaddr *)&sin, sizeof(sin));
+    }
+    select(0, NULL, NULL, NULL, &tv);
+
+    /*
+     * Every datagram is handed out in order and replies are held back
+     * until the last datagram of the batch has been read.
+     */
+    for (i = 0; i < NUM_DGRAMS; i++) {
+        opaque = NULL;
+        olength = 0;
+        len = netsnmp_transport_recv(t, buf, sizeof(buf) - 1, &opaque,
+                                     &olength);
+        snprintf(expect, sizeof(expect), "request %d", i);
+        if (len != (int)strlen(expect) || memcmp(buf, expect, len) != 0)
+            bad++;
+        if (i < NUM_DGRAMS - 1 &&
+            (t->flags & NETSNMP_TRANSPORT_FLAG_RECV_PENDING))
+            pending++;
+        if (len > 0)
+            netsnmp_transport_send(t, buf, len, &opaque, &olength);
+        SNMP_FREE(opaque);
+        if (i == NUM_DGRAMS - 2)
+            OKF(pending_replies(s) == 0, ("replies are queued"));
+    }
+    OKF(bad == 0, ("%d datagrams garbled or out of order", bad));
+#ifdef HAVE_RECVMMSG
+    OKF(pending == NUM_DGRAMS - 1, ("datagrams pending %d times", pending));
+#endif
+    OKF(!(t->flags & NETSNMP_TRANSPORT_FLAG_RECV_PENDING),
+        ("batch consumed"));
+    select(0, NULL, NULL, NULL, &tv);
+    i = pending_replies(s);
+    OKF(i == NUM_DGRAMS, ("%d of %d replies sent", i, NUM_DGRAMS));
+
+    /* A single datagram is answered right away. */
+    sendto(s, "ping", 4, 0, (struct sockaddr *)&sin, sizeof(sin));
+    select(0, NULL, NULL, NULL, &tv);
+    opaque = NULL;
+    len = netsnmp_transport_recv(t, buf, sizeof(buf), &opaque, &olength);
+    OKF(len == 4, ("single datagram (%d bytes)", len));
+    netsnmp_transport_send(t, buf, len, &opaque, &olength);
+    SNMP_FREE(opaque);
+    select(0, NULL, NULL, NULL, &tv);
+    OKF(pending_replies(s) == 1, ("reply sent"));
+
+    close(s);
+    netsnmp_transport_free(t);
+
+    if (__did_plan == 0)
+        PLAN(__test_counter);
+    return 0;
+}
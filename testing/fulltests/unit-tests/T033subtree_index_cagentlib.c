@@ -0,0 +1,131 @@
+/* HEADER Testing the registry lookup index */
+
+#define NUM_REGS   2000
+#define NUM_PROBES 20000
+
+static const char *contexts[] = { "", "bench" };
+static oid      base[] = { 1, 3, 6, 1, 4, 1, 8072, 9999 };
+oid             name[MAX_OID_LEN];
+size_t          len;
+unsigned int    seed = 1;
+struct timeval  start;
+long            linear_us = 0, indexed_us = 0;
+int             c, i, bad, res;
+netsnmp_subtree *ref, *got;
+
+init_snmp("snmp");
+
+/*
+ * Register one subtree per "row" in two contexts, plus a few prefixes
+ * that overlap (and split) the rows below them.
+ */
+for (c = 0; c < 2; c++) {
+    res = MIB_REGISTERED_OK;
+    for (i = 0; i < NUM_REGS && res == MIB_REGISTERED_OK; i++) {
+        memcpy(name, base, sizeof(base));
+        name[8] = i / 50;
+        name[9] = (i % 50) * 3;
+        res = netsnmp_register_null_context(snmp_duplicate_objid(name, 10),
+                                            10, contexts[c]);
+    }
+    for (i = 0; i < NUM_REGS / 50 && res == MIB_REGISTERED_OK; i += 7) {
+        memcpy(name, base, sizeof(base));
+        name[8] = i;
+        res = netsnmp_register_null_context(snmp_duplicate_objid(name, 9),
+                                            9, contexts[c]);
+    }
+    OKF(res == MIB_REGISTERED_OK, ("registrations in context \"%s\"",
+                                   contexts[c]));
+}
+
+netsnmp_set_lookup_cache_size(-1);
+
+/*
+ * Every lookup through the index must give the same answer as a walk of
+ * the subtree list.
+ */
+#define NEXT_PROBE() do {                                       \
+    seed = seed * 1103515245 + 12345;                           \
+    memcpy(name, base, sizeof(base));                           \
+    name[8] = (seed >> 8) % (NUM_REGS / 50 + 2);                \
+    name[9] = (seed >> 16) % 160;                               \
+    len = 8 + (seed >> 4) % 4;                                  \
+    if (len > 10)                                               \
+        name[10] = seed % 3;                                    \
+    if ((seed & 0x3f) == 0)                                     \
+        name[(seed >> 6) % 8]++;                                \
+} while (0)
+
+for (c = 0; c < 2; c++) {
+    bad = 0;
+    for (i = 0; i < NUM_PROBES; i++) {
+        NEXT_PROBE();
+        ref = netsnmp_subtree_find_prev(name, len,
+                                        netsnmp_subtree_find_first(contexts[c]),
+                                        contexts[c]);
+        got = netsnmp_subtree_find_prev(name, len, NULL, contexts[c]);
+        if (ref != got)
+            bad++;
+        ref = netsnmp_subtree_find_next(name, len,
+                                        netsnmp_subtree_find_first(contexts[c]),
+                                        contexts[c]);
+        got = netsnmp_subtree_find_next(name, len, NULL, contexts[c]);
+        if (ref != got)
+            bad++;
+    }
+    OKF(bad == 0, ("%d of %d lookups in context \"%s\" differ", bad,
+                   2 * NUM_PROBES, contexts[c]));
+}
+
+/* Lookups still match after unregistering half of the rows. */
+for (i = 0; i < NUM_REGS; i += 2) {
+    memcpy(name, base, sizeof(base));
+    name[8] = i / 50;
+    name[9] = (i % 50) * 3;
+    unregister_mib_context(name, 10, 0, 0, 0, "bench");
+}
+bad = 0;
+for (i = 0; i < NUM_PROBES; i++) {
+    NEXT_PROBE();
+    ref = netsnmp_subtree_find_prev(name, len,
+                                    netsnmp_subtree_find_first("bench"),
+                                    "bench");
+    got = netsnmp_subtree_find_prev(name, len, NULL, "bench");
+    if (ref != got)
+        bad++;
+}
+OKF(bad == 0, ("%d of %d lookups differ after unregistration", bad,
+               NUM_PROBES));
+
+memcpy(name, base, sizeof(base));
+name[8] = 1;
+name[9] = 0;
+got = netsnmp_subtree_find(name, 10, NULL, "bench");
+OKF(got == NULL || got->namelen != 10,
+    ("unregistered row is not found"));
+name[9] = 3;
+got = netsnmp_subtree_find(name, 10, NULL, "bench");
+OKF(got && got->namelen == 10 &&
+    snmp_oid_compare(got->name_a, got->namelen, name, 10) == 0,
+    ("remaining row is found"));
+OK(netsnmp_subtree_find_prev(base, 1, NULL, "no-such-context") == NULL,
+   "unknown context");
+
+seed = 1;
+netsnmp_get_monotonic_clock(&start);
+for (i = 0; i < NUM_PROBES; i++) {
+    NEXT_PROBE();
+    netsnmp_subtree_find_prev(name, len, netsnmp_subtree_find_first(""), "");
+}
+linear_us = test_elapsed_us(&start);
+seed = 1;
+netsnmp_get_monotonic_clock(&start);
+for (i = 0; i < NUM_PROBES; i++) {
+    NEXT_PROBE();
+    netsnmp_subtree_find_prev(name, len, NULL, "");
+}
+indexed_us = test_elapsed_us(&start);
+printf("# %d lookups: list walk %ld us, index %ld us\n", NUM_PROBES,
+       linear_us, indexed_us);
+
+snmp_shutdown("snmp");
@@ -0,0 +1,155 @@
+/*
+ * HEADER Testing the USM user lookup index
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/snmpusm.h>
+#include <net-snmp/library/testing.h>
+
+#define NUM_USERS  5000
+#define NUM_PROBES 20000
+
+static struct usmUser *
+new_user(const u_char *engineID, size_t engineIDLen, const char *name)
+{
+    struct usmUser *user = usm_create_user();
+
+    if (user == NULL)
+        return NULL;
+    user->engineID = netsnmp_memdup(engineID, engineIDLen);
+    user->engineIDLen = engineIDLen;
+    user->name = strdup(name);
+    user->secName = strdup(name);
+    return user;
+}
+
+/* The reference result: a walk of the sorted user list. */
+static struct usmUser *
+walk_list(const u_char *engineID, size_t engineIDLen, const char *name)
+{
+    struct usmUser *user;
+
+    for (user = usm_get_userList(); user; user = user->next)
+        if (user->name && strcmp(user->name, name) == 0 &&
+            user->engineIDLen == engineIDLen &&
+            memcmp(user->engineID, engineID, engineIDLen) == 0)
+            return user;
+    return NULL;
+}
+
+static int
+list_is_sorted(void)
+{
+    struct usmUser *prev = NULL, *user;
+
+    for (user = usm_get_userList(); user; prev = user, user = user->next) {
+        if (user->prev != prev)
+            return 0;
+        if (prev == NULL)
+            continue;
+        if (prev->engineIDLen != user->engineIDLen) {
+            if (prev->engineIDLen > user->engineIDLen)
+                return 0;
+        } else if (memcmp(prev->engineID, user->engineID,
+                          user->engineIDLen) != 0) {
+            if (memcmp(prev->engineID, user->engineID,
+                       user->engineIDLen) > 0)
+                return 0;
+        } else if (strlen(prev->name) > strlen(user->name) ||
+                   (strlen(prev->name) == strlen(user->name) &&
+                    strcmp(prev->name, user->name) >= 0)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+    u_char          engineIDs[3][5] = {
+        { 0x80, 0, 0x1f, 0x88, 1 },
+        { 0x80, 0, 0x1f, 0x88, 2 },
+        { 0x80, 0, 0x1f, 0x88, 3 },
+    };
+    struct usmUser *user, *ref, *replaced;
+    unsigned int    seed = 1;
+    struct timeval  start;
+    long            linear_us, indexed_us;
+    char            name[32];
+    int             i, e, bad, count;
+
+    for (i = 0; i < NUM_USERS; i++) {
+        snprintf(name, sizeof(name), "user%d", (i * 7919) % NUM_USERS);
+        user = new_user(engineIDs[i % 3], i % 3 == 2 ? 4 : 5, name);
+        if (user == NULL || usm_add_user(user) == NULL)
+            break;
+    }
+    OKF(i == NUM_USERS, ("%d users added", i));
+    OKF(list_is_sorted(), ("user list is sorted"));
+
+    /* Lookups find the same users as a walk of the list. */
+    for (i = 0, bad = 0; i < NUM_PROBES; i++) {
+        seed = seed * 1103515245 + 12345;
+        e = (seed >> 8) % 3;
+        snprintf(name, sizeof(name), "user%u", (seed >> 12) % (NUM_USERS + 50));
+        ref = walk_list(engineIDs[e], e == 2 ? 4 : 5, name);
+        user = usm_get_user(engineIDs[e], e == 2 ? 4 : 5, name);
+        if (user != ref)
+            bad++;
+    }
+    OKF(bad == 0, ("%d of %d lookups differ", bad, NUM_PROBES));
+
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < 1000; i++) {
+        snprintf(name, sizeof(name), "user%d", i);
+        walk_list(engineIDs[i % 3], i % 3 == 2 ? 4 : 5, name);
+    }
+    linear_us = test_elapsed_us(&start);
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < 1000; i++) {
+        snprintf(name, sizeof(name), "user%d", i);
+        usm_get_user(engineIDs[i % 3], i % 3 == 2 ? 4 : 5, name);
+    }
+    indexed_us = test_elapsed_us(&start);
+    printf("# 1000 lookups among %d users: list walk %ld us, index %ld us\n",
+           NUM_USERS, linear_us, indexed_us);
+
+    OKF(usm_get_user(engineIDs[2], 5, "user2") == NULL,
+        ("engineID length is part of the key"));
+    OKF(usm_get_user2(engineIDs[0], 5, "user1\0x", 7) == NULL,
+        ("name length is part of the key"));
+
+    /* Adding an existing user replaces it, in place in the list. */
+    replaced = new_user(engineIDs[0], 5, "user0");
+    usm_add_user(replaced);
+    OKF(usm_get_user(engineIDs[0], 5, "user0") == replaced,
+        ("replacement is found"));
+    for (user = usm_get_userList(), count = 0; user; user = user->next)
+        count++;
+    OKF(count == NUM_USERS, ("%d users listed after replacement", count));
+    OKF(list_is_sorted(), ("user list is still sorted"));
+
+    /* Removed users are no longer found. */
+    for (i = 0; i < NUM_USERS; i += 2) {
+        snprintf(name, sizeof(name), "user%d", i);
+        user = usm_get_user(engineIDs[0], 5, name);
+        if (user) {
+            usm_remove_user(user);
+            usm_free_user(user);
+        }
+    }
+    for (i = 0, bad = 0; i < NUM_USERS; i++) {
+        snprintf(name, sizeof(name), "user%d", i);
+        user = usm_get_user(engineIDs[0], 5, name);
+        if (user != walk_list(engineIDs[0], 5, name))
+            bad++;
+    }
+    OKF(bad == 0, ("%d lookups differ after removal", bad));
+    OKF(list_is_sorted(), ("user list is sorted after removal"));
+
+    if (__did_plan == 0)
+        PLAN(__test_counter);
+    return 0;
+}
@@ -0,0 +1,204 @@
+/*
+ * HEADER Testing PDU arenas
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/testing.h>
+
+#define NUM_VARS  150
+#define NUM_BENCH 2000
+
+static oid      ifEntry[] = { 1, 3, 6, 1, 2, 1, 2, 2, 1 };
+static u_char   packet[65536];
+
+/* A GETBULK response walking a few columns of a wide table. */
+static netsnmp_pdu *
+make_response(void)
+{
+    netsnmp_pdu    *pdu = snmp_pdu_create(SNMP_MSG_RESPONSE);
+    oid             name[MAX_OID_LEN];
+    u_char          str[200];
+    long            l;
+    struct counter64 c64;
+    int             i;
+
+    memcpy(name, ifEntry, sizeof(ifEntry));
+    memset(str, 'x', sizeof(str));
+    for (i = 0; i < NUM_VARS; i++) {
+        name[9] = i % 7 + 1;
+        name[10] = i / 7 + 1;
+        l = i * 1000;
+        str[0] = i;
+        c64.high = i;
+        c64.low = 0xfffff000 + i;
+        switch (i % 7) {
+        case 0:
+            snmp_pdu_add_variable(pdu, name, 11, ASN_INTEGER, &l, sizeof(l));
+            break;
+        case 1:
+            snmp_pdu_add_variable(pdu, name, 11, ASN_OCTET_STR, str, 12);
+            break;
+        case 2:
+            snmp_pdu_add_variable(pdu, name, 11, ASN_OCTET_STR, str,
+                                  60 + i % 100);
+            break;
+        case 3:
+            snmp_pdu_add_variable(pdu, name, 11, ASN_OBJECT_ID, name,
+                                  11 * sizeof(oid));
+            break;
+        case 4:
+            snmp_pdu_add_variable(pdu, name, 11, ASN_COUNTER64, &c64,
+                                  sizeof(c64));
+            break;
+        case 5:
+            snmp_pdu_add_variable(pdu, name, 11, ASN_IPADDRESS, str, 4);
+            break;
+        default:
+            snmp_pdu_add_variable(pdu, name, 11, ASN_GAUGE, &l, sizeof(l));
+            break;
+        }
+    }
+    return pdu;
+}
+
+static netsnmp_pdu *
+parse(const u_char *data, size_t len, int arena)
+{
+    netsnmp_pdu    *pdu = SNMP_MALLOC_TYPEDEF(netsnmp_pdu);
+
+    if (pdu == NULL)
+        return NULL;
+    if (arena && netsnmp_pdu_arena_enable(pdu) != SNMPERR_SUCCESS) {
+        free(pdu);
+        return NULL;
+    }
+    if (snmp_pdu_parse(pdu, NETSNMP_REMOVE_CONST(u_char *, data), &len)) {
+        snmp_free_pdu(pdu);
+        return NULL;
+    }
+    return pdu;
+}
+
+static int
+same_vars(const netsnmp_variable_list *a, const netsnmp_variable_list *b)
+{
+    for (; a && b; a = a->next_variable, b = b->next_variable) {
+        if (a->type != b->type || a->val_len != b->val_len ||
+            snmp_oid_compare(a->name, a->name_length,
+                             b->name, b->name_length) != 0)
+            return 0;
+        if (a->val_len && memcmp(a->val.string, b->val.string, a->val_len))
+            return 0;
+    }
+    return a == NULL && b == NULL;
+}
+
+/* The allocations a heap parse makes: one per varbind, one per big value. */
+static int
+heap_allocations(const netsnmp_pdu *pdu)
+{
+    const netsnmp_variable_list *vp;
+    int             n = 0;
+
+    for (vp = pdu->variables; vp; vp = vp->next_variable)
+        n += 1 + (vp->val.string && vp->val.string != vp->buf);
+    return n;
+}
+
+int
+main(int argc, char *argv[])
+{
+    netsnmp_pdu    *orig, *heap, *arena, *clone;
+    netsnmp_variable_list *vp, *big = NULL;
+    u_char         *end;
+    size_t          len, used;
+    u_int           chunks;
+    u_char          value[300];
+    struct timeval  start;
+    long            heap_us, arena_us;
+    int             i, count, heap_allocs;
+
+    orig = make_response();
+#ifdef NETSNMP_USE_REVERSE_ASNENCODING
+    {
+        u_char         *buf = NULL;
+        size_t          buf_len = 0, offset = 0;
+
+        end = NULL;
+        if (snmp_pdu_realloc_rbuild(&buf, &buf_len, &offset, orig) &&
+            offset <= sizeof(packet)) {
+            memcpy(packet, buf + buf_len - offset, offset);
+            end = packet + offset;
+        }
+        free(buf);
+    }
+#else
+    len = sizeof(packet);
+    end = snmp_pdu_build(orig, packet, &len);
+#endif
+    OKF(end != NULL, ("response encoded"));
+    if (end == NULL)
+        return 1;
+    len = end - packet;
+
+    heap = parse(packet, len, 0);
+    arena = parse(packet, len, 1);
+    OKF(heap && arena, ("response parsed"));
+    if (!heap || !arena)
+        return 1;
+    OKF(heap->arena == NULL, ("no arena unless asked for"));
+    OKF(same_vars(orig->variables, heap->variables), ("heap parse"));
+    OKF(same_vars(orig->variables, arena->variables), ("arena parse"));
+
+    for (vp = arena->variables, count = 0; vp; vp = vp->next_variable) {
+        if (!(vp->flags & NETSNMP_VARBIND_ARENA_STRUCT))
+            count++;
+        if (vp->flags & NETSNMP_VARBIND_ARENA_VALUE)
+            big = vp;
+    }
+    OKF(count == 0, ("%d varbinds outside the arena", count));
+    OKF(big != NULL, ("large values in the arena"));
+    netsnmp_pdu_arena_get_stats(arena, &chunks, &used);
+    OKF(chunks > 0 && chunks <= 8, ("%u arena chunks", chunks));
+
+    /* Varbinds in an arena can still be modified, cloned and freed singly. */
+    memset(value, 'y', sizeof(value));
+    OKF(snmp_set_var_value(big, value, sizeof(value)) == 0 &&
+        big->val_len == sizeof(value) &&
+        !(big->flags & NETSNMP_VARBIND_ARENA_VALUE),
+        ("arena value replaced"));
+    clone = snmp_clone_pdu(arena);
+    OKF(clone && clone->arena == NULL &&
+        same_vars(arena->variables, clone->variables), ("arena PDU cloned"));
+    snmp_free_pdu(clone);
+    vp = snmp_clone_varbind(arena->variables);
+    OKF(vp && vp->flags == 0 && same_vars(arena->variables, vp),
+        ("arena varbinds cloned"));
+    snmp_free_varbind(vp);
+    vp = arena->variables->next_variable;
+    arena->variables->next_variable = vp->next_variable;
+    snmp_free_var(vp);
+    snmp_free_pdu(arena);
+    heap_allocs = heap_allocations(heap);
+    snmp_free_pdu(heap);
+
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < NUM_BENCH; i++)
+        snmp_free_pdu(parse(packet, len, 0));
+    heap_us = test_elapsed_us(&start);
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < NUM_BENCH; i++)
+        snmp_free_pdu(parse(packet, len, 1));
+    arena_us = test_elapsed_us(&start);
+    printf("# %d varbinds: heap parse %d allocations, arena parse %u "
+           "(%lu bytes)\n", NUM_VARS, heap_allocs, chunks,
+           (unsigned long) used);
+    printf("# %d parses + frees: heap %ld us, arena %ld us\n", NUM_BENCH,
+           heap_us, arena_us);
+    snmp_free_pdu(orig);
+
+    if (__did_plan == 0)
+        PLAN(__test_counter);
+    return 0;
+}
@@ -0,0 +1,187 @@
+/*
+ * HEADER Testing MIB name and OID lookups over a large MIB tree
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/testing.h>
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+
+#define NUM_GROUPS 2000
+#define NUM_LEAVES 24
+
+struct node_oid {
+    struct tree    *tp;
+    oid             name[MAX_OID_LEN];
+    size_t          len;
+};
+
+static struct node_oid *nodes;
+static int      num_nodes, max_nodes;
+
+/* One module with a few long sibling lists, written in reverse order. */
+static int
+write_big_mib(const char *dir)
+{
+    char            path[PATH_MAX];
+    FILE           *f;
+    int             g, l;
+
+    snprintf(path, sizeof(path), "%s/BIG-TEST-MIB.txt", dir);
+    f = fopen(path, "w");
+    if (f == NULL)
+        return -1;
+    fprintf(f, "BIG-TEST-MIB DEFINITIONS ::= BEGIN\n"
+            "IMPORTS enterprises FROM SNMPv2-SMI;\n"
+            "bigTest OBJECT IDENTIFIER ::= { enterprises 99999 }\n");
+    for (g = NUM_GROUPS; g > 0; g--) {
+        fprintf(f, "bigGroup%d OBJECT IDENTIFIER ::= { bigTest %d }\n", g, g);
+        for (l = NUM_LEAVES; l > 0; l--)
+            fprintf(f, "bigLeaf%dx%d OBJECT IDENTIFIER ::= { bigGroup%d %d }\n",
+                    g, l, g, l);
+    }
+    fprintf(f, "END\n");
+    return fclose(f);
+}
+
+/* The reference result: get_tree() as a walk of the sibling lists. */
+static struct tree *
+walk_tree(const oid *name, size_t len, struct tree *subtree)
+{
+    struct tree    *child;
+
+    for (; subtree; subtree = subtree->next_peer)
+        if (subtree->subid == *name)
+            break;
+    if (subtree == NULL)
+        return NULL;
+    while (subtree->next_peer && subtree->next_peer->subid == *name)
+        subtree = subtree->next_peer;
+    if (len > 1 && (child = walk_tree(name + 1, len - 1,
+                                      subtree->child_list)) != NULL)
+        return child;
+    return subtree;
+}
+
+static void
+collect(struct tree *tp, oid *name, size_t len)
+{
+    for (; tp; tp = tp->next_peer) {
+        name[len] = tp->subid;
+        if (num_nodes == max_nodes) {
+            max_nodes = max_nodes ? 2 * max_nodes : 1024;
+            nodes = realloc(nodes, max_nodes * sizeof(*nodes));
+        }
+        nodes[num_nodes].tp = tp;
+        memcpy(nodes[num_nodes].name, name, (len + 1) * sizeof(oid));
+        nodes[num_nodes].len = len + 1;
+        num_nodes++;
+        if (tp->child_list && len + 1 < MAX_OID_LEN)
+            collect(tp->child_list, name, len + 1);
+    }
+}
+
+int
+main(int argc, char **argv)
+{
+    char            dir[PATH_MAX], path[PATH_MAX], mibdirs[2 * PATH_MAX];
+    char            buf[SPRINT_MAX_LEN], module[256];
+    const char     *srcmibs = getenv("MIBDIRS");
+    oid             name[MAX_OID_LEN];
+    size_t          len;
+    struct timeval  start;
+    long            load_us, name_us, oid_us, walk_us;
+    struct tree    *tp;
+    int             i, bad, found, big;
+
+    snprintf(dir, sizeof(dir), "/tmp/T036mib_lookup-%d", (int) getpid());
+    OKF(mkdir(dir, 0700) == 0 && write_big_mib(dir) == 0,
+        ("test MIB written to %s", dir));
+    snprintf(mibdirs, sizeof(mibdirs), "%s:%s",
+             srcmibs ? srcmibs : NETSNMP_DEFAULT_MIBDIRS, dir);
+    netsnmp_ds_set_string(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_MIBDIRS,
+                          mibdirs);
+    setenv("MIBS", "ALL", 1);
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, NETSNMP_DS_LIB_QUICK_PRINT,
+                           1);
+
+    netsnmp_get_monotonic_clock(&start);
+    init_snmp("T036");
+    load_us = test_elapsed_us(&start);
+
+    collect(get_tree_head(), name, 0);
+    for (i = 0, big = 0; i < num_nodes; i++)
+        if (strncmp(nodes[i].tp->label, "bigLeaf", 7) == 0)
+            big++;
+    OKF(big == NUM_GROUPS * NUM_LEAVES, ("%d of %d test MIB leaves loaded",
+                                         big, NUM_GROUPS * NUM_LEAVES));
+
+    /* OID -> tree node, as a walk of the sibling lists would find it. */
+    for (i = 0, bad = 0; i < num_nodes; i++)
+        if (get_tree(nodes[i].name, nodes[i].len, get_tree_head()) !=
+            walk_tree(nodes[i].name, nodes[i].len, get_tree_head()))
+            bad++;
+    OKF(bad == 0, ("%d of %d OID lookups differ", bad, num_nodes));
+
+    /* Label -> tree node, within the defining module. */
+    for (i = 0, bad = 0; i < num_nodes; i++) {
+        tp = find_tree_node(nodes[i].tp->label, nodes[i].tp->modid);
+        if (tp == NULL || strcmp(tp->label, nodes[i].tp->label) != 0)
+            bad++;
+    }
+    OKF(bad == 0, ("%d of %d label lookups failed", bad, num_nodes));
+
+    tp = find_tree_node("bigLeaf1234x17", -1);
+    OKF(tp && tp->subid == 17 && tp->parent &&
+        strcmp(tp->parent->label, "bigGroup1234") == 0,
+        ("bigLeaf1234x17 is { bigGroup1234 17 }"));
+    OKF(find_tree_node("bigLeaf1234x25", -1) == NULL,
+        ("bigLeaf1234x25 is not defined"));
+
+    /* OID -> name -> OID round trips through the test MIB. */
+    for (i = 0, bad = 0, found = 0; i < num_nodes; i++) {
+        tp = nodes[i].tp;
+        if (strncmp(tp->label, "big", 3) != 0)
+            continue;
+        found++;
+        snprint_objid(buf, sizeof(buf), nodes[i].name, nodes[i].len);
+        len = MAX_OID_LEN;
+        if (!read_objid(buf, name, &len) ||
+            snmp_oid_compare(name, len, nodes[i].name, nodes[i].len) != 0)
+            bad++;
+    }
+    OKF(found > 0 && bad == 0, ("%d of %d round trips failed", bad, found));
+
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < num_nodes; i++) {
+        tp = nodes[i].tp;
+        snprintf(buf, sizeof(buf), "%s::%s",
+                 module_name(tp->modid, module), tp->label);
+        len = MAX_OID_LEN;
+        read_objid(buf, name, &len);
+    }
+    name_us = test_elapsed_us(&start);
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < num_nodes; i++)
+        snprint_objid(buf, sizeof(buf), nodes[i].name, nodes[i].len);
+    oid_us = test_elapsed_us(&start);
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < num_nodes; i++)
+        get_tree(nodes[i].name, nodes[i].len, get_tree_head());
+    walk_us = test_elapsed_us(&start);
+    printf("# %d MIB nodes: load %ld us, read_objid %ld us, "
+           "snprint_objid %ld us, get_tree %ld us\n",
+           num_nodes, load_us, name_us, oid_us, walk_us);
+
+    snmp_shutdown("T036");
+    snprintf(path, sizeof(path), "%s/BIG-TEST-MIB.txt", dir);
+    unlink(path);
+    rmdir(dir);
+    free(nodes);
+
+    if (__did_plan == 0)
+        PLAN(__test_counter);
+    return 0;
+}
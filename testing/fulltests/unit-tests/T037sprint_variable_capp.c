@@ -0,0 +1,356 @@
+/*
+ * HEADER Testing varbind formatting over a recorded walk
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/testing.h>
+
+#define NUM_ROWS  200
+#define NUM_BENCH 20
+
+/*
+ * The -O option strings to format the walk with, and a checksum of the
+ * output each of them produced before the formatting fast paths.
+ */
+static const struct {
+    const char     *options;
+    unsigned int    checksum;
+} formats[] = {
+    { "", 0x9b23ab54 },
+    { "n", 0x57a793a3 },
+    { "f", 0xf3ff24c9 },
+    { "s", 0x1e2a03e9 },
+    { "S", 0x9b23ab54 },
+    { "u", 0xeb7eccfd },
+    { "q", 0xaf20d141 },
+    { "Q", 0x76b74a44 },
+    { "v", 0x7ae4643c },
+    { "e", 0x531ba000 },
+    { "b", 0xae4aa14a },
+    { "x", 0x0b52f562 },
+    { "a", 0x7b79a765 },
+    { "T", 0xd34d4870 },
+    { "t", 0xc210ff18 },
+    { "U", 0x22f279f4 },
+    { "X", 0xa3b82c32 },
+    { "E", 0xc374ca9c },
+    { "0x", 0x92b2c600 },
+    { "nq", 0xb7f233ee },
+    { "fe", 0xfc59af95 },
+    { "sX", 0xe5483d3f },
+    { "sqU", 0x84a22c78 },
+    { "nvet", 0xaf920270 },
+    { "bn", 0x57a793a3 },
+    { "XE", 0xa3b82c32 },
+};
+
+static void
+add(netsnmp_variable_list **vars, const char *name, const oid *index,
+    size_t index_len, u_char type, const void *value, size_t len)
+{
+    oid             objid[MAX_OID_LEN];
+    size_t          objid_len = MAX_OID_LEN;
+
+    if (!read_objid(name, objid, &objid_len) ||
+        objid_len + index_len > MAX_OID_LEN)
+        return;
+    memcpy(objid + objid_len, index, index_len * sizeof(oid));
+    snmp_varlist_add_variable(vars, objid, objid_len + index_len, type,
+                              value, len);
+}
+
+static int
+compare_vars(const void *p1, const void *p2)
+{
+    const netsnmp_variable_list *v1 = *(netsnmp_variable_list * const *) p1;
+    const netsnmp_variable_list *v2 = *(netsnmp_variable_list * const *) p2;
+
+    return snmp_oid_compare(v1->name, v1->name_length, v2->name,
+                            v2->name_length);
+}
+
+/* Put the varbinds into the order a walk returns them in. */
+static netsnmp_variable_list *
+sort_walk(netsnmp_variable_list *vars)
+{
+    netsnmp_variable_list **array, *vp;
+    int             count, i;
+
+    for (vp = vars, count = 0; vp; vp = vp->next_variable)
+        count++;
+    array = malloc(count * sizeof(*array));
+    if (array == NULL)
+        return vars;
+    for (vp = vars, i = 0; vp; vp = vp->next_variable)
+        array[i++] = vp;
+    qsort(array, count, sizeof(*array), compare_vars);
+    for (i = 0; i < count; i++)
+        array[i]->next_variable = i + 1 < count ? array[i + 1] : NULL;
+    vars = array[0];
+    free(array);
+    return vars;
+}
+
+/*
+ * A walk over a few common tables, the way an agent would return it:
+ * integers, enumerations, strings with and without display hints,
+ * counters, time ticks, addresses, object identifiers, InetAddress and
+ * string indexes and exceptions.
+ */
+static netsnmp_variable_list *
+make_walk(void)
+{
+    netsnmp_variable_list *vars = NULL;
+    oid             index[32], prefix[32];
+    size_t          prefix_len;
+    char            str[64];
+    u_char          bytes[16];
+    long            l;
+    u_long          ul;
+    struct counter64 c64;
+    int             i, j;
+
+    index[0] = 0;
+    prefix_len = 32;
+    read_objid("NET-SNMP-MIB::netSnmpAgentOIDs.10", prefix, &prefix_len);
+    add(&vars, "SNMPv2-MIB::sysObjectID", index, 1, ASN_OBJECT_ID,
+        prefix, prefix_len * sizeof(oid));
+    ul = 123456789;
+    add(&vars, "SNMPv2-MIB::sysUpTime", index, 1, ASN_TIMETICKS, &ul,
+        sizeof(ul));
+    memcpy(bytes, "\x80\x00\x1f\x88\x80\x12\x34\x56\x78\x9a\xbc\xde", 12);
+    add(&vars, "SNMP-FRAMEWORK-MIB::snmpEngineID", index, 1,
+        ASN_OCTET_STR, bytes, 12);
+
+    for (i = 1; i <= NUM_ROWS; i++) {
+        index[0] = i;
+        l = i;
+        add(&vars, "IF-MIB::ifIndex", index, 1, ASN_INTEGER, &l, sizeof(l));
+        snprintf(str, sizeof(str), "eth%d", i - 1);
+        add(&vars, "IF-MIB::ifDescr", index, 1, ASN_OCTET_STR, str,
+            strlen(str));
+        l = i == 1 ? 24 : 6;
+        add(&vars, "IF-MIB::ifType", index, 1, ASN_INTEGER, &l, sizeof(l));
+        l = 1500;
+        add(&vars, "IF-MIB::ifMtu", index, 1, ASN_INTEGER, &l, sizeof(l));
+        ul = 1000000000;
+        add(&vars, "IF-MIB::ifSpeed", index, 1, ASN_GAUGE, &ul, sizeof(ul));
+        for (j = 0; j < 6; j++)
+            bytes[j] = (u_char) (i * 37 + j * 11);
+        add(&vars, "IF-MIB::ifPhysAddress", index, 1, ASN_OCTET_STR, bytes,
+            i == 1 ? 0 : 6);
+        l = 1 + i % 2;
+        add(&vars, "IF-MIB::ifAdminStatus", index, 1, ASN_INTEGER, &l,
+            sizeof(l));
+        ul = 4242 * i;
+        add(&vars, "IF-MIB::ifLastChange", index, 1, ASN_TIMETICKS, &ul,
+            sizeof(ul));
+        ul = 3000000000U + 7 * i;
+        add(&vars, "IF-MIB::ifInOctets", index, 1, ASN_COUNTER, &ul,
+            sizeof(ul));
+        c64.high = i;
+        c64.low = 4000000000U - i;
+        add(&vars, "IF-MIB::ifHCInOctets", index, 1, ASN_COUNTER64, &c64,
+            sizeof(c64));
+        add(&vars, "IF-MIB::ifAlias", index, 1, ASN_OCTET_STR, "", 0);
+
+        /* ipAddressTable: InetAddressType, InetAddress */
+        index[0] = 1;
+        index[1] = 4;
+        index[2] = 10;
+        index[3] = i / 256;
+        index[4] = i % 256;
+        index[5] = 1;
+        l = i;
+        add(&vars, "IP-MIB::ipAddressIfIndex", index, 6, ASN_INTEGER, &l,
+            sizeof(l));
+        prefix_len = 32;
+        read_objid("IP-MIB::ipAddressPrefixOrigin", prefix, &prefix_len);
+        prefix[prefix_len++] = i;
+        prefix[prefix_len++] = 1;
+        prefix[prefix_len++] = 4;
+        prefix[prefix_len++] = 10;
+        prefix[prefix_len++] = 0;
+        prefix[prefix_len++] = 0;
+        prefix[prefix_len++] = 0;
+        prefix[prefix_len++] = 8;
+        add(&vars, "IP-MIB::ipAddressPrefix", index, 6, ASN_OBJECT_ID,
+            prefix, prefix_len * sizeof(oid));
+        ul = 100 * i;
+        add(&vars, "IP-MIB::ipAddressCreated", index, 6, ASN_TIMETICKS, &ul,
+            sizeof(ul));
+        /* ... and the same for IPv6 */
+        index[0] = 2;
+        index[1] = 16;
+        for (j = 0; j < 16; j++)
+            index[2 + j] = j == 0 ? 0xfe : j == 1 ? 0x80 : j == 15 ? i % 256
+                : 0;
+        l = 3;
+        add(&vars, "IP-MIB::ipAddressType", index, 18, ASN_INTEGER, &l,
+            sizeof(l));
+
+        /* ipAddrTable: IpAddress index and value */
+        bytes[0] = 10;
+        bytes[1] = 0;
+        bytes[2] = i / 256;
+        bytes[3] = i % 256;
+        for (j = 0; j < 4; j++)
+            index[j] = bytes[j];
+        add(&vars, "IP-MIB::ipAdEntAddr", index, 4, ASN_IPADDRESS, bytes, 4);
+
+        /* tcpConnectionTable: two InetAddress/port pairs */
+        index[0] = 1;
+        index[1] = 4;
+        index[2] = 127;
+        index[3] = 0;
+        index[4] = 0;
+        index[5] = 1;
+        index[6] = 161;
+        index[7] = 1;
+        index[8] = 4;
+        index[9] = 127;
+        index[10] = 0;
+        index[11] = 0;
+        index[12] = 1;
+        index[13] = 30000 + i;
+        l = 5;
+        add(&vars, "TCP-MIB::tcpConnectionState", index, 14, ASN_INTEGER,
+            &l, sizeof(l));
+        ul = 1000 + i;
+        add(&vars, "TCP-MIB::tcpConnectionProcess", index, 14, ASN_UNSIGNED,
+            &ul, sizeof(ul));
+
+        /* hrSWRunTable */
+        index[0] = 1000 + i;
+        snprintf(str, sizeof(str), "daemon%d", i);
+        add(&vars, "HOST-RESOURCES-MIB::hrSWRunName", index, 1,
+            ASN_OCTET_STR, str, strlen(str));
+        snprintf(str, sizeof(str), "/usr/sbin/daemon%d \"-f\"", i);
+        add(&vars, "HOST-RESOURCES-MIB::hrSWRunPath", index, 1,
+            ASN_OCTET_STR, str, strlen(str));
+        l = 4;
+        add(&vars, "HOST-RESOURCES-MIB::hrSWRunType", index, 1, ASN_INTEGER,
+            &l, sizeof(l));
+        l = -i;
+        add(&vars, "HOST-RESOURCES-MIB::hrSWRunPerfMem", index, 1,
+            ASN_INTEGER, &l, sizeof(l));
+
+        /* vacmAccessTable: string indexes */
+        snprintf(str, sizeof(str), "group%d", i);
+        index[0] = strlen(str);
+        for (j = 0; str[j]; j++)
+            index[1 + j] = (u_char) str[j];
+        index[1 + j] = 0;
+        index[2 + j] = 3;
+        index[3 + j] = 1;
+        add(&vars, "SNMP-VIEW-BASED-ACM-MIB::vacmAccessReadViewName", index,
+            4 + j, ASN_OCTET_STR, "all", 3);
+
+        /* an enterprise without a MIB */
+        index[0] = i;
+        ul = i;
+        add(&vars, "SNMPv2-SMI::enterprises.99999.1.2", index, 1,
+            ASN_UNSIGNED, &ul, sizeof(ul));
+    }
+
+    index[0] = 1;
+    add(&vars, "SNMPv2-SMI::enterprises.99999.3", index, 1,
+        SNMP_NOSUCHINSTANCE, NULL, 0);
+    add(&vars, "SNMPv2-SMI::enterprises.99999.4", index, 1,
+        SNMP_ENDOFMIBVIEW, NULL, 0);
+    return sort_walk(vars);
+}
+
+static void
+reset_out_options(void)
+{
+    static const int booleans[] = {
+        NETSNMP_DS_LIB_2DIGIT_HEX_OUTPUT, NETSNMP_DS_LIB_DONT_BREAKDOWN_OIDS,
+        NETSNMP_DS_LIB_PRINT_NUMERIC_ENUM, NETSNMP_DS_LIB_ESCAPE_QUOTES,
+        NETSNMP_DS_LIB_QUICK_PRINT, NETSNMP_DS_LIB_QUICKE_PRINT,
+        NETSNMP_DS_LIB_NUMERIC_TIMETICKS, NETSNMP_DS_LIB_PRINT_HEX_TEXT,
+        NETSNMP_DS_LIB_DONT_PRINT_UNITS, NETSNMP_DS_LIB_PRINT_BARE_VALUE,
+        NETSNMP_DS_LIB_EXTENDED_INDEX,
+    };
+    size_t          i;
+
+    for (i = 0; i < sizeof(booleans) / sizeof(booleans[0]); i++)
+        netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID, booleans[i], 0);
+    netsnmp_ds_set_int(NETSNMP_DS_LIBRARY_ID,
+                       NETSNMP_DS_LIB_OID_OUTPUT_FORMAT, 0);
+    netsnmp_ds_set_int(NETSNMP_DS_LIBRARY_ID,
+                       NETSNMP_DS_LIB_STRING_OUTPUT_FORMAT, 0);
+}
+
+/* Format the whole walk; returns a checksum of the output. */
+static unsigned int
+format_walk(const netsnmp_variable_list *vars, char *buf, size_t buf_len,
+            int *count, int verbose)
+{
+    unsigned int    sum = 2166136261U;
+    const netsnmp_variable_list *vp;
+    int             len, i;
+
+    for (vp = vars, *count = 0; vp; vp = vp->next_variable, (*count)++) {
+        len = snprint_variable(buf, buf_len, vp->name, vp->name_length, vp);
+        if (len < 0)
+            len = 0;
+        if (verbose)
+            printf("# %s\n", buf);
+        for (i = 0; i < len; i++)
+            sum = (sum ^ (u_char) buf[i]) * 16777619U;
+        sum = (sum ^ '\n') * 16777619U;
+    }
+    return sum;
+}
+
+int
+main(int argc, char **argv)
+{
+    netsnmp_variable_list *vars;
+    char            buf[4096], options[32];
+    struct timeval  start;
+    unsigned int    sum;
+    long            us;
+    size_t          f;
+    int             count, i, verbose = argc > 1;
+
+    setenv("MIBS", "SNMPv2-MIB:IF-MIB:IP-MIB:TCP-MIB:HOST-RESOURCES-MIB:"
+           "SNMP-FRAMEWORK-MIB:SNMP-VIEW-BASED-ACM-MIB:NET-SNMP-MIB", 1);
+    init_snmp("T037");
+
+    vars = make_walk();
+
+    for (f = 0; f < sizeof(formats) / sizeof(formats[0]); f++) {
+        reset_out_options();
+        strlcpy(options, formats[f].options, sizeof(options));
+        if (*options)
+            snmp_out_toggle_options(options);
+        sum = format_walk(vars, buf, sizeof(buf), &count, verbose);
+        OKF(sum == formats[f].checksum,
+            ("-O%s: checksum %#x of %d varbinds, expected %#x",
+             formats[f].options, sum, count, formats[f].checksum));
+    }
+
+    for (f = 0; f < 2; f++) {
+        reset_out_options();
+        strlcpy(options, formats[f].options, sizeof(options));
+        if (*options)
+            snmp_out_toggle_options(options);
+        netsnmp_get_monotonic_clock(&start);
+        for (i = 0; i < NUM_BENCH; i++)
+            format_walk(vars, buf, sizeof(buf), &count, 0);
+        us = test_elapsed_us(&start);
+        printf("# -O%s: %d varbinds in %ld us, %.0f varbinds/s\n",
+               formats[f].options, NUM_BENCH * count, us,
+               us ? NUM_BENCH * count * 1e6 / us : 0.0);
+    }
+
+    snmp_free_varbind(vars);
+    snmp_shutdown("T037");
+
+    if (__did_plan == 0)
+        PLAN(__test_counter);
+    return 0;
+}
@@ -0,0 +1,175 @@
+/*
+ * HEADER Testing VACM view checks over large view sets
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/vacm.h>
+#include <net-snmp/library/testing.h>
+
+#define NUM_VIEWS   100
+#define NUM_ENTRIES 5000
+#define NUM_PROBES  50000       /* subtree checks */
+#define NUM_CHECKS  10000       /* checks also answered by a scan */
+
+static unsigned int seed = 1;
+
+static unsigned int
+rnd(unsigned int n)
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 8) % n;
+}
+
+/* enterprises.<tenant> followed by a few small sub-identifiers */
+static size_t
+random_oid(oid *name, int max_extra)
+{
+    static const oid enterprises[] = { 1, 3, 6, 1, 4, 1 };
+    size_t          len = OID_LENGTH(enterprises);
+    int             extra = rnd(max_extra + 1);
+
+    memcpy(name, enterprises, sizeof(enterprises));
+    name[len++] = rnd(50);
+    while (extra-- > 0)
+        name[len++] = 1 + rnd(4);
+    return len;
+}
+
+static struct vacm_viewEntry *
+view_head(void)
+{
+    vacm_scanViewInit();
+    return vacm_scanViewNext();
+}
+
+/* Compares the checks with a scan of the view entries for random OIDs. */
+static int
+count_differences(int probes)
+{
+    struct vacm_viewEntry *head = view_head();
+    oid             name[MAX_OID_LEN];
+    size_t          len;
+    char            view[16];
+    int             i, bad = 0;
+
+    for (i = 0; i < probes; i++) {
+        snprintf(view, sizeof(view), "view%u", rnd(NUM_VIEWS + 2));
+        len = random_oid(name, 7);
+        if (vacm_getViewEntry(view, name, len, VACM_MODE_FIND) !=
+            netsnmp_view_get(head, view, name, len, VACM_MODE_FIND))
+            bad++;
+        if (vacm_checkSubtree(view, name, len) !=
+            netsnmp_view_subtree_check(head, view, name, len))
+            bad++;
+    }
+    return bad;
+}
+
+int
+main(int argc, char **argv)
+{
+    struct vacm_viewEntry *vp, *head;
+    oid             name[MAX_OID_LEN];
+    size_t          len;
+    char            view[16];
+    struct timeval  start;
+    long            scan_us, trie_us;
+    int             i, count, bad, results[3];
+
+    for (i = 0, count = 0; i < NUM_ENTRIES; i++) {
+        snprintf(view, sizeof(view), "view%u", rnd(NUM_VIEWS));
+        len = random_oid(name, 4);
+        vp = vacm_createViewEntry(view, name, len);
+        if (vp == NULL)
+            continue;
+        count++;
+        vp->viewType = rnd(3) ? SNMP_VIEW_INCLUDED : SNMP_VIEW_EXCLUDED;
+        vp->viewStatus = SNMP_ROW_ACTIVE;
+        /* a quarter of the entries ignore some sub-identifiers */
+        vp->viewMaskLen = rnd(4) ? 0 : 1 + rnd(2);
+        vp->viewMask[0] = 0xfe | rnd(2);
+        vp->viewMask[1] = 0xff & ~(1 << rnd(8)) & ~(1 << rnd(8));
+    }
+    OKF(count == NUM_ENTRIES, ("%d view entries created", count));
+
+    bad = count_differences(NUM_CHECKS);
+    OKF(bad == 0, ("%d of %d checks differ from a scan", bad, 2 * NUM_CHECKS));
+
+    for (i = 0; i < 3; i++)
+        results[i] = 0;
+    for (i = 0; i < NUM_PROBES; i++) {
+        snprintf(view, sizeof(view), "view%u", rnd(NUM_VIEWS));
+        len = random_oid(name, 3);
+        switch (vacm_checkSubtree(view, name, len)) {
+        case VACM_SUCCESS:         results[0]++; break;
+        case VACM_NOTINVIEW:       results[1]++; break;
+        case VACM_SUBTREE_UNKNOWN: results[2]++; break;
+        }
+    }
+    OKF(results[0] && results[1] && results[2],
+        ("%d included, %d excluded, %d unknown subtrees", results[0],
+         results[1], results[2]));
+
+    /* Entries changed in place, after the change is announced. */
+    head = view_head();
+    for (vp = head, i = 0; vp; vp = vp->next, i++) {
+        if (i % 3 == 0)
+            vp->viewType = vp->viewType == SNMP_VIEW_INCLUDED ?
+                SNMP_VIEW_EXCLUDED : SNMP_VIEW_INCLUDED;
+        if (i % 7 == 0) {
+            vp->viewMask[0] = 0x7f;
+            vp->viewMaskLen = 1;
+        }
+    }
+    vacm_viewEntriesChanged();
+    bad = count_differences(NUM_CHECKS / 5);
+    OKF(bad == 0, ("%d checks differ after changing entries", bad));
+
+    /* Destroyed and added entries. */
+    for (i = 0; i < NUM_ENTRIES / 2; i++) {
+        head = view_head();
+        vp = head;
+        if (vp == NULL)
+            break;
+        memcpy(view, vp->viewName + 1, vp->viewName[0]);
+        view[(int) vp->viewName[0]] = '\0';
+        vacm_destroyViewEntry(view, vp->viewSubtree, vp->viewSubtreeLen);
+    }
+    for (i = 0; i < 100; i++) {
+        len = random_oid(name, 4);
+        vp = vacm_createViewEntry("view1", name, len);
+        if (vp)
+            vp->viewType = SNMP_VIEW_EXCLUDED;
+    }
+    bad = count_differences(NUM_CHECKS / 5);
+    OKF(bad == 0, ("%d checks differ after destroying entries", bad));
+
+    head = view_head();
+    seed = 2;
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < NUM_PROBES; i++) {
+        snprintf(view, sizeof(view), "view%u", rnd(NUM_VIEWS));
+        len = random_oid(name, 7);
+        netsnmp_view_subtree_check(head, view, name, len);
+    }
+    scan_us = test_elapsed_us(&start);
+    seed = 2;
+    netsnmp_get_monotonic_clock(&start);
+    for (i = 0; i < NUM_PROBES; i++) {
+        snprintf(view, sizeof(view), "view%u", rnd(NUM_VIEWS));
+        len = random_oid(name, 7);
+        vacm_checkSubtree(view, name, len);
+    }
+    trie_us = test_elapsed_us(&start);
+    printf("# %d subtree checks: scan %ld us, trie %ld us\n",
+           NUM_PROBES, scan_us, trie_us);
+
+    vacm_destroyAllViewEntries();
+    OKF(view_head() == NULL && vacm_checkSubtree("view1", name, len) ==
+        VACM_NOTINVIEW, ("no views left"));
+
+    if (__did_plan == 0)
+        PLAN(__test_counter);
+    return 0;
+}
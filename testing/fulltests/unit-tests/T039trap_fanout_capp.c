@@ -0,0 +1,306 @@
+/*
+ * HEADER Testing notification fan-out with encoded varbinds
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/testing.h>
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+#define NUM_SINKS 64
+#define NUM_TRAPS 100
+#define NUM_VARS  40
+
+static int      rcv_sock;
+
+/* Reads the datagrams that have arrived, waiting up to wait_ms for more. */
+static int
+receive(u_char *last, size_t *last_len, int wait_ms)
+{
+    u_char          buf[65536];
+    struct timeval  tv;
+    fd_set          fds;
+    ssize_t         len;
+    int             n = 0;
+
+    for (;;) {
+        len = recv(rcv_sock, buf, sizeof(buf), MSG_DONTWAIT);
+        if (len > 0) {
+            if (last && (size_t) len <= *last_len) {
+                memcpy(last, buf, len);
+                *last_len = len;
+            }
+            last = NULL;
+            n++;
+            continue;
+        }
+        if (wait_ms == 0)
+            break;
+        FD_ZERO(&fds);
+        FD_SET(rcv_sock, &fds);
+        tv.tv_sec = 0;
+        tv.tv_usec = wait_ms * 1000;
+        if (select(rcv_sock + 1, &fds, NULL, NULL, &tv) <= 0)
+            break;
+    }
+    return n;
+}
+
+/* A linkDown-like notification with a few dozen interface objects. */
+static netsnmp_pdu *
+make_trap(int v1, int num_vars)
+{
+    static const oid sysUpTime[] = { 1, 3, 6, 1, 2, 1, 1, 3, 0 };
+    static const oid trapOid[] = { 1, 3, 6, 1, 6, 3, 1, 1, 4, 1, 0 };
+    static const oid linkDown[] = { 1, 3, 6, 1, 6, 3, 1, 1, 5, 3 };
+    oid             name[] = { 1, 3, 6, 1, 2, 1, 2, 2, 1, 0, 0 };
+    netsnmp_pdu    *pdu;
+    struct counter64 c64;
+    u_long          ticks = 123456;
+    long            ival;
+    char            descr[64];
+    int             i;
+
+    pdu = snmp_pdu_create(v1 ? SNMP_MSG_TRAP : SNMP_MSG_TRAP2);
+    if (v1) {
+        pdu->enterprise = netsnmp_memdup(linkDown, sizeof(linkDown));
+        pdu->enterprise_length = OID_LENGTH(linkDown);
+        pdu->trap_type = SNMP_TRAP_LINKDOWN;
+        pdu->time = ticks;
+        memcpy(pdu->agent_addr, "\x7f\x00\x00\x01", 4);
+    } else {
+        snmp_pdu_add_variable(pdu, sysUpTime, OID_LENGTH(sysUpTime),
+                              ASN_TIMETICKS, &ticks, sizeof(ticks));
+        snmp_pdu_add_variable(pdu, trapOid, OID_LENGTH(trapOid),
+                              ASN_OBJECT_ID, linkDown, sizeof(linkDown));
+    }
+    for (i = 0; i < num_vars; i++) {
+        name[9] = 2 + i % 4;
+        name[10] = 1 + i / 4;
+        switch (i % 4) {
+        case 0:
+            snprintf(descr, sizeof(descr), "GigabitEthernet0/%d uplink", i);
+            snmp_pdu_add_variable(pdu, name, OID_LENGTH(name),
+                                  ASN_OCTET_STR, descr, strlen(descr));
+            break;
+        case 1:
+            ival = 1000 * i - 7;
+            snmp_pdu_add_variable(pdu, name, OID_LENGTH(name),
+                                  ASN_INTEGER, &ival, sizeof(ival));
+            break;
+        case 2:
+            c64.high = i;
+            c64.low = 0x80000000UL + i;
+            snmp_pdu_add_variable(pdu, name, OID_LENGTH(name),
+                                  ASN_COUNTER64, &c64, sizeof(c64));
+            break;
+        default:
+            snmp_pdu_add_variable(pdu, name, OID_LENGTH(name),
+                                  ASN_OBJECT_ID, linkDown, sizeof(linkDown));
+            break;
+        }
+    }
+    return pdu;
+}
+
+static const char *
+version_name(long version)
+{
+    return version == SNMP_VERSION_1 ? "1" :
+        version == SNMP_VERSION_2c ? "2c" : "3";
+}
+
+/*
+ * SNMPv3 sinks send as an authNoPriv user of this engine, as snmptrap
+ * does; without privacy the messages carry no random salt.
+ */
+static netsnmp_session *
+open_sink(long version, int port)
+{
+    static u_char   community[] = "public";
+    static char     user[] = "t039user";
+    static char     pass[] = "t039passphrase";
+    netsnmp_session session, *ss;
+    char            peer[64];
+
+    snmp_sess_init(&session);
+    snprintf(peer, sizeof(peer), "udp:127.0.0.1:%d", port);
+    session.peername = peer;
+    session.version = version;
+    session.community = community;
+    session.community_len = sizeof(community) - 1;
+    if (version == SNMP_VERSION_3) {
+        session.securityName = user;
+        session.securityNameLen = strlen(user);
+        session.securityLevel = SNMP_SEC_LEVEL_AUTHNOPRIV;
+        session.securityAuthProto = snmp_duplicate_objid(
+            usmHMACSHA1AuthProtocol, USM_AUTH_PROTO_SHA_LEN);
+        session.securityAuthProtoLen = USM_AUTH_PROTO_SHA_LEN;
+        session.securityAuthKeyLen = USM_AUTH_KU_LEN;
+        if (generate_Ku(session.securityAuthProto,
+                        session.securityAuthProtoLen, (u_char *) pass,
+                        strlen(pass), session.securityAuthKey,
+                        &session.securityAuthKeyLen) != SNMPERR_SUCCESS)
+            return NULL;
+        session.securityEngineID =
+            snmpv3_generate_engineID(&session.securityEngineIDLen);
+        session.engineBoots = 1;
+        session.engineTime = get_uptime();
+        set_enginetime(session.securityEngineID, session.securityEngineIDLen,
+                       session.engineBoots, session.engineTime, TRUE);
+    }
+    ss = snmp_open(&session);
+    SNMP_FREE(session.securityAuthProto);
+    SNMP_FREE(session.securityEngineID);
+    return ss;
+}
+
+int
+main(int argc, char **argv)
+{
+    netsnmp_session *sinks[NUM_SINKS], *sess;
+    netsnmp_pdu    *template_pdu, *pdu;
+    struct sockaddr_in sin;
+    socklen_t       sinlen = sizeof(sin);
+    struct timeval  start;
+    u_char          plain[65536], encoded[65536], *cp, *cp2;
+    size_t          plain_len, encoded_len;
+    long            us[2];
+    static const long versions[] =
+        { SNMP_VERSION_1, SNMP_VERSION_2c, SNMP_VERSION_3 };
+    long            version;
+    int             port, reverse, v1, pass, i, n, sent, received;
+    int             rcvbuf = 1 << 22;
+
+    init_snmp("T039");
+
+    rcv_sock = socket(AF_INET, SOCK_DGRAM, 0);
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    setsockopt(rcv_sock, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    OKF(rcv_sock >= 0 &&
+        bind(rcv_sock, (struct sockaddr *) &sin, sizeof(sin)) == 0 &&
+        getsockname(rcv_sock, (struct sockaddr *) &sin, &sinlen) == 0,
+        ("notification receiver"));
+    port = ntohs(sin.sin_port);
+
+    /*
+     * A copy sharing the encoded varbinds is built exactly as a full copy
+     * of the PDU, by the forward encoder ...
+     */
+    reverse = netsnmp_ds_get_boolean(NETSNMP_DS_LIBRARY_ID,
+                                     NETSNMP_DS_LIB_REVERSE_ENCODE);
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_REVERSE_ENCODE, 0);
+    for (v1 = 0; v1 < 2; v1++) {
+        template_pdu = make_trap(v1, NUM_VARS);
+        plain_len = sizeof(plain);
+        cp = snmp_pdu_build(template_pdu, plain, &plain_len);
+        netsnmp_pdu_encode_varbinds(template_pdu);
+        pdu = netsnmp_clone_pdu_encoded(template_pdu);
+        snmp_free_pdu(template_pdu);
+        encoded_len = sizeof(encoded);
+        cp2 = snmp_pdu_build(pdu, encoded, &encoded_len);
+        OKF(cp && cp2 && cp - plain == cp2 - encoded &&
+            memcmp(plain, encoded, cp - plain) == 0,
+            ("forward-encoded SNMPv%s PDU with encoded varbinds is "
+             "identical", v1 ? "1" : "2c"));
+        snmp_free_pdu(pdu);
+    }
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_REVERSE_ENCODE, reverse);
+
+    /*
+     * ... and goes out as the same message.
+     */
+    for (i = 0; i < 3; i++) {
+        version = versions[i];
+        v1 = version == SNMP_VERSION_1;
+        sess = open_sink(version, port);
+        OKF(sess != NULL, ("SNMPv%s sink", version_name(version)));
+        if (sess == NULL)
+            continue;
+        template_pdu = make_trap(v1, NUM_VARS);
+        pdu = snmp_clone_pdu(template_pdu);
+        pdu->reqid = 4242;
+        pdu->msgid = 4243;
+        if (!snmp_send(sess, pdu))
+            snmp_free_pdu(pdu);
+        /*
+         * Loopback delivery is immediate; not waiting keeps both SNMPv3
+         * messages within the same second of engine time.
+         */
+        plain_len = sizeof(plain);
+        n = receive(plain, &plain_len, 0);
+
+        OKF(netsnmp_pdu_encode_varbinds(template_pdu) == SNMPERR_SUCCESS &&
+            netsnmp_pdu_encoded_varbinds_len(template_pdu) > 0,
+            ("SNMPv%s varbinds encoded", version_name(version)));
+        pdu = netsnmp_clone_pdu_encoded(template_pdu);
+        /* the copy keeps the encoding alive */
+        snmp_free_pdu(template_pdu);
+        OKF(pdu && pdu->variables == NULL &&
+            netsnmp_pdu_encoded_varbinds_len(pdu) > 0,
+            ("copy shares the encoded varbinds"));
+        pdu->reqid = 4242;
+        pdu->msgid = 4243;
+        if (!snmp_send(sess, pdu))
+            snmp_free_pdu(pdu);
+        encoded_len = sizeof(encoded);
+        n += receive(encoded, &encoded_len, 500);
+
+        OKF(n == 2 && plain_len == encoded_len &&
+            memcmp(plain, encoded, plain_len) == 0,
+            ("SNMPv%s notification with encoded varbinds is identical "
+             "(%d packets, %d and %d bytes)", version_name(version), n,
+             (int) plain_len, (int) encoded_len));
+        snmp_close(sess);
+    }
+
+    /*
+     * The same notification sent to many sinks, copied with all of its
+     * varbinds and then with the encoded varbinds.
+     */
+    for (i = 0; i < NUM_SINKS; i++)
+        sinks[i] = open_sink(SNMP_VERSION_2c, port);
+    template_pdu = make_trap(0, NUM_VARS);
+    for (pass = 0; pass < 2; pass++) {
+        if (pass)
+            netsnmp_pdu_encode_varbinds(template_pdu);
+        sent = received = 0;
+        netsnmp_get_monotonic_clock(&start);
+        for (n = 0; n < NUM_TRAPS; n++) {
+            for (i = 0; i < NUM_SINKS; i++) {
+                pdu = pass ? netsnmp_clone_pdu_encoded(template_pdu) :
+                    snmp_clone_pdu(template_pdu);
+                if (snmp_send(sinks[i], pdu))
+                    sent++;
+                else
+                    snmp_free_pdu(pdu);
+            }
+            received += receive(NULL, NULL, 0);
+        }
+        us[pass] = test_elapsed_us(&start);
+        received += receive(NULL, NULL, 500);
+        OKF(sent == NUM_TRAPS * NUM_SINKS && received == sent,
+            ("%s: %d of %d notifications sent, %d received",
+             pass ? "encoded varbinds" : "copied varbinds", sent,
+             NUM_TRAPS * NUM_SINKS, received));
+    }
+    printf("# %d notifications to %d sinks: copied varbinds %ld us, "
+           "encoded varbinds %ld us\n", NUM_TRAPS, NUM_SINKS, us[0], us[1]);
+
+    snmp_free_pdu(template_pdu);
+    for (i = 0; i < NUM_SINKS; i++)
+        snmp_close(sinks[i]);
+    close(rcv_sock);
+    snmp_shutdown("T039");
+
+    if (__did_plan == 0)
+        PLAN(__test_counter);
+    return 0;
+}
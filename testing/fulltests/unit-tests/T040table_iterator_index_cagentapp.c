@@ -0,0 +1,257 @@
+/*
+ * HEADER Testing the table_iterator row index
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/agent/net-snmp-agent-includes.h>
+#include <net-snmp/library/testing.h>
+
+#define NUM_ROWS   1000
+#define NUM_PROBES 4000
+
+/*
+ * A scratch table indexed by two integers, kept in an unsorted list.  The
+ * same rows are registered twice: once plain, once with the row index.
+ */
+struct row {
+    long            a, b, value;
+    struct row     *next;
+};
+
+static struct row *rows;
+
+static oid      plain_oid[] = { 1, 3, 6, 1, 4, 1, 8072, 9999, 1 };
+static oid      indexed_oid[] = { 1, 3, 6, 1, 4, 1, 8072, 9999, 2 };
+
+#define TABLE_OID_LEN OID_LENGTH(plain_oid)
+
+static netsnmp_variable_list *
+get_next_row(void **loop_context, void **data_context,
+             netsnmp_variable_list *put_index_data,
+             netsnmp_iterator_info *iinfo)
+{
+    struct row     *row = (struct row *) *loop_context;
+
+    if (row == NULL)
+        return NULL;
+    snmp_set_var_typed_integer(put_index_data, ASN_INTEGER, row->a);
+    snmp_set_var_typed_integer(put_index_data->next_variable, ASN_INTEGER,
+                               row->b);
+    *data_context = row;
+    *loop_context = row->next;
+    return put_index_data;
+}
+
+static netsnmp_variable_list *
+get_first_row(void **loop_context, void **data_context,
+              netsnmp_variable_list *put_index_data,
+              netsnmp_iterator_info *iinfo)
+{
+    *loop_context = rows;
+    return get_next_row(loop_context, data_context, put_index_data, iinfo);
+}
+
+static int
+handle_table(netsnmp_mib_handler *handler,
+             netsnmp_handler_registration *reginfo,
+             netsnmp_agent_request_info *reqinfo,
+             netsnmp_request_info *requests)
+{
+    netsnmp_request_info *request;
+    netsnmp_table_request_info *tinfo;
+    struct row     *row;
+
+    for (request = requests; request; request = request->next) {
+        row = (struct row *) netsnmp_extract_iterator_context(request);
+        tinfo = netsnmp_extract_table_info(request);
+        if (request->processed || row == NULL || tinfo == NULL)
+            continue;
+        snmp_set_var_typed_integer(request->requestvb, ASN_INTEGER,
+                                   row->value * 10 + tinfo->colnum);
+    }
+    return SNMP_ERR_NOERROR;
+}
+
+static netsnmp_handler_registration *
+register_table(const char *name, oid *table_oid,
+               netsnmp_iterator_info **iinfo_out)
+{
+    netsnmp_table_registration_info *tinfo;
+    netsnmp_iterator_info *iinfo;
+    netsnmp_handler_registration *reginfo;
+
+    tinfo = SNMP_MALLOC_TYPEDEF(netsnmp_table_registration_info);
+    iinfo = SNMP_MALLOC_TYPEDEF(netsnmp_iterator_info);
+    if (tinfo == NULL || iinfo == NULL)
+        return NULL;
+    netsnmp_table_helper_add_indexes(tinfo, ASN_INTEGER, ASN_INTEGER, 0);
+    tinfo->min_column = 2;
+    tinfo->max_column = 3;
+    iinfo->get_first_data_point = get_first_row;
+    iinfo->get_next_data_point = get_next_row;
+    iinfo->table_reginfo = tinfo;
+    reginfo = netsnmp_create_handler_registration(name, handle_table,
+                                                  table_oid, TABLE_OID_LEN,
+                                                  HANDLER_CAN_RONLY);
+    if (reginfo == NULL ||
+        netsnmp_register_table_iterator2(reginfo, iinfo) !=
+        MIB_REGISTERED_OK)
+        return NULL;
+    *iinfo_out = iinfo;
+    return reginfo;
+}
+
+/*
+ * Runs one GET or GETNEXT through the handler chain.  On return name holds
+ * the OID of the result; returns 1 if a value came back.
+ */
+static int
+query(netsnmp_handler_registration *reginfo, int mode, oid *name,
+      size_t *name_len, long *value)
+{
+    netsnmp_agent_request_info reqinfo;
+    netsnmp_request_info request;
+    netsnmp_variable_list *var;
+    int             found;
+
+    var = SNMP_MALLOC_TYPEDEF(netsnmp_variable_list);
+    if (var == NULL)
+        return 0;
+    memset(&reqinfo, 0, sizeof(reqinfo));
+    memset(&request, 0, sizeof(request));
+    reqinfo.mode = mode;
+    snmp_set_var_objid(var, name, *name_len);
+    var->type = ASN_NULL;
+    request.requestvb = var;
+    request.agent_req_info = &reqinfo;
+
+    netsnmp_call_handlers(reginfo, &reqinfo, &request);
+
+    found = var->type == ASN_INTEGER;
+    if (found)
+        *value = *var->val.integer;
+    memcpy(name, var->name, var->name_length * sizeof(oid));
+    *name_len = var->name_length;
+    netsnmp_free_request_data_sets(&request);
+    snmp_free_varbind(var);
+    return found;
+}
+
+static void
+add_row(long a, long b, long value)
+{
+    struct row     *row = SNMP_MALLOC_TYPEDEF(struct row);
+
+    if (row == NULL)
+        return;
+    row->a = a;
+    row->b = b;
+    row->value = value;
+    row->next = rows;
+    rows = row;
+}
+
+int
+main(int argc, char *argv[])
+{
+    netsnmp_handler_registration *plain, *indexed;
+    netsnmp_iterator_info *plain_iinfo, *indexed_iinfo;
+    oid             p[MAX_OID_LEN], x[MAX_OID_LEN];
+    size_t          p_len, x_len;
+    long            p_val = 0, x_val = 0;
+    unsigned int    seed = 1;
+    int             i, mode, p_found, x_found, bad, steps;
+
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_DONT_PERSIST_STATE, 1);
+    init_snmp("T040");
+
+    for (i = 0; i < NUM_ROWS; i++)
+        add_row((i * 7919) % 97, i, i);
+
+    plain = register_table("plain", plain_oid, &plain_iinfo);
+    indexed = register_table("indexed", indexed_oid, &indexed_iinfo);
+    OKF(plain && indexed, ("scratch tables registered"));
+    if (!plain || !indexed)
+        return 1;
+    OKF(netsnmp_iterator_index_enable(indexed_iinfo, 0) == SNMPERR_SUCCESS,
+        ("row index enabled"));
+
+    /*
+     * Random GET and GETNEXT probes, including partial and out-of-range
+     * instances, give the same answers as the linear walk of the rows.
+     */
+    for (i = 0, bad = 0; i < NUM_PROBES; i++) {
+        mode = i & 1 ? MODE_GETNEXT : MODE_GET;
+        seed = seed * 1103515245 + 12345;
+        memcpy(p, plain_oid, sizeof(plain_oid));
+        p[9] = 1;
+        p[10] = 1 + (seed >> 8) % 4;
+        p[11] = (seed >> 12) % 101;
+        p[12] = (seed >> 4) % (NUM_ROWS + 1);
+        p_len = TABLE_OID_LEN + (seed >> 20) % 5;
+        memcpy(x, p, p_len * sizeof(oid));
+        x[TABLE_OID_LEN - 1] = indexed_oid[TABLE_OID_LEN - 1];
+        x_len = p_len;
+        p_found = query(plain, mode, p, &p_len, &p_val);
+        x_found = query(indexed, mode, x, &x_len, &x_val);
+        x[TABLE_OID_LEN - 1] = plain_oid[TABLE_OID_LEN - 1];
+        if (p_found != x_found || (p_found && p_val != x_val) ||
+            snmp_oid_compare(p, p_len, x, x_len) != 0)
+            bad++;
+    }
+    OKF(bad == 0, ("%d of %d random probes differ", bad, NUM_PROBES));
+
+    /* A full GETNEXT walk visits the same rows in the same order. */
+    memcpy(p, plain_oid, sizeof(plain_oid));
+    memcpy(x, indexed_oid, sizeof(indexed_oid));
+    p_len = x_len = TABLE_OID_LEN;
+    for (steps = 0, bad = 0;; steps++) {
+        p_found = query(plain, MODE_GETNEXT, p, &p_len, &p_val);
+        x_found = query(indexed, MODE_GETNEXT, x, &x_len, &x_val);
+        if (p_found != x_found || (p_found && p_val != x_val) ||
+            p_len != x_len ||
+            snmp_oid_compare(p + TABLE_OID_LEN, p_len - TABLE_OID_LEN,
+                             x + TABLE_OID_LEN, x_len - TABLE_OID_LEN) != 0)
+            bad++;
+        if (!p_found || !x_found || bad)
+            break;
+    }
+    OKF(bad == 0 && steps == 2 * NUM_ROWS,
+        ("walk: %d steps, %d differences", steps, bad));
+
+    /* The index only sees a new row once it has been invalidated. */
+    add_row(500, 1, 77);
+    memcpy(x, indexed_oid, sizeof(indexed_oid));
+    x[9] = 1;
+    x[10] = 2;
+    x[11] = 500;
+    x[12] = 1;
+    x_len = TABLE_OID_LEN + 4;
+    OKF(!query(indexed, MODE_GET, x, &x_len, &x_val),
+        ("new row not found before invalidation"));
+    netsnmp_iterator_index_invalidate(indexed_iinfo);
+    x_found = query(indexed, MODE_GET, x, &x_len, &x_val);
+    OKF(x_found && x_val == 772, ("new row found after invalidation"));
+
+    /* GETNEXT from just before the new row lands on it in both tables. */
+    memcpy(p, plain_oid, sizeof(plain_oid));
+    p[9] = 1;
+    p[10] = 2;
+    p[11] = 500;
+    p_len = TABLE_OID_LEN + 3;
+    memcpy(x, p, p_len * sizeof(oid));
+    x[TABLE_OID_LEN - 1] = indexed_oid[TABLE_OID_LEN - 1];
+    x_len = p_len;
+    p_found = query(plain, MODE_GETNEXT, p, &p_len, &p_val);
+    x_found = query(indexed, MODE_GETNEXT, x, &x_len, &x_val);
+    OKF(p_found && x_found && p_val == 772 && x_val == 772,
+        ("GETNEXT finds the new row"));
+
+    snmp_shutdown("T040");
+
+    if (__did_plan == 0)
+        PLAN(__test_counter);
+    return 0;
+}
@@ -0,0 +1,188 @@
+/*
+ * HEADER Testing background cache reloads
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/agent/net-snmp-agent-includes.h>
+#include <net-snmp/library/testing.h>
+#include <net-snmp/library/fd_event_manager.h>
+
+#ifdef NETSNMP_REENTRANT
+#include <pthread.h>
+#endif
+
+/*
+ * The cached data is a single number: the count of loads so far.  Loads
+ * outside the main thread wait for a byte on the gate pipe, so that the
+ * test decides when a background reload finishes.
+ */
+static netsnmp_cache *cache;
+static int      loads, frees;
+#ifdef NETSNMP_REENTRANT
+static int      frees_wanted;
+static int      gate[2];
+static pthread_t main_thread;
+#endif
+
+static int
+load_hook(netsnmp_cache *cache, void *magic)
+{
+    int            *data;
+
+#ifdef NETSNMP_REENTRANT
+    char            c;
+
+    if (!pthread_equal(pthread_self(), main_thread) &&
+        read(gate[0], &c, 1) != 1)
+        return -1;
+#endif
+    data = (int *) malloc(sizeof(int));
+    if (data == NULL)
+        return -1;
+    *data = ++loads;
+    cache->magic = data;
+    return 0;
+}
+
+static void
+free_hook(netsnmp_cache *cache, void *magic)
+{
+    if (magic) {
+        free(magic);
+        frees++;
+    }
+}
+
+static int
+cached_value(netsnmp_cache *cache)
+{
+    return cache->valid && cache->magic ? *(int *) cache->magic : 0;
+}
+
+#ifdef NETSNMP_REENTRANT
+static int
+reload_done(void)
+{
+    return cache->reload == NULL;
+}
+
+/* frees happen on the main loop; loads may not */
+static int
+freed_enough(void)
+{
+    return frees >= frees_wanted;
+}
+
+/*
+ * Runs the fd event loop, as the agent's main loop would, until done()
+ * holds.  Returns 0 if that took too long.
+ */
+static int
+run_events(int (*done)(void))
+{
+    struct timeval  tv;
+    fd_set          readfds, writefds, exceptfds;
+    int             numfds, count, i;
+
+    for (i = 0; !done() && i < 50; i++) {
+        numfds = 0;
+        FD_ZERO(&readfds);
+        FD_ZERO(&writefds);
+        FD_ZERO(&exceptfds);
+        netsnmp_external_event_info(&numfds, &readfds, &writefds,
+                                    &exceptfds);
+        tv.tv_sec = 0;
+        tv.tv_usec = 100000;
+        count = select(numfds, &readfds, &writefds, &exceptfds, &tv);
+        if (count > 0)
+            netsnmp_dispatch_external_events(&count, &readfds, &writefds,
+                                              &exceptfds);
+    }
+    return done();
+}
+#endif /* NETSNMP_REENTRANT */
+
+int
+main(int argc, char *argv[])
+{
+    u_int           generation;
+
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_DONT_PERSIST_STATE, 1);
+    init_snmp("T041");
+#ifdef NETSNMP_REENTRANT
+    main_thread = pthread_self();
+    if (pipe(gate) != 0)
+        return 1;
+#endif
+
+    cache = netsnmp_cache_create(30, load_hook, free_hook, NULL, 0);
+    OKF(cache != NULL, ("cache created"));
+    if (cache == NULL)
+        return 1;
+    cache->flags |= NETSNMP_CACHE_RELOAD_IN_BACKGROUND |
+        NETSNMP_CACHE_DONT_AUTO_RELEASE;
+
+    /* The first load has nothing to serve meanwhile, so it is synchronous. */
+    netsnmp_cache_check_and_reload(cache);
+    OKF(cached_value(cache) == 1 && cache->reload == NULL,
+        ("first load is synchronous (value %d)", cached_value(cache)));
+
+    /* Once expired, the old data is served while the reload runs. */
+    generation = cache->generation;
+    cache->expired = 1;
+    netsnmp_cache_check_and_reload(cache);
+#ifdef NETSNMP_REENTRANT
+    OKF(cache->reload != NULL && cached_value(cache) == 1 &&
+        cache->stale_served == 1,
+        ("stale data served during reload (value %d)", cached_value(cache)));
+    OKF(write(gate[1], "", 1) == 1 && run_events(reload_done),
+        ("background reload delivered"));
+#endif
+    OKF(cached_value(cache) == 2 && cache->generation == generation + 1 &&
+        frees == 1, ("reloaded data installed (value %d, %d freed)",
+                     cached_value(cache), frees));
+
+    /*
+     * Emptying the cache while a reload is in flight cancels it: the next
+     * request loads afresh, and the late result is freed, not installed.
+     */
+#ifdef NETSNMP_REENTRANT
+    cache->expired = 1;
+    netsnmp_cache_check_and_reload(cache);
+    OKF(cache->reload != NULL, ("reload in flight before empty"));
+#endif
+    netsnmp_cache_empty(cache);
+    OKF(!cache->valid && cache->magic == NULL && frees == 2,
+        ("emptied cache holds no data"));
+    netsnmp_cache_check_and_reload(cache);
+    OKF(cached_value(cache) == 3, ("fresh load after empty (value %d)",
+                                   cached_value(cache)));
+#ifdef NETSNMP_REENTRANT
+    OKF(write(gate[1], "", 1) == 1 && run_events(reload_done),
+        ("cancelled reload finished"));
+    OKF(cached_value(cache) == 3 && loads == 4 && frees == 3,
+        ("cancelled reload discarded (value %d, %d freed)",
+         cached_value(cache), frees));
+
+    /* Freeing the cache while a reload is in flight frees the result. */
+    cache->expired = 1;
+    netsnmp_cache_check_and_reload(cache);
+    OKF(cache->reload != NULL, ("reload in flight before free"));
+#endif
+    netsnmp_cache_free(cache);
+#ifdef NETSNMP_REENTRANT
+    frees_wanted = 5;
+    OKF(write(gate[1], "", 1) == 1 && run_events(freed_enough),
+        ("orphaned reload finished"));
+#endif
+    OKF(loads == frees, ("no data leaked (%d loads, %d freed)", loads,
+                         frees));
+
+    snmp_shutdown("T041");
+
+    if (__did_plan == 0)
+        PLAN(__test_counter);
+    return 0;
+}
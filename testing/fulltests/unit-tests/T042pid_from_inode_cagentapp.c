@@ -0,0 +1,193 @@
+/*
+ * HEADER Testing the inode to pid index
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/testing.h>
+
+#ifdef linux
+#include "util_funcs/get_pid_from_inode.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <signal.h>
+
+#define NUM_SOCKETS 700         /* enough to grow the table */
+
+static ino64_t
+socket_inode(int fd)
+{
+    struct stat     st;
+
+    return fstat(fd, &st) == 0 ? st.st_ino : 0;
+}
+
+/*
+ * Starts a child that holds only <keep> (if >= 0), plus the socket that
+ * arrives on <from> (if >= 0), and waits until its pipe is closed.
+ * Returns once the child is ready, with the write end of its pipe in
+ * *ctl.
+ */
+static pid_t
+spawn(int keep, int from, int *ctl)
+{
+    int             ready[2], hold[2], fd, max;
+    char            c = 0;
+    pid_t           pid;
+
+    if (pipe(ready) != 0 || pipe(hold) != 0)
+        return -1;
+    pid = fork();
+    if (pid < 0)
+        return -1;
+    if (pid == 0) {
+        max = sysconf(_SC_OPEN_MAX);
+        for (fd = 3; fd < max; fd++)
+            if (fd != keep && fd != from && fd != ready[1] && fd != hold[0])
+                close(fd);
+        if (from >= 0) {
+            struct msghdr   msg;
+            struct iovec    iov;
+            char            cbuf[CMSG_SPACE(sizeof(int))];
+
+            memset(&msg, 0, sizeof(msg));
+            iov.iov_base = &c;
+            iov.iov_len = 1;
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = cbuf;
+            msg.msg_controllen = sizeof(cbuf);
+            if (recvmsg(from, &msg, 0) != 1)
+                _exit(1);
+            close(from);
+        }
+        if (write(ready[1], &c, 1) != 1)
+            _exit(1);
+        while (read(hold[0], &c, 1) > 0)
+            ;
+        _exit(0);
+    }
+    close(ready[1]);
+    close(hold[0]);
+    if (read(ready[0], &c, 1) != 1)
+        pid = -1;
+    close(ready[0]);
+    *ctl = hold[1];
+    return pid;
+}
+
+/* Puts socket <fd> in flight on unix socket <to>, owned by nobody. */
+static int
+send_fd(int to, int fd)
+{
+    struct msghdr   msg;
+    struct iovec    iov;
+    struct cmsghdr *cmsg;
+    char            cbuf[CMSG_SPACE(sizeof(int))], c = 0;
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = &c;
+    iov.iov_len = 1;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = cbuf;
+    msg.msg_controllen = sizeof(cbuf);
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    return sendmsg(to, &msg, 0) == 1 ? 0 : -1;
+}
+#endif /* linux */
+
+int
+main(int argc, char *argv[])
+{
+#ifdef linux
+    int             socks[NUM_SOCKETS], sp[2], moved, flying, ctl1, ctl2;
+    ino64_t         inodes[NUM_SOCKETS], moved_inode, flying_inode;
+    pid_t           me = getpid(), child1, child2;
+    struct rlimit   rl;
+    int             i, n, bad;
+
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < NUM_SOCKETS + 64 &&
+        rl.rlim_max >= NUM_SOCKETS + 64) {
+        rl.rlim_cur = NUM_SOCKETS + 64;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    /* Every socket of this process maps to it, also in a later round. */
+    for (n = 0; n < NUM_SOCKETS; n++) {
+        socks[n] = socket(AF_INET, SOCK_DGRAM, 0);
+        if (socks[n] < 0)
+            break;
+        inodes[n] = socket_inode(socks[n]);
+    }
+    netsnmp_get_pid_from_inode_init();
+    for (i = 0, bad = 0; i < n; i++)
+        if (netsnmp_get_pid_from_inode(inodes[i]) != me)
+            bad++;
+    OKF(n > 0 && bad == 0, ("%d of %d sockets not found", bad, n));
+    netsnmp_get_pid_from_inode_init();
+    for (i = 0, bad = 0; i < n; i++)
+        if (netsnmp_get_pid_from_inode(inodes[i]) != me)
+            bad++;
+    OKF(bad == 0, ("%d of %d sockets not found again", bad, n));
+
+    OKF(netsnmp_get_pid_from_inode((ino64_t) -2) == 0,
+        ("an unknown inode has no owner"));
+
+    /* A socket handed to a child and closed here is found in the child. */
+    moved = socket(AF_INET, SOCK_DGRAM, 0);
+    moved_inode = socket_inode(moved);
+    netsnmp_get_pid_from_inode_init();
+    OKF(netsnmp_get_pid_from_inode(moved_inode) == me,
+        ("new socket found in this process"));
+    child1 = spawn(moved, -1, &ctl1);
+    close(moved);
+    netsnmp_get_pid_from_inode_init();
+    OKF(child1 > 0 && netsnmp_get_pid_from_inode(moved_inode) == child1,
+        ("moved socket found in the child"));
+
+    /*
+     * A socket in flight on a unix socket has no owner; once a process
+     * that did not exist before picks it up, it is found there.
+     */
+    flying = socket(AF_INET, SOCK_DGRAM, 0);
+    flying_inode = socket_inode(flying);
+    OKF(socketpair(AF_UNIX, SOCK_STREAM, 0, sp) == 0 &&
+        send_fd(sp[0], flying) == 0, ("socket sent"));
+    close(flying);
+    netsnmp_get_pid_from_inode_init();
+    OKF(netsnmp_get_pid_from_inode(flying_inode) == 0,
+        ("socket in flight has no owner"));
+    child2 = spawn(-1, sp[1], &ctl2);
+    netsnmp_get_pid_from_inode_init();
+    OKF(child2 > 0 && netsnmp_get_pid_from_inode(flying_inode) == child2,
+        ("received socket found in the new process"));
+    for (i = 0, bad = 0; i < n; i++)
+        if (netsnmp_get_pid_from_inode(inodes[i]) != me)
+            bad++;
+    OKF(bad == 0, ("%d of %d sockets not found after the new process", bad,
+                   n));
+
+    close(ctl1);
+    close(ctl2);
+    if (child1 > 0)
+        waitpid(child1, NULL, 0);
+    if (child2 > 0)
+        waitpid(child2, NULL, 0);
+    for (i = 0; i < n; i++)
+        close(socks[i]);
+#else
+    OK(1, "skipped test: linux only");
+#endif /* linux */
+
+    if (__did_plan == 0)
+        PLAN(__test_counter);
+    return 0;
+}
@@ -0,0 +1,147 @@
+/*
+ * HEADER Testing OID printing after MIB modules change
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/testing.h>
+
+#include <sys/stat.h>
+
+/*
+ * MEMO-B-MIB redefines the nodes of MEMO-A-MIB with the same names, only
+ * with another index, so replacing one with the other adds and removes
+ * no nodes.  MEMO-U-MIB defines a table entry whose only column comes
+ * from MEMO-V-MIB, so unloading it leaves the entry node in place.
+ */
+#define MEMO_TABLE(module, index)                                       \
+    module " DEFINITIONS ::= BEGIN\n"                                   \
+    "IMPORTS netSnmpExperimental FROM NET-SNMP-MIB\n"                   \
+    "    OBJECT-TYPE, Integer32 FROM SNMPv2-SMI;\n"                     \
+    "memoTable OBJECT-TYPE SYNTAX SEQUENCE OF MemoEntry\n"              \
+    "    MAX-ACCESS not-accessible STATUS current DESCRIPTION \"t\"\n"  \
+    "    ::= { netSnmpExperimental 4243 }\n"                            \
+    "memoEntry OBJECT-TYPE SYNTAX MemoEntry\n"                          \
+    "    MAX-ACCESS not-accessible STATUS current DESCRIPTION \"e\"\n"  \
+    "    INDEX { " index " } ::= { memoTable 1 }\n"                     \
+    "MemoEntry ::= SEQUENCE { memoIndex Integer32,\n"                   \
+    "    memoName OCTET STRING, memoValue Integer32 }\n"                \
+    "memoIndex OBJECT-TYPE SYNTAX Integer32 MAX-ACCESS read-only\n"     \
+    "    STATUS current DESCRIPTION \"i\" ::= { memoEntry 1 }\n"        \
+    "memoName OBJECT-TYPE SYNTAX OCTET STRING MAX-ACCESS read-only\n"   \
+    "    STATUS current DESCRIPTION \"n\" ::= { memoEntry 2 }\n"        \
+    "memoValue OBJECT-TYPE SYNTAX Integer32 MAX-ACCESS read-only\n"     \
+    "    STATUS current DESCRIPTION \"v\" ::= { memoEntry 3 }\n"        \
+    "END\n"
+
+static const struct {
+    const char     *name;
+    const char     *text;
+} modules[] = {
+    { "MEMO-A-MIB", MEMO_TABLE("MEMO-A-MIB", "memoIndex") },
+    { "MEMO-B-MIB", MEMO_TABLE("MEMO-B-MIB", "IMPLIED memoName") },
+    { "MEMO-U-MIB",
+      "MEMO-U-MIB DEFINITIONS ::= BEGIN\n"
+      "IMPORTS netSnmpExperimental FROM NET-SNMP-MIB\n"
+      "    OBJECT-TYPE FROM SNMPv2-SMI;\n"
+      "memoUTable OBJECT-TYPE SYNTAX SEQUENCE OF MemoUEntry\n"
+      "    MAX-ACCESS not-accessible STATUS current DESCRIPTION \"t\"\n"
+      "    ::= { netSnmpExperimental 4244 }\n"
+      "memoUEntry OBJECT-TYPE SYNTAX MemoUEntry\n"
+      "    MAX-ACCESS not-accessible STATUS current DESCRIPTION \"e\"\n"
+      "    INDEX { IMPLIED memoVName } ::= { memoUTable 1 }\n"
+      "END\n" },
+    { "MEMO-V-MIB",
+      "MEMO-V-MIB DEFINITIONS ::= BEGIN\n"
+      "IMPORTS memoUEntry FROM MEMO-U-MIB\n"
+      "    OBJECT-TYPE FROM SNMPv2-SMI;\n"
+      "memoVName OBJECT-TYPE SYNTAX OCTET STRING MAX-ACCESS read-only\n"
+      "    STATUS current DESCRIPTION \"n\" ::= { memoUEntry 1 }\n"
+      "END\n" },
+};
+
+static oid      memo_value[] =
+    { 1, 3, 6, 1, 4, 1, 8072, 9999, 4243, 1, 3, 104, 105 };
+static oid      memo_v_name[] =
+    { 1, 3, 6, 1, 4, 1, 8072, 9999, 4244, 1, 1, 104, 105 };
+
+/* Prints name and returns whether the result ends with suffix. */
+static int
+prints_as(const oid * name, size_t name_len, const char *suffix)
+{
+    char            buf[SPRINT_MAX_LEN];
+    size_t          len, slen = strlen(suffix);
+
+    if (snprint_objid(buf, sizeof(buf), name, name_len) < 0)
+        return 0;
+    len = strlen(buf);
+    if (len >= slen && strcmp(buf + len - slen, suffix) == 0)
+        return 1;
+    fprintf(stdout, "# printed %s, expected ...%s\n", buf, suffix);
+    return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+    char            dir[] = "/tmp/snmp-T043-XXXXXX";
+    char            path[sizeof(dir) + 32];
+    FILE           *fp;
+    int             i;
+
+    if (mkdtemp(dir) == NULL)
+        return 1;
+    for (i = 0; i < (int) (sizeof(modules) / sizeof(modules[0])); i++) {
+        snprintf(path, sizeof(path), "%s/%s.txt", dir, modules[i].name);
+        fp = fopen(path, "w");
+        if (fp == NULL)
+            return 1;
+        fputs(modules[i].text, fp);
+        fclose(fp);
+    }
+
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_DONT_PERSIST_STATE, 1);
+    init_snmp("T043");
+    add_mibdir(dir);
+
+    /*
+     * Replacing a module changes the index of nodes already printed; the
+     * next print follows the new definition.
+     */
+    OKF(netsnmp_read_module("MEMO-A-MIB") != NULL &&
+        prints_as(memo_value, OID_LENGTH(memo_value), "memoValue.104.105"),
+        ("integer index printed"));
+    OKF(prints_as(memo_value, OID_LENGTH(memo_value), "memoValue.104.105"),
+        ("integer index printed again"));
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_MIB_REPLACE, 1);
+    OKF(netsnmp_read_module("MEMO-B-MIB") != NULL &&
+        prints_as(memo_value, OID_LENGTH(memo_value), "memoValue.'hi'"),
+        ("string index printed after the module is replaced"));
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_MIB_REPLACE, 0);
+
+    /*
+     * Unloading a module keeps the nodes that still have children, without
+     * their index; the next print no longer uses it.
+     */
+    OKF(netsnmp_read_module("MEMO-V-MIB") != NULL &&
+        prints_as(memo_v_name, OID_LENGTH(memo_v_name), "memoVName.'hi'"),
+        ("string index printed"));
+    OKF(netsnmp_unload_module("MEMO-U-MIB") &&
+        prints_as(memo_v_name, OID_LENGTH(memo_v_name),
+                  "memoVName.104.105"),
+        ("index dropped after the module is unloaded"));
+
+    snmp_shutdown("T043");
+    for (i = 0; i < (int) (sizeof(modules) / sizeof(modules[0])); i++) {
+        snprintf(path, sizeof(path), "%s/%s.txt", dir, modules[i].name);
+        unlink(path);
+    }
+    rmdir(dir);
+
+    if (__did_plan == 0)
+        PLAN(__test_counter);
+    return 0;
+}
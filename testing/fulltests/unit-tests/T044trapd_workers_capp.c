@@ -0,0 +1,239 @@
+/*
+ * HEADER Testing snmptrapd throughput with worker threads
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/library/testing.h>
+
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <unistd.h>
+
+#define NUM_INFORMS 2000
+#define WINDOW      64          /* informs in flight */
+
+/*
+ * The generator sends INFORMs over loopback to an snmptrapd started for
+ * each worker thread count, keeping WINDOW of them in flight.  Each one
+ * is logged before it is acknowledged, so none are lost and the rate is
+ * that of the whole receive, format and log path.
+ */
+static const int worker_counts[] = {
+    0,
+#ifdef NETSNMP_REENTRANT
+    1, 2, 4, 8
+#endif
+};
+
+static oid      sysuptime_oid[] = { 1, 3, 6, 1, 2, 1, 1, 3, 0 };
+static oid      trapoid_oid[] = { 1, 3, 6, 1, 6, 3, 1, 1, 4, 1, 0 };
+static oid      coldstart_oid[] = { 1, 3, 6, 1, 6, 3, 1, 1, 5, 1 };
+static oid      syscontact_oid[] = { 1, 3, 6, 1, 2, 1, 1, 4, 0 };
+
+static int      acked, failed;
+
+/* Returns a loopback UDP port that nothing listens on right now. */
+static int
+free_port(void)
+{
+    struct sockaddr_in sin;
+    socklen_t       sinlen = sizeof(sin);
+    int             sock, port = -1;
+
+    sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0)
+        return -1;
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(sock, (struct sockaddr *) &sin, sizeof(sin)) == 0 &&
+        getsockname(sock, (struct sockaddr *) &sin, &sinlen) == 0)
+        port = ntohs(sin.sin_port);
+    close(sock);
+    return port;
+}
+
+/* Starts snmptrapd in the foreground, logging to dir/trapd.log. */
+static pid_t
+start_trapd(const char *dir, int port, int workers)
+{
+    char            conf[256], log[256], addr[64];
+    FILE           *fp;
+    pid_t           pid;
+
+    snprintf(conf, sizeof(conf), "%s/trapd.conf", dir);
+    snprintf(log, sizeof(log), "%s/trapd.log", dir);
+    snprintf(addr, sizeof(addr), "udp:127.0.0.1:%d", port);
+    fp = fopen(conf, "w");
+    if (fp == NULL)
+        return -1;
+    fprintf(fp, "[snmp] persistentDir %s\n"
+            "authcommunity log public\n"
+            "trapdWorkerThreads %d\n"
+            "agentxsocket /dev/null\n", dir, workers);
+    fclose(fp);
+    unlink(log);
+
+    pid = fork();
+    if (pid == 0) {
+        execlp("snmptrapd", "snmptrapd", "-f", "-C", "-c", conf, "-Lf", log,
+               addr, (char *) NULL);
+        _exit(1);
+    }
+    return pid;
+}
+
+static netsnmp_pdu *
+make_inform(int seq)
+{
+    netsnmp_pdu    *pdu = snmp_pdu_create(SNMP_MSG_INFORM);
+    char            buf[32];
+    long            uptime = 0;
+
+    snprintf(buf, sizeof(buf), "inform_%06d", seq);
+    snmp_pdu_add_variable(pdu, sysuptime_oid, OID_LENGTH(sysuptime_oid),
+                          ASN_TIMETICKS, &uptime, sizeof(uptime));
+    snmp_pdu_add_variable(pdu, trapoid_oid, OID_LENGTH(trapoid_oid),
+                          ASN_OBJECT_ID, coldstart_oid,
+                          sizeof(coldstart_oid));
+    snmp_pdu_add_variable(pdu, syscontact_oid, OID_LENGTH(syscontact_oid),
+                          ASN_OCTET_STR, buf, strlen(buf));
+    return pdu;
+}
+
+static int
+inform_done(int op, netsnmp_session *sess, int reqid, netsnmp_pdu *pdu,
+            void *magic)
+{
+    if (op == NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE)
+        acked++;
+    else
+        failed++;
+    return 1;
+}
+
+/* Sends one INFORM and waits for its acknowledgement. */
+static int
+ping(netsnmp_session *sess)
+{
+    netsnmp_pdu    *response = NULL;
+    int             status;
+
+    status = snmp_synch_response(sess, make_inform(0), &response);
+    if (response)
+        snmp_free_pdu(response);
+    return status == STAT_SUCCESS;
+}
+
+/*
+ * Sends count INFORMs, keeping WINDOW in flight, and returns once each
+ * one is acknowledged or has timed out.
+ */
+static void
+send_informs(netsnmp_session *sess, int count)
+{
+    netsnmp_pdu    *pdu;
+    struct timeval  tv;
+    fd_set          fds;
+    int             sent = 0, numfds, block, n;
+
+    acked = failed = 0;
+    while (acked + failed < count) {
+        while (sent < count && sent - acked - failed < WINDOW) {
+            pdu = make_inform(++sent);
+            if (snmp_async_send(sess, pdu, inform_done, NULL) == 0) {
+                snmp_free_pdu(pdu);
+                failed++;
+            }
+        }
+        numfds = 0;
+        block = 1;
+        FD_ZERO(&fds);
+        snmp_select_info(&numfds, &fds, &tv, &block);
+        n = select(numfds, &fds, NULL, NULL, block ? NULL : &tv);
+        if (n > 0)
+            snmp_read(&fds);
+        else if (n == 0)
+            snmp_timeout();
+    }
+}
+
+int
+main(int argc, char *argv[])
+{
+    static u_char   community[] = "public";
+    static const char *const files[] = {
+        "trapd.conf", "trapd.log", "snmptrapd.conf"
+    };
+    char            dir[] = "/tmp/snmp-T044-XXXXXX";
+    char            path[sizeof(dir) + 32];
+    netsnmp_session session, *sess;
+    struct timeval  start;
+    pid_t           pid;
+    long            us;
+    int             i, port, workers, answers, status;
+
+    if (mkdtemp(dir) == NULL)
+        return 1;
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_DONT_PERSIST_STATE, 1);
+    init_snmp("T044");
+
+    for (i = 0; i < (int) (sizeof(worker_counts) / sizeof(worker_counts[0]));
+         i++) {
+        workers = worker_counts[i];
+        port = free_port();
+        pid = port > 0 ? start_trapd(dir, port, workers) : -1;
+
+        snmp_sess_init(&session);
+        snprintf(path, sizeof(path), "udp:127.0.0.1:%d", port);
+        session.peername = path;
+        session.version = SNMP_VERSION_2c;
+        session.community = community;
+        session.community_len = sizeof(community) - 1;
+        session.timeout = 1000000;
+        session.retries = 5;
+        sess = pid > 0 ? snmp_open(&session) : NULL;
+
+        /* the first INFORM is retried until snmptrapd listens */
+        answers = sess != NULL && ping(sess);
+        OKF(answers, ("snmptrapd with %d worker threads answers", workers));
+        if (!answers) {
+            if (sess)
+                snmp_close(sess);
+            if (pid > 0) {
+                kill(pid, SIGTERM);
+                waitpid(pid, NULL, 0);
+            }
+            continue;
+        }
+
+        netsnmp_get_monotonic_clock(&start);
+        send_informs(sess, NUM_INFORMS);
+        us = test_elapsed_us(&start);
+        OKF(acked == NUM_INFORMS,
+            ("%d worker threads: %d of %d informs acknowledged", workers,
+             acked, NUM_INFORMS));
+        printf("# %d worker threads: %d informs in %ld us, %.0f informs/s\n",
+               workers, acked, us, us > 0 ? acked * 1e6 / us : 0.0);
+
+        snmp_close(sess);
+        kill(pid, SIGTERM);
+        OKF(waitpid(pid, &status, 0) == pid && WIFEXITED(status),
+            ("snmptrapd with %d worker threads stopped", workers));
+    }
+
+    snmp_shutdown("T044");
+    for (i = 0; i < (int) (sizeof(files) / sizeof(files[0])); i++) {
+        snprintf(path, sizeof(path), "%s/%s", dir, files[i]);
+        unlink(path);
+    }
+    rmdir(dir);
+
+    if (__did_plan == 0)
+        PLAN(__test_counter);
+    return 0;
+}
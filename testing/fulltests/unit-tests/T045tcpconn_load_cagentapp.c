@@ -0,0 +1,185 @@
+/*
+ * HEADER Testing the Linux tcpConnectionTable loader
+ */
+
+#include <net-snmp/net-snmp-config.h>
+#include <net-snmp/net-snmp-includes.h>
+#include <net-snmp/agent/net-snmp-agent-includes.h>
+#include <net-snmp/data_access/tcpConn.h>
+#include "tcp-mib/tcpConnectionTable/tcpConnectionTable_constants.h"
+#include <net-snmp/library/testing.h>
+
+#ifdef linux
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <unistd.h>
+
+static const int farm_sizes[] = { 100, 1000, 5000 };
+
+/* Two lines of /proc/net/tcp: 127.0.0.1:8080 listening, and one client. */
+static const char fixture[] =
+    "  sl  local_address rem_address   st tx_queue rx_queue tr tm->when "
+    "retrnsmt   uid  timeout inode\n"
+    "   0: 0100007F:1F90 00000000:0000 0A 00000000:00000000 00:00000000 "
+    "00000000     0        0 4711 1 0000000000000000 100 0 0 10 0\n"
+    "   1: 0100007F:1F90 0100007F:D431 01 00000000:00000000 00:00000000 "
+    "00000000     0        0 4712 1 0000000000000000 20 4 30 10 -1\n";
+
+/* Loads tcpConnectionTable and returns the number of rows, or -1. */
+static int
+load(u_int flags, long *us)
+{
+    netsnmp_container *container;
+    struct timeval  start;
+    int             rows;
+
+    netsnmp_get_monotonic_clock(&start);
+    container = netsnmp_access_tcpconn_container_load(NULL, flags);
+    *us = test_elapsed_us(&start);
+    if (container == NULL)
+        return -1;
+    rows = CONTAINER_SIZE(container);
+    netsnmp_access_tcpconn_container_free(container,
+                                          NETSNMP_ACCESS_TCPCONN_FREE_NOFLAGS);
+    return rows;
+}
+
+/*
+ * Opens n loopback connections, keeping both ends, and times loading
+ * them over sock_diag and from /proc/net.
+ */
+static void
+farm(int listener, const struct sockaddr_in *sin, int n, int *socks)
+{
+    int             i, opened, diag_rows, proc_rows;
+    long            diag_us, proc_us;
+
+    for (opened = 0; opened < n; opened++) {
+        socks[2 * opened] = socket(AF_INET, SOCK_STREAM, 0);
+        if (socks[2 * opened] < 0)
+            break;
+        if (connect(socks[2 * opened], (const struct sockaddr *) sin,
+                    sizeof(*sin)) != 0 ||
+            (socks[2 * opened + 1] = accept(listener, NULL, NULL)) < 0) {
+            close(socks[2 * opened]);
+            break;
+        }
+    }
+
+    if (opened == n) {
+        netsnmp_ds_set_string(NETSNMP_DS_APPLICATION_ID,
+                              NETSNMP_DS_AGENT_PROC_NET_DIR, NULL);
+        diag_rows = load(NETSNMP_ACCESS_TCPCONN_LOAD_NOLISTEN, &diag_us);
+        netsnmp_ds_set_string(NETSNMP_DS_APPLICATION_ID,
+                              NETSNMP_DS_AGENT_PROC_NET_DIR, "/proc/net");
+        proc_rows = load(NETSNMP_ACCESS_TCPCONN_LOAD_NOLISTEN, &proc_us);
+        OKF(diag_rows >= 2 * n && proc_rows >= 2 * n,
+            ("%d connections: %d and %d rows loaded", n, diag_rows,
+             proc_rows));
+        printf("# %d connections: sock_diag %ld us, /proc/net %ld us\n", n,
+               diag_us, proc_us);
+    } else
+        OKF(0, ("%d of %d connections opened", opened, n));
+
+    for (i = 0; i < 2 * opened; i++)
+        close(socks[i]);
+}
+#endif /* linux */
+
+int
+main(int argc, char *argv[])
+{
+#ifdef linux
+    char            dir[] = "/tmp/snmp-T045-XXXXXX";
+    char            path[sizeof(dir) + 16];
+    netsnmp_container *container;
+    netsnmp_tcpconn_entry *entry;
+    netsnmp_iterator *it;
+    struct sockaddr_in sin;
+    socklen_t       sinlen = sizeof(sin);
+    struct rlimit   rl;
+    FILE           *fp;
+    int            *socks;
+    int             i, n, listener, listening = 0, established = 0;
+
+    netsnmp_ds_set_boolean(NETSNMP_DS_LIBRARY_ID,
+                           NETSNMP_DS_LIB_DONT_PERSIST_STATE, 1);
+    init_snmp("T045");
+
+    /* The /proc parser reads the files in NETSNMP_DS_AGENT_PROC_NET_DIR. */
+    OKF(mkdtemp(dir) != NULL, ("fixture directory"));
+    snprintf(path, sizeof(path), "%s/tcp", dir);
+    fp = fopen(path, "w");
+    OKF(fp != NULL && fputs(fixture, fp) >= 0 && fclose(fp) == 0,
+        ("fixture written"));
+    netsnmp_ds_set_string(NETSNMP_DS_APPLICATION_ID,
+                          NETSNMP_DS_AGENT_PROC_NET_DIR, dir);
+    container = netsnmp_access_tcpconn_container_load(NULL,
+                                      NETSNMP_ACCESS_TCPCONN_LOAD_NOFLAGS);
+    OKF(container != NULL && CONTAINER_SIZE(container) == 2,
+        ("%d rows loaded from the fixture",
+         container ? (int) CONTAINER_SIZE(container) : -1));
+    if (container) {
+        it = CONTAINER_ITERATOR(container);
+        for (entry = ITERATOR_FIRST(it); entry; entry = ITERATOR_NEXT(it)) {
+            if (entry->loc_addr_len != 4 || entry->loc_port != 8080 ||
+                memcmp(entry->loc_addr, "\177\0\0\1", 4) != 0)
+                continue;
+            if (entry->tcpConnState == TCPCONNECTIONSTATE_LISTEN)
+                listening++;
+            else if (entry->tcpConnState == TCPCONNECTIONSTATE_ESTABLISHED &&
+                     entry->rmt_port == 54321)
+                established++;
+        }
+        ITERATOR_RELEASE(it);
+        netsnmp_access_tcpconn_container_free(container,
+                                          NETSNMP_ACCESS_TCPCONN_FREE_NOFLAGS);
+    }
+    OKF(listening == 1 && established == 1,
+        ("fixture rows parsed (%d listening, %d established)", listening,
+         established));
+    unlink(path);
+    rmdir(dir);
+
+    /* Both loaders see every connection of a socket farm. */
+    n = farm_sizes[sizeof(farm_sizes) / sizeof(farm_sizes[0]) - 1];
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 &&
+        rl.rlim_cur < (rlim_t) (2 * n + 64)) {
+        rl.rlim_cur = rl.rlim_max < (rlim_t) (2 * n + 64) ? rl.rlim_max :
+            (rlim_t) (2 * n + 64);
+        setrlimit(RLIMIT_NOFILE, &rl);
+        getrlimit(RLIMIT_NOFILE, &rl);
+    }
+    socks = malloc(2 * n * sizeof(int));
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    OKF(socks != NULL && listener >= 0 &&
+        bind(listener, (struct sockaddr *) &sin, sizeof(sin)) == 0 &&
+        getsockname(listener, (struct sockaddr *) &sin, &sinlen) == 0 &&
+        listen(listener, 64) == 0, ("listening on loopback"));
+    for (i = 0; socks != NULL &&
+         i < (int) (sizeof(farm_sizes) / sizeof(farm_sizes[0])); i++) {
+        if (rl.rlim_cur < (rlim_t) (2 * farm_sizes[i] + 64)) {
+            printf("# %d connections skipped: %lu files allowed\n",
+                   farm_sizes[i], (unsigned long) rl.rlim_cur);
+            continue;
+        }
+        farm(listener, &sin, farm_sizes[i], socks);
+    }
+    if (listener >= 0)
+        close(listener);
+    free(socks);
+    netsnmp_ds_set_string(NETSNMP_DS_APPLICATION_ID,
+                          NETSNMP_DS_AGENT_PROC_NET_DIR, NULL);
+    snmp_shutdown("T045");
+#else
+    OK(1, "skipped test: linux only");
+#endif /* linux */
+
+    if (__did_plan == 0)
+        PLAN(__test_counter);
+    return 0;
+}